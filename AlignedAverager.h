@@ -0,0 +1,244 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  AlignedAverager.h : Software averaging with trigger jitter correction
+//----------------------------------------------------------------------------------------
+//
+//  The trigger of each segment falls between two samples: the first sample is at
+//  'horPos' (-sampInterval < horPos <= 0) from the trigger. Plain averaging of such
+//  segments smears edges over one sampling interval. Here every segment is first
+//  resampled onto the trigger-aligned grid t = i * sampInterval with a fractional-delay
+//  FIR filter, then accumulated.
+//
+//  FracDelayBank holds one filter per quantised delay (FracDelayPhases steps per
+//  sampling interval), so no filter is designed at run time. The filters are Lanczos
+//  windowed sincs with 'FracDelayTaps' taps, normalised to unit DC gain.
+//
+//  Noise suppression (SoftAvgConfig) is applied to the raw codes before the resampling.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef ALIGNED_AVERAGER_H
+#define ALIGNED_AVERAGER_H
+
+#include <algorithm>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+#include "AcqirisD1Import.h"
+#include "AqSimd.h"
+#include "SoftAverager.h"
+
+enum { FracDelayTaps = 8, FracDelayPhases = 64 };
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class FracDelayBank
+{
+public:
+    FracDelayBank()
+        : m_coeffs((FracDelayPhases + 1) * FracDelayTaps)
+    {
+        double const pi = 3.14159265358979323846;
+        double const lobes = FracDelayTaps / 2;
+
+        // Filter p interpolates at x[i + p / FracDelayPhases] from x[i-3] .. x[i+4]
+        for (int p = 0; p <= FracDelayPhases; ++p)
+        {
+            double const delay = double(p) / FracDelayPhases;
+            double h[FracDelayTaps], sum = 0.0;
+            for (int m = 0; m < FracDelayTaps; ++m)
+            {
+                double const x = (m - (FracDelayTaps / 2 - 1)) - delay;
+                h[m] = 1.0;
+                if (fabs(x) > 1e-12)
+                    h[m] = (fabs(x) < lobes) ? lobes * sin(pi * x) * sin(pi * x / lobes) / (pi * pi * x * x) : 0.0;
+                sum += h[m];
+            }
+            for (int m = 0; m < FracDelayTaps; ++m)
+                m_coeffs[p * FracDelayTaps + m] = float(h[m] / sum);
+        }
+    }
+
+    // Filter for a delay of 'delay' samples, 0 <= delay <= 1
+    float const* Filter(double delay) const
+    {
+        int p = int(floor(delay * FracDelayPhases + 0.5));
+        p = std::min(std::max(p, 0), int(FracDelayPhases));
+        return &m_coeffs[p * FracDelayTaps];
+    }
+
+private:
+    std::vector<float> m_coeffs;
+};
+
+// accP[i] += sum_m hP[m] * bufP[i + m] for 'nbrSamples' outputs
+inline void FracDelayAccumulate(float* accP, float const* bufP, float const* hP, long nbrSamples)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128 h[FracDelayTaps];
+    for (int m = 0; m < FracDelayTaps; ++m)
+        h[m] = _mm_set1_ps(hP[m]);
+
+    for (; i + 4 <= nbrSamples; i += 4)
+    {
+        __m128 y = _mm_mul_ps(h[0], _mm_loadu_ps(bufP + i));
+        for (int m = 1; m < FracDelayTaps; ++m)
+            y = _mm_add_ps(y, _mm_mul_ps(h[m], _mm_loadu_ps(bufP + i + m)));
+        _mm_storeu_ps(accP + i, _mm_add_ps(_mm_loadu_ps(accP + i), y));
+    }
+#endif
+    for (; i < nbrSamples; ++i)
+    {
+        float y = 0.0f;
+        for (int m = 0; m < FracDelayTaps; ++m)
+            y += hP[m] * bufP[i + m];
+        accP[i] += y;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class AlignedAverager
+{
+public:
+    AlignedAverager(long nbrSamples, int nbrThreads, SoftAvgConfig const& cfg)
+        : m_nbrSamples(nbrSamples), m_nbrThreads(std::max(nbrThreads, 1)), m_cfg(cfg),
+          m_workers(m_nbrThreads)
+    {
+        for (int t = 0; t < m_nbrThreads; ++t)
+        {
+            m_workers[t].buffer.assign(nbrSamples + FracDelayTaps, 0.0f);
+            m_workers[t].partial.assign(nbrSamples, 0.0f);
+            m_workers[t].sums.assign(nbrSamples, 0.0);
+            m_workers[t].nbrPartial = 0;
+            m_workers[t].nbrWaveforms = 0;
+        }
+    }
+
+    long NbrSamples() const { return m_nbrSamples; }
+    int NbrThreads() const { return m_nbrThreads; }
+
+    // Add 'nbrSegments' segments of 'NbrSamples()' samples each. Segment s starts at
+    // dataP + s * segmentStride, its first sample is at segDescP[s].horPos.
+    template <class Sample>
+    void AddSegments(Sample const* dataP, long nbrSegments, long segmentStride,
+                     AqSegmentDescriptor const* segDescP, ViReal64 sampInterval)
+    {
+        int const nbrUsed = (int)std::min<long>(m_nbrThreads, nbrSegments);
+        if (nbrUsed < 1)
+            return;
+
+        std::vector<std::thread> threads;
+        long first = 0;
+        for (int t = 0; t < nbrUsed; ++t)
+        {
+            long const last = nbrSegments * (t + 1) / nbrUsed;
+            if (t + 1 < nbrUsed)
+                threads.push_back(std::thread(&AlignedAverager::Work<Sample>, this, t, dataP, first, last,
+                                              segmentStride, segDescP, sampInterval));
+            else
+                Work<Sample>(t, dataP, first, last, segmentStride, segDescP, sampInterval);
+            first = last;
+        }
+
+        for (size_t n = 0; n < threads.size(); ++n)
+            threads[n].join();
+    }
+
+    // Merge the per-thread sums (in ADC codes, on the trigger-aligned grid) into 'sumP';
+    // returns the number of averaged waveforms
+    ViInt64 Sums(ViReal64* sumP)
+    {
+        std::fill(sumP, sumP + m_nbrSamples, 0.0);
+        ViInt64 nbrWaveforms = 0;
+
+        for (int t = 0; t < m_nbrThreads; ++t)
+        {
+            Flush(m_workers[t]);
+            for (long i = 0; i < m_nbrSamples; ++i)
+                sumP[i] += m_workers[t].sums[i];
+            nbrWaveforms += m_workers[t].nbrWaveforms;
+        }
+        return nbrWaveforms;
+    }
+
+private:
+    // Segments summed in single precision before they are moved to the double sums
+    enum { FlushLimit = 256 };
+
+    struct Worker
+    {
+        std::vector<float> buffer;          // one segment after noise suppression, edge-padded
+        std::vector<float> partial;         // single precision sums since the last flush
+        std::vector<ViReal64> sums;
+        long nbrPartial;
+        ViInt64 nbrWaveforms;
+    };
+
+    void Flush(Worker& w)
+    {
+        if (w.nbrPartial == 0)
+            return;
+        for (long i = 0; i < m_nbrSamples; ++i)
+            w.sums[i] += w.partial[i];
+        std::fill(w.partial.begin(), w.partial.end(), 0.0f);
+        w.nbrPartial = 0;
+    }
+
+    // Noise suppression into w.buffer, with 'FracDelayTaps / 2 - 1' samples of padding in
+    // front and 'FracDelayTaps / 2' behind, repeating the first and last values
+    template <class Sample>
+    void Load(Worker& w, Sample const* dataP) const
+    {
+        float* const bufP = &w.buffer[FracDelayTaps / 2 - 1];
+
+        if (!m_cfg.thresholdEnable)
+        {
+            for (long i = 0; i < m_nbrSamples; ++i)
+                bufP[i] = float(dataP[i]);
+        }
+        else
+        {
+            ViInt32 const base = m_cfg.noiseBaseEnable ? m_cfg.noiseBase : 0;
+            for (long i = 0; i < m_nbrSamples; ++i)
+            {
+                ViInt32 const x = dataP[i];
+                bufP[i] = (x > m_cfg.threshold) ? float(x - base) : 0.0f;
+            }
+        }
+
+        std::fill(&w.buffer[0], bufP, bufP[0]);
+        std::fill(bufP + m_nbrSamples, &w.buffer[0] + w.buffer.size(), bufP[m_nbrSamples - 1]);
+    }
+
+    template <class Sample>
+    void Work(int t, Sample const* dataP, long first, long last, long segmentStride,
+              AqSegmentDescriptor const* segDescP, ViReal64 sampInterval)
+    {
+        Worker& w = m_workers[t];
+
+        for (long s = first; s < last; ++s)
+        {
+            if (w.nbrPartial == FlushLimit)
+                Flush(w);
+
+            // Sample i of the segment is at (i + horPos / sampInterval) from the trigger,
+            // the aligned sample i is at x[i + delay]
+            double const delay = std::min(std::max(-segDescP[s].horPos / sampInterval, 0.0), 1.0);
+
+            Load(w, dataP + s * segmentStride);
+            FracDelayAccumulate(&w.partial[0], &w.buffer[0], m_bank.Filter(delay), m_nbrSamples);
+            ++w.nbrPartial;
+            ++w.nbrWaveforms;
+        }
+    }
+
+    long m_nbrSamples;
+    int m_nbrThreads;
+    SoftAvgConfig m_cfg;
+    FracDelayBank m_bank;
+    std::vector<Worker> m_workers;
+};
+
+#endif // ALIGNED_AVERAGER_H
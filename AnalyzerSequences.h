@@ -0,0 +1,199 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  AnalyzerSequences.h : Register sequences of the analyzer (AC / SC) sample programs
+//----------------------------------------------------------------------------------------
+//
+//  The steps the sample programs take on the firmware, written once against
+//  FpgaRegisters and FpgaWait, so that GetStartedAnalyzerSim runs and times the same code
+//  as the programs against the model of FpgaSimulator.h:
+//  - StartDEInterface(): enable the DCMs, start the DE interface, wait for the DE clock
+//    (all firmwares, after the acquisition has started)
+//  - CaptureDeMonitor(): capture into the data entry monitor (BaseTest firmware)
+//  - StartFftCore(), WaitForFftSpectrum(), StopFftCore(): FFT firmware
+//  - ResetDualPortMemory(), FillDualPortMemory(), ReadDualPortMemory(): memory example
+//  - StartDataLinks(), CaptureStreamMonitors(): SC240 streamer firmwares
+//  Each returns VI_SUCCESS, ACQIRIS_ERROR_TIMEOUT or the status of the first register
+//  access that failed; the messages are left to the programs. Control registers written
+//  with Modify() (Main Control) should be shadowed by the caller (see FpgaRegisters.h).
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef ANALYZER_SEQUENCES_H
+#define ANALYZER_SEQUENCES_H
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "FpgaRegisters.h"
+#include "FpgaWait.h"
+
+
+// Registers and buffers of the firmwares used by the sequences
+enum
+{
+    AnalyzerFPGACtrlReg = 3, AnalyzerFPGAStatusReg = 6, AnalyzerDECtrlReg = 8, AnalyzerSRAMCtrlReg = 39,
+    AnalyzerMainCtrlReg = 64, AnalyzerDeMonCtrlReg = 65, AnalyzerMainStatusReg = 65,
+    AnalyzerNbrAccReg = 66, AnalyzerFFTConfReg = 67, AnalyzerMemExampleCtrlReg = 66,
+    AnalyzerSLC0CtrlReg = 80, AnalyzerSLC0StatusReg = 81, AnalyzerSLCOffset = 4,
+    AnalyzerDeMonitorID = 0x0c, AnalyzerSRAMID = 0x04, AnalyzerSpectrumID = 0x81
+};
+
+// Channel 2 starts in the middle of the dual port memory
+static ViInt32 const AnalyzerSRAMChan2Addr = 0x00080000;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// 'fpgaCtrl' is written to the FPGA control register: the DCM enable bits, and 0x00000100
+// for a readout in Big-Endian format
+inline ViStatus StartDEInterface(FpgaRegisters& regs, FpgaWait& wait, ViInt32 fpgaCtrl = 0x00ff0000)
+{
+    regs.Begin();
+    regs.Write(AnalyzerFPGACtrlReg, 0);                 // First disable everything
+    regs.Write(AnalyzerFPGACtrlReg, fpgaCtrl);
+    ViStatus status = regs.Commit();
+    if (status != VI_SUCCESS)
+        return status;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    regs.Begin();
+    regs.Write(AnalyzerDECtrlReg, 0);
+    regs.Write(AnalyzerDECtrlReg, 0x80000000);          // Start the DE interface
+    status = regs.Commit();
+    if (status != VI_SUCCESS)
+        return status;
+
+    return wait.Until("DE clock", AnalyzerFPGAStatusReg, 0x00100000, 0x00100000, 0.1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Restart the capture bit (0x1000) of Main Control; "monitor buffer full" raises the
+// "processing done" interrupt
+inline ViStatus CaptureDeMonitor(FpgaRegisters& regs, FpgaWait& wait)
+{
+    regs.Begin();
+    regs.Modify(AnalyzerMainCtrlReg, 0x00001000, 0);
+    regs.Modify(AnalyzerMainCtrlReg, 0, 0x00001000);
+    ViStatus const status = regs.Commit();
+    if (status != VI_SUCCESS)
+        return status;
+
+    return wait.UntilInterrupt("DE monitor capture", AnalyzerDeMonCtrlReg, 0x80000000, 0x80000000, 0.1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// 'nbrAcc' power spectra per pipeline; 'fftConfig' bit 0x20 lets the core overwrite a
+// spectrum not read in time. The core runs continuously (the trigger is ignored).
+inline ViStatus StartFftCore(FpgaRegisters& regs, ViInt32 nbrAcc, ViInt32 fftConfig)
+{
+    regs.Begin();
+    regs.Write(AnalyzerNbrAccReg, nbrAcc);
+    regs.Write(AnalyzerFFTConfReg, fftConfig);
+    regs.Write(AnalyzerMainCtrlReg, 0x00000001);
+    return regs.Commit();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// "Buffer full" of Main Status; reading the spectrum buffer to its end clears it
+inline ViStatus WaitForFftSpectrum(FpgaWait& wait, double timeoutSeconds = 1.0)
+{
+    return wait.Until("FFT spectrum", AnalyzerMainStatusReg, 0x80000000, 0x80000000, timeoutSeconds);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// The core goes on until the last data block has been processed
+inline ViStatus StopFftCore(FpgaRegisters& regs, FpgaWait& wait)
+{
+    ViStatus const status = regs.Write(AnalyzerMainCtrlReg, 0);
+    if (status != VI_SUCCESS)
+        return status;
+
+    return wait.Until("FFT core stop", AnalyzerMainStatusReg, 0x00010000, 0, 1.0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+inline ViStatus ResetDualPortMemory(FpgaRegisters& regs)
+{
+    regs.Begin();
+    regs.Write(AnalyzerSRAMCtrlReg, 1);                 // Set the "reset" bit
+    regs.Write(AnalyzerSRAMCtrlReg, 0);                 // and clear it again
+    return regs.Commit();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Stream into the memory from the next trigger until it is full
+inline ViStatus FillDualPortMemory(FpgaRegisters& regs, FpgaWait& wait)
+{
+    ViStatus status = regs.Write(AnalyzerSRAMCtrlReg, 0);   // Port A to the FPGA internal bus
+    if (status != VI_SUCCESS)
+        return status;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // Bit 0 reads as 0 until the memory is full
+    status = regs.Write(AnalyzerMemExampleCtrlReg, 0x3);
+    if (status != VI_SUCCESS)
+        return status;
+
+    return wait.Until("memory full", AnalyzerMemExampleCtrlReg, 0x01, 0x01, 2.0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// 'nbrLongs' words of each channel, with port A given to the program
+inline ViStatus ReadDualPortMemory(FpgaRegisters& regs, ViInt32 nbrLongs, ViInt32* chan1P, ViInt32* chan2P)
+{
+    regs.Begin();
+    regs.Write(AnalyzerSRAMCtrlReg, 2);
+    regs.ReadIndirect(AnalyzerSRAMID, 0, nbrLongs, chan1P);
+    regs.ReadIndirect(AnalyzerSRAMID, AnalyzerSRAMChan2Addr, nbrLongs, chan2P);
+    return regs.Commit();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Write the SLC control of links 0 .. nbrLinks - 1 (at least one), wait until all have
+// 'readyBits' in their status, then reset their status flags (bit 31 of the control
+// clears itself)
+inline ViStatus StartDataLinks(FpgaRegisters& regs, FpgaWait& wait, ViInt32 const* slcCtrlP, int nbrLinks,
+                               ViInt32 readyBits, double timeoutSeconds)
+{
+    std::vector<FpgaCondition> links;
+    regs.Begin();
+    for (int n = 0; n < nbrLinks; ++n)
+    {
+        regs.Write(AnalyzerSLC0CtrlReg + n * AnalyzerSLCOffset, slcCtrlP[n]);
+        FpgaCondition const link = { AnalyzerSLC0StatusReg + n * AnalyzerSLCOffset, readyBits, readyBits };
+        links.push_back(link);
+    }
+    ViStatus status = regs.Commit();
+    if (status == VI_SUCCESS)
+        status = wait.UntilAll(nbrLinks > 1 ? "data links" : "data link", &links[0], nbrLinks, timeoutSeconds);
+    if (status != VI_SUCCESS)
+        return status;
+
+    regs.Begin();
+    for (int n = 0; n < nbrLinks; ++n)
+        regs.Modify(AnalyzerSLC0CtrlReg + n * AnalyzerSLCOffset, 0, 0x80000000);
+    return regs.Commit();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Restart the 'captureBits' of Main Control, wait for the "buffer ready" bit (31) of the
+// control registers 'monitorRegsP' (at least one) of the monitors they start
+inline ViStatus CaptureStreamMonitors(FpgaRegisters& regs, FpgaWait& wait, char const* name, ViInt32 captureBits,
+                                      ViInt32 const* monitorRegsP, int nbrMonitors, double timeoutSeconds)
+{
+    regs.Begin();
+    regs.Modify(AnalyzerMainCtrlReg, captureBits, 0);
+    regs.Modify(AnalyzerMainCtrlReg, 0, captureBits);
+    ViStatus const status = regs.Commit();
+    if (status != VI_SUCCESS)
+        return status;
+
+    std::vector<FpgaCondition> monitors;
+    for (int n = 0; n < nbrMonitors; ++n)
+    {
+        FpgaCondition const monitor = { monitorRegsP[n], ViInt32(0x80000000), ViInt32(0x80000000) };
+        monitors.push_back(monitor);
+    }
+    return wait.UntilAll(name, &monitors[0], nbrMonitors, timeoutSeconds);
+}
+
+#endif // ANALYZER_SEQUENCES_H
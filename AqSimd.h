@@ -0,0 +1,19 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  AqSimd.h : SIMD selection for the host-side processing helpers
+//----------------------------------------------------------------------------------------
+//
+//  The processing headers use SSE2 intrinsics when the compiler targets them and fall
+//  back to plain C++ loops otherwise. SSE2 is always available on x64; for 32-bit x86
+//  builds add '-msse2' (gcc) or '/arch:SSE2' (Visual C++) to the compiler flags.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef AQ_SIMD_H
+#define AQ_SIMD_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AQ_SSE2 1
+#endif
+
+#endif // AQ_SIMD_H
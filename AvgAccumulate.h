@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  AvgAccumulate.h : Host-side accumulation of averaged waveforms
+//----------------------------------------------------------------------------------------
+//
+//  The on-board averager returns 32-bit sums over 'NbrWaveforms' triggers. These helpers
+//  add such readouts into 64-bit per-sample sums on the host, so averages can be made
+//  deeper than the on-board accumulator allows.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef AVG_ACCUMULATE_H
+#define AVG_ACCUMULATE_H
+
+#include "vpptype.h"
+#include "AqSimd.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// sumP[i] += dataP[i] for 'nbrSamples' samples
+inline void AccumulateInt32(ViInt64* sumP, ViInt32 const* dataP, long nbrSamples)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    for (; i + 4 <= nbrSamples; i += 4)
+    {
+        // Sign-extend four 32-bit sums to 64 bits and add them two by two
+        __m128i const v = _mm_loadu_si128((__m128i const*)(dataP + i));
+        __m128i const sign = _mm_srai_epi32(v, 31);
+        __m128i* const sP = (__m128i*)(sumP + i);
+
+        _mm_storeu_si128(sP, _mm_add_epi64(_mm_loadu_si128(sP), _mm_unpacklo_epi32(v, sign)));
+        _mm_storeu_si128(sP + 1, _mm_add_epi64(_mm_loadu_si128(sP + 1), _mm_unpackhi_epi32(v, sign)));
+    }
+#endif
+    for (; i < nbrSamples; ++i)
+        sumP[i] += dataP[i];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// sumP[i] += dataP[i] for 'nbrSamples' unsigned values (e.g. power spectrum lines)
+inline void AccumulateUInt32(ViUInt64* sumP, ViUInt32 const* dataP, long nbrSamples)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128i const zero = _mm_setzero_si128();
+    for (; i + 4 <= nbrSamples; i += 4)
+    {
+        // Zero-extend four 32-bit values to 64 bits and add them two by two
+        __m128i const v = _mm_loadu_si128((__m128i const*)(dataP + i));
+        __m128i* const sP = (__m128i*)(sumP + i);
+
+        _mm_storeu_si128(sP, _mm_add_epi64(_mm_loadu_si128(sP), _mm_unpacklo_epi32(v, zero)));
+        _mm_storeu_si128(sP + 1, _mm_add_epi64(_mm_loadu_si128(sP + 1), _mm_unpackhi_epi32(v, zero)));
+    }
+#endif
+    for (; i < nbrSamples; ++i)
+        sumP[i] += dataP[i];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Convert 64-bit sums over 'nbrWaveforms' waveforms to Volts
+inline void NormalizeInt64(ViReal64* voltsP, ViInt64 const* sumP, long nbrSamples,
+                           ViInt64 nbrWaveforms, ViReal64 vGain, ViReal64 vOffset)
+{
+    ViReal64 const scale = nbrWaveforms > 0 ? vGain / ViReal64(nbrWaveforms) : 0.0;
+
+    for (long i = 0; i < nbrSamples; ++i)
+        voltsP[i] = ViReal64(sumP[i]) * scale - vOffset;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Convert 32-bit averager sums over 'nbrWaveforms' waveforms to Volts
+inline void NormalizeInt32(ViReal32* voltsP, ViInt32 const* sumP, long nbrSamples,
+                           ViInt32 nbrWaveforms, ViReal64 vGain, ViReal64 vOffset)
+{
+    ViReal32 const scale = nbrWaveforms > 0 ? ViReal32(vGain / nbrWaveforms) : 0.0f;
+    ViReal32 const offset = ViReal32(vOffset);
+
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128 const scaleV = _mm_set1_ps(scale);
+    __m128 const offsetV = _mm_set1_ps(offset);
+    for (; i + 4 <= nbrSamples; i += 4)
+    {
+        __m128 const v = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i const*)(sumP + i)));
+        _mm_storeu_ps(voltsP + i, _mm_sub_ps(_mm_mul_ps(v, scaleV), offsetV));
+    }
+#endif
+    for (; i < nbrSamples; ++i)
+        voltsP[i] = ViReal32(sumP[i]) * scale - offset;
+}
+
+#endif // AVG_ACCUMULATE_H
@@ -0,0 +1,134 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  AvgReadout.h : Multi-segment readout of averaged waveforms in Volts
+//----------------------------------------------------------------------------------------
+//
+//  ReadAvgSegments() reads all segments of the last average with 'ReadModeAvgW'. The
+//  buffers are sized from the averager configuration ('NbrSamples', 'NbrSegments'), and
+//  the 32-bit sums are converted to Volts with 'nbrAvgWforms', 'vGain' and 'vOffset'.
+//  When the driver reports no 'nbrAvgWforms', the configured 'NbrWaveforms' is used.
+//
+//  WriteAvgSegments() stores the result as a binary file:
+//  - AvgFileHeader
+//  - nbrSegments x nbrSamples ViReal32 values in Volts, segment after segment
+//  - nbrSegments AqSegmentDescriptorAvg (horPos, timestamps, trigger counts, ...)
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef AVG_READOUT_H
+#define AVG_READOUT_H
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "AcqirisImport.h"
+#include "AcqirisD1Import.h"
+
+#include "AvgAccumulate.h"
+
+
+struct AvgSegments
+{
+    ViInt32 nbrSamples;
+    ViInt32 nbrSegments;
+    ViInt32 nbrAvgWforms;                           // waveforms summed per segment
+    ViReal64 sampTime;
+    std::vector<ViReal32> volts;                    // nbrSegments x nbrSamples
+    std::vector<AqSegmentDescriptorAvg> segDesc;
+};
+
+struct AvgFileHeader
+{
+    char magic[8];                                  // "AQAVG01"
+    ViInt32 nbrSegments;
+    ViInt32 nbrSamples;
+    ViInt32 nbrAvgWforms;
+    ViInt32 reserved;
+    ViReal64 sampTime;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+inline ViStatus ReadAvgSegments(ViSession instrId, ViInt32 channel, AvgSegments& avg)
+{
+    ViInt32 nbrSamples = 0, nbrSegments = 0, nbrWaveforms = 0;
+    ViStatus status = AcqrsD1_getAvgConfigInt32(instrId, 0, "NbrSamples", &nbrSamples);
+    if (status < VI_SUCCESS) return status;
+    status = AcqrsD1_getAvgConfigInt32(instrId, 0, "NbrSegments", &nbrSegments);
+    if (status < VI_SUCCESS) return status;
+    status = AcqrsD1_getAvgConfigInt32(instrId, 0, "NbrWaveforms", &nbrWaveforms);
+    if (status < VI_SUCCESS) return status;
+    if (nbrSegments < 1) nbrSegments = 1;
+
+    // The data array needs some extra room per segment to compensate for alignment
+    std::vector<ViInt32> sums(nbrSegments * (nbrSamples + 32));
+    avg.segDesc.resize(nbrSegments);
+
+    AqReadParameters readParam;
+    ::memset(&readParam, 0, sizeof(readParam));
+    readParam.dataType = ReadInt32;
+    readParam.readMode = ReadModeAvgW;
+    readParam.firstSegment = 0;
+    readParam.nbrSegments = nbrSegments;
+    readParam.firstSampleInSeg = 0;
+    readParam.nbrSamplesInSeg = nbrSamples;
+    readParam.segmentOffset = nbrSamples;
+    readParam.dataArraySize = ViInt32(sums.size() * sizeof(ViInt32));
+    readParam.segDescArraySize = ViInt32(avg.segDesc.size() * sizeof(AqSegmentDescriptorAvg));
+
+    AqDataDescriptor dataDesc;
+    ::memset(&dataDesc, 0, sizeof(dataDesc));
+    status = AcqrsD1_readData(instrId, channel, &readParam, &sums[0], &dataDesc, &avg.segDesc[0]);
+    if (status < VI_SUCCESS) return status;
+
+    avg.nbrSamples = std::min(dataDesc.returnedSamplesPerSeg, nbrSamples);
+    avg.nbrSegments = std::min(dataDesc.returnedSegments, nbrSegments);
+
+    // Keep only the segments that lie entirely inside the returned buffer
+    size_t const firstPoint = size_t(dataDesc.indexFirstPoint);
+    size_t const segEnd = firstPoint + size_t(avg.nbrSamples);
+    if (dataDesc.indexFirstPoint < 0 || avg.nbrSamples < 0 || avg.nbrSegments < 0 || segEnd > sums.size())
+        avg.nbrSegments = 0;
+    else if (nbrSamples > 0)
+        avg.nbrSegments = std::min(avg.nbrSegments, ViInt32((sums.size() - segEnd) / nbrSamples + 1));
+    avg.nbrAvgWforms = dataDesc.nbrAvgWforms > 0 ? dataDesc.nbrAvgWforms : nbrWaveforms;
+    avg.sampTime = dataDesc.sampTime;
+    avg.segDesc.resize(avg.nbrSegments);
+    avg.volts.resize(avg.nbrSegments * avg.nbrSamples);
+
+    for (ViInt32 seg = 0; seg < avg.nbrSegments; ++seg)
+    {
+        ViInt32 const* const sumP = &sums[dataDesc.indexFirstPoint + seg * nbrSamples];
+        NormalizeInt32(&avg.volts[seg * avg.nbrSamples], sumP, avg.nbrSamples,
+                       avg.nbrAvgWforms, dataDesc.vGain, dataDesc.vOffset);
+    }
+
+    return status;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+inline bool WriteAvgSegments(char const* fileName, AvgSegments const& avg)
+{
+    FILE* file = fopen(fileName, "wb");
+    if (file == NULL)
+        return false;
+
+    AvgFileHeader header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, "AQAVG01", 8);
+    header.nbrSegments = avg.nbrSegments;
+    header.nbrSamples = avg.nbrSamples;
+    header.nbrAvgWforms = avg.nbrAvgWforms;
+    header.sampTime = avg.sampTime;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !avg.volts.empty())
+        ok = fwrite(&avg.volts[0], sizeof(ViReal32), avg.volts.size(), file) == avg.volts.size();
+    if (ok && !avg.segDesc.empty())
+        ok = fwrite(&avg.segDesc[0], sizeof(AqSegmentDescriptorAvg), avg.segDesc.size(), file) == avg.segDesc.size();
+
+    return (fclose(file) == 0) && ok;
+}
+
+#endif // AVG_READOUT_H
@@ -0,0 +1,255 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  DigitalCFD.h : Constant-fraction timing of pulses in raw digitizer segments
+//----------------------------------------------------------------------------------------
+//
+//  The constant-fraction signal of a segment y (base line removed, negated with
+//  'invertData') is
+//
+//      c[i] = fraction * y[i] - y[i - delay]
+//
+//  which crosses zero from positive to negative on the leading edge of every pulse at
+//  the same fraction of its amplitude. A crossing is taken when y exceeds 'threshold'
+//  at the sample before it; the next one is armed once y has gone back below the
+//  threshold. The crossing is located between samples by linear interpolation, or with
+//  the cubic through c[i-1] .. c[i+2].
+//
+//  c is computed with SSE2 four samples at a time, and crossing candidates are found
+//  from comparison masks; only the candidates are interpolated one by one. CfdEngine
+//  spreads the segments of a readout over several threads.
+//
+//  Hit times are relative to the trigger of their segment (including the segment
+//  'horPos'); the trigger timestamp of the segment is kept next to it.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef DIGITAL_CFD_H
+#define DIGITAL_CFD_H
+
+#include <algorithm>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+#include "AcqirisD1Import.h"
+#include "AqSimd.h"
+
+
+enum CfdInterpolation { CfdLinear = 1, CfdCubic = 2 };
+
+struct CfdConfig
+{
+    ViInt32 delay;                      // in samples, about the pulse rise time
+    ViReal32 fraction;                  // 0 < fraction < 1
+    ViReal32 threshold;                 // arming level above the base line, in ADC codes
+    ViInt32 baselineSamples;            // base line = mean of the first samples, 0 = none
+    bool invertData;                    // negative pulses
+    CfdInterpolation interpolation;
+};
+
+struct CfdHit
+{
+    ViInt32 segment;                    // segment within the readout
+    ViInt32 reserved;
+    ViUInt64 timeStamp;                 // trigger timestamp of the segment in ps
+    ViReal64 time;                      // from the trigger, in seconds
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Position in samples of the zero crossing between i and i + 1
+inline double CfdCrossing(float const* cP, long i, long nbrSamples, CfdInterpolation interpolation)
+{
+    double const c0 = cP[i], c1 = cP[i + 1];
+    double x = c0 / (c0 - c1);          // linear estimate in [0, 1)
+
+    if (interpolation == CfdCubic && i >= 1 && i + 2 < nbrSamples)
+    {
+        // Lagrange cubic through c[i-1] .. c[i+2] at t = -1, 0, 1, 2; Newton steps from
+        // the linear estimate, kept if they stay within the interval
+        double const cm = cP[i - 1], c2 = cP[i + 2];
+        double const a = (-cm + 3.0 * c0 - 3.0 * c1 + c2) / 6.0;
+        double const b = (cm - 2.0 * c0 + c1) / 2.0;
+        double const d = (-2.0 * cm - 3.0 * c0 + 6.0 * c1 - c2) / 6.0;
+
+        double t = x;
+        for (int n = 0; n < 3; ++n)
+        {
+            double const f = ((a * t + b) * t + d) * t + c0;
+            double const df = (3.0 * a * t + 2.0 * b) * t + d;
+            if (df == 0.0)
+                break;
+            t -= f / df;
+        }
+        if (t >= 0.0 && t <= 1.0)
+            x = t;
+    }
+    return i + x;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Crossing positions (in samples) of one segment already converted to floats 'yP',
+// with 'cP' as work space; both hold 'nbrSamples' values
+inline void CfdSegment(float const* yP, float* cP, long nbrSamples, CfdConfig const& cfg,
+                       std::vector<double>& positions)
+{
+    long const delay = std::max<long>(cfg.delay, 1);
+    float const fraction = cfg.fraction;
+
+    // Constant-fraction signal; no signal before 'delay'
+    long i = 0;
+    for (; i < delay && i < nbrSamples; ++i)
+        cP[i] = 0.0f;
+#ifdef AQ_SSE2
+    __m128 const fractionV = _mm_set1_ps(fraction);
+    for (; i + 4 <= nbrSamples; i += 4)
+        _mm_storeu_ps(cP + i, _mm_sub_ps(_mm_mul_ps(fractionV, _mm_loadu_ps(yP + i)), _mm_loadu_ps(yP + i - delay)));
+#endif
+    for (; i < nbrSamples; ++i)
+        cP[i] = fraction * yP[i] - yP[i - delay];
+
+    // Crossing candidates: c[i] > 0 >= c[i+1] with y[i] above the threshold
+    bool armed = true;
+    i = delay;
+    while (i + 1 < nbrSamples)
+    {
+        if (!armed)
+        {
+            // Wait for the pulse to go back below the threshold
+            for (; i + 1 < nbrSamples && yP[i] >= cfg.threshold; ++i)
+                ;
+            armed = true;
+            continue;
+        }
+
+#ifdef AQ_SSE2
+        __m128 const zero = _mm_setzero_ps();
+        __m128 const thresholdV = _mm_set1_ps(cfg.threshold);
+        for (; i + 5 <= nbrSamples; i += 4)
+        {
+            __m128 const c0 = _mm_loadu_ps(cP + i);
+            __m128 const c1 = _mm_loadu_ps(cP + i + 1);
+            __m128 const y = _mm_loadu_ps(yP + i);
+            __m128 const hit = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(c0, zero), _mm_cmple_ps(c1, zero)),
+                                          _mm_cmpgt_ps(y, thresholdV));
+            if (_mm_movemask_ps(hit) != 0)
+                break;
+        }
+#endif
+        long const end = std::min(i + 4, nbrSamples - 1);
+        for (; i < end; ++i)
+        {
+            if (cP[i] > 0.0f && cP[i + 1] <= 0.0f && yP[i] > cfg.threshold)
+                break;
+        }
+        if (i == end)
+            continue;
+
+        positions.push_back(CfdCrossing(cP, i, nbrSamples, cfg.interpolation));
+        armed = false;
+        ++i;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class CfdEngine
+{
+public:
+    CfdEngine(long nbrSamples, int nbrThreads, CfdConfig const& cfg)
+        : m_nbrSamples(nbrSamples), m_nbrThreads(std::max(nbrThreads, 1)), m_cfg(cfg),
+          m_workers(m_nbrThreads)
+    {
+        for (int t = 0; t < m_nbrThreads; ++t)
+        {
+            m_workers[t].y.resize(nbrSamples);
+            m_workers[t].c.resize(nbrSamples);
+        }
+    }
+
+    int NbrThreads() const { return m_nbrThreads; }
+
+    // Hits of 'nbrSegments' segments in segment order. Segment s starts at
+    // dataP + s * segmentStride, its first sample is at segDescP[s].horPos.
+    template <class Sample>
+    void Process(Sample const* dataP, long nbrSegments, long segmentStride, AqSegmentDescriptor const* segDescP,
+                 ViReal64 sampInterval, std::vector<CfdHit>& hits)
+    {
+        int const nbrUsed = (int)std::min<long>(m_nbrThreads, nbrSegments);
+        if (nbrUsed < 1)
+            return;
+
+        std::vector<std::thread> threads;
+        long first = 0;
+        for (int t = 0; t < nbrUsed; ++t)
+        {
+            long const last = nbrSegments * (t + 1) / nbrUsed;
+            m_workers[t].hits.clear();
+            if (t + 1 < nbrUsed)
+                threads.push_back(std::thread(&CfdEngine::Work<Sample>, this, t, dataP, first, last,
+                                              segmentStride, segDescP, sampInterval));
+            else
+                Work<Sample>(t, dataP, first, last, segmentStride, segDescP, sampInterval);
+            first = last;
+        }
+
+        for (size_t n = 0; n < threads.size(); ++n)
+            threads[n].join();
+
+        for (int t = 0; t < nbrUsed; ++t)
+            hits.insert(hits.end(), m_workers[t].hits.begin(), m_workers[t].hits.end());
+    }
+
+private:
+    struct Worker
+    {
+        std::vector<float> y;           // segment without base line
+        std::vector<float> c;           // constant-fraction signal
+        std::vector<double> positions;
+        std::vector<CfdHit> hits;
+    };
+
+    template <class Sample>
+    void Work(int t, Sample const* dataP, long first, long last, long segmentStride,
+              AqSegmentDescriptor const* segDescP, ViReal64 sampInterval)
+    {
+        Worker& w = m_workers[t];
+        float const sign = m_cfg.invertData ? -1.0f : 1.0f;
+        long const nbrBase = std::min<long>(m_cfg.baselineSamples, m_nbrSamples);
+
+        for (long s = first; s < last; ++s)
+        {
+            Sample const* const segP = dataP + s * segmentStride;
+
+            float baseline = 0.0f;
+            if (nbrBase > 0)
+            {
+                long sum = 0;
+                for (long i = 0; i < nbrBase; ++i)
+                    sum += segP[i];
+                baseline = float(sum) / nbrBase;
+            }
+            for (long i = 0; i < m_nbrSamples; ++i)
+                w.y[i] = sign * (float(segP[i]) - baseline);
+
+            w.positions.clear();
+            CfdSegment(&w.y[0], &w.c[0], m_nbrSamples, m_cfg, w.positions);
+
+            CfdHit hit;
+            hit.segment = ViInt32(s);
+            hit.reserved = 0;
+            hit.timeStamp = (ViUInt64(segDescP[s].timeStampHi) << 32) | segDescP[s].timeStampLo;
+            for (size_t n = 0; n < w.positions.size(); ++n)
+            {
+                hit.time = segDescP[s].horPos + w.positions[n] * sampInterval;
+                w.hits.push_back(hit);
+            }
+        }
+    }
+
+    long m_nbrSamples;
+    int m_nbrThreads;
+    CfdConfig m_cfg;
+    std::vector<Worker> m_workers;
+};
+
+#endif // DIGITAL_CFD_H
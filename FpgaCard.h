@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  FpgaCard.h : Register access layer of FpgaRegisters.h on the card
+//----------------------------------------------------------------------------------------
+//
+//  FpgaCard is the FpgaRegisters of the sample programs: its transfers, the loading of
+//  the firmware and the interrupt wait go to the driver. It is kept apart from
+//  FpgaRegisters.h so that FpgaSimulator.h and GetStartedAnalyzerSim do not depend on
+//  the driver library.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef FPGA_CARD_H
+#define FPGA_CARD_H
+
+#include "AcqirisImport.h"
+#include "AcqirisD1Import.h"
+#include "FpgaRegisters.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class FpgaCard : public FpgaRegisters
+{
+public:
+    explicit FpgaCard(ViSession instrID = 0, char const* deviceName = "Block1Dev1")
+        : FpgaRegisters(instrID, deviceName) {}
+
+    virtual ViStatus WaitForProcessingDone(ViInt32 timeoutMs)
+    {
+        return AcqrsD1_waitForEndOfProcessing(InstrID(), timeoutMs);
+    }
+
+protected:
+    virtual ViStatus Transfer(ViInt32 regID, ViInt32 nbrValues, ViInt32* dataP, ViInt32 readWrite)
+    {
+        return Acqrs_logicDeviceIO(InstrID(), const_cast<char*>(DeviceName()), regID, nbrValues, dataP,
+                                   readWrite, 0);
+    }
+
+    virtual ViStatus Configure(char const* fileName, ViInt32 flags)
+    {
+        return Acqrs_configLogicDevice(InstrID(), const_cast<char*>(DeviceName()), const_cast<char*>(fileName),
+                                       flags);
+    }
+};
+
+#endif // FPGA_CARD_H
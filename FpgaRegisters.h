@@ -0,0 +1,290 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  FpgaRegisters.h : Register access layer for the analyzer (AC / SC) firmwares
+//----------------------------------------------------------------------------------------
+//
+//  All register traffic of a program goes through one FpgaRegisters object instead of
+//  separate Acqrs_logicDeviceIO() calls:
+//  - ReadIndirect() reads a firmware buffer through the indirect access port (start
+//    address, buffer identifier, then the data) in one call
+//  - control registers declared with Shadow() keep the last value written. Read() of
+//    such a register returns that value without a transfer, Modify() is a
+//    read-modify-write without the read, and a Write() of the value already in the
+//    register is dropped. Only registers that read back what was written, and whose
+//    writes have no other effect, may be shadowed (not a register with a self-clearing
+//    bit or one the firmware changes by itself).
+//  - between Begin() and Commit() the operations are queued and run back to back at
+//    Commit(), in order, stopping at the first error. Reads in a transaction fill their
+//    destination at Commit().
+//  The driver has no multi-register call, so a transaction still does one transfer per
+//  register; what it saves is the transfers the shadow makes unnecessary and the
+//  per-call checking of the program. Stats() counts the transfers, those saved and the
+//  time spent in the driver, to compare against the plain call sequence.
+//
+//  FpgaRegisters does not call the driver itself: Transfer(), Configure() and
+//  WaitForProcessingDone() are implemented by FpgaCard (FpgaCard.h) on the card, and by
+//  FpgaSimulator (FpgaSimulator.h) on a model of the firmware, which therefore builds
+//  and runs without the driver library.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef FPGA_REGISTERS_H
+#define FPGA_REGISTERS_H
+
+#include <chrono>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+
+
+// Indirect access port of the default firmware
+enum { FpgaReadAddrReg = 0, FpgaStartAddrReg = 1, FpgaBufferIDReg = 2 };
+
+// Called after every transfer: 'function' is "ReadFPGA" or "WriteFPGA"
+typedef void (*FpgaIoLog)(void* contextP, char const* function, ViInt32 regID, ViInt32 nbrValues,
+                          ViInt32 const* dataP, ViStatus status);
+
+struct FpgaRegisterStats
+{
+    ViUInt64 nbrTransfers;              // calls to the driver
+    ViUInt64 nbrReadsSaved;             // read from the shadow
+    ViUInt64 nbrWritesSaved;            // value already in a shadowed register
+    double seconds;                     // in the driver
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class FpgaRegisters
+{
+public:
+    enum { MaxRegisters = 256 };        // register identifiers 0 .. MaxRegisters - 1 can be shadowed
+
+    explicit FpgaRegisters(ViSession instrID = 0, char const* deviceName = "Block1Dev1")
+        : m_instrID(instrID), m_logP(NULL), m_logContextP(NULL), m_inTransaction(false)
+    {
+        ::strncpy(m_deviceName, deviceName, sizeof(m_deviceName) - 1);
+        m_deviceName[sizeof(m_deviceName) - 1] = '\0';
+        ::memset(m_shadowed, 0, sizeof(m_shadowed));
+        Invalidate();
+        ClearStats();
+    }
+
+    virtual ~FpgaRegisters() {}
+
+    void Attach(ViSession instrID) { m_instrID = instrID; Invalidate(); }
+
+    // Acqrs_configLogicDevice() on the device of this object; the shadow values are lost
+    ViStatus ConfigLogicDevice(char const* fileName, ViInt32 flags)
+    {
+        Invalidate();
+        return Configure(fileName, flags);
+    }
+
+    // Wait for the "processing done" interrupt of the firmware (see FpgaWait.h)
+    virtual ViStatus WaitForProcessingDone(ViInt32 timeoutMs) = 0;
+
+    void SetLog(FpgaIoLog logP, void* contextP) { m_logP = logP; m_logContextP = contextP; }
+
+    // Keep the value of 'regID' on the host; it is read once on first use
+    void Shadow(ViInt32 regID)
+    {
+        if (regID >= 0 && regID < MaxRegisters)
+            m_shadowed[regID] = true;
+    }
+
+    // Forget the shadow values (the firmware was reloaded or reset)
+    void Invalidate() { ::memset(m_valid, 0, sizeof(m_valid)); }
+
+    FpgaRegisterStats const& Stats() const { return m_stats; }
+    void ClearStats() { ::memset(&m_stats, 0, sizeof(m_stats)); }
+
+    ViStatus Read(ViInt32 regID, ViInt32& value) { return Run(Operation(OpRead, regID, 1, &value, 0, 0)); }
+    ViStatus Write(ViInt32 regID, ViInt32 value) { return Run(Operation(OpWrite, regID, 1, NULL, 0, value)); }
+
+    // value = (value & ~clearBits) | setBits
+    ViStatus Modify(ViInt32 regID, ViInt32 clearBits, ViInt32 setBits)
+    {
+        return Run(Operation(OpModify, regID, 1, NULL, clearBits, setBits));
+    }
+
+    // 'nbrValues' transfers to or from the same register, always done
+    ViStatus ReadBlock(ViInt32 regID, ViInt32 nbrValues, ViInt32* dataP)
+    {
+        return Run(Operation(OpReadBlock, regID, nbrValues, dataP, 0, 0));
+    }
+    ViStatus WriteBlock(ViInt32 regID, ViInt32 nbrValues, ViInt32 const* dataP)
+    {
+        return Run(Operation(OpWriteBlock, regID, nbrValues, const_cast<ViInt32*>(dataP), 0, 0));
+    }
+
+    // 'nbrValues' 32-bit words of firmware buffer 'bufferID' from 'startAddr'
+    ViStatus ReadIndirect(ViInt32 bufferID, ViInt32 startAddr, ViInt32 nbrValues, ViInt32* dataP)
+    {
+        return Run(Operation(OpReadIndirect, bufferID, nbrValues, dataP, startAddr, 0));
+    }
+
+    // Queue the following operations until Commit()
+    void Begin() { m_inTransaction = true; m_queue.clear(); }
+
+    ViStatus Commit()
+    {
+        m_inTransaction = false;
+        ViStatus status = VI_SUCCESS;
+        for (size_t n = 0; n < m_queue.size() && status == VI_SUCCESS; ++n)
+            status = Execute(m_queue[n]);
+        m_queue.clear();
+        return status;
+    }
+
+protected:
+    // One Acqrs_logicDeviceIO() call: 'nbrValues' reads (readWrite 0) or writes (1) of 'regID'
+    virtual ViStatus Transfer(ViInt32 regID, ViInt32 nbrValues, ViInt32* dataP, ViInt32 readWrite) = 0;
+
+    // Load 'fileName' into the FPGA (NULL with flags 1 clears it)
+    virtual ViStatus Configure(char const* fileName, ViInt32 flags) = 0;
+
+    ViSession InstrID() const { return m_instrID; }
+    char const* DeviceName() const { return m_deviceName; }
+
+private:
+    enum OpCode { OpRead, OpWrite, OpModify, OpReadBlock, OpWriteBlock, OpReadIndirect };
+
+    struct Operation
+    {
+        Operation(OpCode c, ViInt32 r, ViInt32 n, ViInt32* d, ViInt32 a, ViInt32 v)
+            : code(c), regID(r), nbrValues(n), dataP(d), arg(a), value(v) {}
+
+        OpCode code;
+        ViInt32 regID;                  // buffer identifier for OpReadIndirect
+        ViInt32 nbrValues;
+        ViInt32* dataP;
+        ViInt32 arg;                    // bits to clear, start address for OpReadIndirect
+        ViInt32 value;                  // value to write, bits to set
+    };
+
+    ViStatus Run(Operation const& op)
+    {
+        if (!m_inTransaction)
+            return Execute(op);
+        m_queue.push_back(op);
+        return VI_SUCCESS;
+    }
+
+    bool IsShadowed(ViInt32 regID) const { return regID >= 0 && regID < MaxRegisters && m_shadowed[regID]; }
+
+    ViStatus Execute(Operation const& op)
+    {
+        switch (op.code)
+        {
+        case OpRead:
+            return ReadShadow(op.regID, *op.dataP);
+
+        case OpWrite:
+            return WriteShadow(op.regID, op.value);
+
+        case OpModify:
+        {
+            ViInt32 value = 0;
+            ViStatus const status = ReadShadow(op.regID, value);
+            if (status != VI_SUCCESS)
+                return status;
+            return WriteShadow(op.regID, (value & ~op.arg) | op.value);
+        }
+
+        case OpReadBlock:
+        {
+            ViStatus const status = Io(op.regID, op.nbrValues, op.dataP, 0);
+            if (status == VI_SUCCESS && op.nbrValues > 0)
+                Remember(op.regID, op.dataP[op.nbrValues - 1]);
+            return status;
+        }
+
+        case OpWriteBlock:
+        {
+            ViStatus const status = Io(op.regID, op.nbrValues, op.dataP, 1);
+            if (status == VI_SUCCESS && op.nbrValues > 0)
+                Remember(op.regID, op.dataP[op.nbrValues - 1]);
+            else if (status != VI_SUCCESS && IsShadowed(op.regID))
+                m_valid[op.regID] = false;      // the register may hold any of the values
+            return status;
+        }
+
+        case OpReadIndirect:
+        {
+            ViInt32 startAddr = op.arg, bufferID = op.regID;
+            ViStatus status = Io(FpgaStartAddrReg, 1, &startAddr, 1);
+            if (status == VI_SUCCESS)
+                status = Io(FpgaBufferIDReg, 1, &bufferID, 1);
+            if (status == VI_SUCCESS)
+                status = Io(FpgaReadAddrReg, op.nbrValues, op.dataP, 0);
+            return status;
+        }
+        }
+        return VI_SUCCESS;
+    }
+
+    ViStatus ReadShadow(ViInt32 regID, ViInt32& value)
+    {
+        if (IsShadowed(regID) && m_valid[regID])
+        {
+            value = m_values[regID];
+            ++m_stats.nbrReadsSaved;
+            return VI_SUCCESS;
+        }
+        ViStatus const status = Io(regID, 1, &value, 0);
+        if (status == VI_SUCCESS)
+            Remember(regID, value);
+        return status;
+    }
+
+    ViStatus WriteShadow(ViInt32 regID, ViInt32 value)
+    {
+        if (IsShadowed(regID) && m_valid[regID] && m_values[regID] == value)
+        {
+            ++m_stats.nbrWritesSaved;
+            return VI_SUCCESS;
+        }
+        ViStatus const status = Io(regID, 1, &value, 1);
+        if (status == VI_SUCCESS)
+            Remember(regID, value);
+        else if (IsShadowed(regID))
+            m_valid[regID] = false;
+        return status;
+    }
+
+    void Remember(ViInt32 regID, ViInt32 value)
+    {
+        if (IsShadowed(regID))
+        {
+            m_values[regID] = value;
+            m_valid[regID] = true;
+        }
+    }
+
+    ViStatus Io(ViInt32 regID, ViInt32 nbrValues, ViInt32* dataP, ViInt32 readWrite)
+    {
+        std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+        ViStatus const status = Transfer(regID, nbrValues, dataP, readWrite);
+        m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ++m_stats.nbrTransfers;
+
+        if (m_logP != NULL)
+            m_logP(m_logContextP, readWrite ? "WriteFPGA" : "ReadFPGA", regID, nbrValues, dataP, status);
+        return status;
+    }
+
+    ViSession m_instrID;
+    char m_deviceName[32];
+    FpgaIoLog m_logP;
+    void* m_logContextP;
+
+    bool m_shadowed[MaxRegisters];
+    bool m_valid[MaxRegisters];
+    ViInt32 m_values[MaxRegisters];
+
+    bool m_inTransaction;
+    std::vector<Operation> m_queue;
+    FpgaRegisterStats m_stats;
+};
+
+#endif // FPGA_REGISTERS_H
@@ -0,0 +1,550 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  FpgaSimulator.h : Register-level model of the analyzer (AC / SC) firmwares
+//----------------------------------------------------------------------------------------
+//
+//  FpgaSimulator is an FpgaRegisters whose Transfer(), Configure() and
+//  WaitForProcessingDone() act on a model of the firmware instead of the driver, so that the register sequences of the
+//  analyzer programs run without a card. The model covers the registers these programs
+//  use:
+//  - all firmwares: indirect access port (ReadAddr / StartAddr / BufferID), FPGA
+//    control and status (the DE clock is ready 'deClockSeconds' after the DE interface
+//    is started with the DCMs enabled), DE control
+//  - FpgaSimDefault (AC2x0.bit / SC2x0.bit): Main Control capture bit (0x1000) and the
+//    data entry monitor (control 65, buffer 0x0c)
+//  - FpgaSimFft (AC240FFT*.bit): Main Control run bit, Main Status busy (bit 16) and
+//    buffer full (bit 31), number of accumulations, FFT configuration, spectrum buffer
+//    0x81. Reading the spectrum buffer to its last word clears "buffer full". With the
+//    overwrite bit (0x20) of the FFT configuration the core goes on accumulating and
+//    replaces a spectrum not read in time (counted by SpectraOverwritten()); without it,
+//    the core waits for the read before starting the next spectrum.
+//  - FpgaSimMemory (memory example): SRAM control (reset, port A access), example
+//    control (bit 0 set once the memory is full), dual port memory buffer 0x04
+//  - FpgaSimStreamer (SC240 streamers): capture bits 0x1000 / 0x2000 / 0x4000 of Main
+//    Control for the DS / Tx / Rx monitors (65, 66, 67, buffers 0x0c, 0x10, 0x20) and
+//    the SLC links (control 80 + 4 * n, status 81 + 4 * n; the Tx and Rx ready bits
+//    follow 'linkSeconds' after the enables, bits 30 and 31 of the control clear
+//    themselves)
+//  Other registers read back what was written. The buffers hold synthetic data.
+//
+//  Time is the real time: each transfer takes 'transferSeconds' plus 'wordSeconds' per
+//  value, and the firmware events happen after the delays of FpgaSimTiming, so that the
+//  polling loops of the programs (with their Sleep()) behave as on the card. The
+//  defaults keep a complete sequence in the millisecond range.
+//
+//  The "processing done" interrupt (WaitForProcessingDone()) is raised by the monitor
+//  buffers becoming full; the other firmwares route no interrupt. By default the wait
+//  returns as long as a monitor buffer is full (level). With SetEdgeInterrupt(true) it
+//  only returns for a buffer that becomes full during the wait: an interrupt raised
+//  before the wait is lost, as when a program starts waiting too late.
+//
+//  Accesses a card would not accept (no firmware loaded, unknown buffer, read past a
+//  buffer) fail with FpgaSimError and are listed by Problems().
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef FPGA_SIMULATOR_H
+#define FPGA_SIMULATOR_H
+
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AcqirisImport.h"
+#include "FpgaRegisters.h"
+
+
+enum FpgaSimFirmware { FpgaSimNone, FpgaSimDefault, FpgaSimFft, FpgaSimMemory, FpgaSimStreamer };
+
+// Returned by the simulator for an access the card would refuse (not a driver code)
+static ViStatus const FpgaSimError = ViStatus(0xBFFA7F00);
+
+struct FpgaSimTiming
+{
+    FpgaSimTiming()
+        : transferSeconds(0.0), wordSeconds(0.0), loadSeconds(0.0), deClockSeconds(1e-3),
+          captureSeconds(1e-3), accumulationSeconds(5e-5), memoryFillSeconds(2e-3),
+          linkSeconds(5e-3), stopSeconds(1e-3) {}
+
+    double transferSeconds;             // per call of Acqrs_logicDeviceIO()
+    double wordSeconds;                 // per value transferred
+    double loadSeconds;                 // Acqrs_configLogicDevice()
+    double deClockSeconds;              // DE interface started to DE clock ready
+    double captureSeconds;              // capture bit set to monitor buffer ready
+    double accumulationSeconds;         // per power spectrum of the FFT core
+    double memoryFillSeconds;           // start of the memory example to memory full
+    double linkSeconds;                 // SLC enable to link ready
+    double stopSeconds;                 // FFT core disabled to not busy
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class FpgaSimulator : public FpgaRegisters
+{
+public:
+    enum { NbrLinks = 12 };
+
+    explicit FpgaSimulator(FpgaSimFirmware firmware = FpgaSimDefault, FpgaSimTiming const& timing = FpgaSimTiming())
+        : m_timing(timing), m_edgeInterrupt(false)
+    {
+        Load(firmware);
+    }
+
+    FpgaSimTiming& Timing() { return m_timing; }
+    FpgaSimFirmware Firmware() const { return m_firmware; }
+    std::vector<std::string> const& Problems() const { return m_problems; }
+    unsigned long SpectraOverwritten() const { return m_nbrOverwritten; }
+    void ClearProblems() { m_problems.clear(); }
+
+    // Edge-triggered interrupt: only a buffer filled during the wait ends it
+    void SetEdgeInterrupt(bool edge) { m_edgeInterrupt = edge; }
+
+    // The monitors raise the "processing done" interrupt when their buffer is full
+    virtual ViStatus WaitForProcessingDone(ViInt32 timeoutMs)
+    {
+        if (m_monitors.empty())
+            return Problem("interrupt wait, but the firmware routes no interrupt");
+
+        Clock::time_point const deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        Update();                                   // the edges before the wait are gone
+        std::vector<bool> capturing(m_monitors.size());
+        for (;;)
+        {
+            for (size_t n = 0; n < m_monitors.size(); ++n)
+                capturing[n] = m_monitors[n].capturing;
+            Update();
+            Clock::time_point next = deadline;
+            for (size_t n = 0; n < m_monitors.size(); ++n)
+            {
+                Monitor const& monitor = m_monitors[n];
+                bool const full = (Stored(monitor.ctrlReg) & 0x80000000) != 0;
+                if (monitor.capturing)
+                    next = (monitor.ready < next) ? monitor.ready : next;
+                else if (full && (!m_edgeInterrupt || capturing[n]))
+                    return VI_SUCCESS;
+            }
+
+            Clock::time_point const now = Clock::now();
+            if (now >= deadline)
+                return ViStatus(ACQIRIS_ERROR_TIMEOUT);
+            Clock::time_point const step = now + std::chrono::microseconds(100);  // DE clock not ready yet
+            std::this_thread::sleep_until(next > step ? next : step);
+        }
+    }
+
+    static FpgaSimFirmware FirmwareOf(char const* fileName)
+    {
+        std::string name(fileName);
+        for (size_t n = 0; n < name.size(); ++n)
+            name[n] = char(::toupper((unsigned char)name[n]));
+        if (name.find("FFT") != std::string::npos)
+            return FpgaSimFft;
+        if (name.find("MEM") != std::string::npos)
+            return FpgaSimMemory;
+        if (name.find("STRM") != std::string::npos || name.find("STREAM") != std::string::npos
+            || name.find("SC240STR") != std::string::npos)
+            return FpgaSimStreamer;
+        return FpgaSimDefault;
+    }
+
+protected:
+    // The firmware is chosen from the file name; NULL with flags 1 clears the FPGA
+    virtual ViStatus Configure(char const* fileName, ViInt32 flags)
+    {
+        Elapse(m_timing.loadSeconds);
+        if (fileName == NULL)
+        {
+            if ((flags & 1) == 0)
+                return Problem("ConfigLogicDevice: no file name");
+            Load(FpgaSimNone);
+            return VI_SUCCESS;
+        }
+        Load(FirmwareOf(fileName));
+        return VI_SUCCESS;
+    }
+
+    virtual ViStatus Transfer(ViInt32 regID, ViInt32 nbrValues, ViInt32* dataP, ViInt32 readWrite)
+    {
+        Elapse(m_timing.transferSeconds + m_timing.wordSeconds * nbrValues);
+        if (m_firmware == FpgaSimNone)
+            return Problem("register access without firmware");
+        if (nbrValues <= 0 || dataP == NULL)
+            return Problem("empty transfer");
+
+        Update();
+        if (readWrite)
+        {
+            for (ViInt32 n = 0; n < nbrValues; ++n)
+                WriteRegister(regID, dataP[n]);
+            return VI_SUCCESS;
+        }
+        if (regID == FpgaReadAddrReg)
+            return ReadBuffer(nbrValues, dataP);
+        ViInt32 const value = ReadRegister(regID);
+        for (ViInt32 n = 0; n < nbrValues; ++n)
+            dataP[n] = value;
+        return VI_SUCCESS;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum
+    {
+        FPGACtrlReg = 3, FPGAStatusReg = 6, DECtrlReg = 8, SRAMCtrlReg = 39,
+        MainCtrlReg = 64, MainStatusReg = 65, NbrAccReg = 66, FFTConfReg = 67, MemExampleCtrlReg = 66,
+        DsMonCtrlReg = 65, TxMonCtrlReg = 66, RxMonCtrlReg = 67, SLCBaseReg = 80, SLCOffset = 4,
+        DeMonitorID = 0x0c, TxMonitorID = 0x10, RxMonitorID = 0x20, SpectrumID = 0x81, SRAMID = 0x04,
+        MonitorWords = 0x1000, SpectrumWords = 16 * 1024, SRAMWords = 0x100000
+    };
+
+    struct Monitor
+    {
+        ViInt32 ctrlReg;
+        ViInt32 captureBit;
+        ViInt32 bufferID;
+        bool capturing;
+        Clock::time_point ready;
+    };
+
+    struct Link
+    {
+        ViInt32 enables;                // bit 0 Tx, bit 1 Rx
+        Clock::time_point ready;
+    };
+
+    void Load(FpgaSimFirmware firmware)
+    {
+        m_firmware = firmware;
+        m_registers.clear();
+        m_buffers.clear();
+        m_monitors.clear();
+        m_deClock = false;
+        m_fftRunning = m_fftStopping = m_spectrumFull = false;
+        m_memoryFilling = m_memoryFull = false;
+        m_nbrCaptures = m_nbrSpectra = m_nbrOverwritten = 0;
+        for (int n = 0; n < NbrLinks; ++n)
+            m_links[n].enables = 0;
+
+        switch (firmware)
+        {
+        case FpgaSimDefault:
+            AddMonitor(DsMonCtrlReg, 0x1000, DeMonitorID);
+            break;
+        case FpgaSimFft:
+            m_buffers[SpectrumID].assign(SpectrumWords, 0);
+            break;
+        case FpgaSimMemory:
+            m_buffers[SRAMID].assign(SRAMWords, 0);
+            break;
+        case FpgaSimStreamer:
+            AddMonitor(DsMonCtrlReg, 0x1000, DeMonitorID);
+            AddMonitor(TxMonCtrlReg, 0x2000, TxMonitorID);
+            AddMonitor(RxMonCtrlReg, 0x4000, RxMonitorID);
+            break;
+        case FpgaSimNone:
+            break;
+        }
+    }
+
+    void AddMonitor(ViInt32 ctrlReg, ViInt32 captureBit, ViInt32 bufferID)
+    {
+        Monitor const monitor = { ctrlReg, captureBit, bufferID, false, Clock::time_point() };
+        m_monitors.push_back(monitor);
+        m_buffers[bufferID].assign(MonitorWords, 0);
+    }
+
+    ViInt32 Stored(ViInt32 regID) const
+    {
+        std::map<ViInt32, ViInt32>::const_iterator const it = m_registers.find(regID);
+        return it == m_registers.end() ? 0 : it->second;
+    }
+
+    bool IsLinkReg(ViInt32 regID) const
+    {
+        return m_firmware == FpgaSimStreamer && regID >= SLCBaseReg && regID < SLCBaseReg + NbrLinks * SLCOffset;
+    }
+
+    // Advance the firmware state to now
+    void Update()
+    {
+        Clock::time_point const now = Clock::now();
+        bool const deClock = m_deClock && now >= m_deClockReady;
+
+        for (size_t n = 0; n < m_monitors.size(); ++n)
+        {
+            Monitor& monitor = m_monitors[n];
+            if (monitor.capturing && deClock && now >= monitor.ready)
+            {
+                monitor.capturing = false;
+                m_registers[monitor.ctrlReg] = Stored(monitor.ctrlReg) | 0x80000000;
+                FillWaveform(m_buffers[monitor.bufferID], 0, MonitorWords);
+            }
+        }
+
+        bool const overwrite = (Stored(FFTConfReg) & 0x20) != 0;
+        if (m_fftRunning && deClock && (!m_spectrumFull || overwrite) && now >= m_spectrumReady)
+        {
+            // With overwrite, each spectrum finished since the last update replaced the previous one
+            unsigned long nbrFinished = 1;
+            if (overwrite)
+                nbrFinished += static_cast<unsigned long>((now - m_spectrumReady) / SpectrumDuration());
+            m_nbrOverwritten += m_spectrumFull ? nbrFinished : nbrFinished - 1;
+            m_spectrumFull = true;
+            m_spectrumReady = now + SpectrumDuration();
+            FillSpectrum();
+        }
+        if (m_fftStopping && now >= m_fftStopped)
+            m_fftStopping = false;
+
+        if (m_memoryFilling && deClock && now >= m_memoryReady)
+        {
+            m_memoryFilling = false;
+            m_memoryFull = true;
+            std::vector<ViInt32>& sram = m_buffers[SRAMID];
+            FillWaveform(sram, 0, SRAMWords / 2);
+            FillWaveform(sram, SRAMWords / 2, SRAMWords / 2);
+        }
+    }
+
+    ViInt32 ReadRegister(ViInt32 regID)
+    {
+        Clock::time_point const now = Clock::now();
+        if (regID == FPGAStatusReg)
+            return (m_deClock && now >= m_deClockReady) ? 0x00100000 : 0;
+
+        if (IsLinkReg(regID))
+        {
+            Link const& link = m_links[(regID - SLCBaseReg) / SLCOffset];
+            if ((regID - SLCBaseReg) % SLCOffset == 0)
+                return Stored(regID);
+            if (link.enables == 0 || now < link.ready)
+                return 0;
+            return ((link.enables & 1) ? 0x14 : 0) | ((link.enables & 2) ? 0x48 : 0);
+        }
+
+        if (m_firmware == FpgaSimFft && regID == MainStatusReg)
+            return ((m_fftRunning || m_fftStopping) ? 0x00010000 : 0) | (m_spectrumFull ? 0x80000000 : 0);
+        if (m_firmware == FpgaSimMemory && regID == MemExampleCtrlReg)
+            return (Stored(regID) & ~1) | (m_memoryFull ? 1 : 0);
+        return Stored(regID);
+    }
+
+    void WriteRegister(ViInt32 regID, ViInt32 value)
+    {
+        Clock::time_point const now = Clock::now();
+        ViInt32 const previous = Stored(regID);
+
+        if (regID == FPGAStatusReg)
+        {
+            Problem("write to the FPGA status register");
+            return;
+        }
+        if (regID == FPGACtrlReg && (value & 0x00ff0000) == 0)
+            m_deClock = false;                      // DCMs off: the DE clock stops
+        if (regID == DECtrlReg)
+        {
+            bool const start = (value & 0x80000000) != 0;
+            if (!start)
+                m_deClock = false;
+            else if ((previous & 0x80000000) == 0 || !m_deClock)
+            {
+                m_deClock = (Stored(FPGACtrlReg) & 0x00ff0000) != 0;
+                m_deClockReady = now + Duration(m_timing.deClockSeconds);
+            }
+        }
+
+        if (IsLinkReg(regID))
+        {
+            if ((regID - SLCBaseReg) % SLCOffset == 0)
+            {
+                Link& link = m_links[(regID - SLCBaseReg) / SLCOffset];
+                if ((value & 3) != link.enables)
+                {
+                    link.enables = value & 3;
+                    link.ready = now + Duration(m_timing.linkSeconds);
+                }
+                value &= 0x3fffffff;                // reset bits clear themselves
+            }
+            m_registers[regID] = value;
+            return;
+        }
+
+        for (size_t n = 0; n < m_monitors.size(); ++n)
+        {
+            Monitor& monitor = m_monitors[n];
+            if (regID == MainCtrlReg)
+            {
+                bool const was = (previous & monitor.captureBit) != 0, is = (value & monitor.captureBit) != 0;
+                if (is && !was)
+                {
+                    monitor.capturing = true;
+                    monitor.ready = now + Duration(m_timing.captureSeconds);
+                    ++m_nbrCaptures;
+                }
+                else if (!is)
+                {
+                    monitor.capturing = false;
+                    m_registers[monitor.ctrlReg] = Stored(monitor.ctrlReg) & 0x7fffffff;
+                }
+            }
+            else if (regID == monitor.ctrlReg)
+                value = (value & 0x7fffffff) | (Stored(regID) & 0x80000000);    // ready is read-only
+        }
+
+        if (m_firmware == FpgaSimFft && regID == MainCtrlReg)
+        {
+            bool const run = (value & 1) != 0;
+            if (run && !m_fftRunning)
+            {
+                m_spectrumReady = now + SpectrumDuration();
+                m_spectrumFull = false;
+            }
+            else if (!run && m_fftRunning)
+            {
+                m_fftStopping = true;
+                m_fftStopped = now + Duration(m_timing.stopSeconds);
+            }
+            m_fftRunning = run;
+        }
+        if (m_firmware == FpgaSimFft && regID == MainStatusReg)
+        {
+            Problem("write to the FFT main status register");
+            return;
+        }
+
+        if (m_firmware == FpgaSimMemory && regID == SRAMCtrlReg && (value & 1) != 0)
+        {
+            std::fill(m_buffers[SRAMID].begin(), m_buffers[SRAMID].end(), 0);
+            m_memoryFull = false;
+        }
+        if (m_firmware == FpgaSimMemory && regID == MemExampleCtrlReg)
+        {
+            if ((value & 2) != 0 && !m_memoryFilling)
+            {
+                if ((Stored(SRAMCtrlReg) & 2) != 0)
+                    Problem("memory example started with port A held by the program");
+                m_memoryFilling = true;
+                m_memoryFull = false;
+                m_memoryReady = now + Duration(m_timing.memoryFillSeconds);
+            }
+            value &= ~1;
+        }
+
+        m_registers[regID] = value;
+    }
+
+    ViStatus ReadBuffer(ViInt32 nbrValues, ViInt32* dataP)
+    {
+        ViInt32 const bufferID = Stored(FpgaBufferIDReg), startAddr = Stored(FpgaStartAddrReg);
+        std::map<ViInt32, std::vector<ViInt32> >::const_iterator const it = m_buffers.find(bufferID);
+        if (it == m_buffers.end())
+            return Problem("read of unknown buffer");
+        if (bufferID == SRAMID && (Stored(SRAMCtrlReg) & 2) == 0)
+            return Problem("dual port memory read without port A access");
+        std::vector<ViInt32> const& buffer = it->second;
+        if (startAddr < 0 || size_t(startAddr) + size_t(nbrValues) > buffer.size())
+            return Problem("read past the end of a buffer");
+        for (ViInt32 n = 0; n < nbrValues; ++n)
+            dataP[n] = buffer[startAddr + n];
+        m_registers[FpgaStartAddrReg] = startAddr + nbrValues;     // the port increments the address
+
+        if (bufferID == SpectrumID && m_spectrumFull && size_t(startAddr) + size_t(nbrValues) == buffer.size())
+        {
+            // Spectrum read: without overwrite the core was waiting for it
+            if ((Stored(FFTConfReg) & 0x20) == 0)
+                m_spectrumReady = Clock::now() + SpectrumDuration();
+            m_spectrumFull = false;
+        }
+        return VI_SUCCESS;
+    }
+
+    // Both pipelines accumulate 'NbrAccReg' power spectra each
+    Clock::duration SpectrumDuration() const
+    {
+        ViInt32 const nbrAcc = Stored(NbrAccReg) > 0 ? Stored(NbrAccReg) : 1;
+        return Duration(2 * nbrAcc * m_timing.accumulationSeconds);
+    }
+
+    // 8-bit samples of a sine with a period of 50 samples, 4 per word, shifted for each capture
+    void FillWaveform(std::vector<ViInt32>& buffer, size_t first, size_t nbrWords)
+    {
+        ViUInt8 period[50];
+        for (int n = 0; n < 50; ++n)
+            period[n] = ViUInt8(ViInt8(100.0 * sin(2.0 * 3.14159265358979 * n / 50.0)));
+
+        size_t sample = (7 * m_nbrCaptures) % 50;
+        for (size_t n = 0; n < nbrWords; ++n)
+        {
+            ViUInt32 word = 0;
+            for (int b = 0; b < 4; ++b, sample = (sample == 49) ? 0 : sample + 1)
+                word |= ViUInt32(period[sample]) << (8 * b);
+            buffer[first + n] = ViInt32(word);
+        }
+    }
+
+    // A line on a noise floor, scaled by the number of accumulations; new noise for each spectrum
+    void FillSpectrum()
+    {
+        std::vector<ViInt32>& spectrum = m_buffers[SpectrumID];
+        ViInt32 const nbrAcc = 2 * (Stored(NbrAccReg) > 0 ? Stored(NbrAccReg) : 1);
+        ViUInt32 noise = 12345 + ViUInt32(m_nbrSpectra++);
+        for (size_t n = 0; n < spectrum.size(); ++n)
+        {
+            noise = noise * 1103515245u + 12345u;
+            ViInt32 const line = (n >= 1000 && n <= 1002) ? (n == 1001 ? 100000 : 20000) : 0;
+            spectrum[n] = nbrAcc * (line + ViInt32(100 + (noise >> 24)));
+        }
+    }
+
+    ViStatus Problem(char const* text)
+    {
+        m_problems.push_back(text);
+        return FpgaSimError;
+    }
+
+    static Clock::duration Duration(double seconds)
+    {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    // Sleep for long delays, spin for the short ones the scheduler cannot resolve
+    static void Elapse(double seconds)
+    {
+        if (seconds <= 0.0)
+            return;
+        if (seconds >= 1e-3)
+        {
+            std::this_thread::sleep_for(Duration(seconds));
+            return;
+        }
+        Clock::time_point const end = Clock::now() + Duration(seconds);
+        while (Clock::now() < end)
+            ;
+    }
+
+    FpgaSimTiming m_timing;
+    bool m_edgeInterrupt;
+    FpgaSimFirmware m_firmware;
+    std::map<ViInt32, ViInt32> m_registers;
+    std::map<ViInt32, std::vector<ViInt32> > m_buffers;
+    std::vector<Monitor> m_monitors;
+    Link m_links[NbrLinks];
+    std::vector<std::string> m_problems;
+    unsigned long m_nbrCaptures;
+    unsigned long m_nbrSpectra, m_nbrOverwritten;
+
+    bool m_deClock;                     // started with the DCMs enabled
+    Clock::time_point m_deClockReady;
+    bool m_fftRunning, m_fftStopping, m_spectrumFull;
+    Clock::time_point m_spectrumReady, m_fftStopped;
+    bool m_memoryFilling, m_memoryFull;
+    Clock::time_point m_memoryReady;
+};
+
+#endif // FPGA_SIMULATOR_H
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  FpgaWait.h : Waiting for firmware status bits without fixed Sleep() loops
+//----------------------------------------------------------------------------------------
+//
+//  The analyzer programs used to poll a status register with Sleep(1) or Sleep(10) and
+//  count iterations, so a wait lasted up to a sleep too long and its timeout depended
+//  on the scheduler. FpgaWait waits on the registers of an FpgaRegisters object until a
+//  deadline of the monotonic clock:
+//  - Until() reads the registers back to back for 'spinSeconds', then sleeps between
+//    reads, starting at 20 us and doubling up to 'maxSleepSeconds', never beyond the
+//    deadline
+//  - UntilInterrupt() is for a condition whose signal the firmware routes to the
+//    "processing done" interrupt (e.g. "monitor buffer full" of the BaseTest firmware):
+//    it blocks in AcqrsD1_waitForEndOfProcessing(), then confirms the condition with
+//    one read, and goes on polling if the interrupt came from something else. When the
+//    interrupt does not come (not routed, raised before the wait, or taken by an
+//    earlier wait), the condition is read once more at the deadline before a timeout
+//    is reported. Without interrupt support it polls until the deadline.
+//  Both return VI_SUCCESS, ACQIRIS_ERROR_TIMEOUT, or the status of a failed read. Every
+//  wait is recorded with its duration and number of reads (Records(), Print()).
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef FPGA_WAIT_H
+#define FPGA_WAIT_H
+
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "AcqirisImport.h"
+#include "FpgaRegisters.h"
+
+
+// (value of 'regID' & mask) == expected
+struct FpgaCondition
+{
+    ViInt32 regID;
+    ViInt32 mask;
+    ViInt32 expected;
+};
+
+struct FpgaWaitRecord
+{
+    char const* name;
+    double seconds;
+    ViInt32 nbrReads;
+    bool interrupt;                     // woken by the interrupt
+    ViStatus status;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class FpgaWait
+{
+public:
+    explicit FpgaWait(FpgaRegisters& regs, double spinSeconds = 50e-6, double maxSleepSeconds = 1e-3)
+        : m_regs(regs), m_spinSeconds(spinSeconds), m_maxSleepSeconds(maxSleepSeconds) {}
+
+    ViStatus Until(char const* name, ViInt32 regID, ViInt32 mask, ViInt32 expected, double timeoutSeconds)
+    {
+        FpgaCondition const condition = { regID, mask, expected };
+        return UntilAll(name, &condition, 1, timeoutSeconds);
+    }
+
+    // All the conditions at the same time
+    ViStatus UntilAll(char const* name, FpgaCondition const* conditionsP, int nbrConditions, double timeoutSeconds)
+    {
+        Clock::time_point const start = Clock::now();
+        FpgaWaitRecord record = { name, 0.0, 0, false, VI_SUCCESS };
+        record.status = Poll(conditionsP, nbrConditions, start + Duration(timeoutSeconds), record);
+        return Finish(record, start);
+    }
+
+    ViStatus UntilInterrupt(char const* name, ViInt32 regID, ViInt32 mask, ViInt32 expected, double timeoutSeconds)
+    {
+        FpgaCondition const condition = { regID, mask, expected };
+        Clock::time_point const start = Clock::now(), deadline = start + Duration(timeoutSeconds);
+        FpgaWaitRecord record = { name, 0.0, 0, false, VI_SUCCESS };
+
+        ViInt32 const timeoutMs = ViInt32(timeoutSeconds * 1000.0 + 0.5);
+        ViStatus status = m_regs.WaitForProcessingDone(timeoutMs > 0 ? timeoutMs : 1);
+        record.interrupt = (status == VI_SUCCESS);
+
+        // Confirm the condition after the interrupt. After a timeout the deadline is over,
+        // so this is one last read: the condition may be met without a new interrupt.
+        // If the wait failed, this polls until the deadline.
+        status = Poll(&condition, 1, deadline, record);
+        record.status = status;
+        return Finish(record, start);
+    }
+
+    std::vector<FpgaWaitRecord> const& Records() const { return m_records; }
+    void Clear() { m_records.clear(); }
+
+    double TotalSeconds() const
+    {
+        double seconds = 0.0;
+        for (size_t n = 0; n < m_records.size(); ++n)
+            seconds += m_records[n].seconds;
+        return seconds;
+    }
+
+    void Print(FILE* file) const
+    {
+        for (size_t n = 0; n < m_records.size(); ++n)
+        {
+            FpgaWaitRecord const& record = m_records[n];
+            char const* const result = (record.status == VI_SUCCESS) ? ""
+                : (record.status == ViStatus(ACQIRIS_ERROR_TIMEOUT)) ? ", timeout" : ", error";
+            fprintf(file, "%-24s %9.3f ms %6d reads%s%s\n", record.name, record.seconds * 1e3, int(record.nbrReads),
+                record.interrupt ? ", interrupt" : "", result);
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static Clock::duration Duration(double seconds)
+    {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    ViStatus Poll(FpgaCondition const* conditionsP, int nbrConditions, Clock::time_point deadline,
+                  FpgaWaitRecord& record)
+    {
+        Clock::time_point const spinEnd = Clock::now() + Duration(m_spinSeconds);
+        double sleepSeconds = 20e-6;
+        for (;;)
+        {
+            bool met = true;
+            for (int n = 0; n < nbrConditions && met; ++n)
+            {
+                ViInt32 value = 0;
+                ViStatus const status = m_regs.ReadBlock(conditionsP[n].regID, 1, &value);
+                ++record.nbrReads;
+                if (status != VI_SUCCESS)
+                    return status;
+                met = (value & conditionsP[n].mask) == conditionsP[n].expected;
+            }
+            if (met)
+                return VI_SUCCESS;
+
+            Clock::time_point const now = Clock::now();
+            if (now >= deadline)
+                return ViStatus(ACQIRIS_ERROR_TIMEOUT);
+            if (now < spinEnd)
+                continue;
+
+            Clock::duration const sleep = Duration(sleepSeconds);
+            std::this_thread::sleep_for(deadline - now < sleep ? deadline - now : sleep);
+            sleepSeconds = (2 * sleepSeconds < m_maxSleepSeconds) ? 2 * sleepSeconds : m_maxSleepSeconds;
+        }
+    }
+
+    ViStatus Finish(FpgaWaitRecord& record, Clock::time_point start)
+    {
+        record.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        m_records.push_back(record);
+        return record.status;
+    }
+
+    FpgaRegisters& m_regs;
+    double m_spinSeconds;
+    double m_maxSleepSeconds;
+    std::vector<FpgaWaitRecord> m_records;
+};
+
+#endif // FPGA_WAIT_H
@@ -0,0 +1,310 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GateStore.h : Gate-indexed store of SSR waveforms
+//----------------------------------------------------------------------------------------
+//
+//  A store is a gate file in the GTB1 format of PeakStream.h (WriteGateBatch()), plus an
+//  index of its gates held in memory, with one column per field:
+//      segment, timestamp (of the segment), position, length, offset (in the file)
+//  and the segments by their timestamp and first gate. Queries (gates longer than N,
+//  gates in a timestamp range) only read the index; the samples are read from the file
+//  when a gate or a full segment is asked for.
+//
+//  - Create() starts a new file; Append() writes the gates of each readout to it right
+//    away and indexes them, so the samples are never kept in memory
+//  - Open() indexes an existing GTB1 file (e.g. "AcqirisGates.bin" written by
+//    GetStartedSSRStream), reading the block headers and columns and skipping the
+//    samples. An opened store is read only: Append() fails.
+//  Gates before the first segment header of a readout are written to the file, but
+//  have no segment and are not indexed.
+//
+//  Offsets are 64-bit, so files over 2 GB also work where 'long' has 32 bits.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef GATE_STORE_H
+#define GATE_STORE_H
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+#include "PeakStream.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// 64-bit file positioning
+inline bool GateFileSeek(FILE* file, ViUInt64 offset, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(file, __int64(offset), origin) == 0;
+#else
+    return fseeko(file, off_t(offset), origin) == 0;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class GateStore
+{
+public:
+    GateStore() : m_file(NULL), m_writable(false), m_fileBytes(0), m_nbrBytes(0), m_timeOrdered(true) {}
+    ~GateStore() { Close(); }
+
+    long NbrSegments() const { return long(m_segTimeStamp.size()); }
+    long NbrGates() const { return long(m_gateSegment.size()); }
+    ViUInt64 NbrBytes() const { return m_nbrBytes; }            // samples of the indexed gates
+
+    // Index columns, by gate number
+    ViInt32 Segment(long gate) const { return m_gateSegment[gate]; }
+    ViUInt64 TimeStamp(long gate) const { return m_segTimeStamp[m_gateSegment[gate]]; }
+    ViUInt32 Position(long gate) const { return m_gatePosition[gate]; }
+    ViUInt32 Length(long gate) const { return m_gateLength[gate]; }
+    ViUInt64 Offset(long gate) const { return m_gateOffset[gate]; }
+
+    // Start an empty store in a new file
+    bool Create(char const* fileName)
+    {
+        Close();
+        m_file = fopen(fileName, "w+b");
+        m_writable = (m_file != NULL);
+        return m_writable;
+    }
+
+    // Write the segments and gates of a decoded SSR readout to the file and index them
+    bool Append(ViUInt32 acquisition, PeakBatch const& batch)
+    {
+        if (!m_writable)
+            return false;
+        if (!GateFileSeek(m_file, m_fileBytes, SEEK_SET) || !WriteGateBatch(m_file, acquisition, batch))
+        {
+            m_writable = false;         // the file stays valid up to the last complete block
+            return false;
+        }
+
+        ViUInt64 const samplesOffset = m_fileBytes + SamplesStart(batch.NbrSegments(), batch.NbrGates());
+        Index(batch.NbrSegments(), Data(batch.segTimeStamp), Data(batch.segFirstGate),
+              batch.NbrGates(), Data(batch.gatePosition), Data(batch.gateLength), samplesOffset);
+
+        ViUInt64 nbrBytes = 0;
+        for (long n = 0; n < batch.NbrGates(); ++n)
+            nbrBytes += batch.gateLength[n];
+        m_fileBytes = samplesOffset + nbrBytes;
+        return true;
+    }
+
+    // Queries on the index: append the numbers of the matching gates to 'gates'
+    void SelectLongerThan(ViUInt32 minLength, std::vector<long>& gates) const
+    {
+        for (size_t n = 0; n < m_gateLength.size(); ++n)
+            if (m_gateLength[n] > minLength)
+                gates.push_back(long(n));
+    }
+
+    // Gates of the segments with first <= timestamp <= last
+    void SelectTimeRange(ViUInt64 first, ViUInt64 last, std::vector<long>& gates) const
+    {
+        if (m_timeOrdered)
+        {
+            // Segments were stored in time order: the range is a run of segments, and
+            // their gates a run of gates
+            long const segFirst = long(std::lower_bound(m_segTimeStamp.begin(), m_segTimeStamp.end(), first)
+                                       - m_segTimeStamp.begin());
+            long const segEnd = long(std::upper_bound(m_segTimeStamp.begin(), m_segTimeStamp.end(), last)
+                                     - m_segTimeStamp.begin());
+            for (long n = FirstGate(segFirst); n < FirstGate(segEnd); ++n)
+                gates.push_back(n);
+        }
+        else
+        {
+            for (size_t n = 0; n < m_gateSegment.size(); ++n)
+            {
+                ViUInt64 const timeStamp = m_segTimeStamp[m_gateSegment[n]];
+                if (timeStamp >= first && timeStamp <= last)
+                    gates.push_back(long(n));
+            }
+        }
+    }
+
+    // Samples of one gate
+    bool GateSamples(long gate, std::vector<ViInt8>& samples)
+    {
+        samples.resize(m_gateLength[gate]);
+        return samples.empty() || ReadSamples(m_gateOffset[gate], m_gateLength[gate], &samples[0]);
+    }
+
+    // Full segment of 'nbrSamples' samples: 'fill' outside the gates
+    bool ReconstructSegment(long segment, long nbrSamples, ViInt8 fill, ViInt8* dataP)
+    {
+        std::fill(dataP, dataP + nbrSamples, fill);
+
+        for (long n = FirstGate(segment); n < FirstGate(segment + 1); ++n)
+        {
+            long const position = long(m_gatePosition[n]);
+            long const length = std::min(long(m_gateLength[n]), nbrSamples - position);
+            if (length > 0 && !ReadSamples(m_gateOffset[n], length, dataP + position))
+                return false;
+        }
+        return true;
+    }
+
+    // Index a GTB1 file; the samples stay in the file
+    bool Open(char const* fileName)
+    {
+        Close();
+        m_file = fopen(fileName, "rb");
+        if (m_file == NULL)
+            return false;
+
+        ViUInt64 fileSize = 0;
+        bool ok = GateFileSeek(m_file, 0, SEEK_END) && FileTell(fileSize) && GateFileSeek(m_file, 0, SEEK_SET);
+
+        std::vector<ViUInt64> segTimeStamp;
+        std::vector<ViInt32> segFirstGate;
+        std::vector<ViUInt32> gatePosition, gateLength;
+        while (ok && m_fileBytes < fileSize)
+        {
+            GateFileBlock block;
+            ok = fread(&block, sizeof(block), 1, m_file) == 1 && ::memcmp(block.magic, "GTB1", 4) == 0
+                && block.nbrSegments >= 0 && block.nbrGates >= 0;
+
+            // Counts from a corrupt header must not size the columns beyond the file
+            ViUInt64 const samplesOffset = ok ? m_fileBytes + SamplesStart(block.nbrSegments, block.nbrGates) : 0;
+            ok = ok && samplesOffset + block.nbrBytes <= fileSize;
+            if (!ok)
+                break;
+
+            segTimeStamp.resize(block.nbrSegments);
+            segFirstGate.resize(block.nbrSegments);
+            gatePosition.resize(block.nbrGates);
+            gateLength.resize(block.nbrGates);
+            ok = ReadColumn(segTimeStamp) && ReadColumn(segFirstGate)
+                && ReadColumn(gatePosition) && ReadColumn(gateLength);
+
+            ViUInt64 nbrBytes = 0;
+            for (size_t n = 0; ok && n < gateLength.size(); ++n)
+                nbrBytes += gateLength[n];
+            for (size_t n = 0; ok && n < segFirstGate.size(); ++n)
+                ok = segFirstGate[n] >= (n > 0 ? segFirstGate[n - 1] : 0) && segFirstGate[n] <= block.nbrGates;
+            ok = ok && nbrBytes == block.nbrBytes;
+            if (!ok)
+                break;
+
+            Index(block.nbrSegments, Data(segTimeStamp), Data(segFirstGate),
+                  block.nbrGates, Data(gatePosition), Data(gateLength), samplesOffset);
+            m_fileBytes = samplesOffset + nbrBytes;
+            ok = GateFileSeek(m_file, m_fileBytes, SEEK_SET);
+        }
+
+        if (!ok)
+        {
+            Close();
+            return false;
+        }
+        m_timeOrdered = std::is_sorted(m_segTimeStamp.begin(), m_segTimeStamp.end());
+        return true;
+    }
+
+    // Returns false if the file could not be completed
+    bool Close()
+    {
+        bool const ok = (m_file == NULL) || fclose(m_file) == 0;
+        m_file = NULL;
+        m_writable = false;
+        m_fileBytes = 0;
+        m_segTimeStamp.clear(); m_segFirstGate.clear();
+        m_gateSegment.clear(); m_gatePosition.clear(); m_gateLength.clear(); m_gateOffset.clear();
+        m_nbrBytes = 0;
+        m_timeOrdered = true;
+        return ok;
+    }
+
+private:
+    template <class T>
+    static T const* Data(std::vector<T> const& values) { return values.empty() ? NULL : &values[0]; }
+
+    // Bytes from the start of a GTB1 block to its samples
+    static ViUInt64 SamplesStart(long nbrSegments, long nbrGates)
+    {
+        return sizeof(GateFileBlock) + ViUInt64(nbrSegments) * (sizeof(ViUInt64) + sizeof(ViInt32))
+            + ViUInt64(nbrGates) * 2 * sizeof(ViUInt32);
+    }
+
+    // Add the segments and gates of one block, whose samples start at 'samplesOffset'
+    void Index(long nbrSegments, ViUInt64 const* segTimeStampP, ViInt32 const* segFirstGateP,
+               long nbrGates, ViUInt32 const* positionP, ViUInt32 const* lengthP, ViUInt64 samplesOffset)
+    {
+        long const firstGate = nbrSegments > 0 ? segFirstGateP[0] : nbrGates;
+        ViInt32 const gateBase = ViInt32(m_gateSegment.size() - firstGate);
+
+        ViUInt64 offset = samplesOffset;
+        for (long n = 0; n < firstGate; ++n)
+            offset += lengthP[n];
+
+        for (long seg = 0; seg < nbrSegments; ++seg)
+        {
+            if (!m_segTimeStamp.empty() && segTimeStampP[seg] < m_segTimeStamp.back())
+                m_timeOrdered = false;
+            m_segTimeStamp.push_back(segTimeStampP[seg]);
+            m_segFirstGate.push_back(gateBase + segFirstGateP[seg]);
+
+            long const end = (seg + 1 < nbrSegments) ? segFirstGateP[seg + 1] : nbrGates;
+            for (long n = segFirstGateP[seg]; n < end; ++n)
+            {
+                m_gateSegment.push_back(ViInt32(m_segTimeStamp.size() - 1));
+                m_gatePosition.push_back(positionP[n]);
+                m_gateLength.push_back(lengthP[n]);
+                m_gateOffset.push_back(offset);
+                offset += lengthP[n];
+                m_nbrBytes += lengthP[n];
+            }
+        }
+    }
+
+    long FirstGate(long segment) const
+    {
+        return segment < NbrSegments() ? long(m_segFirstGate[segment]) : NbrGates();
+    }
+
+    bool ReadSamples(ViUInt64 offset, size_t size, ViInt8* dataP)
+    {
+        return m_file != NULL && GateFileSeek(m_file, offset, SEEK_SET) && fread(dataP, 1, size, m_file) == size;
+    }
+
+    bool FileTell(ViUInt64& offset)
+    {
+#ifdef _WIN32
+        __int64 const position = _ftelli64(m_file);
+#else
+        off_t const position = ftello(m_file);
+#endif
+        offset = ViUInt64(position);
+        return position >= 0;
+    }
+
+    template <class T>
+    bool ReadColumn(std::vector<T>& values)
+    {
+        return values.empty() || fread(&values[0], sizeof(T), values.size(), m_file) == values.size();
+    }
+
+    FILE* m_file;
+    bool m_writable;                    // made by Create()
+    ViUInt64 m_fileBytes;               // end of the last complete block
+
+    // Segment columns
+    std::vector<ViUInt64> m_segTimeStamp;
+    std::vector<ViInt32> m_segFirstGate;
+
+    // Gate columns
+    std::vector<ViInt32> m_gateSegment;
+    std::vector<ViUInt32> m_gatePosition;
+    std::vector<ViUInt32> m_gateLength;
+    std::vector<ViUInt64> m_gateOffset;
+
+    ViUInt64 m_nbrBytes;
+    bool m_timeOrdered;                 // segment timestamps ascending
+};
+
+#endif // GATE_STORE_H
@@ -0,0 +1,550 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedAC240fftStreamVC.cpp : C++ demo program for the AC240 2GS/s Spectrum Analyzer firmware
+//                                   Continuous spectra with host-side 64-bit accumulation
+//----------------------------------------------------------------------------------------
+//  Copyright Agilent Technologies, Inc. 2006, 2007-2009
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+
+/* Description:
+ *
+ * GetStartedAC240fftVC.cpp reads a single accumulated power spectrum. This program keeps
+ * the FFT core running and reads every spectrum as soon as it is ready, for as long as
+ * requested (hours if needed):
+ *
+ * - The FFT core is configured without buffer overwrite: when a spectrum is full, the core
+ *   waits until it has been read before accumulating the next one, so no spectrum is lost
+ *   and none is read while being replaced. Reading the buffer clears it (bufClear = 0).
+ * - The main thread waits for "buffer full", reads the spectrum into a free readout buffer
+ *   and goes back to waiting; the core restarts as soon as the read is done.
+ * - An accumulator thread adds the spectra into 64-bit sums on the host. Every
+ *   'spectraPerRecord' spectra it appends the sum of these spectra to the time series
+ *   "AcqirisFFT.bin" and writes the sum of all spectra so far to "Acqiris.data".
+ *
+ * The on-board sums are 32 bits (readMode = 0), which is enough for 'NbrAcc' = 30; longer
+ * integrations are done on the host, without limit.
+ *
+ * "AcqirisFFT.bin" starts with an FftFileHeader, followed by one FftRecordHeader and
+ * 'nbrLines' unsigned 64-bit sums per record (little endian, no padding).
+ *
+ * Usage: GetStartedAC240fftStreamVC [seconds [spectraPerRecord]]
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include <windows.h>
+
+#include "vpptype.h"
+
+// ### Acqiris Digitizer Device Driver ###
+#include "AcqirisImport.h"
+#include "AcqirisD1Import.h"
+
+#include "AvgAccumulate.h"
+#include "AnalyzerSequences.h"
+#include "FpgaCard.h"
+#include "FpgaSimulator.h"
+#include "FpgaWait.h"
+#include "SlotRing.h"
+
+
+
+// ### Options ###
+// uncomment the following line to log fpga read / write access in a file called "FpgaIo.log"
+//#define FPGA_IO_LOG
+// uncomment the following line to run the register accesses against the firmware model of
+// "FpgaSimulator.h" instead of the card (the digitizer can be simulated by the driver)
+//#define FPGA_SIMULATOR
+
+#ifdef FPGA_IO_LOG
+FILE* ioLogFile = NULL;
+
+void LogFpgaIo(void* contextP, char const* function, ViInt32 regID, ViInt32 nbrValues, ViInt32 const* dataArrayP,
+               ViStatus status)
+{
+    FILE* file = (FILE*)contextP;
+    fprintf(file, "%s Reg #%3i (%ix):", strcmp(function, "WriteFPGA") == 0 ? "Write" : "Read ", (int)regID,
+        (int)nbrValues);
+    for(int i=0; i<nbrValues; ++i) fprintf(file, " %08x", (unsigned int)dataArrayP[i]);
+    fprintf(file, " => 0x%08x\n", (unsigned int)status);
+}
+#endif
+
+
+
+
+// ### Simulation flag ###
+bool simulation = false;
+// Set to true to simulate digitizers (useful for application development)
+
+
+
+// ### Global variables ###
+static const int maxNbrInstruments = 10;
+ViSession InstrumentID[maxNbrInstruments];  // Array of instrument handles
+ViSession currentID;                        // ID of currently used instrument
+long NumInstruments;                        // Number of instruments
+ViStatus status;                            // Status returned by calls to AcqrsD1... API functions
+#ifdef FPGA_SIMULATOR
+FpgaSimulator fpgaRegs(FpgaSimFft);         // Firmware model instead of the card (FpgaSimulator.h)
+#else
+FpgaCard fpgaRegs;                          // All register accesses of the current instrument
+#endif
+FpgaWait fpgaWait(fpgaRegs);                // Waits on the firmware status, with their durations
+
+// ### Constants ###
+// Register addresses
+static const long FPGACtrlReg       =   3;          // FPGA control register
+static const long FPGAStatusReg     =   6;          // FPGA status register
+static const long DECtrlReg         =   8;          // DE-bus control register (from MAC)
+static const long MainCtrlReg       =  64;          // Main Control register
+static const long MainStatusReg     =  65;          // Main Status register
+static const long NbrAccReg         =  66;          // Number of accumulations
+static const long FFTConfReg        =  67;          // Configuration register for FFT processing
+
+static const long SumOfSpectrum     = 0x81;         // Identifier of buffer holding the summed power spectrum
+
+long const NbrSpectralLines         = 16*1024;      // Number of bins in the acquired spectrum (fixed in firmware)
+long const NbrAcc                   = 30;           // Power spectra per pipeline in each on-board spectrum
+double const SampInterval           = 0.5e-9;       // 2GS/s
+
+// ### Time series file ###
+struct FftFileHeader
+{
+    char magic[8];                      // "AQFFTTS"
+    ViInt32 nbrLines;                   // per spectrum
+    ViInt32 nbrAccumulations;           // power spectra in each on-board spectrum (both pipelines)
+    ViReal64 sampInterval;              // of the digitizer, in seconds
+    ViInt64 startTime;                  // time() at the start of streaming
+};
+
+struct FftRecordHeader
+{
+    ViUInt32 firstSpectrum;             // index of the first on-board spectrum in this record
+    ViUInt32 nbrSpectra;                // on-board spectra summed in this record
+    ViReal64 firstSeconds;              // read times of the first and last one, since startTime
+    ViReal64 lastSeconds;
+};
+
+// One on-board spectrum
+struct SpectrumReadout
+{
+    std::vector<ViInt32> lines;
+    ViUInt32 index;
+    double seconds;                     // read time since the start of streaming
+};
+
+// Running 64-bit sums, filled by the accumulator thread
+struct SpectrumSums
+{
+    std::vector<ViUInt64> total;        // all spectra
+    std::vector<ViUInt64> record;       // spectra of the current record
+    ViUInt64 nbrSpectra;
+    FftRecordHeader recordHeader;
+    long nbrRecords;
+    bool writeError;                    // a record could not be written: no more are
+};
+
+
+// ### Function prototypes ###
+void Acquire(void);
+void AccumulateSpectra(SlotRing<SpectrumReadout>* ringP, SpectrumSums* accP, FILE* seriesFile,
+                       long spectraPerRecord);
+void Configure(void);
+void FindDevices(void);
+void InitFPGA(void);
+void LoadFPGA(void);
+void PublishSum(SpectrumSums const& acc);
+void Stop(void);
+long StreamSpectra(double seconds, long spectraPerRecord);
+void WaitForOperator(void);
+bool WriteRecord(FILE* file, SpectrumSums& acc);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    printf("\nAcqiris Analyzer - Continuous Spectra\n^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^\n\n");
+
+    double const seconds = (argc > 1) ? atof(argv[1]) : 60.0;          // Streaming time
+    long const spectraPerRecord = (argc > 2) ? atol(argv[2]) : 1000;   // On-board spectra per record
+
+    if (seconds <= 0.0 || spectraPerRecord < 1)
+    {
+        printf("Usage: GetStartedAC240fftStreamVC [seconds [spectraPerRecord]]\n");
+        return -1;
+    }
+
+#ifdef FPGA_IO_LOG
+    ioLogFile = fopen("FpgaIo.log", "w");
+    fpgaRegs.SetLog(LogFpgaIo, ioLogFile);
+#endif
+
+    FindDevices();          // ### Initialize the Analyzer(s) ###
+    printf("I have found %d Acqiris Analyzer(s) on your PC\n", (int)NumInstruments);
+    WaitForOperator();
+
+    LoadFPGA();             // ### Load the firmware into the FPGA ###
+    Configure();            // ### Configure the digitizer ###
+    Acquire();              // ### Start continuous acquisition + transfer to FPGA ###
+    InitFPGA();             // ### Initialize the FPGA ###
+    long const nbrSpectra = StreamSpectra(seconds, spectraPerRecord);   // ### Read every spectrum ###
+    Stop();                 // ### Stop the FPGA and the acquisition ###
+
+    printf("Operation terminated: Accumulated %ld power spectra\n", nbrSpectra);
+    WaitForOperator();
+
+    Acqrs_closeAll();       // ### Let the driver perform any necessary cleanup tasks ###
+
+#ifdef FPGA_IO_LOG
+    fclose(ioLogFile);
+    ioLogFile = NULL;
+#endif
+
+
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void AccumulateSpectra(SlotRing<SpectrumReadout>* ringP, SpectrumSums* accP, FILE* seriesFile,
+                       long spectraPerRecord)
+{
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        SpectrumReadout const& readout = (*ringP)[idx];
+        ViUInt32 const* linesP = reinterpret_cast<ViUInt32 const*>(&readout.lines[0]);
+
+        // The power sums are unsigned
+        AccumulateUInt32(&accP->total[0], linesP, NbrSpectralLines);
+        AccumulateUInt32(&accP->record[0], linesP, NbrSpectralLines);
+        ++accP->nbrSpectra;
+
+        FftRecordHeader& header = accP->recordHeader;
+        if (header.nbrSpectra++ == 0)
+        {
+            header.firstSpectrum = readout.index;
+            header.firstSeconds = readout.seconds;
+        }
+        header.lastSeconds = readout.seconds;
+
+        ringP->Release();
+
+        if (header.nbrSpectra == ViUInt32(spectraPerRecord))
+        {
+            // Keep accumulating after a write error: the sum is still published
+            if (!accP->writeError && !WriteRecord(seriesFile, *accP))
+                accP->writeError = true;
+            PublishSum(*accP);
+        }
+    }
+
+    // The last, partial record
+    if (accP->recordHeader.nbrSpectra > 0 && !accP->writeError && !WriteRecord(seriesFile, *accP))
+        accP->writeError = true;
+    PublishSum(*accP);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void Acquire(void)
+{
+    printf("Starting Acquisition\n");
+    // ### Start digitizing the signal and stream to digital data to the FPGA ###
+    status = AcqrsD1_configMode(currentID, 1, 0, 0);    // Set the mode to 'Streaming to DPU' ( = 1)
+    if (status != 0)
+        printf("configMode: Error %08x\n", (unsigned int)status);
+
+    status = AcqrsD1_acquire(currentID);                // Start the acquisition
+    if (status != 0)
+        printf("acquire: Error %08x\n", (unsigned int)status);
+
+    // It makes no sense to wait for the end of acquisition, since the digitizer will stream data continuously
+    // to the FPGA. Using "AcqrsD1_stopAcquisition(currentID);" is the only way to stop it.
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void Configure(void)
+{
+    // ### Digitizer Configuration ###
+
+    printf("Configuring Digitizer\n");
+
+    double delayTime = 0.0;
+    long coupling = 3, bandwidth = 0;
+    double fullScale = 2.0, offset = 0.0;
+
+    // interlace ADCs to get 2GS/s
+    status = AcqrsD1_configChannelCombination(currentID, 2, 1);
+
+    // Configure timebase
+    status = AcqrsD1_configHorizontal(currentID, SampInterval, delayTime);
+
+    // Configure vertical settings of channel 1
+    status = AcqrsD1_configVertical(currentID, 1, fullScale, offset, coupling, bandwidth);
+
+    // NOTE: The FFT core runs continuously and ignores the trigger, so no trigger is configured.
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void FindDevices(void)
+{
+    static char const* simulated[1] = { "PCI::AC240" };
+
+    if (simulation)
+    {
+        NumInstruments = 1;
+
+        // Initialize the digitizers in simulation mode
+        for (int i = 0; i < NumInstruments; i++)
+        {
+            status = Acqrs_InitWithOptions(
+                (ViRsrc)simulated[i], VI_FALSE, VI_FALSE, "simulate=TRUE", &(InstrumentID[i]));
+        }
+    }
+    else
+    {
+        // Find all digitizers
+        status = Acqrs_getNbrInstruments(&NumInstruments);
+
+        if (NumInstruments > maxNbrInstruments)         // Protect against too many instruments
+            NumInstruments = maxNbrInstruments;
+
+        // Initialize the analyzers
+        for (int i = 0; i < NumInstruments; i++)
+        {
+            char resourceName[20];
+            sprintf(resourceName, "PCI::INSTR%d", i);
+
+            status = Acqrs_InitWithOptions(
+                resourceName, VI_FALSE, VI_FALSE, "", &(InstrumentID[i]));
+        }
+    }
+    currentID = InstrumentID[0];                // Use the first instrument only
+    fpgaRegs.Attach(currentID);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////
+void InitFPGA()
+{
+    // ### Initialization of the FPGA ###
+    // NOTE: Firmware initialisation should be done AFTER the acquisition + transfer
+    //       to the FPGA have started, because the DE-input clock is started/stopped
+    //       with the acquisition.
+
+    // Set the DCM enable bits in the FPGA configuration register, start the DE interface
+    // in the FPGA and wait until the DE clock is ready (see AnalyzerSequences.h)
+    printf("Initializing FPGA\n");
+    status = StartDEInterface(fpgaRegs, fpgaWait, 0x00ff0000);     // Enable all DCMs
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+        printf("Timeout while waiting for DE clock!\n");
+
+    // Set number of power spectra to accumulate per pipeline ('NbrAcc').
+    // Note that with both pipelines enabled, the actual number
+    // of accumulations is twice the value set here.
+    // Configure the FFT core. We use the following settings:
+    // readMode = 0 (read low 32 bits)
+    // overwrite = 0 (a full buffer is kept until it has been read)
+    // bufClear = 0 (clear automatically)
+    // shift = 0 (no bit shift)
+    // Start the FFT core in continous mode (trigger is ignored)
+    status = StartFftCore(fpgaRegs, NbrAcc, 0x00000000);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void LoadFPGA(void)
+{
+    // ### Load the firmware into the FPGA
+    char fileName[50] = "AC240FFT2GSs.bit";
+
+    printf("Loading bit file \"%s\" into FPGA\n", fileName);
+    // Clear the FPGA first
+    status = fpgaRegs.ConfigLogicDevice(NULL, 1);
+
+    // Load the FPGA (flag = 3 will allow a search for FPGAPATH in the 'AqDrv4.ini' file)
+    status = fpgaRegs.ConfigLogicDevice(fileName, 3);
+    // If there is a problem, report it
+    if (status != VI_SUCCESS)
+    {
+        char message [256];
+        Acqrs_errorMessage(currentID, status, message, sizeof(message));
+        printf("Problem with loading firmware into FPGA: %s\n", message);
+    }
+    else
+    {
+        // Display some information about the loaded firmware
+        char text[256];
+        status = Acqrs_getInstrumentInfo(currentID, "LogDevHdrBlock1Dev1S name", &text);
+        printf("Firmware file name: %s\n", text);
+        status = Acqrs_getInstrumentInfo(currentID, "LogDevHdrBlock1Dev1S version", &text);
+        printf("Version: %s --- ", text);
+        status = Acqrs_getInstrumentInfo(currentID, "LogDevHdrBlock1Dev1S compDate", &text);
+        printf("%s\n\n", text);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void PublishSum(SpectrumSums const& acc)
+{
+    // ### Write the sum of all spectra so far, replacing the previous one ###
+    FILE* file = fopen("Acqiris.data", "w");
+    if (file == NULL)
+    {
+        printf("Couldn't open output file \"Acqiris.data\"!\n");
+        return;
+    }
+    fprintf(file, "# Spectra: %llu\n", (unsigned long long)acc.nbrSpectra);
+    fprintf(file, "# Accumulations: %llu\n", (unsigned long long)(acc.nbrSpectra * 2 * NbrAcc));
+    fprintf(file, "Power Spectrum Sum\n");
+    for (long i = 0; i < NbrSpectralLines; i++)
+        fprintf(file, "%llu\n", (unsigned long long)acc.total[i]);
+    fclose(file);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void Stop(void)
+{
+    printf("Stopping data processing\n");
+    // Disable FFT core
+    // and wait until it stops: acquisition and processing might continue after
+    // disabling the core until the last data block has been completely processed.
+    status = StopFftCore(fpgaRegs, fpgaWait);
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+        printf("Timeout while waiting for end of processing!\n");
+
+    //  ### Stop data conversion ###
+    status = AcqrsD1_stopAcquisition(currentID);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+long StreamSpectra(double seconds, long spectraPerRecord)
+{
+    // ### Read every spectrum for 'seconds' ###
+    typedef std::chrono::steady_clock Clock;
+
+    FILE* seriesFile = fopen("AcqirisFFT.bin", "wb");
+    if (seriesFile == NULL)
+    {
+        printf("Couldn't open output file \"AcqirisFFT.bin\"!\n");
+        return 0;
+    }
+    FftFileHeader fileHeader;
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    strcpy(fileHeader.magic, "AQFFTTS");
+    fileHeader.nbrLines = NbrSpectralLines;
+    fileHeader.nbrAccumulations = 2 * NbrAcc;
+    fileHeader.sampInterval = SampInterval;
+    fileHeader.startTime = ViInt64(time(NULL));
+    if (fwrite(&fileHeader, sizeof(fileHeader), 1, seriesFile) != 1)
+    {
+        printf("Error writing output file \"AcqirisFFT.bin\"!\n");
+        fclose(seriesFile);
+        return 0;
+    }
+
+    // Four buffers, so that writing a record does not hold the core
+    SlotRing<SpectrumReadout> ring(4);
+    for (long n = 0; n < ring.Size(); n++)
+        ring[n].lines.resize(NbrSpectralLines);
+
+    SpectrumSums acc;
+    acc.total.assign(NbrSpectralLines, 0);
+    acc.record.assign(NbrSpectralLines, 0);
+    acc.nbrSpectra = 0;
+    memset(&acc.recordHeader, 0, sizeof(acc.recordHeader));
+    acc.nbrRecords = 0;
+    acc.writeError = false;
+
+    std::thread accumulator(AccumulateSpectra, &ring, &acc, seriesFile, spectraPerRecord);
+
+    printf("Streaming spectra for %.0f s\n", seconds);
+    Clock::time_point const start = Clock::now();
+    Clock::time_point const end = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(seconds));
+
+    ViUInt32 nbrRead = 0;
+    double waitSeconds = 0.0, maxWaitSeconds = 0.0;
+    while (Clock::now() < end)
+    {
+        // Wait until the "buffer full" flag of the Main Status register goes to 1
+        status = WaitForFftSpectrum(fpgaWait);
+
+        // Keep the totals only: there is a wait per spectrum
+        double const waited = fpgaWait.Records().back().seconds;
+        fpgaWait.Clear();
+        waitSeconds += waited;
+        maxWaitSeconds = (waited > maxWaitSeconds) ? waited : maxWaitSeconds;
+
+        if (status != VI_SUCCESS)
+        {
+            if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+                printf("Timeout while waiting for spectrum!\n");
+            else
+                printf("Reading the FFT status: Error %08x\n", (unsigned int)status);
+            break;
+        }
+
+        long const idx = ring.WaitFree();
+        SpectrumReadout& readout = ring[idx];
+
+        // Reading the buffer to its end releases the core for the next spectrum
+        status = fpgaRegs.ReadIndirect(SumOfSpectrum, 0, NbrSpectralLines, &readout.lines[0]);
+        if (status != VI_SUCCESS)
+        {
+            printf("Reading spectrum %u: Error %08x\n", (unsigned int)nbrRead, (unsigned int)status);
+            break;
+        }
+        readout.index = nbrRead++;
+        readout.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        ring.Publish();
+    }
+
+    ring.Close();
+    accumulator.join();
+    if (fclose(seriesFile) != 0)
+        acc.writeError = true;
+
+    double const elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("Read %u spectra in %.1f s (%.1f per second), %ld records\n", (unsigned int)nbrRead, elapsed,
+        elapsed > 0.0 ? nbrRead / elapsed : 0.0, acc.nbrRecords);
+    printf("Waiting for spectra: %.3f s in total, at most %.3f ms\n", waitSeconds, maxWaitSeconds * 1e3);
+    printf("Accumulator was busy on %ld spectra\n", ring.Stalls());
+    if (acc.writeError)
+        printf("Error writing \"AcqirisFFT.bin\": saved %ld complete records, the sum to \"Acqiris.data\"\n",
+            acc.nbrRecords);
+    else
+        printf("Saved the spectra to \"AcqirisFFT.bin\" and their sum to \"Acqiris.data\"\n");
+    return long(acc.nbrSpectra);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void WaitForOperator(void)
+{
+    printf("Please press 'Enter' to continue\n");
+    getchar();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+bool WriteRecord(FILE* file, SpectrumSums& acc)
+{
+    // ### Append the sum of the spectra of this record to the time series ###
+    bool const written = fwrite(&acc.recordHeader, sizeof(acc.recordHeader), 1, file) == 1
+        && fwrite(&acc.record[0], sizeof(ViUInt64), acc.record.size(), file) == acc.record.size()
+        && fflush(file) == 0;
+
+    std::fill(acc.record.begin(), acc.record.end(), 0);
+    memset(&acc.recordHeader, 0, sizeof(acc.recordHeader));
+    if (written)
+        ++acc.nbrRecords;
+    return written;
+}
@@ -35,14 +35,31 @@
 #include "AcqirisImport.h"
 #include "AcqirisD1Import.h"
 
+#include "AnalyzerSequences.h"
+#include "FpgaCard.h"
+#include "FpgaSimulator.h"
+#include "FpgaWait.h"
+
 
 
 // ### Options ###
 // uncomment the following line to log fpga read / write access in a file called "FpgaIo.log"
 //#define FPGA_IO_LOG
+// uncomment the following line to run the register accesses against the firmware model of
+// "FpgaSimulator.h" instead of the card (the digitizer can be simulated by the driver)
+//#define FPGA_SIMULATOR
 
 #ifdef FPGA_IO_LOG
 FILE* ioLogFile = NULL;
+
+void LogFpgaIo(void* contextP, char const* function, ViInt32 regID, ViInt32 nbrValues, ViInt32 const* dataArrayP,
+               ViStatus status)
+{
+    FILE* file = (FILE*)contextP;
+    fprintf(file, "%s Reg #%3i (%ix):", strcmp(function, "WriteFPGA") == 0 ? "Write" : "Read ", regID, nbrValues);
+    for(int i=0; i<nbrValues; ++i) fprintf(file, " %08x", dataArrayP[i]);
+    fprintf(file, " => 0x%08x\n", status);
+}
 #endif
 
 
@@ -60,6 +77,12 @@ ViSession InstrumentID[maxNbrInstruments];  // Array of instrument handles
 ViSession currentID;                        // ID of currently used instrument
 long NumInstruments;                        // Number of instruments
 ViStatus status;                            // Status returned by calls to AcqrsD1... API functions
+#ifdef FPGA_SIMULATOR
+FpgaSimulator fpgaRegs(FpgaSimFft);         // Firmware model instead of the card (FpgaSimulator.h)
+#else
+FpgaCard fpgaRegs;                          // All register accesses of the current instrument
+#endif
+FpgaWait fpgaWait(fpgaRegs);                // Waits on the firmware status, with their durations
 
 // ### Constants ###
 // Register addresses
@@ -100,6 +123,7 @@ int main (int argc, char *argv[])
 
 #ifdef FPGA_IO_LOG
     ioLogFile = fopen("FpgaIo.log", "w");
+    fpgaRegs.SetLog(LogFpgaIo, ioLogFile);
 #endif
 
     FindDevices();          // ### Initialize the Analyzer(s) ###
@@ -114,6 +138,7 @@ int main (int argc, char *argv[])
     ReadSpectrum();         // ### Read the last acquired power spectrum ###
     Stop();                 // ### Stop the FPGA and the acquisition ###
 
+    fpgaWait.Print(stdout);  // ### How long each wait on the firmware took ###
     printf("Operation terminated: Wrote 1 power spectrum to disk\n");
     WaitForOperator();
 
@@ -213,6 +238,7 @@ void FindDevices(void)
         }
     }
     currentID = InstrumentID[0];                // Use the first instrument only
+    fpgaRegs.Attach(currentID);
 }
 
 
@@ -224,26 +250,19 @@ void InitFPGA()
     //       to the FPGA have started, because the DE-input clock is started/stopped
     //       with the acquisition.
 
-    // Set the DCM enable bits in the FPGA configuration register
+    // Set the DCM enable bits in the FPGA configuration register, start the DE interface
+    // in the FPGA and wait until the DE clock is ready (see AnalyzerSequences.h)
     printf("Initializing FPGA\n");
-    long fpgaCtrl = 0;
-    WriteFPGA(FPGACtrlReg, 1, &fpgaCtrl);       // First disable everything
-    fpgaCtrl |= 0x00ff0000;                     // Enable all DCMs
+    long fpgaCtrl = 0x00ff0000;                 // Enable all DCMs
 //  fpgaCtrl |= 0x00000100;                     // Enable readout in Big-Endian format (if needed)
-    WriteFPGA(FPGACtrlReg, 1, &fpgaCtrl);
-    Sleep(10);                                  // Wait some time
-
-    // Start the DE interface in the FPGA
-    long deCtrl = 0x00000000;
-    WriteFPGA(DECtrlReg, 1, &deCtrl);
-    deCtrl = 0x80000000;
-    WriteFPGA(DECtrlReg, 1, &deCtrl);
+    status = StartDEInterface(fpgaRegs, fpgaWait, fpgaCtrl);
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+        printf("Timeout while waiting for DE clock!\n");
 
     // Set number of power spectra to accumulate per pipeline.
     // Note that with both pipelines enabled, the actual number
     // of accumulations is twice the value set here.
     long nbrAcc = 30;
-    WriteFPGA(NbrAccReg, 1, &nbrAcc);
 
     // Configure the FFT core. We use the following settings:
     // readMode = 0 (read low 32 bits)
@@ -251,29 +270,9 @@ void InitFPGA()
     // bufClear = 0 (clear automatically)
     // shift = 0 (no bit shift)
     long fftConfig = 0x00000020;
-    WriteFPGA(FFTConfReg, 1, &fftConfig);
-
-    // Wait until the DE clock is ready
-    bool ready = false;
-    long timeout = 100;             // With a 'Sleep' of 1 ms, should be a timeout of 100 ms
-
-    while ((!ready) && (timeout > 0))
-    {
-        --timeout;
-        
-        long fpgaStatus;
-        ReadFPGA(FPGAStatusReg, 1, &fpgaStatus);
-        ready = ((fpgaStatus & 0x00100000) != 0);
-        if (!ready) 
-            Sleep(1);
-    }
-
-    if (timeout <= 0)
-        printf("Timeout while waiting for DE clock!\n");
 
     // Start the FFT core in continous mode (trigger is ignored)
-    long mainCtrl = 0x00000001;
-    WriteFPGA(MainCtrlReg, 1, &mainCtrl);
+    status = StartFftCore(fpgaRegs, nbrAcc, fftConfig);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -284,10 +283,10 @@ void LoadFPGA(void)
 
     printf("Loading bit file \"%s\" into FPGA\n", fileName);
     // Clear the FPGA first
-    status = Acqrs_configLogicDevice(currentID, "Block1Dev1", NULL, 1);
+    status = fpgaRegs.ConfigLogicDevice(NULL, 1);
 
     // Load the FPGA (flag = 3 will allow a search for FPGAPATH in the 'AqDrv4.ini' file)
-    status = Acqrs_configLogicDevice(currentID, "Block1Dev1", fileName, 3);
+    status = fpgaRegs.ConfigLogicDevice(fileName, 3);
     // If there is a problem, report it
     if (status != VI_SUCCESS)
     {
@@ -311,15 +310,7 @@ void LoadFPGA(void)
 //////////////////////////////////////////////////////////////////////////////////////////
 long ReadFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    ViStatus status = Acqrs_logicDeviceIO(currentID, "Block1Dev1", regID, nbrValues, dataArrayP, 0, 0);
-
-#ifdef FPGA_IO_LOG
-    fprintf(ioLogFile, "Read  Reg #%3i (%ix):", regID, nbrValues);
-    for(int i=0; i<nbrValues; ++i) fprintf(ioLogFile, " %08x", dataArrayP[i]);
-    fprintf(ioLogFile, " => 0x%08x\n", status);
-#endif
-
-    return status;
+    return fpgaRegs.ReadBlock(regID, nbrValues, dataArrayP);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -330,13 +321,8 @@ void ReadSpectrum(void)
     printf("Reading spectrum data\n");
     long spectrum[NbrSpectralLines];
     
-    // Set up indirect addressing
-	long startAddr  = 0x0;
-	long bufAddress = SumOfSpectrum;
-	WriteFPGA(StartAddrReg, 1, &startAddr);
-	WriteFPGA(BufferIDReg,  1, &bufAddress);
-    // Read out the data
-	ReadFPGA(ReadAddrReg, NbrSpectralLines, spectrum);
+    // Read out the data through the indirect access port
+    fpgaRegs.ReadIndirect(SumOfSpectrum, 0, NbrSpectralLines, spectrum);
 
     // Write the data to a file
     FILE* file = fopen("Acqiris.data", "w");
@@ -358,27 +344,10 @@ void Stop(void)
 {
     printf("Stopping data processing\n");
     // Disable FFT core
-    long mainCtrl = 0x00000000;
-    WriteFPGA(MainCtrlReg, 1, &mainCtrl);
-
-    // Wait until the FFT core stops
-    // Acquisition and processing might continue after
-    // disabling the core until the last data block has
-    // been completely processed.
-    long timeout = 100;
-    bool done = false;
-    long mainStatus;
-
-    while (!done && timeout > 0)
-    {
-        --timeout;
-        ReadFPGA(MainStatusReg, 1, &mainStatus);
-        done = (mainStatus & 0x00010000) == 0;
-        if (!done)
-            Sleep(10);
-    }
-
-    if (timeout <= 0)
+    // and wait until it stops: acquisition and processing might continue after
+    // disabling the core until the last data block has been completely processed.
+    status = StopFftCore(fpgaRegs, fpgaWait);
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         printf("Timeout while waiting for end of processing!\n");
 
     //  ### Stop data conversion ###
@@ -401,35 +370,15 @@ void WaitForSpectrum()
 
     // Wait until the "buffer full" flag of the Main Status
     // register goes to 1
-    long timeout = 100;
-    bool ready = false;
-    long mainStatus = 0;
-
-    while (!ready && timeout > 0)
-    {
-        --timeout;
-        ReadFPGA(MainStatusReg, 1, &mainStatus);
-        ready = (mainStatus & 0x80000000L) != 0;
-        if (!ready)
-            Sleep(10);
-    }
-
-    if (timeout <= 0)
+    status = WaitForFftSpectrum(fpgaWait);
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         printf("Timeout while waiting for spectrum!\n");
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
 long WriteFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    ViStatus status = Acqrs_logicDeviceIO(currentID, "Block1Dev1", regID, nbrValues, dataArrayP, 1, 0);
-
-#ifdef FPGA_IO_LOG
-    fprintf(ioLogFile, "Write Reg #%3i (%ix):", regID, nbrValues);
-    for(int i=0; i<nbrValues; ++i) fprintf(ioLogFile, " %08x", dataArrayP[i]);
-    fprintf(ioLogFile, " => 0x%08x\n", status);
-#endif
-
-    return status;
+    return fpgaRegs.WriteBlock(regID, nbrValues, dataArrayP);
 }
 
 
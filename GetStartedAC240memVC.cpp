@@ -36,14 +36,31 @@
 #include "AcqirisImport.h"
 #include "AcqirisD1Import.h"
 
+#include "AnalyzerSequences.h"
+#include "FpgaCard.h"
+#include "FpgaSimulator.h"
+#include "FpgaWait.h"
+
 
 // ### Options ###
 // uncomment the following line to log fpga read / write access in a file called "FpgaIo.log"
 //#define FPGA_IO_LOG
+// uncomment the following line to run the register accesses against the firmware model of
+// "FpgaSimulator.h" instead of the card (the digitizer can be simulated by the driver)
+//#define FPGA_SIMULATOR
 
 
 #ifdef FPGA_IO_LOG
 FILE* ioLogFile = NULL;
+
+void LogFpgaIo(void* contextP, char const* function, ViInt32 regID, ViInt32 nbrValues, ViInt32 const* dataArrayP,
+               ViStatus status)
+{
+    FILE* file = (FILE*)contextP;
+    fprintf(file, "%s Reg #%3i (%ix):", strcmp(function, "WriteFPGA") == 0 ? "Write" : "Read ", regID, nbrValues);
+    for(int i=0; i<nbrValues; ++i) fprintf(file, " %08x", dataArrayP[i]);
+    fprintf(file, " => 0x%08x\n", status);
+}
 #endif
 
 
@@ -59,6 +76,12 @@ ViSession InstrumentID[maxNbrInstruments];  // Array of instrument handles
 ViSession currentID;                        // ID of currently used instrument
 long NumInstruments;                        // Number of instruments
 ViStatus status;        // Status returned by calls to AcqrsD1... API functions
+#ifdef FPGA_SIMULATOR
+FpgaSimulator fpgaRegs(FpgaSimMemory);      // Firmware model instead of the card (FpgaSimulator.h)
+#else
+FpgaCard fpgaRegs;                          // All register accesses of the current instrument
+#endif
+FpgaWait fpgaWait(fpgaRegs);                // Waits on the firmware status, with their durations
 
 
 
@@ -99,6 +122,7 @@ int main (int argc, char *argv[])
 
 #ifdef FPGA_IO_LOG
     ioLogFile = fopen("FpgaIo.log", "w");
+    fpgaRegs.SetLog(LogFpgaIo, ioLogFile);
 #endif
 
     FindDevices();          // ### Initialize the Analyzer(s) ###
@@ -118,6 +142,7 @@ int main (int argc, char *argv[])
     ReadMemoryBlock();      // ### Read a block of data from the memory ###
     Stop();                 // ### Stop the FPGA and the acquisition ###
 
+    fpgaWait.Print(stdout);  // ### How long each wait on the firmware took ###
     printf("Operation completed: Wrote 1 monitoring data block to disk\n");
     WaitForOperator();
 
@@ -206,6 +231,7 @@ void FindDevices(void)
         }
     }
     currentID = InstrumentID[0];                // Use the first instrument only
+    fpgaRegs.Attach(currentID);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -214,44 +240,16 @@ void InitFPGA()
     // ### Initialization of the FPGA ###
     printf("Initializing firmware\n");
    
-    // Set the DCM enable bits in the FPGA configuration register
-    long fpgaCtrl = 0;
-    WriteFPGA(FPGACtrlReg, 1, &fpgaCtrl);       // First disable everything
-    fpgaCtrl |= 0x00ff0000;                     // Enable all DCMs
+    // Set the DCM enable bits in the FPGA configuration register, start the DE interface
+    // in the FPGA and wait until the DE clock is ready (see AnalyzerSequences.h)
+    long fpgaCtrl = 0x00ff0000;                 // Enable all DCMs
 //  fpgaCtrl |= 0x00000100;                     // Enable readout in Big-Endian format (if needed)
-    WriteFPGA(FPGACtrlReg, 1, &fpgaCtrl);
-    Sleep(10);                                  // Wait some time
-
-
-    // Initialize the DE interface
-    long deCtrl = 0;
-    WriteFPGA(DECtrlReg, 1, &deCtrl);
-    deCtrl = 0x80000000;                    // Starts the DE interface in the FPGA
-    WriteFPGA(DECtrlReg, 1, &deCtrl);
-
-    // Wait until the DE clock is ready
-    bool ready = false;
-    long timeout = 100;             // With a 'Sleep' of 1 ms, should be a timeout of 100 ms
-
-    while ((!ready) && (timeout > 0))
-    {
-        timeout--;
-        
-        long fpgaStatus;
-        ReadFPGA(FPGAStatusReg, 1, &fpgaStatus);
-        ready = ((fpgaStatus & 0x00100000) != 0);
-        if (!ready) 
-            Sleep(1);
-    }
-
-    if (timeout <= 0)
+    status = StartDEInterface(fpgaRegs, fpgaWait, fpgaCtrl);
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         printf("Timeout while waiting for DE clock!\n");
 
     // Reset the dual port memory
-    long dpMemCtrl = 0x1;       // set the "reset" bit
-    WriteFPGA(SRAMCtrlReg, 1, &dpMemCtrl);
-    dpMemCtrl = 0x0;            // clear it again
-    WriteFPGA(SRAMCtrlReg, 1, &dpMemCtrl);
+    status = ResetDualPortMemory(fpgaRegs);
     printf("\n");
 }
 
@@ -264,10 +262,10 @@ void LoadFPGA(void)
     printf("loading firmware...\n", fileName);
 
     // Clear the FPGA first
-    status = Acqrs_configLogicDevice(currentID, "Block1Dev1", NULL, 1);
+    status = fpgaRegs.ConfigLogicDevice(NULL, 1);
     
     // Load the FPGA (flag = 3 will allow a search for FPGAPATH in the 'AqDrv4.ini' file)
-    status = Acqrs_configLogicDevice(currentID, "Block1Dev1", fileName, 3);
+    status = fpgaRegs.ConfigLogicDevice(fileName, 3);
     // If there is a problem, report it
     if (status != VI_SUCCESS)
     {
@@ -291,15 +289,7 @@ void LoadFPGA(void)
 //////////////////////////////////////////////////////////////////////////////////////////
 long ReadFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    ViStatus status = Acqrs_logicDeviceIO(currentID, "Block1Dev1", regID, nbrValues, dataArrayP, 0, 0);
-
-#ifdef FPGA_IO_LOG
-    fprintf(ioLogFile, "Read  Reg #%3i (%ix):", regID, nbrValues);
-    for(int i=0; i<nbrValues; ++i) fprintf(ioLogFile, " %08x", dataArrayP[i]);
-    fprintf(ioLogFile, " => 0x%08x\n", status);
-#endif
-
-    return status;
+    return fpgaRegs.ReadBlock(regID, nbrValues, dataArrayP);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -310,25 +300,12 @@ void ReadMemoryBlock(void)
     static const long nbrLongs = (nbrValues + 3)/4;
     long chan1Data[nbrLongs];
     long chan2Data[nbrLongs];
-    long startAddr  = 0;
-    long bufAddress = SRAMBufAddress;
 
     printf("Reading acquired data\n");
 
-    // Set port A for access by the program
-    long dpMemCtrl = 0x00000002L;
-    WriteFPGA(SRAMCtrlReg, 1, &dpMemCtrl);
-    
-    // Read channel 1 data
-    WriteFPGA(StartAddrReg, 1, &startAddr);
-    WriteFPGA(BufferIDReg, 1, &bufAddress);
-    ReadFPGA(ReadAddrReg, nbrLongs, chan1Data);
-
-    // Read channel 2 data
-    startAddr = 0x00080000L;        // start address for channel 2 (middle of DP memory)
-    WriteFPGA(StartAddrReg, 1, &startAddr);
-    WriteFPGA(BufferIDReg, 1, &bufAddress);
-    ReadFPGA(ReadAddrReg, nbrLongs, chan2Data);
+    // Set port A for access by the program, read channel 1 data, then channel 2 data
+    // (from the middle of DP memory)
+    status = ReadDualPortMemory(fpgaRegs, nbrLongs, chan1Data, chan2Data);
 
 
     // Print the waveform
@@ -367,15 +344,7 @@ void WaitForOperator(void)
 //////////////////////////////////////////////////////////////////////////////////////////
 long WriteFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    ViStatus status = Acqrs_logicDeviceIO(currentID, "Block1Dev1", regID, nbrValues, dataArrayP, 1, 0);
-
-#ifdef FPGA_IO_LOG
-    fprintf(ioLogFile, "Write Reg #%3i (%ix):", regID, nbrValues);
-    for(int i=0; i<nbrValues; ++i) fprintf(ioLogFile, " %08x", dataArrayP[i]);
-    fprintf(ioLogFile, " => 0x%08x\n", status);
-#endif
-
-    return status;
+    return fpgaRegs.WriteBlock(regID, nbrValues, dataArrayP);
 }
 
 
@@ -384,33 +353,12 @@ void WriteToMemory(void)
 {
     // ### Acquire some data and store it in the dual port memory ###
 
-    // Connect port A to FPGA Internal Bus port
-    long dpMemCtrl = 0x0;
-    WriteFPGA(SRAMCtrlReg, 1, &dpMemCtrl);
-    Sleep(10);
-    // Start storage into the dual port memory
-    long exampleCtrl = 0x3;     // start writing stream data to memory on next trigger
-                                // note that bit 0 will still read as 0 until the memory is full
-
-    WriteFPGA(MemExampleCtrlReg, 1, &exampleCtrl);
-
-
+    // Connect port A to FPGA Internal Bus port, start writing stream data to memory on
+    // next trigger and wait until the buffer is full (see AnalyzerSequences.h)
     printf("Streaming data to memory...\n");
+    status = FillDualPortMemory(fpgaRegs, fpgaWait);
 
-    // Wait until the buffer is full
-    bool memFull = false;
-    long timeout = 200;    // with a sleep of 10 ms this should be a timeout of ~10 s
-
-    while(!memFull && timeout > 0) {
-        --timeout;
-        ReadFPGA(MemExampleCtrlReg, 1, &exampleCtrl);
-        memFull = (exampleCtrl & 0x01L) == 0x01;
-
-        if (!memFull)
-            Sleep(10);
-    }
-
-    if (timeout <= 0)
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         printf("Timeout on waiting for memory full!\n");
     else
         printf("Memory full\n");
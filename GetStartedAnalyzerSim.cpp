@@ -0,0 +1,243 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedAnalyzerSim.cpp
+//
+//  Runs the register sequences of the analyzer sample programs (AnalyzerSequences.h)
+//  against the firmware model of FpgaSimulator.h, without a card or a loaded bitfile:
+//  - monitor:  StartDEInterface + CaptureDeMonitor + monitor readout (GetStartedAnalyzersVC)
+//  - fft:      StartDEInterface + StartFftCore + WaitForFftSpectrum + spectrum readout +
+//              StopFftCore (GetStartedAC240fftVC)
+//  - fftstream: ten spectra read back to back without overwrite (GetStartedAC240fftStreamVC)
+//  - memory:   StartDEInterface + ResetDualPortMemory + FillDualPortMemory +
+//              ReadDualPortMemory (GetStartedAC240memVC)
+//  - streamer: StartDEInterface + StartDataLinks + CaptureStreamMonitors
+//              (GetStartedSC240BaseStrmVC)
+//  - order:    the DE interface started before the DCMs, which must time out
+//  - missed:   a DE monitor capture that is complete before the wait for its interrupt
+//              starts, with the edge-triggered interrupt of the model: the interrupt is
+//              lost and the wait must still succeed from the status bit
+//  Each sequence is checked (no timeout, data in the buffers, no access the firmware
+//  would refuse) and timed: the latency of the sequence, the register transfers it
+//  needs, the time spent in them and the time spent waiting in FpgaWait (FpgaWait.h).
+//  The program returns the number of sequences that failed, so that it can run as a
+//  regression test.
+//
+//  Usage: GetStartedAnalyzerSim [nbrRuns [transferMicroseconds]]
+//
+//  'transferMicroseconds' is the cost of one Acqrs_logicDeviceIO() call in the model
+//  (default 0). The firmware delays are the defaults of FpgaSimTiming.
+//
+//----------------------------------------------------------------------------------------
+//
+//  Copyright Agilent Technologies Inc. 2000, 200-2009
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#include <AcqirisImport.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "AnalyzerSequences.h"
+#include "FpgaSimulator.h"
+#include "FpgaWait.h"
+
+
+// Buffers of the firmwares read by the runner (see the sample programs)
+static const ViInt32 TxMonitorID        = 0x10;
+static const ViInt32 RxMonitorID        = 0x20;
+static const ViInt32 TxMonCtrlReg       =   66;
+static const ViInt32 RxMonCtrlReg       =   67;
+static const ViInt32 NbrSpectralLines   = 16*1024;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+static bool NotEmpty(std::vector<ViInt32> const& data)
+{
+    for (size_t n = 0; n < data.size(); ++n)
+        if (data[n] != 0)
+            return true;
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+static bool RunMonitor(FpgaSimulator& regs, FpgaWait& wait)
+{
+    regs.ConfigLogicDevice("AC2x0.bit", 3);
+    regs.Shadow(AnalyzerMainCtrlReg);
+    if (StartDEInterface(regs, wait) != VI_SUCCESS || CaptureDeMonitor(regs, wait) != VI_SUCCESS)
+        return false;
+
+    std::vector<ViInt32> monitor(250);
+    return regs.ReadIndirect(AnalyzerDeMonitorID, 0, ViInt32(monitor.size()), &monitor[0]) == VI_SUCCESS
+        && NotEmpty(monitor);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+static bool RunFft(FpgaSimulator& regs, FpgaWait& wait)
+{
+    regs.ConfigLogicDevice("AC240FFT2GSs.bit", 3);
+    if (StartDEInterface(regs, wait) != VI_SUCCESS || StartFftCore(regs, 30, 0x00000020) != VI_SUCCESS)
+        return false;
+
+    // Wait for 'buffer full', read the spectrum
+    if (WaitForFftSpectrum(wait) != VI_SUCCESS)
+        return false;
+    std::vector<ViInt32> spectrum(NbrSpectralLines);
+    if (regs.ReadIndirect(AnalyzerSpectrumID, 0, NbrSpectralLines, &spectrum[0]) != VI_SUCCESS)
+        return false;
+    size_t peak = 0;
+    for (size_t n = 1; n < spectrum.size(); ++n)
+        if (spectrum[n] > spectrum[peak])
+            peak = n;
+
+    return StopFftCore(regs, wait) == VI_SUCCESS && peak == 1001;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+static bool RunFftStream(FpgaSimulator& regs, FpgaWait& wait)
+{
+    regs.ConfigLogicDevice("AC240FFT2GSs.bit", 3);
+    // No overwrite: the core waits for each read
+    if (StartDEInterface(regs, wait) != VI_SUCCESS || StartFftCore(regs, 30, 0x00000000) != VI_SUCCESS)
+        return false;
+
+    // Every spectrum is new (the noise changes) and has the line
+    std::vector<ViInt32> spectrum(NbrSpectralLines), previous;
+    for (int n = 0; n < 10; ++n)
+    {
+        if (WaitForFftSpectrum(wait) != VI_SUCCESS)
+            return false;
+        if (regs.ReadIndirect(AnalyzerSpectrumID, 0, NbrSpectralLines, &spectrum[0]) != VI_SUCCESS)
+            return false;
+        if (spectrum[1001] <= spectrum[1000] || spectrum == previous)
+            return false;
+        previous = spectrum;
+    }
+
+    return StopFftCore(regs, wait) == VI_SUCCESS && regs.SpectraOverwritten() == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+static bool RunMemory(FpgaSimulator& regs, FpgaWait& wait)
+{
+    regs.ConfigLogicDevice("AC240MemExample.bit", 3);
+    if (StartDEInterface(regs, wait) != VI_SUCCESS || ResetDualPortMemory(regs) != VI_SUCCESS
+        || FillDualPortMemory(regs, wait) != VI_SUCCESS)
+        return false;
+
+    // Read both channels
+    static const ViInt32 nbrLongs = 16384 / 4;
+    std::vector<ViInt32> chan1(nbrLongs), chan2(nbrLongs);
+    return ReadDualPortMemory(regs, nbrLongs, &chan1[0], &chan2[0]) == VI_SUCCESS
+        && NotEmpty(chan1) && NotEmpty(chan2);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+static bool RunStreamer(FpgaSimulator& regs, FpgaWait& wait)
+{
+    regs.ConfigLogicDevice("SC240str1.bit", 3);
+    regs.Shadow(AnalyzerMainCtrlReg);
+    if (StartDEInterface(regs, wait) != VI_SUCCESS)
+        return false;
+
+    // Enable Tx and Rx of links 0 and 1, wait for the link layers
+    ViInt32 const slcCtrl[2] = { 0x023f0003, 0x033f0003 };
+    if (StartDataLinks(regs, wait, slcCtrl, 2, 0x5c, 10.0) != VI_SUCCESS)
+        return false;
+
+    // Capture into the Tx and Rx monitors
+    ViInt32 const monitors[2] = { TxMonCtrlReg, RxMonCtrlReg };
+    bool const ready = CaptureStreamMonitors(regs, wait, "Tx and Rx monitors", 0x00006000, monitors, 2, 1.0)
+        == VI_SUCCESS;
+    regs.Modify(AnalyzerMainCtrlReg, 0x00006000, 0);
+
+    std::vector<ViInt32> txData(512), rxData(512);
+    return ready
+        && regs.ReadIndirect(TxMonitorID, 0, 512, &txData[0]) == VI_SUCCESS
+        && regs.ReadIndirect(RxMonitorID, 0, 512, &rxData[0]) == VI_SUCCESS
+        && NotEmpty(txData) && txData == rxData;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// A wrong order must be caught: it succeeds when the wait for the DE clock times out
+static bool RunOrder(FpgaSimulator& regs, FpgaWait& wait)
+{
+    regs.ConfigLogicDevice("AC2x0.bit", 3);
+    regs.Write(AnalyzerDECtrlReg, 0);
+    regs.Write(AnalyzerDECtrlReg, 0x80000000);      // Start the DE interface
+    regs.Write(AnalyzerFPGACtrlReg, 0x00ff0000);    // and only then the DCMs
+    return wait.Until("DE clock", AnalyzerFPGAStatusReg, 0x00100000, 0x00100000, 0.1)
+        == ViStatus(ACQIRIS_ERROR_TIMEOUT);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// The capture is over before the wait: no interrupt comes, the status bit is set
+static bool RunMissedInterrupt(FpgaSimulator& regs, FpgaWait& wait)
+{
+    regs.ConfigLogicDevice("AC2x0.bit", 3);
+    regs.Shadow(AnalyzerMainCtrlReg);
+    regs.SetEdgeInterrupt(true);
+    if (StartDEInterface(regs, wait) != VI_SUCCESS)
+        return false;
+
+    regs.Modify(AnalyzerMainCtrlReg, 0x00001000, 0);
+    regs.Modify(AnalyzerMainCtrlReg, 0, 0x00001000);
+    std::this_thread::sleep_for(std::chrono::duration<double>(5 * regs.Timing().captureSeconds));
+    return wait.UntilInterrupt("DE monitor capture", AnalyzerDeMonCtrlReg, 0x80000000, 0x80000000, 0.02)
+        == VI_SUCCESS && !wait.Records().back().interrupt;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+    long const nbrRuns = (argc > 1) ? atol(argv[1]) : 5;
+    FpgaSimTiming timing;
+    timing.transferSeconds = (argc > 2) ? atof(argv[2]) * 1e-6 : 0.0;
+
+    struct Sequence { char const* name; bool (*run)(FpgaSimulator&, FpgaWait&); };
+    Sequence const sequences[] = {
+        { "monitor", RunMonitor }, { "fft", RunFft }, { "fftstream", RunFftStream },
+        { "memory", RunMemory }, { "streamer", RunStreamer }, { "order", RunOrder },
+        { "missed", RunMissedInterrupt } };
+    int const nbrSequences = sizeof(sequences) / sizeof(sequences[0]);
+
+    printf("%d runs, %.1f us per transfer\n", int(nbrRuns), timing.transferSeconds * 1e6);
+    printf("%-10s %10s %10s %12s %12s %12s  %s\n",
+        "sequence", "mean ms", "max ms", "transfers", "in driver ms", "waiting ms", "result");
+
+    int nbrFailed = 0;
+    for (int s = 0; s < nbrSequences; ++s)
+    {
+        double sumSeconds = 0.0, maxSeconds = 0.0, driverSeconds = 0.0, waitSeconds = 0.0, nbrTransfers = 0.0;
+        bool ok = true;
+        std::string problem;
+        for (long run = 0; run < nbrRuns; ++run)
+        {
+            FpgaSimulator regs(FpgaSimNone, timing);
+            FpgaWait wait(regs);
+
+            std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+            bool const passed = sequences[s].run(regs, wait);
+            double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            sumSeconds += seconds;
+            maxSeconds = (seconds > maxSeconds) ? seconds : maxSeconds;
+            driverSeconds += regs.Stats().seconds;
+            waitSeconds += wait.TotalSeconds();
+            nbrTransfers += double(regs.Stats().nbrTransfers);
+            if (!regs.Problems().empty() && problem.empty())
+                problem = regs.Problems()[0];
+            ok = ok && passed && regs.Problems().empty();
+        }
+
+        nbrFailed += ok ? 0 : 1;
+        printf("%-10s %10.3f %10.3f %12.1f %12.3f %12.3f  %s%s%s\n", sequences[s].name,
+            sumSeconds / nbrRuns * 1e3, maxSeconds * 1e3, nbrTransfers / nbrRuns, driverSeconds / nbrRuns * 1e3,
+            waitSeconds / nbrRuns * 1e3, ok ? "ok" : "FAILED", problem.empty() ? "" : ": ", problem.c_str());
+    }
+
+    return nbrFailed;
+}
@@ -26,9 +26,20 @@
  * of the Analyzer. If you want to use a custom bit file, you will have to edit the LoadFPGA()
  * function. The necessary code can be found between the "#ifdef MY_FPGA" and the "#endif"
  * compiler directives inside this function (it is skipped by the compiler by default).
+ *
+ * All register accesses go through FpgaRegisters (see FpgaRegisters.h). The Main Control
+ * register is shadowed on the host, so setting its bits needs no read, and a monitor
+ * block is read with a single ReadIndirect() call. With COMPARE_REGISTER_ACCESS defined,
+ * CompareRegisterAccess() times the register sequence of a capture and readout done the
+ * plain way and through the layer.
+ * Waits on status bits go through FpgaWait (see FpgaWait.h) instead of Sleep() loops, and
+ * the program prints how long each of them took. The register sequences themselves are
+ * in AnalyzerSequences.h, shared with GetStartedAnalyzerSim, which runs them against the
+ * firmware model.
  */
 
 
+#include <chrono>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -40,9 +51,20 @@
 #include "AcqirisImport.h"
 #include "AcqirisD1Import.h"
 
+#include "AnalyzerSequences.h"
+#include "FpgaCard.h"
+#include "FpgaSimulator.h"
+#include "FpgaWait.h"
+
 // ### Simulation flag ###
 bool simulation = false;
 // Set to true to simulate digitizers (useful for application development)
+// Define FPGA_SIMULATOR to also replace the firmware by the model of "FpgaSimulator.h"
+//#define FPGA_SIMULATOR
+// Define COMPARE_REGISTER_ACCESS to time 1000 capture and readout register sequences after the
+// monitor block, plain and through FpgaRegisters (the plain calls go to the card, also with
+// FPGA_SIMULATOR)
+//#define COMPARE_REGISTER_ACCESS
 
 // ### Global variables ###
 static const int maxNbrInstruments = 10;
@@ -50,6 +72,12 @@ ViSession InstrumentID[maxNbrInstruments];  // Array of instrument handles
 ViSession currentID;                        // ID of currently used instrument
 long NumInstruments;                        // Number of instruments
 ViStatus status;        // Status returned by calls to AcqrsD1... API functions
+#ifdef FPGA_SIMULATOR
+FpgaSimulator fpgaRegs(FpgaSimDefault);     // Firmware model instead of the card (FpgaSimulator.h)
+#else
+FpgaCard fpgaRegs;                          // All register accesses of the current instrument
+#endif
+FpgaWait fpgaWait(fpgaRegs);                // Waits on the firmware status, with their durations
 
 // ### Constants ###
 // The following register addresses correspond to the default FPGA-firmware
@@ -65,6 +93,9 @@ static const long DeMonitorAddress  = 0x0c;         // Identifier of data entry
 
 void Acquire(void);
 void CaptureMonitorBlock();
+#ifdef COMPARE_REGISTER_ACCESS
+void CompareRegisterAccess(void);
+#endif
 void Configure(void);
 void FindDevices(void);
 void InitFPGA(void);
@@ -91,8 +122,12 @@ int main (int argc, char *argv[])
     InitFPGA();             // ### Initialize the FPGA ###
     CaptureMonitorBlock();  // ### Capture a monitoring block in the FPGA ###
     ReadMonitorBlock();     // ### Read a block of data from the FPGA ###
+#ifdef COMPARE_REGISTER_ACCESS
+    CompareRegisterAccess(); // ### Time the register accesses of a monitor block ###
+#endif
     Stop();                 // ### Stop the FPGA and the acquisition ###
 
+    fpgaWait.Print(stdout);  // ### How long each wait on the firmware took ###
     printf("Operation terminated: Wrote 1 monitoring data block to disk\n");
     WaitForOperator();
 
@@ -118,31 +153,60 @@ void CaptureMonitorBlock()
 {
     // ### Capture data into the 'In' monitoring buffer ###
 
-    // Reset the 'capture' bit and write it at 1 again (at the end of this routine)
-    long monitorCtrl, mainCtrl;
-    ReadFPGA(MainCtrlReg, 1, &mainCtrl);
-    mainCtrl &= 0xffffefff;
-    WriteFPGA(MainCtrlReg, 1, &mainCtrl);
+    // Reset the 'capture' bit and write it at 1 again (the Main Control register is
+    // only read the first time, then it comes from the shadow), then wait until data has
+    // been captured in the DE monitor (see AnalyzerSequences.h)
+    status = CaptureDeMonitor(fpgaRegs, fpgaWait);
 
-    mainCtrl |= 0x00001000;                 // Enable capture into DE monitor
-    WriteFPGA(MainCtrlReg, 1, &mainCtrl);
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+        printf("WaitForEndOfCapture: Timeout on Capture\n");
+}
+
+#ifdef COMPARE_REGISTER_ACCESS
+//////////////////////////////////////////////////////////////////////////////////////////
+void CompareRegisterAccess(void)
+{
+    // ### Register accesses of a capture and readout, plain calls against FpgaRegisters ###
+    // Only the register sequence is timed: there is no wait for the capture to finish.
+    static const long nbrBlocks = 1000;
+    static const long nbrValues = 1000;
+    long monitorArray[nbrValues/4];
 
-    // Wait until data has been captured in the DE monitor
-    bool ready = false;
-    long timeout = 100;         // With a 'Sleep' of 1 ms, should be a timeout of 100 ms
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long n = 0; n < nbrBlocks; n++)
+    {
+        long mainCtrl, startAddr = 0, bufAddress = DeMonitorAddress;
+        Acqrs_logicDeviceIO(currentID, "Block1Dev1", MainCtrlReg, 1, &mainCtrl, 0, 0);
+        mainCtrl &= 0xffffefff;
+        Acqrs_logicDeviceIO(currentID, "Block1Dev1", MainCtrlReg, 1, &mainCtrl, 1, 0);
+        mainCtrl |= 0x00001000;
+        Acqrs_logicDeviceIO(currentID, "Block1Dev1", MainCtrlReg, 1, &mainCtrl, 1, 0);
+        Acqrs_logicDeviceIO(currentID, "Block1Dev1", StartAddrReg, 1, &startAddr, 1, 0);
+        Acqrs_logicDeviceIO(currentID, "Block1Dev1", BufferIDReg, 1, &bufAddress, 1, 0);
+        Acqrs_logicDeviceIO(currentID, "Block1Dev1", ReadAddrReg, nbrValues/4, monitorArray, 0, 0);
+    }
+    double const plainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    while ((!ready) && (timeout > 0))
+    // The plain calls bypassed the shadow
+    fpgaRegs.Invalidate();
+    fpgaRegs.ClearStats();
+    start = std::chrono::steady_clock::now();
+    for (long n = 0; n < nbrBlocks; n++)
     {
-        timeout--;
-        ReadFPGA(DeMonCtrl, 1, &monitorCtrl);
-        ready = ((monitorCtrl & 0x80000000) != 0);
-        if (!ready)
-            Sleep(1);
+        fpgaRegs.Begin();
+        fpgaRegs.Modify(MainCtrlReg, 0x00001000, 0);
+        fpgaRegs.Modify(MainCtrlReg, 0, 0x00001000);
+        fpgaRegs.ReadIndirect(DeMonitorAddress, 0, nbrValues/4, monitorArray);
+        fpgaRegs.Commit();
     }
+    double const layerSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    if (timeout <= 0)
-        printf("WaitForEndOfCapture: Timeout on Capture\n");
+    FpgaRegisterStats const& stats = fpgaRegs.Stats();
+    printf("Plain calls:   %.1f us per block, 6 transfers per block\n", plainSeconds / nbrBlocks * 1e6);
+    printf("FpgaRegisters: %.1f us per block, %.2f transfers per block (%.0f reads saved)\n",
+        layerSeconds / nbrBlocks * 1e6, double(stats.nbrTransfers) / nbrBlocks, double(stats.nbrReadsSaved));
 }
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////////////
 void Configure(void)
@@ -205,6 +269,9 @@ void FindDevices(void)
         }
     }
     currentID = InstrumentID[0];                // Use the first instrument only
+
+    fpgaRegs.Attach(currentID);
+    fpgaRegs.Shadow(MainCtrlReg);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -218,30 +285,13 @@ void InitFPGA()
     //       enabled AFTER the acquisition + transfer to the FPGA have started, because the DE-input clock
     //       is started/stopped with the acquisition.
 
-    // Set the DCM enable bits in the FPGA configuration register
-    long fpgaCtrl = 0;
-    WriteFPGA(FPGACtrlReg, 1, &fpgaCtrl);       // First disable everything
-    fpgaCtrl |= 0x00ff0000;                     // Enable bits for DCMA and DCMB
+    // Set the DCM enable bits in the FPGA configuration register, start the DE interface
+    // in the FPGA and wait until the DE clock is ready (see AnalyzerSequences.h)
+    long fpgaCtrl = 0x00ff0000;                 // Enable bits for DCMA and DCMB
 //  fpgaCtrl |= 0x00000100;                     // Enable readout in Big-Endian format (if needed)
-    WriteFPGA(FPGACtrlReg, 1, &fpgaCtrl);
-    Sleep(10);                                  // Wait some time
-    long deCtrl = 0x80000000;                   // Start the DE interface in the FPGA
-    WriteFPGA(DECtrlReg, 1, &deCtrl);
-
-    // Wait until the DE clock is ready
-    bool ready = false;
-    long timeout = 100;             // With a 'Sleep' of 1 ms, should be a timeout of 100 ms
-
-    while ((!ready) && (timeout > 0))
-    {
-        timeout--;
-        
-        long fpgaStatus;
-        ReadFPGA(FPGAStatusReg, 1, &fpgaStatus);
-        ready = ((fpgaStatus & 0x00100000) != 0);
-        if (!ready) 
-            Sleep(1);
-    }
+    status = StartDEInterface(fpgaRegs, fpgaWait, fpgaCtrl);
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+        printf("Timeout while waiting for DE clock!\n");
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -251,10 +301,10 @@ void LoadFPGA(void)
     char fileName[50] = "MyTestFile.bit";
 #ifdef MY_FPGA
     // Clear the FPGA first
-    status = Acqrs_configLogicDevice(currentID, "Block1Dev1", NULL, 1);
+    status = fpgaRegs.ConfigLogicDevice(NULL, 1);
 
     // Load the FPGA (flag = 3 will allow a search for FPGAPATH in the 'AqDrv4.ini' file)
-    status = Acqrs_configLogicDevice(currentID, "Block1Dev1", fileName, 3);
+    status = fpgaRegs.ConfigLogicDevice(fileName, 3);
     // If there is a problem, report it
     if (status != VI_SUCCESS)
     {
@@ -268,7 +318,7 @@ void LoadFPGA(void)
 //////////////////////////////////////////////////////////////////////////////////////////
 long ReadFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    return Acqrs_logicDeviceIO(currentID, "Block1Dev1", regID, nbrValues, dataArrayP, 0, 0);
+    return fpgaRegs.ReadBlock(regID, nbrValues, dataArrayP);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -276,12 +326,9 @@ void ReadMonitorBlock(void)
 {
     static const long nbrValues = 1000;
     long monitorArray[nbrValues];
-    long startAddr  = 0;
-    long bufAddress = DeMonitorAddress;
 
-    WriteFPGA(StartAddrReg, 1, &startAddr);
-    WriteFPGA(BufferIDReg, 1, &bufAddress);
-    ReadFPGA(ReadAddrReg, nbrValues/4, monitorArray);       // 'nbrValues/4' = number of 32-bit words
+    // 'nbrValues/4' = number of 32-bit words
+    fpgaRegs.ReadIndirect(DeMonitorAddress, 0, nbrValues/4, monitorArray);
 
     // Print the waveform
     char buffer[100];
@@ -314,7 +361,7 @@ void WaitForOperator(void)
 //////////////////////////////////////////////////////////////////////////////////////////
 long WriteFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    return Acqrs_logicDeviceIO(currentID, "Block1Dev1", regID, nbrValues, dataArrayP, 1, 0);
+    return fpgaRegs.WriteBlock(regID, nbrValues, dataArrayP);
 }
 
 
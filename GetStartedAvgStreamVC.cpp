@@ -0,0 +1,324 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedAvgStreamVC.cpp : C++ demo program for Agilent Acqiris Averagers
+//                              Continuous averaging with host-side 64-bit accumulation
+//----------------------------------------------------------------------------------------
+//  Copyright Agilent Technologies, Inc. 1999-2010
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The on-board averager sums 'NbrWaveforms' triggers per acquisition into 32-bit values.
+//  This program re-arms the averager immediately after each readout and adds every
+//  readout into 64-bit sums on the host, so the total depth is only limited by run time.
+//
+//  - The main thread waits for each block, reads it into a free readout buffer and
+//    restarts the acquisition before doing anything else.
+//  - An accumulator thread adds the readouts into the 64-bit sums and periodically
+//    writes the running average (in Volts) to "AcqirisAvg.data".
+//
+//  Usage: GetStartedAvgStreamVC [nbrBlocks [publishInterval]]
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+using std::cout; using std::endl;
+using std::ofstream;
+using std::vector;
+
+#include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
+#include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
+
+#include "AvgAccumulate.h"
+#include "SlotRing.h"
+
+// Macro for status code checking
+char ErrMsg[256];
+#define CHECK_API_CALL(f, s) { if (s)\
+{ Acqrs_errorMessage(VI_NULL, s, ErrMsg, 256); cout<<f<<": "<<ErrMsg<<endl; } }
+
+// One averaged readout
+struct AvgReadout
+{
+    vector<ViInt32> dataArray;
+    vector<AqSegmentDescriptorAvg> segDescArray;
+    AqDataDescriptor dataDesc;
+    bool valid;                         // false if the readout failed
+};
+
+// Running 64-bit sums, filled by the accumulator thread
+struct AvgSums
+{
+    vector<ViInt64> sums;
+    ViInt64 nbrWaveforms;
+    ViReal64 vGain;
+    ViReal64 vOffset;
+    long nbrBlocks;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void PublishAverage(AvgSums const& acc, ViInt32 nbrSamples, ViInt32 nbrSegments)
+{
+    vector<ViReal64> volts(acc.sums.size());
+    NormalizeInt64(&volts[0], &acc.sums[0], (long)volts.size(), acc.nbrWaveforms, acc.vGain, acc.vOffset);
+
+    ofstream outFile("AcqirisAvg.data");
+    outFile << "# Blocks: " << acc.nbrBlocks << "\n";
+    outFile << "# Waveforms: " << acc.nbrWaveforms << "\n";
+    outFile << "# Segments: " << nbrSegments << " of " << nbrSamples << " samples\n";
+    outFile << "# Voltage\n";
+    for (size_t i = 0; i < volts.size(); i++)
+        outFile << volts[i] << "\n";
+    outFile.close();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void AccumulateReadouts(SlotRing<AvgReadout>* ringP, AvgSums* accP, ViInt32 nbrSamples,
+                        ViInt32 nbrSegments, ViInt32 nbrWaveForms, long publishInterval)
+{
+    long const totalSamples = nbrSamples * nbrSegments;
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        AvgReadout const& readout = (*ringP)[idx];
+        AqDataDescriptor const& dataDesc = readout.dataDesc;
+
+        if (!readout.valid)
+        {
+            ringP->Release();
+            continue;
+        }
+
+        AccumulateInt32(&accP->sums[0], &readout.dataArray[dataDesc.indexFirstPoint], totalSamples);
+
+        // 'nbrAvgWforms' reports the depth actually used by the firmware
+        accP->nbrWaveforms += dataDesc.nbrAvgWforms > 0 ? dataDesc.nbrAvgWforms : nbrWaveForms;
+        accP->vGain = dataDesc.vGain;
+        accP->vOffset = dataDesc.vOffset;
+        ++accP->nbrBlocks;
+
+        ringP->Release();
+
+        if (accP->nbrBlocks % publishInterval == 0)
+        {
+            PublishAverage(*accP, nbrSamples, nbrSegments);
+            cout << "Published average of " << accP->nbrWaveforms << " waveforms" << endl;
+        }
+    }
+
+    PublishAverage(*accP, nbrSamples, nbrSegments);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    ViStatus status = VI_SUCCESS; // All API functions return a status code that needs to be checked
+
+    cout << "Agilent Acqiris - GetStartedAvgStreamVC" << endl;
+
+    long const nbrBlocks = (argc > 1) ? atol(argv[1]) : 1000;      // Averager readouts to accumulate
+    long const publishInterval = (argc > 2) ? atol(argv[2]) : 10;  // Readouts between file updates
+
+    if (nbrBlocks < 1 || publishInterval < 1)
+    {
+        cout << "Usage: GetStartedAvgStreamVC [nbrBlocks [publishInterval]]" << endl;
+        return -1;
+    }
+
+
+    // Search for instruments ////////////////////////////////////////////////////////////
+
+    ViInt32 numInstr; // Number of instruments
+
+    status = AcqrsD1_multiInstrAutoDefine("", &numInstr);
+    CHECK_API_CALL("AcqrsD1_multiInstrAutoDefine", status);
+
+    if (numInstr < 1)
+    {
+        cout << "No instrument found!" << endl;
+        return -1; // No instrument found
+    }
+    // Use the first digitizer
+    ViChar rscStr[16] = "PCI::INSTR0"; // Resource string
+    ViChar options[32] = ""; // No options necessary
+
+    cout << numInstr << " Agilent Acqiris Digitizer(s) found on your PC\n";
+
+
+    // Initialization of the instrument //////////////////////////////////////////////////
+
+    ViSession instrID = VI_NULL; // Instrument handle
+
+    status = Acqrs_InitWithOptions(rscStr, VI_FALSE, VI_FALSE, options, &instrID);
+    CHECK_API_CALL("Acqrs_InitWithOptions", status);
+
+
+    // Configuration of basic digitizer functionality ////////////////////////////////////
+
+	ViReal64 const sampInterval = 10.0e-9;  // 100 MHz sampling rate
+	ViReal64 const delayTime = 0.0;
+
+	ViInt32 const nbrSamples = 1024;
+	ViInt32 const nbrSegments = 1;
+
+	ViInt32 const usedChannel = 1;          // This example uses channel 1
+
+	ViInt32 const coupling = 3;             // DC coupling
+	ViInt32 const bandwidth = 0;            // No bandwidth limit
+	ViReal64 const fullScale = 0.5;         // 500 mV full scale
+	ViReal64 const offset = 0.0;            // No offset
+
+	ViInt32 const trigClass = 0;                        // Edge trigger
+	ViInt32 const sourcePattern = 1 << (usedChannel-1); // Trigger on channel 1
+	ViInt32 const trigCoupling = 0;                     // DC coupling
+	ViInt32 const trigSlope = 0;                        // Positive slope
+	ViReal64 const trigLevel = 10.0;	                // +10% of FSR (i.e. + 50 mV)
+
+	status = AcqrsD1_configHorizontal(instrID, sampInterval, delayTime);
+	CHECK_API_CALL("AcqrsD1_configHorizontal", status);
+
+	status = AcqrsD1_configMemory(instrID, nbrSamples, nbrSegments);
+	CHECK_API_CALL("AcqrsD1_configMemory", status);
+
+	status = AcqrsD1_configVertical(instrID, usedChannel, fullScale, offset, coupling, bandwidth);
+	CHECK_API_CALL("AcqrsD1_configVertical", status);
+
+	status = AcqrsD1_configTrigClass(instrID, trigClass, sourcePattern, 0x0, 0, 0.0, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigClass", status);
+
+	status = AcqrsD1_configTrigSource(instrID, usedChannel, trigCoupling, trigSlope, trigLevel, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigSource", status);
+
+
+    // Configuration of averager functionality ///////////////////////////////////////////
+
+	ViInt32 const mode = 2;                 // Averager mode
+	ViInt32 const nbrWaveForms = 100;       // On-board depth of each block
+	ViInt32 const ditherRange = 15;         // Enable dithering
+	ViInt32 const trigResync = 1;           // Resynchronize trigger
+	ViInt32 const startDelay = 0;
+	ViInt32 const stopDelay = 0;
+
+	status = AcqrsD1_configMode(instrID, mode, 0, 0);
+	CHECK_API_CALL("AcqrsD1_configMode", status);
+
+	status = AcqrsD1_configAvgConfigInt32(instrID, 0, "NbrSamples", nbrSamples);
+	CHECK_API_CALL("AcqrsD1_configAvgConfigInt32(NbrSamples)", status);
+
+	status = AcqrsD1_configAvgConfigInt32(instrID, 0, "NbrSegments", nbrSegments);
+	CHECK_API_CALL("AcqrsD1_configAvgConfigInt32(NbrSegments)", status);
+
+	status = AcqrsD1_configAvgConfigInt32(instrID, 0, "StartDelay", startDelay);
+	CHECK_API_CALL("AcqrsD1_configAvgConfigInt32(StartDelay)", status);
+
+	status = AcqrsD1_configAvgConfigInt32(instrID, 0, "StopDelay", stopDelay);
+	CHECK_API_CALL("AcqrsD1_configAvgConfigInt32(StopDelay)", status);
+
+	status = AcqrsD1_configAvgConfigInt32(instrID, 0, "NbrWaveforms", nbrWaveForms);
+	CHECK_API_CALL("AcqrsD1_configAvgConfigInt32(NbrWaveforms)", status);
+
+	status = AcqrsD1_configAvgConfigInt32(instrID, 0, "DitherRange", ditherRange);
+	CHECK_API_CALL("AcqrsD1_configAvgConfigInt32(DitherRange)", status);
+
+	status = AcqrsD1_configAvgConfigInt32(instrID, 0, "TrigResync", trigResync);
+	CHECK_API_CALL("AcqrsD1_configAvgConfigInt32(TrigResync)", status);
+
+
+    // Readout buffers ///////////////////////////////////////////////////////////////////
+
+    // Two buffers: one being accumulated while the next one is read
+	SlotRing<AvgReadout> ring(2);
+	for (long n = 0; n < ring.Size(); n++)
+	{
+	    ring[n].dataArray.resize(nbrSegments * (nbrSamples + 32));
+	    ring[n].segDescArray.resize(nbrSegments);
+	}
+
+	AqReadParameters readParams;
+	readParams.dataType = ReadInt32;
+	readParams.readMode = ReadModeAvgW;
+	readParams.firstSegment = 0;
+	readParams.nbrSegments = nbrSegments;
+	readParams.firstSampleInSeg = 0;
+	readParams.nbrSamplesInSeg = nbrSamples;
+	readParams.segmentOffset = nbrSamples;
+	readParams.dataArraySize = static_cast<ViInt32>(ring[0].dataArray.size() * sizeof(ViInt32));                           // in bytes
+	readParams.segDescArraySize = static_cast<ViInt32>(ring[0].segDescArray.size() * sizeof(AqSegmentDescriptorAvg));  // in bytes
+
+	readParams.flags = 0;
+	readParams.reserved = 0;
+	readParams.reserved2 = 0.0;
+	readParams.reserved3 = 0.0;
+
+	AvgSums acc;
+	acc.sums.assign(nbrSamples * nbrSegments, 0);
+	acc.nbrWaveforms = 0;
+	acc.vGain = 0.0;
+	acc.vOffset = 0.0;
+	acc.nbrBlocks = 0;
+
+	std::thread accumulator(AccumulateReadouts, &ring, &acc, nbrSamples, nbrSegments,
+	                        nbrWaveForms, publishInterval);
+
+
+    // Continuous acquisition ////////////////////////////////////////////////////////////
+
+	status = AcqrsD1_acquire(instrID);
+	CHECK_API_CALL("AcqrsD1_acquire", status);
+
+	long nbrRead = 0;
+	for (; nbrRead < nbrBlocks; nbrRead++)
+	{
+	    // Wait for the interrupt to signal the end of the acquisition
+	    status = AcqrsD1_waitForEndOfAcquisition(instrID, 10000);
+
+	    if (status != VI_SUCCESS)
+	    {
+	        // Note: 'AcqrsD1_forceTrig' (software trigger) is not supported for Averagers
+	        status = AcqrsD1_stopAcquisition(instrID);
+	        cout << "\nThe acquisition has been stopped - last block invalid!" << endl;
+	        break;
+	    }
+
+	    long const idx = ring.WaitFree();
+	    AvgReadout& readout = ring[idx];
+
+	    status = AcqrsD1_readData(instrID, usedChannel, &readParams, &readout.dataArray[0],
+	                              &readout.dataDesc, &readout.segDescArray[0]);
+	    CHECK_API_CALL("AcqrsD1_readData", status);
+
+	    // Re-arm right away; the accumulation runs while the next block is averaged
+	    if (nbrRead + 1 < nbrBlocks)
+	    {
+	        ViStatus const acqStatus = AcqrsD1_acquire(instrID);
+	        CHECK_API_CALL("AcqrsD1_acquire", acqStatus);
+	    }
+
+	    // The sums start at 'indexFirstPoint'; a descriptor that puts them past the buffer is not used
+	    size_t const firstPoint = size_t(readout.dataDesc.indexFirstPoint);
+	    readout.valid = (status >= VI_SUCCESS) && readout.dataDesc.indexFirstPoint >= 0
+	        && firstPoint + size_t(nbrSamples) * size_t(nbrSegments) <= readout.dataArray.size();
+	    if (status >= VI_SUCCESS && !readout.valid)
+	        cout << "Readout " << nbrRead << ": first point " << readout.dataDesc.indexFirstPoint
+	             << " outside the buffer, skipped" << endl;
+	    ring.Publish();
+	}
+
+	ring.Close();
+	accumulator.join();
+
+	cout << "Accumulated " << acc.nbrBlocks << " blocks, " << acc.nbrWaveforms << " waveforms" << endl;
+	cout << "Accumulator was busy on " << ring.Stalls() << " readouts" << endl;
+	cout << "Saved the running average to \"AcqirisAvg.data\"" << endl;
+
+    status = Acqrs_close(instrID);
+	CHECK_API_CALL("Acqrs_close", status);
+
+    status = Acqrs_closeAll();
+	CHECK_API_CALL("Acqrs_closeAll", status);
+
+    return 0;
+}
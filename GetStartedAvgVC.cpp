@@ -16,6 +16,8 @@ using std::vector;
 #include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
 #include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
 
+#include "AvgReadout.h"
+
 // Macro for status code checking
 char ErrMsg[256];
 #define CHECK_API_CALL(f, s) { if (s)\
@@ -181,46 +183,19 @@ int main (int argc, char *argv[])
 
 
     // Data Readout //////////////////////////////////////////////////////////////////////
-    
-	AqReadParameters		readParams;
-	AqDataDescriptor		dataDesc;
-	
-	vector<ViInt32> dataArray(nbrSegments * (nbrSamples + 32));
-	vector<AqSegmentDescriptorAvg> segDescArray(nbrSegments);
-
-	readParams.dataType = ReadInt32;
-	readParams.readMode = ReadModeAvgW;     
-	readParams.firstSegment = 0;
-	readParams.nbrSegments = nbrSegments;
-	readParams.firstSampleInSeg = 0;
-	readParams.nbrSamplesInSeg = nbrSamples;
-	readParams.segmentOffset = nbrSamples;
-	readParams.dataArraySize = static_cast<ViInt32>(dataArray.size() * sizeof(dataArray[0]));           // in bytes
-	readParams.segDescArraySize = static_cast<ViInt32>(segDescArray.size() * sizeof(segDescArray[0]));  // in bytes
-
-	readParams.flags = 0;
-	readParams.reserved = 0;
-	readParams.reserved2 = 0.0;
-	readParams.reserved3 = 0.0;
-
-	status = AcqrsD1_readData(instrID, usedChannel, &readParams, &dataArray[0], &dataDesc, &segDescArray[0]);
+
+    // All segments are read and converted to Volts (see AvgReadout.h)
+	AvgSegments avg;
+	status = ReadAvgSegments(instrID, usedChannel, avg);
 	CHECK_API_CALL("AcqrsD1_readData", status);
 
     // Save data to file /////////////////////////////////////////////////////////////////
 	if(status >= 0)
 	{
-	    ofstream outFileD("Acqiris.data");
-
-        size_t totalSamples = nbrSamples * nbrSegments;
-        if (totalSamples + dataDesc.indexFirstPoint > dataArray.size())
-            totalSamples = dataArray.size() - dataDesc.indexFirstPoint;
-        
-	    for (size_t i = 0; i < totalSamples; i++) 
-		    outFileD << dataArray[dataDesc.indexFirstPoint + i] << endl;
-		    
-	    outFileD.close();
-	    
-	    cout << "Saved one averaged trace to \"Acqiris.data\"" << endl;
+	    if (WriteAvgSegments("Acqiris.bin", avg))
+	        cout << "Saved " << avg.nbrSegments << " averaged trace(s) to \"Acqiris.bin\"" << endl;
+	    else
+	        cout << "Could not write \"Acqiris.bin\"" << endl;
 	}
     
     status = Acqrs_close(instrID);
@@ -0,0 +1,375 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedDigitalCFD.cpp : C++ demo program for Agilent Acqiris Digitizers
+//                             Constant-fraction pulse timing on raw waveforms
+//----------------------------------------------------------------------------------------
+//  Copyright Agilent Technologies, Inc. 1999-2010
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The digitizer acquires 'nbrSegments' triggers per acquisition in sequence mode. Each
+//  acquisition is read with 'ReadModeSeqW' as raw ADC codes and handed to a processing
+//  thread, which times every pulse with a digital constant-fraction discriminator on
+//  all cores (see DigitalCFD.h) while the next acquisition runs.
+//
+//  The hits are written as CfdHit records to "AcqirisCFD.bin": segment number counted
+//  from the start of the run, trigger timestamp in ps, and time from the trigger in s.
+//
+//  Usage: GetStartedDigitalCFD [nbrAcquisitions]
+//         GetStartedDigitalCFD -bench      (no instrument needed)
+//
+//  The benchmark times synthetic pulses with random amplitudes and sub-sample positions
+//  and reports the timing resolution (RMS of the error) and the processing rate.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+using std::cout; using std::endl;
+using std::vector;
+
+#include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
+#include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
+
+#include "DigitalCFD.h"
+#include "SlotRing.h"
+
+// Macro for status code checking
+char ErrMsg[256];
+#define CHECK_API_CALL(f, s) { if (s)\
+{ Acqrs_errorMessage(VI_NULL, s, ErrMsg, 256); cout<<f<<": "<<ErrMsg<<endl; } }
+
+// Raw ADC data type used for the readout: ViInt8 for 8-bit digitizers, ViInt16 for
+// digitizers with more than 8 bits
+typedef ViInt8 SampleType;
+
+// Configuration
+ViReal64 const sampInterval = 1.0e-9;   // 1 GS/s
+ViInt32 const nbrSamples = 1024;
+ViInt32 const nbrSegments = 100;        // Waveforms per acquisition
+ViInt32 const usedChannel = 1;
+
+// Constant-fraction discriminator
+ViInt32 const cfdDelay = 4;             // Samples, about the rise time of the pulses
+ViReal32 const cfdFraction = 0.3f;
+ViReal64 const cfdThresholdV = 0.02;    // Arming level in Volts above the base line
+ViInt32 const invertData = 1;           // Negative pulses
+
+// One sequence readout
+struct SeqReadout
+{
+    vector<SampleType> dataArray;
+    vector<AqSegmentDescriptor> segDescArray;
+    AqDataDescriptor dataDesc;
+    ViUInt32 acquisition;
+    bool valid;
+};
+
+// Totals of the processing thread
+struct CfdStats
+{
+    long nbrAcquisitions;
+    long nbrHits;
+    bool writeError;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+CfdConfig MakeConfig(ViReal64 vGain)
+{
+    CfdConfig cfg;
+    cfg.delay = cfdDelay;
+    cfg.fraction = cfdFraction;
+    cfg.threshold = ViReal32(cfdThresholdV / vGain);
+    cfg.baselineSamples = 32;
+    cfg.invertData = (invertData != 0);
+    cfg.interpolation = CfdCubic;
+    return cfg;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Processing thread: time the pulses of every readout and append them to 'file'
+void TimePulses(SlotRing<SeqReadout>* ringP, ViInt32 segmentStride, FILE* file, CfdStats* statsP)
+{
+    CfdEngine* engineP = NULL;
+    vector<CfdHit> hits;
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        SeqReadout const& readout = (*ringP)[idx];
+        if (readout.valid)
+        {
+            AqDataDescriptor const& dataDesc = readout.dataDesc;
+
+            // The arming threshold is converted with the first readout
+            if (engineP == NULL)
+                engineP = new CfdEngine(dataDesc.returnedSamplesPerSeg, (int)std::thread::hardware_concurrency(),
+                                        MakeConfig(dataDesc.vGain));
+
+            hits.clear();
+            engineP->Process(&readout.dataArray[dataDesc.indexFirstPoint], dataDesc.returnedSegments, segmentStride,
+                             &readout.segDescArray[0], dataDesc.sampTime, hits);
+
+            for (size_t n = 0; n < hits.size(); n++)
+                hits[n].segment += ViInt32(readout.acquisition * nbrSegments);
+            if (!hits.empty() && fwrite(&hits[0], sizeof(CfdHit), hits.size(), file) != hits.size())
+                statsP->writeError = true;
+
+            ++statsP->nbrAcquisitions;
+            statsP->nbrHits += long(hits.size());
+        }
+        ringP->Release();
+    }
+
+    delete engineP;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Pulse with a Gaussian rise (sigma 2 samples) and an exponential decay (8 samples),
+// peak at t = 0
+double SyntheticPulse(double t)
+{
+    return (t < 0.0) ? exp(-0.5 * t * t / 4.0) : exp(-t / 8.0);
+}
+
+template <class Sample>
+void BenchmarkType(char const* name, double fullRange, CfdInterpolation interpolation)
+{
+    // One pulse per segment, amplitude 15..100 % of half range, +-1 LSB of noise
+    vector<Sample> data(nbrSegments * nbrSamples);
+    vector<AqSegmentDescriptor> segDesc(nbrSegments);
+    vector<double> truth(nbrSegments);
+    ::memset(&segDesc[0], 0, segDesc.size() * sizeof(AqSegmentDescriptor));
+
+    unsigned int seed = 12345;
+    for (long seg = 0; seg < nbrSegments; seg++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        truth[seg] = 200.0 + (seed >> 8) % 100000 / 1000.0;
+        seed = seed * 1103515245u + 12345u;
+        double const amplitude = -fullRange / 2.0 * (0.15 + 0.85 * ((seed >> 8) % 1000) / 1000.0);
+
+        for (long i = 0; i < nbrSamples; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            double const noise = ((seed >> 8) % 2001) / 1000.0 - 1.0;
+            data[seg * nbrSamples + i] = Sample(floor(amplitude * SyntheticPulse(i - truth[seg]) + noise + 0.5));
+        }
+    }
+
+    CfdConfig cfg = MakeConfig(1.0);
+    cfg.threshold = ViReal32(0.1 * fullRange / 2.0);
+    cfg.interpolation = interpolation;
+
+    int const nbrThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    CfdEngine engine(nbrSamples, nbrThreads, cfg);
+    vector<CfdHit> hits;
+    long const nbrPasses = 20;
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (long pass = 0; pass < nbrPasses; pass++)
+    {
+        hits.clear();
+        engine.Process(&data[0], nbrSegments, nbrSamples, &segDesc[0], 1.0, hits);
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The constant-fraction point is at a fixed distance from the peak: the resolution
+    // is the spread of the error around its mean
+    double sum = 0.0, sum2 = 0.0;
+    for (size_t n = 0; n < hits.size(); n++)
+    {
+        double const error = hits[n].time - truth[hits[n].segment];
+        sum += error;
+        sum2 += error * error;
+    }
+    double const mean = hits.empty() ? 0.0 : sum / hits.size();
+    double const rms = hits.empty() ? 0.0 : sqrt(sum2 / hits.size() - mean * mean);
+
+    cout << name << (interpolation == CfdCubic ? " cubic " : " linear") << ": " << hits.size() << " hits in "
+         << nbrSegments << " pulses, resolution " << rms * sampInterval * 1.0e12 << " ps RMS at "
+         << 1.0e-9 / sampInterval << " GS/s, " << double(nbrPasses) * nbrSegments * nbrSamples / seconds / 1.0e6
+         << " MSamples/s on " << nbrThreads << " threads" << endl;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void Benchmark()
+{
+    BenchmarkType<ViInt8>("Int8 ", 256.0, CfdLinear);
+    BenchmarkType<ViInt8>("Int8 ", 256.0, CfdCubic);
+    BenchmarkType<ViInt16>("Int16", 65536.0, CfdLinear);
+    BenchmarkType<ViInt16>("Int16", 65536.0, CfdCubic);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    ViStatus status = VI_SUCCESS; // All API functions return a status code that needs to be checked
+
+    cout << "Agilent Acqiris - GetStartedDigitalCFD" << endl;
+
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+    {
+        Benchmark();
+        return 0;
+    }
+
+    long const nbrAcquisitions = (argc > 1) ? atol(argv[1]) : 100;
+    if (nbrAcquisitions < 1)
+    {
+        cout << "Usage: GetStartedDigitalCFD [nbrAcquisitions | -bench]" << endl;
+        return -1;
+    }
+
+
+    // Search for instruments ////////////////////////////////////////////////////////////
+
+    ViInt32 numInstr; // Number of instruments
+
+    status = AcqrsD1_multiInstrAutoDefine("", &numInstr);
+    CHECK_API_CALL("AcqrsD1_multiInstrAutoDefine", status);
+
+    if (numInstr < 1)
+    {
+        cout << "No instrument found!" << endl;
+        return -1; // No instrument found
+    }
+    ViChar rscStr[16] = "PCI::INSTR0"; // Resource string
+    ViChar options[32] = ""; // No options necessary
+
+
+    // Initialization of the instrument //////////////////////////////////////////////////
+
+    ViSession instrID = VI_NULL; // Instrument handle
+
+    status = Acqrs_InitWithOptions(rscStr, VI_FALSE, VI_FALSE, options, &instrID);
+    CHECK_API_CALL("Acqrs_InitWithOptions", status);
+
+
+    // Configuration of the digitizer ////////////////////////////////////////////////////
+
+	ViReal64 const delayTime = 0.0;
+	ViInt32 const coupling = 3;             // DC coupling, 50 Ohm
+	ViInt32 const bandwidth = 0;            // No bandwidth limit
+	ViReal64 const fullScale = 0.5;         // 500 mV full scale
+	ViReal64 const offset = 0.0;            // No offset
+
+	status = AcqrsD1_configHorizontal(instrID, sampInterval, delayTime);
+	CHECK_API_CALL("AcqrsD1_configHorizontal", status);
+
+	status = AcqrsD1_configMemory(instrID, nbrSamples, nbrSegments);
+	CHECK_API_CALL("AcqrsD1_configMemory", status);
+
+	status = AcqrsD1_configVertical(instrID, usedChannel, fullScale, offset, coupling, bandwidth);
+	CHECK_API_CALL("AcqrsD1_configVertical", status);
+
+	status = AcqrsD1_configTrigClass(instrID, 0, 1 << (usedChannel-1), 0x0, 0, 0.0, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigClass", status);
+
+	status = AcqrsD1_configTrigSource(instrID, usedChannel, 0, 0, 10.0, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigSource", status);
+
+
+    // Readout buffers ///////////////////////////////////////////////////////////////////
+
+    // The sequence readout needs some extra samples per segment
+	ViInt32 const segmentStride = nbrSamples + 32;
+
+	SlotRing<SeqReadout> ring(2);
+	for (long n = 0; n < ring.Size(); n++)
+	{
+	    ring[n].dataArray.resize(nbrSegments * segmentStride + 32);
+	    ring[n].segDescArray.resize(nbrSegments);
+	}
+
+	AqReadParameters readParams;
+	::memset(&readParams, 0, sizeof(readParams));
+	readParams.dataType = (sizeof(SampleType) == 1) ? ReadInt8 : ReadInt16;
+	readParams.readMode = ReadModeSeqW;
+	readParams.firstSegment = 0;
+	readParams.nbrSegments = nbrSegments;
+	readParams.firstSampleInSeg = 0;
+	readParams.nbrSamplesInSeg = nbrSamples;
+	readParams.segmentOffset = segmentStride;
+	readParams.dataArraySize = static_cast<ViInt32>(ring[0].dataArray.size() * sizeof(SampleType));
+	readParams.segDescArraySize = static_cast<ViInt32>(ring[0].segDescArray.size() * sizeof(AqSegmentDescriptor));
+
+
+    // Acquisition and pulse timing /////////////////////////////////////////////////////
+
+	FILE* file = fopen("AcqirisCFD.bin", "wb");
+	if (file == NULL)
+	{
+	    cout << "Cannot create \"AcqirisCFD.bin\"" << endl;
+	    return -1;
+	}
+
+	CfdStats stats;
+	::memset(&stats, 0, sizeof(stats));
+	std::thread timer(TimePulses, &ring, segmentStride, file, &stats);
+
+	status = AcqrsD1_acquire(instrID);
+	CHECK_API_CALL("AcqrsD1_acquire", status);
+
+	std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+	for (long acq = 0; acq < nbrAcquisitions; acq++)
+	{
+	    status = AcqrsD1_waitForEndOfAcquisition(instrID, 2000);
+	    if (status != VI_SUCCESS)
+	    {
+	        status = AcqrsD1_stopAcquisition(instrID);
+	        cout << "\nAcquisition timeout - stopped after " << acq << " acquisitions" << endl;
+	        break;
+	    }
+
+	    long const idx = ring.WaitFree();
+	    SeqReadout& readout = ring[idx];
+
+	    status = AcqrsD1_readData(instrID, usedChannel, &readParams, &readout.dataArray[0],
+	                              &readout.dataDesc, &readout.segDescArray[0]);
+	    CHECK_API_CALL("AcqrsD1_readData", status);
+
+	    // Start the next acquisition before the pulse timing of this one
+	    if (acq + 1 < nbrAcquisitions)
+	    {
+	        ViStatus const acqStatus = AcqrsD1_acquire(instrID);
+	        CHECK_API_CALL("AcqrsD1_acquire", acqStatus);
+	    }
+
+	    readout.acquisition = ViUInt32(acq);
+	    readout.valid = (status >= VI_SUCCESS);
+	    ring.Publish();
+	}
+
+	ring.Close();
+	timer.join();
+	fclose(file);
+
+	double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	status = AcqrsD1_stopAcquisition(instrID);
+	CHECK_API_CALL("AcqrsD1_stopAcquisition", status);
+
+	cout << "Timed " << stats.nbrHits << " pulses in " << stats.nbrAcquisitions << " acquisitions ("
+	     << stats.nbrAcquisitions * double(nbrSegments) * nbrSamples / seconds / 1.0e6 << " MSamples/s)" << endl;
+	cout << "Pulse timing was busy on " << ring.Stalls() << " readouts" << endl;
+	if (stats.writeError)
+	    cout << "Error writing \"AcqirisCFD.bin\"" << endl;
+	else
+	    cout << "Saved the hits to \"AcqirisCFD.bin\"" << endl;
+
+    status = Acqrs_close(instrID);
+	CHECK_API_CALL("Acqrs_close", status);
+
+    status = Acqrs_closeAll();
+	CHECK_API_CALL("Acqrs_closeAll", status);
+
+    return 0;
+}
@@ -22,16 +22,40 @@
 //  (The delays and fullscale parameters depends on your filter characteristics)
 //  5.- Adjust AP full scale, gates, and delay settings in GetStarted.cpp
 //
+//  Incremental mode
+//========================================================================================
+//  GetStartedHistoTDC nbrBlocks [checkpointBlocks]
+//
+//  Acquires 'nbrBlocks' blocks of 'blockWaveforms' acquisitions. Every block is read with
+//  clearing (the default readout) and added into 64-bit host bins (see TdcHistogram.h),
+//  so long runs neither saturate the on-board bins nor spend acquisitions on resets.
+//  Every 'checkpointBlocks' blocks the merged histogram is written to "AcqirisHisto.bin"
+//  and can be looked at while the run goes on.
+//
+//  Sparse storage
+//========================================================================================
+//  The histogram (the merged one in incremental mode) is saved to "AcqirisHisto.sph"
+//  with only its non-zero bins, one SparseHistogram per segment (see SparseHistogram.h).
+//
 //////////////////////////////////////////////////////////////////////////////////////////
 
 #include <AcqirisImport.h>
 #include <AcqirisD1Import.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "SparseHistogram.h"
+#include "TdcHistogram.h"
+
 
 int main(int argc, char *argv[])
 {
+	long const nbrBlocks = (argc > 1) ? atol(argv[1]) : 0;      // 0 = single histogram
+	long const checkpointBlocks = (argc > 2) ? atol(argv[2]) : 10;
+	if (nbrBlocks < 0 || checkpointBlocks < 1)
+		return fprintf(stderr, "Usage: GetStartedHistoTDC [nbrBlocks [checkpointBlocks >= 1]]\n"), 1;
+
 	ViSession idInstrument;
 	ViStatus status = Acqrs_InitWithOptions((ViRsrc)"PCI::INSTR0", VI_FALSE,
 			VI_FALSE, "CAL=0", &idInstrument);
@@ -86,8 +110,8 @@ int main(int argc, char *argv[])
 
 
     // Configure histogram parameters
-	typedef unsigned long ValueType;	// will set histoDepth to 1: 32 bits bins
-	//typedef unsigned short ValueType; // will set histoDepth to 0: 16 bits bins
+	typedef ViUInt32 ValueType;	        // will set histoDepth to 1: 32 bits bins
+	//typedef ViUInt16 ValueType;       // will set histoDepth to 0: 16 bits bins
 	ViInt32 histoMode = 1;        // 1 = simple histogram, 3 = histo with interpolation
 	ViInt32 histoIncrement = 2;   // 1 = increment by 1, 2 = increment by value
 	ViInt32 histoHorzRes = 4;     // n = 0-4: increase resolution by 2 ** n
@@ -110,14 +134,7 @@ int main(int argc, char *argv[])
     status = AcqrsD1_configAvgConfig(idInstrument, idChannel, "ValidDeltaPosPeakV", &validPeak);
 
 
-    // Perform first acquisition for void
-	status = AcqrsD1_acquire(idInstrument);
-	status = AcqrsD1_waitForEndOfAcquisition(idInstrument, 200);
-
-    if (status == (ViStatus)ACQIRIS_ERROR_ACQ_TIMEOUT)
-        fprintf(stderr, "Error: Acquisition timeout.\n");
-
-	// Readout histogram data once to zero all data
+	// Readout buffer
 	long const nbrBinsPerSeg = nbrSamples * (1 << histoHorzRes);
 	long const nbrReadSegs = (histoMode == 2) ? 1 : nbrSegments;
 	long const nbrReadBins = nbrBinsPerSeg * nbrReadSegs;
@@ -127,6 +144,7 @@ int main(int argc, char *argv[])
 
 	AqReadParameters readParam;
     AqDataDescriptor dataDesc;
+    ::memset(&readParam, 0, sizeof(readParam));
     ::memset(&dataDesc, 0, sizeof(dataDesc));
 	readParam.dataType = histoDepth == 0 ? ReadInt16 : ReadInt32;
 	readParam.readMode = ReadModeHistogram;
@@ -137,6 +155,95 @@ int main(int argc, char *argv[])
 	readParam.segmentOffset = 0;
 	readParam.dataArraySize = nbrBytesAlloc;
     readParam.segDescArraySize = 0;
+    readParam.flags = 0;          // clear the histogram after reading it
+
+	if (nbrBlocks > 0)
+	{
+		// Incremental mode: one readout (without acquisition) clears the stale histogram,
+		// after that every readout clears the block it returns
+		ViInt32 blockWaveforms = 10000;
+		status = AcqrsD1_configAvgConfig(idInstrument, 0, "NbrRoundRobins", &blockWaveforms);
+
+		status = AcqrsD1_readData(idInstrument, idChannel, &readParam, dataArray, &dataDesc, NULL);
+
+		TdcHistogram histogram(nbrReadSegs, nbrBinsPerSeg);
+		long nbrFailed = 0;
+
+		status = AcqrsD1_acquire(idInstrument);
+
+		for (long nBlock = 0 ; nBlock < nbrBlocks ; ++nBlock)
+		{
+			status = AcqrsD1_waitForEndOfAcquisition(idInstrument, 2000);
+			if (status == (ViStatus)ACQIRIS_ERROR_ACQ_TIMEOUT)
+			{
+				fprintf(stderr, "Error: Acquisition timeout after %ld blocks.\n", nBlock);
+				AcqrsD1_stopAcquisition(idInstrument);
+				break;
+			}
+
+			status = AcqrsD1_readData(idInstrument, idChannel, &readParam, dataArray, &dataDesc, NULL);
+
+			// The on-board histogram is clear again: start the next block before merging
+			if (nBlock + 1 < nbrBlocks)
+				AcqrsD1_acquire(idInstrument);
+
+			if (status < VI_SUCCESS)
+			{
+				fprintf(stderr, "Error: Read error %d (%08x).\n", (int)status, (int)status);
+				++nbrFailed;
+			}
+			else
+				histogram.Merge(dataArray, nbrBinsPerSeg, blockWaveforms);
+
+			if ((nBlock + 1) % checkpointBlocks == 0 || nBlock + 1 == nbrBlocks)
+			{
+				if (!histogram.Checkpoint("AcqirisHisto.bin"))
+					fprintf(stderr, "Error: cannot write AcqirisHisto.bin\n");
+
+				printf("# Block %ld: %llu acquisitions, %llu counts\n", nBlock + 1,
+					   (unsigned long long)histogram.NbrWaveforms(), (unsigned long long)histogram.TotalCounts());
+			}
+		}
+
+		if (nbrFailed != 0)
+			printf("# %ld blocks could not be read\n", nbrFailed);
+
+		// Final histogram in sparse form
+		FILE *file = fopen("AcqirisHisto.sph", "wb");
+		if (file != NULL)
+		{
+			SparseHistogram sparse;
+			for (long seg = 0 ; seg < histogram.NbrSegments() ; ++seg)
+			{
+				sparse.FromDense(histogram.Segment(seg), ViUInt32(histogram.NbrBinsPerSeg()));
+				sparse.Write(file);
+			}
+			fclose(file);
+		}
+
+		delete[] dataArray;
+		status = Acqrs_closeAll();
+
+		return 0;
+	}
+
+    // Perform first acquisition for void
+	status = AcqrsD1_acquire(idInstrument);
+	status = AcqrsD1_waitForEndOfAcquisition(idInstrument, 200);
+
+    if (status == (ViStatus)ACQIRIS_ERROR_ACQ_TIMEOUT)
+        fprintf(stderr, "Error: Acquisition timeout.\n");
+
+	// Readout histogram data once to zero all data
+	readParam.dataType = histoDepth == 0 ? ReadInt16 : ReadInt32;
+	readParam.readMode = ReadModeHistogram;
+	readParam.firstSegment = 0;
+	readParam.nbrSegments = nbrReadSegs;
+    readParam.firstSampleInSeg = 0;
+	readParam.nbrSamplesInSeg = nbrBinsPerSeg;
+	readParam.segmentOffset = 0;
+	readParam.dataArraySize = nbrBytesAlloc;
+    readParam.segDescArraySize = 0;
     readParam.flags = 0; //AqSkipClearHistogram;
 
 	status = AcqrsD1_readData(idInstrument, idChannel, &readParam, dataArray, &dataDesc, NULL);
@@ -176,21 +283,28 @@ int main(int argc, char *argv[])
     if (status < VI_SUCCESS)
         fprintf(stderr, "Error: Read error %d (%08x).\n", (int)status, (int)status);
 	else
-	{   // Printout the data
+	{   // Printout the data, only the non-zero bins are kept
 		printf("# Read %d bytes: %d segments of %d values\n", (int)dataDesc.actualDataSize,
 				(int)dataDesc.returnedSegments, (int)dataDesc.returnedSamplesPerSeg);
 
+		FILE *file = fopen("AcqirisHisto.sph", "wb");
+		SparseHistogram histogram;
+
 		for (int s = 0 ; s < dataDesc.returnedSegments ; ++s)
 		{
-			printf("# Segment %d\n", s);
-			ValueType *segmentArray = dataArray + (s * nbrBinsPerSeg);
+			histogram.FromDense(dataArray + (s * nbrBinsPerSeg), dataDesc.returnedSamplesPerSeg);
+			printf("# Segment %d: %ld non-zero bins, centroid %g\n", s, histogram.NbrNonZero(),
+				   histogram.Centroid());
 
-			for (int n = 0 ; n < dataDesc.returnedSamplesPerSeg ; ++n)
-				if (segmentArray[n] > 0)
-					printf("%d\t%lu\n", n, segmentArray[n]);
+			for (long n = 0 ; n < histogram.NbrNonZero() ; ++n)
+				printf("%lu\t%llu\n", (unsigned long)histogram.Bin(n), (unsigned long long)histogram.Count(n));
 
+			if (file != NULL && !histogram.Write(file))
+				fprintf(stderr, "Error: cannot write AcqirisHisto.sph\n");
 		}
 
+		if (file != NULL)
+			fclose(file);
 	}
 
 	delete[] dataArray;
@@ -10,80 +10,96 @@
 
 #include <AcqirisImport.h>
 #include <AcqirisD1Import.h>
+#include <chrono>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
-
-struct SegmentHeader
-{
-    unsigned long timeStampHi : 24;
-    unsigned long tag : 8;
-    unsigned long timeStampLo;
-};
-
-struct PeakData
-{
-    long amplitude : 20;
-    unsigned long unused : 4;
-    unsigned long tag : 8;
-    unsigned long position;
-};
-
-struct GateHeader
-{
-    unsigned long position : 24;
-    unsigned long tag : 8;
-    unsigned long length;
-};
+#include "PeakStream.h"
 
 
+// Decode a PeakTDC / SSR stream, then print it segment by segment
 void PrintoutData(char const *dataP, long length)
 {
-    char const * const dataEndP = dataP + length;
+    PeakBatch batch;
+    long errorOffset = 0;
 
-    while (dataP < dataEndP)
-    {
-        switch (dataP[3])
-        {
-        case 0x00:
-            {
-                GateHeader const *gateP = (GateHeader const *)dataP;
-                dataP += sizeof(GateHeader);
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    int const status = DecodePeakStream(dataP, length, batch, &errorOffset);
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-                printf("# Gate: pos %lu len %lu\n", gateP->position, gateP->length);
+    if (status != PeakStreamOk)
+        printf("# Invalid record (%d) at offset %ld\n", status, errorOffset);
 
-                dataP += gateP->length;
+    long nPeak = 0, nGate = 0;
+    for (long nSeg = -1; nSeg < batch.NbrSegments(); ++nSeg)
+    {
+        long const lastPeak = (nSeg + 1 < batch.NbrSegments()) ? batch.segFirstPeak[nSeg + 1] : batch.NbrPeaks();
+        long const lastGate = (nSeg + 1 < batch.NbrSegments()) ? batch.segFirstGate[nSeg + 1] : batch.NbrGates();
 
-            }
-            break;
+        if (nSeg >= 0)
+            printf("# Segment: %06lx:%08lx\n", (unsigned long)(batch.segTimeStamp[nSeg] >> 32),
+                   (unsigned long)(batch.segTimeStamp[nSeg] & 0xffffffff));
 
-        case 0x10:
-            {
-                PeakData const *peakP = (PeakData const *)dataP;
-                dataP += sizeof(PeakData);
+        for (; nGate < lastGate; ++nGate)
+            printf("# Gate: pos %lu len %lu\n", (unsigned long)batch.gatePosition[nGate],
+                   (unsigned long)batch.gateLength[nGate]);
 
-                printf("Peak: pos %lu ampl %d\n", peakP->position / 16, peakP->amplitude / 16);
+        for (; nPeak < lastPeak; ++nPeak)
+            printf("Peak: pos %lu ampl %d\n", (unsigned long)batch.peakPosition[nPeak] / 16,
+                   (int)batch.peakAmplitude[nPeak] / 16);
+    }
 
-            }
-            break;
+    if (seconds > 0.0)
+        printf("# Decoded %ld records in %g s (%g records/s)\n", batch.NbrRecords(), seconds,
+               batch.NbrRecords() / seconds);
+}
 
-        case 0x04:
-            {
-                SegmentHeader const *segP = (SegmentHeader const *)dataP;
-                dataP += sizeof(SegmentHeader);
 
-                printf("# Segment: %06lx:%08lx\n", segP->timeStampHi, segP->timeStampLo);
+// Decoder throughput on a synthetic stream of 'nbrSegments' segments with 'nbrPeaks'
+// peaks each
+void Benchmark(long nbrSegments, long nbrPeaks)
+{
+    std::vector<unsigned int> stream;
+    for (long nSeg = 0; nSeg < nbrSegments; ++nSeg)
+    {
+        stream.push_back(0x04000000 | (unsigned int)(nSeg >> 8));
+        stream.push_back((unsigned int)nSeg << 24);
+        for (long n = 0; n < nbrPeaks; ++n)
+        {
+            stream.push_back(0x10000000 | ((unsigned int)(n * 1234567) & 0xfffff));
+            stream.push_back((unsigned int)(n * 16 * 20 + (n & 15)));
+        }
+    }
 
-            }
-            break;
+    PeakBatch batch;
+    long const length = long(stream.size() * sizeof(unsigned int));
+    long const nbrPasses = 20;
+    long nbrRecords = 0;
 
-        }
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (long pass = 0; pass < nbrPasses; ++pass)
+    {
+        batch.Clear();
+        DecodePeakStream(&stream[0], length, batch);
+        nbrRecords += batch.NbrRecords();
     }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+    printf("# %ld segments x %ld peaks: %g records/s, %g MB/s\n", nbrSegments, nbrPeaks,
+           nbrRecords / seconds, nbrPasses * length / seconds / 1.0e6);
 }
 
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+    {
+        Benchmark(10000, 100);
+        Benchmark(100000, 10);
+        return 0;
+    }
+
 	ViSession idInstrument;
 	ViStatus status = Acqrs_InitWithOptions((ViRsrc)"PCI::INSTR0", VI_FALSE,
 			VI_FALSE, "CAL=0", &idInstrument);
@@ -0,0 +1,235 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedPeakTDCStream.cpp: Continuous PeakTDC acquisition on AP240 modules
+//
+//----------------------------------------------------------------------------------------
+//
+//  Copyright Agilent Technologies Inc., 2000, 2001-2009
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Every AcqrsD1_processData() call uses the switch flag, so the module processes the
+//  next acquisition in its other memory bank while the host reads the 'ReadModePeak'
+//  data of the previous one. The readouts go through a ring of buffers to a writer
+//  thread, which decodes them (see PeakStream.h) and appends the peaks of every
+//  acquisition to "AcqirisPeaks.bin".
+//
+//  When the writer still holds every buffer, the acquisition is not read and counted as
+//  dropped: the host did not keep up with the module.
+//
+//  Usage: GetStartedPeakTDCStream [nbrAcquisitions]
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#include <AcqirisImport.h>
+#include <AcqirisD1Import.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "PeakStream.h"
+#include "SlotRing.h"
+
+
+// One ReadModePeak readout
+struct PeakReadout
+{
+    std::vector<ViInt32> dataArray;
+    AqDataDescriptor dataDesc;
+    ViUInt32 acquisition;
+};
+
+// Totals of the writer thread
+struct WriterStats
+{
+    long nbrAcquisitions;
+    long nbrSegments;
+    long nbrPeaks;
+    long nbrInvalid;
+    bool writeError;
+};
+
+
+// Decode the readouts in acquisition order and append them to 'file'
+void WritePeaks(SlotRing<PeakReadout> *ringP, FILE *file, WriterStats *statsP)
+{
+    PeakBatch batch;
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        PeakReadout const &readout = (*ringP)[idx];
+
+        batch.Clear();
+        if (DecodePeakStream(&readout.dataArray[0], readout.dataDesc.actualDataSize, batch) != PeakStreamOk)
+            ++statsP->nbrInvalid;
+
+        // The batch does not point into the buffer (no gates), release it before writing
+        ViUInt32 const acquisition = readout.acquisition;
+        ringP->Release();
+
+        if (!WritePeakBatch(file, acquisition, batch))
+            statsP->writeError = true;
+
+        ++statsP->nbrAcquisitions;
+        statsP->nbrSegments += batch.NbrSegments();
+        statsP->nbrPeaks += batch.NbrPeaks();
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+	long const nbrAcquisitions = (argc > 1) ? atol(argv[1]) : 1000;
+	if (nbrAcquisitions < 1)
+		return fprintf(stderr, "Usage: GetStartedPeakTDCStream [nbrAcquisitions]\n"), 1;
+
+	ViSession idInstrument;
+	ViStatus status = Acqrs_InitWithOptions((ViRsrc)"PCI::INSTR0", VI_FALSE,
+			VI_FALSE, "CAL=0", &idInstrument);
+
+	if (status != VI_SUCCESS)
+		return fprintf(stderr, "ERROR: Instrument not found.\n"), 1;
+
+    status = Acqrs_calibrate(idInstrument);
+
+	// Configure instrument mode and timebase
+	ViInt32 modePeakTDC = 5;
+	status = AcqrsD1_configMode(idInstrument, modePeakTDC, 0, 0);
+
+    long const idChannel = 1;
+    status = AcqrsD1_configChannelCombination(idInstrument, 2, idChannel);
+
+    ViReal64 fullscale = 1.0;        // fullscale value in Volts
+    ViReal64 offset = 0.0;           // offset value in Volts
+    ViInt32 coupling = 3;            // coupling DC, 50 ohm
+    ViInt32 bandwidth = 0;           // no bandwidth limit
+    status = AcqrsD1_configVertical(idInstrument, idChannel, fullscale,
+                                    offset, coupling, bandwidth);
+
+	ViReal64 sampInterval = 0.5e-9;  // sampling interval in seconds
+	ViReal64 delayTime = 0.0;        // trigger delay time in seconds
+	status = AcqrsD1_configHorizontal(idInstrument, sampInterval, delayTime);
+
+	// Configure edge trigger on channel 1
+	ViInt32 trigClass = 0;
+	ViInt32 sourcePattern = 0x1;		// Trigger on Channel 1
+	status = AcqrsD1_configTrigClass(idInstrument, trigClass, sourcePattern, 0x0, 0, 0.0, 0.0);
+
+	// Configure the trigger conditions of channel 1 internal trigger
+	ViInt32 trigCoupling = 0;			// DC coupling
+	ViInt32 trigSlope = 0;				// Positive slope
+	ViReal64 trigLevel = 10.0;			// Trigger level = +10% of FSR (i.e. + 50 mV)
+	status = AcqrsD1_configTrigSource(idInstrument, 1, trigCoupling, trigSlope, trigLevel, 0.0);
+
+	// Configure analyzer parameters
+	ViInt32 nbrSamples = 2048;
+    ViInt32 nbrSegments = 16;
+    ViInt32 invertData = 1;
+	ViReal64 startPeak = 0.02;    // start hysteresis in Volts
+	ViReal64 validPeak = 0.02;    // valid hysteresis in Volts
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "NbrSamples", &nbrSamples);
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "NbrSegments", &nbrSegments);
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "InvertData", &invertData);
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "StartDeltaPosPeakV", &startPeak);
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "ValidDeltaPosPeakV", &validPeak);
+
+	// Readout buffers: one segment header per segment and at most one peak every
+	// second sample
+	long const nbrBytesAlloc = (8 + 8 * (nbrSamples / 2)) * nbrSegments;
+
+	SlotRing<PeakReadout> ring(4);
+	for (long n = 0 ; n < ring.Size() ; ++n)
+		ring[n].dataArray.resize(nbrBytesAlloc / sizeof(ViInt32));
+
+	AqReadParameters readParam;
+	::memset(&readParam, 0, sizeof(readParam));
+	readParam.dataType = ReadInt32;
+	readParam.readMode = ReadModePeak;
+	readParam.firstSegment = 0;
+	readParam.nbrSegments = nbrSegments;
+	readParam.firstSampleInSeg = 0;
+	readParam.nbrSamplesInSeg = 0;
+	readParam.segmentOffset = 0;
+	readParam.dataArraySize = nbrBytesAlloc;
+	readParam.segDescArraySize = 0;
+
+	FILE *file = fopen("AcqirisPeaks.bin", "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "ERROR: cannot create AcqirisPeaks.bin\n");
+		Acqrs_closeAll();
+		return 1;
+	}
+
+	WriterStats stats;
+	::memset(&stats, 0, sizeof(stats));
+	std::thread writer(WritePeaks, &ring, file, &stats);
+
+	// Acquisition loop
+	long nbrRead = 0, nbrDropped = 0, nbrErrors = 0;
+
+	std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    status = AcqrsD1_acquire(idInstrument);
+
+	for (long nAcq = 0 ; nAcq < nbrAcquisitions ; ++nAcq)
+	{
+	    // Switch banks: the module goes on with the next acquisition during the readout
+	    long const lastswitch = (nAcq == nbrAcquisitions - 1) ? 1 : 0;
+		status = AcqrsD1_processData(idInstrument, 1, 1 + lastswitch);
+		status = AcqrsD1_waitForEndOfProcessing(idInstrument, 2000);
+
+		if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+		{
+			status = AcqrsD1_stopAcquisition(idInstrument);
+			printf("# Timeout after %ld acquisitions\n", nAcq);
+			break;
+		}
+
+		long const idx = ring.TryFree();
+		if (idx < 0)
+		{
+			++nbrDropped;
+			continue;
+		}
+
+		PeakReadout &readout = ring[idx];
+		readout.acquisition = ViUInt32(nAcq);
+		::memset(&readout.dataDesc, 0, sizeof(readout.dataDesc));
+
+		status = AcqrsD1_readData(idInstrument, idChannel, &readParam, &readout.dataArray[0],
+		                          &readout.dataDesc, NULL);
+		if (status < VI_SUCCESS)
+		{
+			fprintf(stderr, "Error: readData: %d (%08x)\n", (int)status, (int)status);
+			++nbrErrors;
+			readout.dataDesc.actualDataSize = 0;
+		}
+
+		ring.Publish();
+		++nbrRead;
+	}
+
+	ring.Close();
+	writer.join();
+	fclose(file);
+
+	double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("# Read %ld acquisitions in %g s (%g acquisitions/s)\n", nbrRead, seconds, nbrRead / seconds);
+	printf("# Dropped %ld acquisitions the host could not keep up with, %ld readout errors\n",
+	       nbrDropped, nbrErrors);
+	printf("# Wrote %ld acquisitions, %ld segments, %ld peaks (%g peaks/s) to AcqirisPeaks.bin\n",
+	       stats.nbrAcquisitions, stats.nbrSegments, stats.nbrPeaks, stats.nbrPeaks / seconds);
+	if (stats.nbrInvalid != 0)
+		printf("# %ld readouts contained invalid records\n", stats.nbrInvalid);
+	if (stats.writeError)
+		fprintf(stderr, "Error: writing AcqirisPeaks.bin failed\n");
+
+    status = Acqrs_closeAll();
+
+	return 0;
+}
@@ -0,0 +1,332 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedSARStream.cpp : C++ demo program for Agilent Acqiris Digitizers
+//                            Continuous SAR mode acquisition without dead time
+//----------------------------------------------------------------------------------------
+//  Copyright (C) Agilent Technologies, Inc. 2007-2009
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  In SAR (Simultaneous Acquisition and Readout) mode the digitizer fills 'nbrBanks'
+//  memory banks in turn and goes on acquiring as long as one bank is free. The readout
+//  therefore only has to free every bank before the others are full.
+//
+//  The main thread only waits for a bank, copies it into a ring of buffers (see
+//  SlotRing.h) and frees it right away with AcqrsD1_freeBank(). When no trigger comes,
+//  a software trigger is forced, as in GetStartedSARmode. A writer thread converts the
+//  buffers to a binary file "AcqirisSAR.bin", one block per acquisition:
+//  - SarFileBlock (acquisition number, timestamp, vGain, vOffset)
+//  - nbrSamples ViInt8 raw ADC values (Volts = value * vGain - vOffset)
+//
+//  Dead time: the driver does not tell how many banks are full, so the program estimates
+//  it. A wait for a bank that returns within 'readyMicroseconds' is taken to have found
+//  the bank already filled; the number of such banks in a row is the estimated backlog
+//  of the digitizer. When it reaches nbrBanks - 1, every bank was probably full and
+//  triggers may have been missed. The program reports how often this happened; a slow
+//  wait for a full bank, or a fast one for a bank just filled, makes the estimate miss
+//  or add such cases. The writer also analyses the trigger timestamps (see
+//  TriggerTiming.h) and saves the summary to "AcqirisSARTiming.txt".
+//
+//  Usage: GetStartedSARStream [nbrAcquisitions]    (0: run until Ctrl-C)
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+using std::cout; using std::endl;
+using std::vector;
+
+#include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
+#include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
+
+#include "SlotRing.h"
+#include "TriggerTiming.h"
+
+// Macro for status code checking
+char ErrMsg[256];
+#define CHECK_API_CALL(f, s) { if (s)\
+{ Acqrs_errorMessage(VI_NULL, s, ErrMsg, 256); cout<<f<<": "<<ErrMsg<<endl; } }
+
+
+// Configuration
+ViInt32 const nbrBanks = 10;
+ViInt32 const nbrRingSlots = 64;        // host buffers between readout and writer
+long const readyMicroseconds = 20;      // a wait shorter than this is taken as a bank already full
+
+// One bank
+struct SarReadout
+{
+    vector<ViInt8> dataArray;
+    AqDataDescriptor dataDesc;
+    AqSegmentDescriptor segDesc;
+    ViUInt32 acquisition;
+};
+
+struct SarFileBlock
+{
+    char magic[4];                      // "SAR1"
+    ViUInt32 acquisition;
+    ViInt32 nbrSamples;
+    ViInt32 reserved;
+    ViUInt64 timeStamp;                 // in ps
+    ViReal64 vGain;
+    ViReal64 vOffset;
+};
+
+// Totals of the writer thread
+struct WriterStats
+{
+    long nbrAcquisitions;
+    TriggerTiming timing;
+    bool writeError;
+};
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void OnInterrupt(int)
+{
+    stopRequested = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Writer thread: append every bank to 'file'
+void WriteBanks(SlotRing<SarReadout>* ringP, FILE* file, WriterStats* statsP)
+{
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        SarReadout const& readout = (*ringP)[idx];
+        AqDataDescriptor const& dataDesc = readout.dataDesc;
+
+        SarFileBlock block;
+        ::memset(&block, 0, sizeof(block));
+        ::memcpy(block.magic, "SAR1", 4);
+        block.acquisition = readout.acquisition;
+        block.nbrSamples = dataDesc.returnedSamplesPerSeg;
+        block.timeStamp = ((ViUInt64)readout.segDesc.timeStampHi << 32) + readout.segDesc.timeStampLo;
+        block.vGain = dataDesc.vGain;
+        block.vOffset = dataDesc.vOffset;
+
+        if (fwrite(&block, sizeof(block), 1, file) != 1
+            || fwrite(&readout.dataArray[dataDesc.indexFirstPoint], 1, block.nbrSamples, file) != size_t(block.nbrSamples))
+            statsP->writeError = true;
+        ringP->Release();
+
+        if (block.nbrSamples > 0)
+            statsP->timing.Add(block.timeStamp);
+        ++statsP->nbrAcquisitions;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    ViStatus status; // All API functions return a status code that needs to be checked
+
+    cout << "Agilent Acqiris - GetStartedSARStream\n\n";
+
+    long const nbrAcquisitions = (argc > 1) ? atol(argv[1]) : 10000;
+    if (nbrAcquisitions < 0)
+    {
+        cout << "Usage: GetStartedSARStream [nbrAcquisitions]    (0: run until Ctrl-C)" << endl;
+        return -1;
+    }
+
+    // Search for instruments ////////////////////////////////////////////////////////////
+    ViInt32 numInstr; // Number of instruments
+
+    status = AcqrsD1_multiInstrAutoDefine("", &numInstr);
+    CHECK_API_CALL("AcqrsD1_multiInstrAutoDefine", status);
+
+    if (numInstr < 1)
+    {
+        cout << "No instrument found!" << endl;
+        return -1; // No instrument found
+    }
+    // Use the first digitizer
+    ViChar rscStr[16] = "PCI::INSTR0"; // Resource string
+    ViChar options[32] = ""; // No options necessary
+
+    cout << numInstr << " Agilent Acqiris Digitizer(s) found on your PC\n";
+
+    // Initialization of the instrument //////////////////////////////////////////////////
+    ViSession instrID; // Instrument handle
+
+    status = Acqrs_InitWithOptions(rscStr, VI_FALSE, VI_FALSE, options, &instrID);
+    CHECK_API_CALL("Acqrs_InitWithOptions", status);
+
+    // Configuration of the digitizer ////////////////////////////////////////////////////
+
+    // Configure timebase
+    ViReal64 sampInterval = 1.e-8, delayTime = 0.0;
+    status = AcqrsD1_configHorizontal(instrID, sampInterval, delayTime);
+    CHECK_API_CALL("AcqrsD1_configHorizontal", status);
+
+    // Enable SAR mode
+    status = AcqrsD1_configMode(instrID, 0, 0, 10); // 10 = SAR
+    CHECK_API_CALL("AcqrsD1_configMode (Does this device support SAR mode ?)", status);
+
+    ViInt32 nbrSamples = 1000, nbrSegments = 1;
+    status = AcqrsD1_configMemoryEx(instrID, 0, nbrSamples, nbrSegments, nbrBanks, 0);
+    CHECK_API_CALL("AcqrsD1_configMemoryEx", status);
+
+    // Configure vertical settings of channel 1
+    ViReal64 fullScale = 1.0, offset = 0.0;
+    ViInt32 coupling = 3, bandwidth = 0;
+    status = AcqrsD1_configVertical(instrID, 1, fullScale, offset, coupling, bandwidth);
+    CHECK_API_CALL("AcqrsD1_configVertical", status);
+
+    // Configure edge trigger on channel 1
+    status = AcqrsD1_configTrigClass(instrID, 0, 0x00000001, 0, 0, 0.0, 0.0);
+    CHECK_API_CALL("AcqrsD1_configTrigClass", status);
+
+    // Configure the trigger conditions of channel 1 (internal trigger)
+    ViInt32 trigCoupling = 0, slope = 0;
+    ViReal64 level = 20.0; // In % of vertical full scale when using internal trigger
+    status = AcqrsD1_configTrigSource(instrID, 1, trigCoupling, slope, level, 0.0);
+    CHECK_API_CALL("AcqrsD1_configTrigSource", status);
+
+    // Acquisition ///////////////////////////////////////////////////////////////////////
+
+    // Start the acquisition
+    status = AcqrsD1_acquire(instrID);
+    CHECK_API_CALL("AcqrsD1_acquire", status);
+
+    // Retrieval of the memory settings
+    status = AcqrsD1_getMemory(instrID, &nbrSamples, &nbrSegments);
+    CHECK_API_CALL("AcqrsD1_getMemory", status);
+
+    // Definition of the read parameters for raw ADC readout
+    AqReadParameters readPar;
+    ::memset(&readPar, 0, sizeof(readPar));
+    readPar.dataType = ReadInt8; // 8bit, raw ADC values data type
+    readPar.readMode = ReadModeStdW; // Single-segment read mode
+    readPar.firstSegment = 0;
+    readPar.nbrSegments = 1;
+    readPar.firstSampleInSeg = 0;
+    readPar.nbrSamplesInSeg = nbrSamples;
+    readPar.segmentOffset = 0;
+    readPar.dataArraySize = (nbrSamples + 32) * sizeof(ViInt8); // Array size in bytes
+    readPar.segDescArraySize = sizeof(AqSegmentDescriptor);
+
+    SlotRing<SarReadout> ring(nbrRingSlots);
+    for (long n = 0; n < ring.Size(); ++n)
+        ring[n].dataArray.resize(readPar.dataArraySize);
+
+    FILE* file = fopen("AcqirisSAR.bin", "wb");
+    if (file == NULL)
+    {
+        cout << "Cannot create \"AcqirisSAR.bin\"" << endl;
+        Acqrs_closeAll();
+        return -1;
+    }
+
+    WriterStats stats;
+    stats.nbrAcquisitions = 0;
+    stats.writeError = false;
+    std::thread writer(WriteBanks, &ring, file, &stats);
+
+    std::signal(SIGINT, OnInterrupt);
+
+    long nbrRead = 0, nbrForced = 0, nbrErrors = 0;
+    long backlog = 0, maxBacklog = 0, nbrAllFull = 0;
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+    for (ViUInt32 acq = 0; (nbrAcquisitions == 0 || long(acq) < nbrAcquisitions) && !stopRequested; acq++)
+    {
+        // Wait for the next bank with a timeout of 100ms
+        std::chrono::steady_clock::time_point const waitStart = std::chrono::steady_clock::now();
+        status = AcqrsD1_waitForEndOfAcquisition(instrID, 100);
+        long const waited = long(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - waitStart).count());
+
+        if (status != VI_SUCCESS)
+        {
+            // Acquisition did not complete successfully, force a software trigger.
+            status = AcqrsD1_forceTrig(instrID);
+            CHECK_API_CALL("AcqrsD1_forceTrigger", status);
+
+            status = AcqrsD1_waitForEndOfAcquisition(instrID, 100);
+            CHECK_API_CALL("AcqrsD1_waitForEndOfAcquisition", status);
+            ++nbrForced;
+            backlog = 0;
+        }
+        else if (waited < readyMicroseconds)
+        {
+            // The bank was already full: one more in the backlog of the digitizer
+            if (++backlog >= nbrBanks - 1)
+                ++nbrAllFull;
+            maxBacklog = std::max(maxBacklog, backlog);
+        }
+        else
+            backlog = 0;
+
+        // Copy the bank into the ring and free it at once
+        long const idx = ring.WaitFree();
+        SarReadout& readout = ring[idx];
+        readout.acquisition = acq;
+
+        status = AcqrsD1_readData(instrID, 1, &readPar, &readout.dataArray[0], &readout.dataDesc, &readout.segDesc);
+        CHECK_API_CALL("AcqrsD1_readData", status);
+
+        ViStatus const freeStatus = AcqrsD1_freeBank(instrID, 0);
+        CHECK_API_CALL("AcqrsD1_freeBank", freeStatus);
+
+        if (status != VI_SUCCESS)
+        {
+            // Nothing to write; the slot is handed over empty
+            ++nbrErrors;
+            readout.dataDesc.returnedSamplesPerSeg = 0;
+            readout.dataDesc.indexFirstPoint = 0;
+        }
+
+        ring.Publish();
+        ++nbrRead;
+    }
+
+    ring.Close();
+    writer.join();
+    fclose(file);
+
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    status = AcqrsD1_stopAcquisition(instrID);
+    CHECK_API_CALL("AcqrsD1_stopAcquisition", status);
+
+    // Results ///////////////////////////////////////////////////////////////////////////
+    cout << "Read " << nbrRead << " banks in " << seconds << " s (" << nbrRead / seconds << " banks/s), "
+         << nbrForced << " forced triggers, " << nbrErrors << " readout errors" << endl;
+    cout << "Estimated from the waits under " << readyMicroseconds << " us: largest backlog " << maxBacklog
+         << " of " << nbrBanks << " banks, all banks full " << nbrAllFull << " times" << endl;
+    cout << "The readout waited " << ring.Stalls() << " times for the writer (" << nbrRingSlots << " buffers)" << endl;
+
+    TriggerTiming const& timing = stats.timing;
+    cout << "Trigger rate " << timing.Rate() << " /s (last " << timing.WindowRate() << " /s), interval "
+         << timing.Mean() * 1.0e3 << " ms, jitter " << timing.Jitter() * 1.0e3 << " ms, largest "
+         << timing.Max() * 1.0e3 << " ms, " << timing.NbrGaps() << " anomalous gaps" << endl;
+    if (!timing.WriteSummary("AcqirisSARTiming.txt"))
+        cout << "Error writing \"AcqirisSARTiming.txt\"" << endl;
+
+    if (stats.writeError)
+        cout << "Error writing \"AcqirisSAR.bin\"" << endl;
+    else
+        cout << "Saved " << stats.nbrAcquisitions << " banks to \"AcqirisSAR.bin\"" << endl;
+
+    // Close the instrument
+    status = Acqrs_close(instrID);
+    CHECK_API_CALL("Acqrs_close", status);
+
+    // Free remaining resources
+    status = Acqrs_closeAll();
+    CHECK_API_CALL("Acqrs_closeAll", status);
+
+    return status;
+}
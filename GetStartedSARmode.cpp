@@ -13,6 +13,8 @@ using std::cout; using std::endl;
 #include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
 #include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
 
+#include "TriggerTiming.h"
+
 // Macro for status code checking
 char ErrMsg[256];
 #define CHECK_API_CALL(f, s) { if (s)\
@@ -120,6 +122,7 @@ int main (int argc, char *argv[])
     AqSegmentDescriptor segDesc;
     ViUInt64 timeStamp, previousStamp = 0;
     ViInt8 * adcArrayP = new ViInt8[readPar.dataArraySize];
+    TriggerTiming timing; // Statistics of the trigger intervals, see TriggerTiming.h
 
     for (ViInt32 acq = 1; acq <= nbrSARLoops; acq++) // For a 'true' SAR mode, this loop is supposed to be infinite.
     {
@@ -152,6 +155,7 @@ int main (int argc, char *argv[])
 	        cout << "Acq: " << acq << " - TimeStamp difference : " << diff << " ms." << endl;
 
         previousStamp = timeStamp;
+        timing.Add(timeStamp);
 
         // Write the waveform into a file
         std::string fileName;
@@ -174,6 +178,11 @@ int main (int argc, char *argv[])
 
     delete [] adcArrayP;
 
+    // Summary of the trigger timing next to the waveform files
+    cout << "Trigger rate: " << timing.Rate() << " /s, jitter: " << timing.Jitter() * 1.0e3 << " ms, "
+         << timing.NbrGaps() << " anomalous gaps" << endl;
+    timing.WriteSummary("AcqirisLoopTiming.txt");
+
     status = AcqrsD1_stopAcquisition(instrID);
     CHECK_API_CALL("AcqrsD1_stopAcquisition", status);
 
@@ -25,6 +25,10 @@
  * You will need to loop the Tx port of first optical data link (link 0) back to it's
  * Rx port for this example to work properly. Otherwise you will get a timeout on
  * capture and the contents of the Rx Monitor buffer will be undefined.
+ *
+ * All register accesses go through FpgaRegisters (see FpgaRegisters.h): the Main Control
+ * register is shadowed, so setting or clearing its bits needs no read, and a monitor
+ * buffer is read with a single ReadIndirect() call.
  */
 
 #include <fstream>
@@ -35,9 +39,17 @@ using std::cout; using std::endl;
 #include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
 #include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
 
+#include "AnalyzerSequences.h"
+#include "FpgaCard.h"
+#include "FpgaSimulator.h"
+#include "FpgaWait.h"
+
 // Uncomment the following line to log fpga read / write access in a file called "FpgaIo.log"
 //#define FPGA_IO_LOG
 
+// Uncomment the following line to replace the firmware by the model of "FpgaSimulator.h"
+//#define FPGA_SIMULATOR
+
 
 // Macro for status code checking
 char ErrMsg[256];
@@ -75,6 +87,13 @@ static const char dataFileName[] = "Acqiris.data";
 // Name of IO log file, only created if 'FPGA_IO_LOG' is defined.
 static const char fpgaIoLogFileName[] = "FpgaIo.log";
 
+#ifdef FPGA_SIMULATOR
+FpgaSimulator fpgaRegs(FpgaSimStreamer);    // Firmware model instead of the card (FpgaSimulator.h)
+#else
+FpgaCard fpgaRegs;                          // All register accesses of the instrument
+#endif
+FpgaWait fpgaWait(fpgaRegs);                // Waits on the firmware status, with their durations
+
 
 
 //! Start digitizing the signal and stream to digital data to the FPGA.
@@ -107,70 +126,45 @@ void OutputArray(std::ofstream &ioLogFile, char function[], long regID, long *da
 }
 
 
-//! Read the specified 'regID' from the FPGA.
-ViStatus ReadFPGA(ViSession instrID, std::ofstream &ioLogFile, long regID, long nbrValues, long* dataArrayP)
+//! Read the specified 'regID' from the FPGA (through 'fpgaRegs', logged by LogFpgaIo()).
+ViStatus ReadFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    ViStatus status;
-    
-    status = Acqrs_logicDeviceIO(instrID, "Block1Dev1", regID, nbrValues, dataArrayP, 0, 0);
-    CHECK_API_CALL("Acqrs_logicDeviceIO", status);   
+    return fpgaRegs.ReadBlock(regID, nbrValues, dataArrayP);
+}
 
-    OutputArray(ioLogFile, "ReadFPGA", regID, dataArrayP, nbrValues);
 
-    return status;
+//! Write into the specified 'regID' of the FPGA (through 'fpgaRegs', logged by LogFpgaIo()).
+ViStatus WriteFPGA(long regID, long nbrValues, long* dataArrayP)
+{
+    return fpgaRegs.WriteBlock(regID, nbrValues, dataArrayP);
 }
 
 
-//! Write into the specified 'regID' of the FPGA.
-ViStatus WriteFPGA(ViSession instrID, std::ofstream &ioLogFile, long regID, long nbrValues, long* dataArrayP)
+//! Check and log every register access of 'fpgaRegs' into the 'ioLogFile' given as 'contextP'.
+void LogFpgaIo(void* contextP, char const* function, ViInt32 regID, ViInt32 nbrValues, ViInt32 const* dataArrayP,
+               ViStatus status)
 {
-    ViStatus status;
-    
-    status = Acqrs_logicDeviceIO(instrID, "Block1Dev1", regID, nbrValues, dataArrayP, 1, 0);
     CHECK_API_CALL("Acqrs_logicDeviceIO", status);   
-
-    OutputArray(ioLogFile, "WriteFPGA", regID, dataArrayP, nbrValues);
-
-    return status;
+    OutputArray(*(std::ofstream*)contextP, (char*)function, regID, (long*)dataArrayP, nbrValues);
 }
 
 
 //! Capture data into the 'Tx' and 'Rx' monitoring buffers
-void CaptureMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
+void CaptureMonitorBlock(void)
 {
     cout << "Capturing monitor block...\n";
 
-    long bufCtrl = 0;
-    long mainCtrl = 0;
-    // Set the 'capture' bits in the main control register
-    ReadFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
-    mainCtrl |= 0x00006000L;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
-
-    // Wait for end of capture
-    bool ready = false;
-    long timeout = 100;
-
-    while (!ready && timeout > 0)
-    {
-        --timeout;
-
-        // Test the 'buffer ready' bit of the Monitor Control and Status registers
-        // For Tx...
-        ReadFPGA(instrID, ioLogFile, TxMonCtrlReg, 1, &bufCtrl);
-        ready = (bufCtrl & 0x80000000L) != 0;
-        // ... and Rx
-        ReadFPGA(instrID, ioLogFile, RxMonCtrlReg, 1, &bufCtrl);
-        ready = ready && (bufCtrl & 0x80000000L) != 0;
-
-        if (!ready) Sleep(10);
-    }
+    // Set the 'capture' bits in the main control register (shadowed, no read needed) and
+    // wait for end of capture: the 'buffer ready' bits of the Tx and Rx Monitor Control
+    // and Status registers (see AnalyzerSequences.h)
+    long const monitors[2] = { TxMonCtrlReg, RxMonCtrlReg };
+    ViStatus const status = CaptureStreamMonitors(fpgaRegs, fpgaWait, "Tx and Rx monitors", 0x00006000L,
+                                                  monitors, 2, 1.0);
 
     // Reset the capture bits to 0
-    mainCtrl &= ~0x00006000L;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+    fpgaRegs.Modify(MainCtrlReg, 0x00006000L, 0);
 
-    if (timeout <= 0)
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         cout << "WaitForEndOfCapture: Timeout on Capture\n";
 }
 
@@ -247,20 +241,20 @@ ViSession FindDevices(void)
 
 
 //! Initialization of the FPGA.
-void InitFPGA(ViSession instrID, std::ofstream &ioLogFile)
+void InitFPGA(ViSession instrID)
 {
     ViStatus status;
     cout << "Initializing FPGA\n";
 
     // Initialize and start the 1ns trigger manager AFTER acquisition has started
     long value = 4; // initialize the DCM
-    WriteFPGA(instrID, ioLogFile, TriggerCtrlReg, 1, &value);
+    WriteFPGA(TriggerCtrlReg, 1, &value);
     Sleep(10);      // Wait some time
     value = 8;      // Reset the timestamp counter
-    WriteFPGA(instrID, ioLogFile, TriggerCtrlReg, 1, &value);
+    WriteFPGA(TriggerCtrlReg, 1, &value);
     Sleep(10);      // Wait some time
     value = 1;      // Start the 1ns Trigger Manager
-    WriteFPGA(instrID, ioLogFile, TriggerCtrlReg, 1, &value);
+    WriteFPGA(TriggerCtrlReg, 1, &value);
 
     // Turn on the PLL reference clock for the Rocket IO
     status = Acqrs_setAttributeString(instrID, 0, "odlTxBitRate", "2.5G");
@@ -268,38 +262,16 @@ void InitFPGA(ViSession instrID, std::ofstream &ioLogFile)
 
     Sleep(10);      // Wait for PLL to stabilize
 
-    // Set the DCM enable bits in the FPGA configuration register
-    long fpgaCtrl = 0;
-    WriteFPGA(instrID, ioLogFile, FPGACtrlReg, 1, &fpgaCtrl);       // First disable everything
-    fpgaCtrl |= 0x00ff0000;                     // Enable all DCMs
-    WriteFPGA(instrID, ioLogFile, FPGACtrlReg, 1, &fpgaCtrl);
-    Sleep(10);                                  // Wait some time
-
-    // Start the DE interface
-    long deCtrl = 0x80000000;
-    WriteFPGA(instrID, ioLogFile, DECtrlReg, 1, &deCtrl);
-
-    // Wait until the DE clock is ready
-    bool ready = false;
-    long timeout = 100;             // With a 'Sleep' of 1 ms, should be a timeout of 100 ms
-
-    while ((!ready) && (timeout > 0))
-    {
-        timeout--;
-        
-        long fpgaStatus;
-        ReadFPGA(instrID, ioLogFile, FPGAStatusReg, 1, &fpgaStatus);
-        ready = ((fpgaStatus & 0x00100000) != 0);
-        if (!ready) 
-            Sleep(1);
-    }
+    // Set the DCM enable bits in the FPGA configuration register, start the DE interface
+    // and wait until the DE clock is ready (see AnalyzerSequences.h)
+    status = StartDEInterface(fpgaRegs, fpgaWait, 0x00ff0000);     // Enable all DCMs
 
-    if (timeout <= 0)
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         cout << "Timeout while waiting for DE clock!\n";
 
    // Clear the Main Control Register
    long mainCtrl = 0;
-   WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+   WriteFPGA(MainCtrlReg, 1, &mainCtrl);
 }
 
 
@@ -310,11 +282,11 @@ void LoadFPGA(ViSession instrID)
     cout << "Loading firmware '" << fpgaFileName << "'\n";
 
     // Clear the FPGA first
-    status = Acqrs_configLogicDevice(instrID, "Block1Dev1", NULL, 1);
+    status = fpgaRegs.ConfigLogicDevice(NULL, 1);
     CHECK_API_CALL("Acqrs_configLogicDevice", status);   
 
     // Load the FPGA (flag = 3 will allow a search for FPGAPATH in the 'AqDrv4.ini' file)
-    status = Acqrs_configLogicDevice(instrID, "Block1Dev1", fpgaFileName, 3);
+    status = fpgaRegs.ConfigLogicDevice(fpgaFileName, 3);
     CHECK_API_CALL("Acqrs_configLogicDevice", status);   
 
     if (status == VI_SUCCESS)
@@ -367,7 +339,7 @@ void WaitForOperatorTo(char const* text)
 
 
 //! Read out the monitor data.
-void ReadMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
+void ReadMonitorBlock(void)
 {
     cout << "Reading monitor data\n";
 
@@ -403,19 +375,9 @@ void ReadMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
     long txData[NbrLongs];  // Buffer for 'Tx Monitor' data
     long rxData[NbrLongs];  // Buffer for 'Rx Monitor' data
 
-    long startAddr  = 0;    // Read from beginning of monitor buffers
-
-    // read Tx Monitor data
-    long bufferID = TxMonitorID;
-    WriteFPGA(instrID, ioLogFile, StartAddrReg, 1, &startAddr);
-    WriteFPGA(instrID, ioLogFile, BufferIDReg,  1, &bufferID);
-    ReadFPGA(instrID, ioLogFile, ReadAddrReg, NbrLongs, txData);
-
-    // read Rx Monitor data
-    bufferID = RxMonitorID;
-    WriteFPGA(instrID, ioLogFile, StartAddrReg, 1, &startAddr);
-    WriteFPGA(instrID, ioLogFile, BufferIDReg,  1, &bufferID);
-    ReadFPGA(instrID, ioLogFile, ReadAddrReg, NbrLongs, rxData);
+    // read Tx and Rx Monitor data, from the beginning of the monitor buffers
+    fpgaRegs.ReadIndirect(TxMonitorID, 0, NbrLongs, txData);
+    fpgaRegs.ReadIndirect(RxMonitorID, 0, NbrLongs, rxData);
 
     // Write the data to a file
     std::ofstream outFile(dataFileName);
@@ -504,15 +466,11 @@ void ReadMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
 //! Initialization of the optical data links.
 /*! NOTE: The polarity of the links depends on the hardware option. For more info, see
     the section on programming the streamer firmware in the streamer user manual. */
-void StartLink(ViSession instrID, std::ofstream &ioLogFile)
+void StartLink(ViSession instrID)
 {
     ViStatus status;
 
-    long regAddr = 0;
     long slcCtrl = 0;
-    long slcStatus = 0;
-    long timeout = 1000;    // With a 'Sleep' of 10 ms, should be a timeout of 10 s
-    bool ready = false;
     long nbrLinks = 0;
     
     // Check if you have the '2 link' or the '12 link' option
@@ -537,43 +495,28 @@ void StartLink(ViSession instrID, std::ofstream &ioLogFile)
         slcCtrl = 0x033f0003L;
     }
 
-    WriteFPGA(instrID, ioLogFile, SLC0CtrlReg, 1, &slcCtrl);
+    // Test the "Tx physical layer ready" and "Tx link layer ready" bits for the transmitter
+    // Test the "Rx physical layer ready" and "Rx link layer ready" bits for the receiver
+    // Once ready, reset the link status flags (see AnalyzerSequences.h)
+    status = StartDataLinks(fpgaRegs, fpgaWait, &slcCtrl, 1, 0x0000005cL, 10.0);
 
-    do
-    {
-        --timeout;
-        // Check the data link status
-        ReadFPGA(instrID, ioLogFile, SLC0StatusReg, 1, &slcStatus);
-        // Test the "Tx physical layer ready" and "Tx link layer ready" bits for the transmitter
-        // Test the "Rx physical layer ready" and "Rx link layer ready" bits for the receiver
-        ready = (slcStatus & 0x0000005cL) == 0x0000005cL;
-
-        if (!ready) Sleep(10);
-    }
-    while (!ready && timeout > 0);
-
-    if (timeout <= 0)
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
     {
         cout << "Timeout while waiting for data links (Is Tx connected to Rx ?)\n";
     } else
     {
-        // Reset the link status flags
-        ReadFPGA(instrID, ioLogFile, SLC0CtrlReg, 1, &slcCtrl);
-        slcCtrl |= 0x80000000L;         // "Reset status flags" bit
-        WriteFPGA(instrID, ioLogFile, SLC0CtrlReg, 1, &slcCtrl);
-
         cout << "Data links ready!\n";
     }
 }
 
 
 //! Start the Streamer core
-void StartStream(ViSession instrID, std::ofstream &ioLogFile)
+void StartStream(void)
 {
     printf("Starting data streaming\n");
     // Configure the frame size
     long strmConf = NbrSamples / 16 - 1;
-    WriteFPGA(instrID, ioLogFile, StrmConfReg, 1, &strmConf);
+    WriteFPGA(StrmConfReg, 1, &strmConf);
 
     // Configure and start the Streamer
     // Transfer on = 1
@@ -581,25 +524,25 @@ void StartStream(ViSession instrID, std::ofstream &ioLogFile)
     long mainCtrl = 0x00008100L;
     // Set the number of accumulations
     mainCtrl |= (NbrAccum - 1) << 24;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+    WriteFPGA(MainCtrlReg, 1, &mainCtrl);
 }
 
 
 //! Stop the streaming firmware and data acquisition.
-void Stop(ViSession instrID, std::ofstream &ioLogFile)
+void Stop(ViSession instrID)
 {
     ViStatus status;
 
     cout << "Stopping\n";
     // Turn off the streamer
     long mainCtrl = 0;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+    WriteFPGA(MainCtrlReg, 1, &mainCtrl);
 
     // Turn off the data links
     long slcCtrl = 0xc0000000;            // Reset Rx Controller and status flags
-    WriteFPGA(instrID, ioLogFile, SLC0CtrlReg, 1, &slcCtrl);
+    WriteFPGA(SLC0CtrlReg, 1, &slcCtrl);
     slcCtrl = 0;                          // Turn everything off
-    WriteFPGA(instrID, ioLogFile, SLC0CtrlReg, 1, &slcCtrl);
+    WriteFPGA(SLC0CtrlReg, 1, &slcCtrl);
 
     // Turn off the link frequency PLL
     status = Acqrs_setAttributeString(instrID, 0, "odlTxBitRate", "None");
@@ -607,15 +550,15 @@ void Stop(ViSession instrID, std::ofstream &ioLogFile)
 
     // Turn off the 1 ns Trigger Manager
     long trigCtrl = 0;
-    WriteFPGA(instrID, ioLogFile, TriggerCtrlReg, 1, &trigCtrl);
+    WriteFPGA(TriggerCtrlReg, 1, &trigCtrl);
 
     // Stop the DE interface
     long deCtrl = 0x0;
-    WriteFPGA(instrID, ioLogFile, DECtrlReg, 1, &deCtrl);
+    WriteFPGA(DECtrlReg, 1, &deCtrl);
 
     // Stop the DCMs
     long fpgaCtrl = 0;
-    WriteFPGA(instrID, ioLogFile, FPGACtrlReg, 1, &fpgaCtrl);
+    WriteFPGA(FPGACtrlReg, 1, &fpgaCtrl);
 
     // Stop data conversion
     status = AcqrsD1_stopAcquisition(instrID);
@@ -644,17 +587,21 @@ int main (int argc, char *argv[])
     cout << "Agilent Acqiris Analyzer - Getting Started\n\n";
 
     ViSession instrID = FindDevices();          // Initialize the Analyzer(s)
+    fpgaRegs.Attach(instrID);
+    fpgaRegs.Shadow(MainCtrlReg);               // Only written by this program
+    fpgaRegs.SetLog(LogFpgaIo, &ioLogFile);
     WaitForOperatorTo("continue");
 
     LoadFPGA(instrID);             // Load the firmware into the FPGA
     Configure(instrID);            // Configure the digitizer
     Acquire(instrID);              // Start continuous acquisition + transfer to FPGA
-    InitFPGA(instrID, ioLogFile);             // Initialize the FPGA
-    StartLink(instrID, ioLogFile);            // Start the optical data link
-    StartStream(instrID, ioLogFile);          // Start the Streamer core
-    CaptureMonitorBlock(instrID, ioLogFile);  // Capture a monitoring block in the FPGA
-    ReadMonitorBlock(instrID, ioLogFile);     // Read a block of data from the FPGA
-    Stop(instrID, ioLogFile);                 // Stop the FPGA and the acquisition
+    InitFPGA(instrID);                        // Initialize the FPGA
+    StartLink(instrID);                       // Start the optical data link
+    StartStream();                            // Start the Streamer core
+    CaptureMonitorBlock();                    // Capture a monitoring block in the FPGA
+    ReadMonitorBlock();                       // Read a block of data from the FPGA
+    Stop(instrID);                            // Stop the FPGA and the acquisition
+    fpgaWait.Print(stdout);                     // How long each wait on the firmware took
 
     status = Acqrs_close(instrID);
     CHECK_API_CALL("Acqrs_close", status);
@@ -23,6 +23,10 @@
  * If you want to use the Rx Monitor buffer, uncomment the line "#define USE_RX_LINK"
  * below. See the comment just above that line for information about providing an
  * input signal.
+ *
+ * All register accesses go through FpgaRegisters (see FpgaRegisters.h): the Main Control
+ * register is shadowed, so setting or clearing its bits needs no read, and a monitor
+ * buffer is read with a single ReadIndirect() call.
  */
 
 #include <fstream>
@@ -33,6 +37,11 @@ using std::cout; using std::endl;
 #include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
 #include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
 
+#include "AnalyzerSequences.h"
+#include "FpgaCard.h"
+#include "FpgaSimulator.h"
+#include "FpgaWait.h"
+
 
 // Uncomment the following line to enable the odl receiver; You will have to loop the
 // odl outputs back to the inputs, input 1 to output 2 and vice versa, for this to work
@@ -42,6 +51,9 @@ using std::cout; using std::endl;
 // Uncomment the following line to log fpga read / write access in a file called "FpgaIo.log"
 //#define FPGA_IO_LOG
 
+// Uncomment the following line to replace the firmware by the model of "FpgaSimulator.h"
+//#define FPGA_SIMULATOR
+
 
 
 // Macro for status code checking
@@ -92,6 +104,13 @@ static const char dataFileName[] = "Acqiris.data";
 // Name of IO log file, only created if 'FPGA_IO_LOG' is defined.
 static const char fpgaIoLogFileName[] = "FpgaIo.log";
 
+#ifdef FPGA_SIMULATOR
+FpgaSimulator fpgaRegs(FpgaSimStreamer);    // Firmware model instead of the card (FpgaSimulator.h)
+#else
+FpgaCard fpgaRegs;                          // All register accesses of the instrument
+#endif
+FpgaWait fpgaWait(fpgaRegs);                // Waits on the firmware status, with their durations
+
 
 
 //! Start digitizing the signal and stream the digital data to the FPGA.
@@ -124,59 +143,50 @@ void OutputArray(std::ofstream &ioLogFile, char function[], long regID, long *da
 }
 
 
-//! Read the specified 'regID' from the FPGA.
-ViStatus ReadFPGA(ViSession instrID, std::ofstream &ioLogFile, long regID, long nbrValues, long* dataArrayP)
+//! Read the specified 'regID' from the FPGA (through 'fpgaRegs', logged by LogFpgaIo()).
+ViStatus ReadFPGA(long regID, long nbrValues, long* dataArrayP)
 {
-    ViStatus status;
-    
-    status = Acqrs_logicDeviceIO(instrID, "Block1Dev1", regID, nbrValues, dataArrayP, 0, 0);
-    CHECK_API_CALL("Acqrs_logicDeviceIO", status);   
+    return fpgaRegs.ReadBlock(regID, nbrValues, dataArrayP);
+}
 
-    OutputArray(ioLogFile, "ReadFPGA", regID, dataArrayP, nbrValues);
 
-    return status;
+//! Write into the specified 'regID' of the FPGA (through 'fpgaRegs', logged by LogFpgaIo()).
+ViStatus WriteFPGA(long regID, long nbrValues, long* dataArrayP)
+{
+    return fpgaRegs.WriteBlock(regID, nbrValues, dataArrayP);
 }
 
 
-//! Write into the specified 'regID' of the FPGA.
-ViStatus WriteFPGA(ViSession instrID, std::ofstream &ioLogFile, long regID, long nbrValues, long* dataArrayP)
+//! Check and log every register access of 'fpgaRegs' into the 'ioLogFile' given as 'contextP'.
+void LogFpgaIo(void* contextP, char const* function, ViInt32 regID, ViInt32 nbrValues, ViInt32 const* dataArrayP,
+               ViStatus status)
 {
-    ViStatus status;
-    
-    status = Acqrs_logicDeviceIO(instrID, "Block1Dev1", regID, nbrValues, dataArrayP, 1, 0);
     CHECK_API_CALL("Acqrs_logicDeviceIO", status);   
-
-    OutputArray(ioLogFile, "WriteFPGA", regID, dataArrayP, nbrValues);
-
-    return status;
+    OutputArray(*(std::ofstream*)contextP, (char*)function, regID, (long*)dataArrayP, nbrValues);
 }
 
 
 //! Capture monitor data from the 'DS', 'Tx' and (optionally) 'Rx' streams
-void CaptureMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
+void CaptureMonitorBlock(void)
 {
     cout << "Capturing monitor data...\n";
-    long monitorCtrl, mainCtrl;
-    bool ready = false;
-    long timeout;
+    long monitorCtrl, captureBits = 0;
 
-    // Reset the 'capture' bits
-    ReadFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
-    mainCtrl &= ~0x00007000;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+    // Reset the 'capture' bits (the Main Control register is shadowed, no read needed)
+    fpgaRegs.Modify(MainCtrlReg, 0x00007000, 0);
 
     // Set up the Data Stream capture mode:
     // Capture mode = event triggered
     // Stream to capture = Stream A
     monitorCtrl = 0x10000000L;
-    WriteFPGA(instrID, ioLogFile, DsMonCtrl, 1, &monitorCtrl);
+    WriteFPGA(DsMonCtrl, 1, &monitorCtrl);
 
     // Set up the 'Tx' stream capture mode:
     // Capture mode = event masked link triggered
     // Stream to capture = Stream A
     // Link to capture = Link 0
     monitorCtrl = 0x20000000L;
-    WriteFPGA(instrID, ioLogFile, TxMonCtrl, 1, &monitorCtrl);
+    WriteFPGA(TxMonCtrl, 1, &monitorCtrl);
 
 #ifdef USE_RX_LINK
     // Set up the 'Rx' stream capture mode:
@@ -188,42 +198,26 @@ void CaptureMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
     // input 2 and vice versa, so we capture Rx link 1 together with Tx link 0.
     // The two buffers should therefore contain the same data with this setup.
     monitorCtrl = 0x20010000L;
-    WriteFPGA(instrID, ioLogFile, RxMonCtrl, 1, &monitorCtrl);
+    WriteFPGA(RxMonCtrl, 1, &monitorCtrl);
     // Enable capture of 'Rx' stream
-    mainCtrl |= 0x00004000L;
+    captureBits |= 0x00004000L;
 #endif
 
     // Enable capture of 'DS' and 'Tx' streams
-    mainCtrl |= 0x00003000L;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
-
-
-    // Wait until data have been captured in the monitoring buffers
-    timeout = 100;      // With a 'Sleep' of 1 ms, should be a timeout of 100 ms
-
-    while ((!ready) && (timeout > 0))
-    {
-        --timeout;
-
-        // test for 'DS' monitor ready
-        ReadFPGA(instrID, ioLogFile, DsMonCtrl, 1, &monitorCtrl);
-        ready = ((monitorCtrl & 0x80000000) != 0);
-        
-        // test for 'Tx' monitor ready
-        ReadFPGA(instrID, ioLogFile, TxMonCtrl, 1, &monitorCtrl);
-        ready = ready && ((monitorCtrl & 0x80000000) != 0);
+    captureBits |= 0x00003000L;
 
+    // Wait until data have been captured in the monitoring buffers: 'DS', 'Tx' (and 'Rx') monitor ready
+    // (see AnalyzerSequences.h)
+    long const monitors[3] = { DsMonCtrl, TxMonCtrl, RxMonCtrl };
 #ifdef USE_RX_LINK
-        // test for 'Rx' monitor ready
-        ReadFPGA(instrID, ioLogFile, RxMonCtrl, 1, &monitorCtrl);
-        ready = ready && ((monitorCtrl & 0x80000000) != 0);
+    int const nbrMonitors = 3;
+#else
+    int const nbrMonitors = 2;
 #endif
+    ViStatus const status = CaptureStreamMonitors(fpgaRegs, fpgaWait, "monitors", captureBits,
+                                                  monitors, nbrMonitors, 0.1);
 
-        if (!ready)
-            Sleep(1);
-    }
-
-    if (timeout <= 0)
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         cout << "Timeout on Capture\n";
 }
 
@@ -304,14 +298,14 @@ ViSession FindDevices(void)
 
 //! Initialization of the FPGA
 /*! NOTE: This is specific to the 'sc240stream2.bit' firmware */
-void InitFPGA(ViSession instrID, std::ofstream &ioLogFile)
+void InitFPGA(ViSession instrID)
 {
     ViStatus status;
 
     cout << "Initializing firmware\n";
     // Enable the trigger manager AFTER acquisition has started
     long value = 1;   
-    WriteFPGA(instrID, ioLogFile, TriggerCtrlReg, 1, &value);
+    WriteFPGA(TriggerCtrlReg, 1, &value);
 
     // Turn on the PLL reference clock for the Rocket IO
     status = Acqrs_setAttributeString(instrID, 0, "odlTxBitRate", "2.5G");
@@ -319,53 +313,30 @@ void InitFPGA(ViSession instrID, std::ofstream &ioLogFile)
 
     Sleep(10);      // Wait for PLL to stabilize
 
-    // Set the DCM enable bits in the FPGA configuration register
-    long fpgaCtrl = 0;
-    WriteFPGA(instrID, ioLogFile, FPGACtrlReg, 1, &fpgaCtrl);       // First disable everything
-    fpgaCtrl |= 0x000c0000;                     // Enable bits for DCMA and DCMB
+    // Set the DCM enable bits in the FPGA configuration register, start the DE interface
+    // in the FPGA and wait until the DE clock is ready (see AnalyzerSequences.h)
+    long fpgaCtrl = 0x000c0000;                 // Enable bits for DCMA and DCMB
 //  fpgaCtrl |= 0x00000100;                     // Enable readout in Big-Endian format (if needed)
-    WriteFPGA(instrID, ioLogFile, FPGACtrlReg, 1, &fpgaCtrl);
-    Sleep(10);                                  // Wait some time
-
-    // Start the DE interface in the FPGA
-    long deCtrl = 0;
-    WriteFPGA(instrID, ioLogFile, DECtrlReg, 1, &deCtrl);
-    deCtrl = 0x80000000;
-    WriteFPGA(instrID, ioLogFile, DECtrlReg, 1, &deCtrl);
-
-    // Wait until the DE clock is ready
-    bool ready = false;
-    long timeout = 100;             // With a 'Sleep' of 1 ms, should be a timeout of 100 ms
-
-    while ((!ready) && (timeout > 0))
-    {
-        timeout--;
-        
-        long fpgaStatus;
-        ReadFPGA(instrID, ioLogFile, FPGAStatusReg, 1, &fpgaStatus);
-        ready = ((fpgaStatus & 0x00100000) != 0);
-        if (!ready) 
-            Sleep(1);
-    }
+    status = StartDEInterface(fpgaRegs, fpgaWait, fpgaCtrl);
 
     // Clear the Main Control Register
     long mainCtrl = 0;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+    WriteFPGA(MainCtrlReg, 1, &mainCtrl);
 }
 
 
 //! Load the streamer firmware into the FPGA
-void LoadFPGA(ViSession instrID)
+void LoadFPGA(void)
 {
     ViStatus status;
 
     cout << "loading firmware '" << fpgaFileName << "'\n";
     // Clear the FPGA first
-    status = Acqrs_configLogicDevice(instrID, "Block1Dev1", NULL, 1);
+    status = fpgaRegs.ConfigLogicDevice(NULL, 1);
     CHECK_API_CALL("Acqrs_configLogicDevice", status);
 
     // Load the FPGA (flag = 3 will allow a search for FPGAPATH in the 'AqDrv4.ini' file)
-    status = Acqrs_configLogicDevice(instrID, "Block1Dev1", fpgaFileName, 3);
+    status = fpgaRegs.ConfigLogicDevice(fpgaFileName, 3);
     CHECK_API_CALL("Acqrs_configLogicDevice", status);
 }
 
@@ -379,7 +350,7 @@ void WaitForOperatorTo(char const* text)
 
 
 //! Read out the monitor data
-void ReadMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
+void ReadMonitorBlock(void)
 {
     static const long nbrValues = 8192;
     static const long nbrLongs = (nbrValues + 3)/4; // number of longs to read = ceil(nbrValues / 4)
@@ -389,35 +360,23 @@ void ReadMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
     long txMonitorData[nbrLongs];
 
     long startAddr  = 0;
-    long bufAddress;
 
     // Find start address for the (circular) 'DS' monitor
-    ReadFPGA(instrID, ioLogFile, DsMonCtrl, 1, &startAddr);
+    ReadFPGA(DsMonCtrl, 1, &startAddr);
     startAddr &= 0x0000ffff;
 
     // Read 'DS' monitor data
-    bufAddress = DsMonitorAddress;
-    WriteFPGA(instrID, ioLogFile, StartAddrReg, 1, &startAddr);
-    WriteFPGA(instrID, ioLogFile, BufferIDReg, 1, &bufAddress);
-    ReadFPGA(instrID, ioLogFile, ReadAddrReg, nbrLongs, dsMonitorData);
-
-    // Read 'Tx' monitor data
-    startAddr = 0;      // 'Tx' monitor starts at 0
-    bufAddress = TxMonitorAddress;
-    WriteFPGA(instrID, ioLogFile, StartAddrReg, 1, &startAddr);
-    WriteFPGA(instrID, ioLogFile, BufferIDReg, 1, &bufAddress);
-    ReadFPGA(instrID, ioLogFile, ReadAddrReg, nbrLongs, txMonitorData);
+    fpgaRegs.ReadIndirect(DsMonitorAddress, startAddr, nbrLongs, dsMonitorData);
+
+    // Read 'Tx' monitor data ('Tx' monitor starts at 0)
+    fpgaRegs.ReadIndirect(TxMonitorAddress, 0, nbrLongs, txMonitorData);
 
 #ifdef USE_RX_LINK
    // allocate memory for the acquired data
    long rxMonitorData[nbrLongs];
 
-    // Read 'Rx' monitor data
-    startAddr = 0;      // 'Rx' monitor starts at 0
-    bufAddress = RxMonitorAddress;
-    WriteFPGA(instrID, ioLogFile, StartAddrReg, 1, &startAddr);
-    WriteFPGA(instrID, ioLogFile, BufferIDReg, 1, &bufAddress);
-    ReadFPGA(instrID, ioLogFile, ReadAddrReg, nbrLongs, rxMonitorData);
+    // Read 'Rx' monitor data ('Rx' monitor starts at 0)
+    fpgaRegs.ReadIndirect(RxMonitorAddress, 0, nbrLongs, rxMonitorData);
 #endif
 
     // Write the data to a file
@@ -464,15 +423,11 @@ void ReadMonitorBlock(ViSession instrID, std::ofstream &ioLogFile)
 //! Initialization of the optical data links.
 /*! NOTE: The polarity of the links depends on the hardware option. For more info, see
     the section on programming the streamer firmware in the streamer user manual. */
-void StartLinks(ViSession instrID, std::ofstream &ioLogFile)
+void StartLinks(ViSession instrID)
 {
     ViStatus status;
 
-    long regAddr;
-    long slcCtrl;
-    long slcStatus = 0;
-    long timeout = 1000;    // With a 'Sleep' of 10 ms, should be a timeout of 10 s
-    bool ready = false;
+    long slcCtrl[2];                    // SLC control of data links 0 and 1
     long nbrLinks = 0;
     // The following bit mask contains the bits of the SLC status register which indicate
     // that the Tx Link is ready (Tx Physical Layer Ready (TXR), Tx Link Layer Ready (TXK))
@@ -490,19 +445,17 @@ void StartLinks(ViSession instrID, std::ofstream &ioLogFile)
 
     printf("Initializing optical data links...\n");
     // Configure data link 0
-    regAddr = StreamerSLCbase1 + 0*SLCbaseOffset + SLCctrlOffset;
-
     if (nbrLinks <= 2)
     {
         // For '2 link' hardware:
         // Tx polarity = default, Rx polarity = inverted
         // Rx FIFO threshold = 0x3f
         // Tx Enable = 1
-        slcCtrl = 0x023f0001L;
+        slcCtrl[0] = 0x023f0001L;
         
 #ifdef USE_RX_LINK
         // Rx Enable = 1
-        slcCtrl |= 0x00000002L;
+        slcCtrl[0] |= 0x00000002L;
 #endif
 
     }
@@ -512,80 +465,43 @@ void StartLinks(ViSession instrID, std::ofstream &ioLogFile)
         // Tx polarity = inverted, Rx polarity = inverted
         // Rx FIFO threshold = 0x3f
         // Tx Enable = 1
-        slcCtrl = 0x033f0001L;
+        slcCtrl[0] = 0x033f0001L;
         
 #ifdef USE_RX_LINK
         // Rx Enable = 1
-        slcCtrl |= 0x00000002L;
+        slcCtrl[0] |= 0x00000002L;
 #endif
 
     }
 
-    WriteFPGA(instrID, ioLogFile, regAddr, 1, &slcCtrl);
-
     // Configure data link 1
-    regAddr = StreamerSLCbase1 + 1*SLCbaseOffset + SLCctrlOffset;
     // This is the same for both hardware variants:
     // Tx polarity = inverted, Rx polarity = inverted
     // Rx FIFO threshold = 0x3f
     // Tx Enable = 1
-    slcCtrl = 0x033f0001L;
+    slcCtrl[1] = 0x033f0001L;
     
 #ifdef USE_RX_LINK
     // Rx Enable = 1
-    slcCtrl |= 0x00000002L;
+    slcCtrl[1] |= 0x00000002L;
 #endif
 
-    WriteFPGA(instrID, ioLogFile, regAddr, 1, &slcCtrl);
-
-    // Wait until the links are ready
-    do
-    {
-        --timeout;
-        // Check data link 0 status
-        regAddr = StreamerSLCbase1 + 0*SLCbaseOffset + SLCstatusOffset;
-        ReadFPGA(instrID, ioLogFile, regAddr, 1, &slcStatus);
-        // Test the "Tx physical layer ready" and "Tx link layer ready" bits for the transmitter
-        // Test the "Rx physical layer ready" and "Rx link layer ready" bits for the receiver
-        ready = (slcStatus & linkReadyBits) == linkReadyBits;
-
-        // Check data link 1 status
-        regAddr = StreamerSLCbase1 + 1*SLCbaseOffset + SLCstatusOffset;
-        ReadFPGA(instrID, ioLogFile, regAddr, 1, &slcStatus);
-        // Test the "Tx physical layer ready" and "Tx link layer ready" bits for the transmitter
-        // Test the "Rx physical layer ready" and "Rx link layer ready" bits for the receiver
-        ready = ready && (slcStatus & linkReadyBits) == linkReadyBits;
-
-        if (!ready) Sleep(10);
-    }
-    while (!ready && timeout > 0);
+    // Write both, wait until the links are ready: the link ready bits in the status of data
+    // links 0 and 1, then reset the link status flags (see AnalyzerSequences.h)
+    status = StartDataLinks(fpgaRegs, fpgaWait, slcCtrl, 2, linkReadyBits, 10.0);
 
-    if (timeout <= 0)
+    if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
         cout << "Timeout while waiting for data links\n";
     else
-    {
-        // Reset the link status flags
-        regAddr = StreamerSLCbase1 + 0*SLCbaseOffset + SLCctrlOffset;
-        ReadFPGA(instrID, ioLogFile, regAddr, 1, &slcCtrl);
-        slcCtrl |= 0x80000000L;         // "Reset status flags" bit
-        WriteFPGA(instrID, ioLogFile, regAddr, 1, &slcCtrl);
-
-        regAddr = StreamerSLCbase1 + 1*SLCbaseOffset + SLCctrlOffset;
-        ReadFPGA(instrID, ioLogFile, regAddr, 1, &slcCtrl);
-        slcCtrl |= 0x80000000L;         // "Reset status flags" bit
-        WriteFPGA(instrID, ioLogFile, regAddr, 1, &slcCtrl);
-
         cout << "Data links ready!\n";
-    }
 }
 
 
 //! Start data streams.
-void StartStreams(ViSession instrID, std::ofstream &ioLogFile)
+void StartStreams(void)
 {
     long globalConfig;
     long streamConfig;
-    long mainCtrl;
 
     cout << "Starting data streams\n";
 
@@ -594,43 +510,36 @@ void StartStreams(ViSession instrID, std::ofstream &ioLogFile)
     // Enable streams A & B
     // Streaming mode = triggered
     globalConfig = 0x85000009L;
-    WriteFPGA(instrID, ioLogFile, StreamerConfigGlob, 1, &globalConfig);
+    WriteFPGA(StreamerConfigGlob, 1, &globalConfig);
     
     // Individual stream configuration:
     // User frame size = 1, stripe frame size = 512 blocks (= 8192 samples)
     streamConfig = 0x00010200L;
-    WriteFPGA(instrID, ioLogFile, StreamerConfigSrcA, 1, &streamConfig);
-    WriteFPGA(instrID, ioLogFile, StreamerConfigSrcB, 1, &streamConfig);
+    WriteFPGA(StreamerConfigSrcA, 1, &streamConfig);
+    WriteFPGA(StreamerConfigSrcB, 1, &streamConfig);
 
-    ReadFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
-    // Clear the bits we want to change
-    mainCtrl &= ~0x000001F0L;
-    // Main control configuration:
+    // Main control configuration, clearing the bits we want to change:
     // Channel A => Stream A
     // Channel B => Stream B
     // Start framing process
-    mainCtrl |=  0x00000140L;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+    fpgaRegs.Modify(MainCtrlReg, 0x000001F0L, 0x00000140L);
     cout << "Streaming...\n\n";
 }
 
 
 //! Stop data conversion.
-void Stop(ViSession instrID, std::ofstream &ioLogFile)
+void Stop(ViSession instrID)
 {
     ViStatus status;
 
-    long mainCtrl = 0;
     long linkCtrl = 0;
 
     // Stop the streams
-    ReadFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
-    mainCtrl &= ~0x00000100L;
-    WriteFPGA(instrID, ioLogFile, MainCtrlReg, 1, &mainCtrl);
+    fpgaRegs.Modify(MainCtrlReg, 0x00000100L, 0);
     
     // Stop the links
-    WriteFPGA(instrID, ioLogFile, StreamerSLCbase1 + 0*SLCbaseOffset + SLCctrlOffset, 1, &linkCtrl);
-    WriteFPGA(instrID, ioLogFile, StreamerSLCbase1 + 1*SLCbaseOffset + SLCctrlOffset, 1, &linkCtrl);
+    WriteFPGA(StreamerSLCbase1 + 0*SLCbaseOffset + SLCctrlOffset, 1, &linkCtrl);
+    WriteFPGA(StreamerSLCbase1 + 1*SLCbaseOffset + SLCctrlOffset, 1, &linkCtrl);
 
     // Stop the acquisition
     status = AcqrsD1_stopAcquisition(instrID);
@@ -660,17 +569,21 @@ int main (int argc, char *argv[])
 
     ViSession instrID;
     instrID = FindDevices();                    // Initialize the Analyzer
+    fpgaRegs.Attach(instrID);
+    fpgaRegs.Shadow(MainCtrlReg);               // Only written by this program
+    fpgaRegs.SetLog(LogFpgaIo, &ioLogFile);
     WaitForOperatorTo("continue");
 
-    LoadFPGA(instrID);                          // Load the firmware into the FPGA (if not using default file)
+    LoadFPGA();                                 // Load the firmware into the FPGA (if not using default file)
     Configure(instrID);                         // Configure the digitizer
     Acquire(instrID);                           // Start continuous acquisition + transfer to FPGA
-    InitFPGA(instrID, ioLogFile);               // Initialize the FPGA
-    StartLinks(instrID, ioLogFile);             // Configure the optical data links
-    StartStreams(instrID, ioLogFile);           // Start data streaming
-    CaptureMonitorBlock(instrID, ioLogFile);    // Capture a monitoring block in the FPGA
-    ReadMonitorBlock(instrID, ioLogFile);       // Read a block of data from the FPGA
-    Stop(instrID, ioLogFile);                   // Stop the FPGA and the acquisition
+    InitFPGA(instrID);                          // Initialize the FPGA
+    StartLinks(instrID);                        // Configure the optical data links
+    StartStreams();                             // Start data streaming
+    CaptureMonitorBlock();                      // Capture a monitoring block in the FPGA
+    ReadMonitorBlock();                         // Read a block of data from the FPGA
+    Stop(instrID);                              // Stop the FPGA and the acquisition
+    fpgaWait.Print(stdout);                     // How long each wait on the firmware took
 
     status = Acqrs_close(instrID);
     CHECK_API_CALL("Acqrs_close", status);
@@ -0,0 +1,244 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedSSRStream.cpp: Continuous Threshold Gated SSR acquisition on AP240 modules
+//
+//----------------------------------------------------------------------------------------
+//
+//  Copyright Agilent Technologies Inc., 2000, 2001-2009
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Every AcqrsD1_processData() call uses the switch flag, so the module processes the
+//  next acquisition in its other memory bank while the host reads the 'ReadModeSSRW'
+//  data of the previous one. The readouts rotate through 'nbrBuffers' buffers (sized by
+//  SsrBufferPool.h) to a writer thread, which decodes them (see PeakStream.h) and
+//  appends the gates of every acquisition to the gate store "AcqirisGates.bin" (see
+//  GateStore.h, which also indexes the file for queries).
+//
+//  No acquisition is skipped: when the writer still holds every buffer, the readout
+//  waits for one to be released. The module keeps the acquisition in its bank meanwhile;
+//  such waits are reported, they add dead time between acquisitions.
+//
+//  Usage: GetStartedSSRStream [nbrAcquisitions [nbrBuffers]]
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#include <AcqirisImport.h>
+#include <AcqirisD1Import.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "GateStore.h"
+#include "PeakStream.h"
+#include "SlotRing.h"
+#include "SsrBufferPool.h"
+
+
+// One ReadModeSSRW readout; the buffer comes from the pool of the acquisition thread
+struct GateReadout
+{
+    SsrBuffer *bufferP;
+    AqDataDescriptor dataDesc;
+    ViUInt32 acquisition;
+};
+
+// Totals of the writer thread
+struct WriterStats
+{
+    long nbrAcquisitions;
+    long nbrSegments;
+    long nbrGates;
+    double nbrGateBytes;
+    long nbrInvalid;
+    bool writeError;
+};
+
+
+// Decode the readouts in acquisition order and append their gates to the store
+void WriteGates(SlotRing<GateReadout> *ringP, GateStore *storeP, WriterStats *statsP)
+{
+    PeakBatch batch;
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        GateReadout const &readout = (*ringP)[idx];
+
+        batch.Clear();
+        if (DecodePeakStream(&readout.bufferP->data[0], readout.dataDesc.actualDataSize, batch) != PeakStreamOk)
+            ++statsP->nbrInvalid;
+
+        // The gate samples are in the buffer: release it only once they are written
+        if (!storeP->Append(readout.acquisition, batch))
+            statsP->writeError = true;
+        ringP->Release();
+
+        ++statsP->nbrAcquisitions;
+        statsP->nbrSegments += batch.NbrSegments();
+        statsP->nbrGates += batch.NbrGates();
+        for (long n = 0 ; n < batch.NbrGates() ; ++n)
+            statsP->nbrGateBytes += batch.gateLength[n];
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+	long const nbrAcquisitions = (argc > 1) ? atol(argv[1]) : 1000;
+	long const nbrBuffers = (argc > 2) ? atol(argv[2]) : 4;
+	if (nbrAcquisitions < 1 || nbrBuffers < 2)
+		return fprintf(stderr, "Usage: GetStartedSSRStream [nbrAcquisitions [nbrBuffers >= 2]]\n"), 1;
+
+	// The store writes the gates to the file as they come
+	GateStore store;
+	if (!store.Create("AcqirisGates.bin"))
+		return fprintf(stderr, "ERROR: cannot create AcqirisGates.bin\n"), 1;
+
+	ViSession idInstrument;
+	ViStatus status = Acqrs_InitWithOptions((ViRsrc)"PCI::INSTR0", VI_FALSE,
+			VI_FALSE, "CAL=0", &idInstrument);
+
+	if (status != VI_SUCCESS)
+		return fprintf(stderr, "ERROR: Instrument not found.\n"), 1;
+
+	status = Acqrs_calibrate(idInstrument);
+
+	// Configure instrument mode and timebase
+	ViInt32 modeSSR = 7;
+	status = AcqrsD1_configMode(idInstrument, modeSSR, 0, 0);
+
+	ViReal64 sampInterval = 1e-9;    // sampling interval in seconds
+	ViReal64 delayTime = 0.0;        // trigger delay time in seconds
+	status = AcqrsD1_configHorizontal(idInstrument, sampInterval, delayTime);
+
+	long const idChannel = 1;
+
+	ViReal64 fullscale = 2.0;        // fullscale value in Volts
+	ViReal64 offset = 0.0;           // offset value in Volts
+	ViInt32 coupling = 3;            // coupling DC, 50 ohm
+	ViInt32 bandwidth = 0;           // no bandwidth limit
+	status = AcqrsD1_configVertical(idInstrument, idChannel, fullscale, offset, coupling, bandwidth);
+
+	// Configure edge trigger on channel 1
+	ViInt32 trigClass = 0;
+	ViInt32 sourcePattern = 0x1;		// Trigger on Channel 1
+	status = AcqrsD1_configTrigClass(idInstrument, trigClass, sourcePattern, 0x0, 0, 0.0, 0.0);
+
+	// Configure the trigger conditions of channel 1 internal trigger
+	ViInt32 trigCoupling = 0;			// DC coupling
+	ViInt32 trigSlope = 0;				// Positive slope
+	ViReal64 trigLevel = 10.0;			// Trigger level = +10% of FSR (i.e. + 100 mV)
+	status = AcqrsD1_configTrigSource(idInstrument, 1, trigCoupling, trigSlope, trigLevel, 0.0);
+
+	// Configure analyzer parameters
+	ViInt32 nbrSamples = 1024;
+	ViInt32 nbrSegments = 12;
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "NbrSamples", &nbrSamples);
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "NbrSegments", &nbrSegments);
+
+	ViInt32 startDelay = 0;
+	ViInt32 stopDelay = 0;
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "StartDelay", &startDelay);
+	status = AcqrsD1_configAvgConfig(idInstrument, 0, "StopDelay", &stopDelay);
+
+	// Configure gates parameters
+	ViInt32 gateType = 2;         // 1 = user defined, 2 = threshold
+	ViReal64 threshold = -0.125;
+	ViInt32 invertData = 0;       // 0 = normal data, 1 = invert data
+
+	status = AcqrsD1_configAvgConfig(idInstrument, idChannel, "GateType", &gateType);
+	status = AcqrsD1_configAvgConfig(idInstrument, idChannel, "Threshold", &threshold);
+	status = AcqrsD1_configAvgConfig(idInstrument, idChannel, "InvertData", &invertData);
+
+	// Readout buffers, the first ones for 3 gates of 512 samples per segment
+	SsrBufferPool pool((8 + (8 + 512) * 3) * nbrSegments, SsrWorstCaseBytes(nbrSamples, nbrSegments));
+
+	SlotRing<GateReadout> ring(nbrBuffers);
+	for (long n = 0 ; n < ring.Size() ; ++n)
+		ring[n].bufferP = NULL;
+
+	AqReadParameters readParam;
+	::memset(&readParam, 0, sizeof(readParam));
+	readParam.dataType = ReadInt8;
+	readParam.readMode = ReadModeSSRW;
+	readParam.firstSegment = 0;
+	readParam.nbrSegments = nbrSegments;
+	readParam.firstSampleInSeg = 0;
+	readParam.nbrSamplesInSeg = nbrSamples;
+	readParam.segmentOffset = nbrSamples;
+	readParam.segDescArraySize = 0;
+
+	WriterStats stats;
+	::memset(&stats, 0, sizeof(stats));
+	std::thread writer(WriteGates, &ring, &store, &stats);
+
+	// Acquisition loop
+	long nbrRead = 0, nbrErrors = 0;
+
+	std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+	status = AcqrsD1_acquire(idInstrument);
+
+	for (long nAcq = 0 ; nAcq < nbrAcquisitions ; ++nAcq)
+	{
+		// Switch banks: the module goes on with the next acquisition during the readout
+		long const lastswitch = (nAcq == nbrAcquisitions - 1) ? 1 : 0;
+		status = AcqrsD1_processData(idInstrument, 0, 1 + lastswitch);
+		status = AcqrsD1_waitForEndOfProcessing(idInstrument, 2000);
+
+		if (status == (ViStatus)ACQIRIS_ERROR_TIMEOUT)
+		{
+			status = AcqrsD1_stopAcquisition(idInstrument);
+			printf("# Timeout after %ld acquisitions\n", nAcq);
+			break;
+		}
+
+		// The pool is only used by this thread: the buffer of a released slot goes back
+		// to it, and the slot gets one sized for the current readouts
+		long const idx = ring.WaitFree();
+		GateReadout &readout = ring[idx];
+		if (readout.bufferP != NULL)
+			pool.Put(readout.bufferP);
+		readout.bufferP = pool.Get();
+		readout.acquisition = ViUInt32(nAcq);
+
+		status = pool.Read(idInstrument, idChannel, readParam, *readout.bufferP, readout.dataDesc);
+		if (status < VI_SUCCESS)
+		{
+			fprintf(stderr, "Error: readData: %d (%08x)\n", (int)status, (int)status);
+			++nbrErrors;
+			readout.dataDesc.actualDataSize = 0;
+		}
+
+		ring.Publish();
+		++nbrRead;
+	}
+
+	ring.Close();
+	writer.join();
+
+	double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (long n = 0 ; n < ring.Size() ; ++n)
+		if (ring[n].bufferP != NULL)
+			pool.Put(ring[n].bufferP);
+
+	printf("# Read %ld acquisitions in %g s (%g acquisitions/s), %ld readout errors\n",
+	       nbrRead, seconds, nbrRead / seconds, nbrErrors);
+	printf("# The readout waited %ld times for the writer (%ld buffers)\n", ring.Stalls(), nbrBuffers);
+	printf("# Buffers of %.0f bytes on average, worst case %ld bytes, %ld readouts repeated\n",
+	       pool.MeanBufferBytes(), pool.WorstCaseBytes(), pool.Stats().nbrRetries);
+	printf("# Wrote %ld acquisitions, %ld segments, %ld gates (%.0f samples) to AcqirisGates.bin\n",
+	       stats.nbrAcquisitions, stats.nbrSegments, stats.nbrGates, stats.nbrGateBytes);
+	if (stats.nbrInvalid != 0)
+		printf("# %ld readouts contained invalid records\n", stats.nbrInvalid);
+	printf("# Indexed %ld gates in %ld segments\n", store.NbrGates(), store.NbrSegments());
+	if (!store.Close() || stats.writeError)
+		fprintf(stderr, "Error: writing AcqirisGates.bin failed\n");
+
+	status = Acqrs_closeAll();
+
+	return 0;
+}
@@ -0,0 +1,333 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedSoftPeakTDC.cpp : C++ demo program for Agilent Acqiris Digitizers
+//                              PeakTDC in software for digitizers without PeakTDC firmware
+//----------------------------------------------------------------------------------------
+//  Copyright Agilent Technologies, Inc. 1999-2010
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The digitizer acquires 'nbrSegments' triggers per acquisition in sequence mode. Each
+//  acquisition is read with 'ReadModeSeqW' as raw ADC codes and handed to a processing
+//  thread, which finds the peaks with the PeakTDC settings (StartDeltaPosPeakV,
+//  ValidDeltaPosPeakV, InvertData, see SoftPeakTDC.h) while the next acquisition runs.
+//
+//  The peaks are produced as PeakTDC records and appended, acquisition by acquisition,
+//  to "AcqirisPeaks.bin" in the same layout as GetStartedPeakTDCStream (PeakStream.h).
+//
+//  Usage: GetStartedSoftPeakTDC [nbrAcquisitions]
+//         GetStartedSoftPeakTDC -bench      (no instrument needed)
+//
+//  The benchmark reports the peak finding rate in samples per second, to be compared
+//  with the readout rate of the digitizer.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+using std::cout; using std::endl;
+using std::vector;
+
+#include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
+#include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
+
+#include "PeakStream.h"
+#include "SlotRing.h"
+#include "SoftPeakTDC.h"
+
+// Macro for status code checking
+char ErrMsg[256];
+#define CHECK_API_CALL(f, s) { if (s)\
+{ Acqrs_errorMessage(VI_NULL, s, ErrMsg, 256); cout<<f<<": "<<ErrMsg<<endl; } }
+
+// Raw ADC data type used for the readout: ViInt8 for 8-bit digitizers, ViInt16 for
+// digitizers with more than 8 bits
+typedef ViInt8 SampleType;
+
+// Configuration
+ViReal64 const sampInterval = 1.0e-9;   // 1 GS/s
+ViInt32 const nbrSamples = 2048;
+ViInt32 const nbrSegments = 100;        // Waveforms per acquisition
+ViInt32 const usedChannel = 1;
+
+// Peak detection, levels in Volts
+ViReal64 const startDeltaPosPeakV = 0.02;
+ViReal64 const validDeltaPosPeakV = 0.02;
+ViInt32 const invertData = 1;           // Negative peaks
+
+// One sequence readout
+struct SeqReadout
+{
+    vector<SampleType> dataArray;
+    vector<AqSegmentDescriptor> segDescArray;
+    AqDataDescriptor dataDesc;
+    ViUInt32 acquisition;
+    bool valid;
+};
+
+// Totals of the processing thread
+struct PeakStats
+{
+    long nbrAcquisitions;
+    long nbrPeaks;
+    bool writeError;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Processing thread: find the peaks of every readout and append them to 'file'
+void FindPeaks(SlotRing<SeqReadout>* ringP, ViInt32 segmentStride, FILE* file, PeakStats* statsP)
+{
+    vector<ViUInt32> records;
+    PeakBatch batch;
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        SeqReadout const& readout = (*ringP)[idx];
+        if (readout.valid)
+        {
+            AqDataDescriptor const& dataDesc = readout.dataDesc;
+
+            // The thresholds follow the vertical gain of each readout
+            SoftPeakConfig cfg;
+            cfg.startDelta = SoftPeakDelta(startDeltaPosPeakV, dataDesc.vGain);
+            cfg.validDelta = SoftPeakDelta(validDeltaPosPeakV, dataDesc.vGain);
+            cfg.invertData = (invertData != 0);
+
+            records.clear();
+            SoftPeakTDC(&readout.dataArray[dataDesc.indexFirstPoint], dataDesc.returnedSegments, segmentStride,
+                        dataDesc.returnedSamplesPerSeg, &readout.segDescArray[0], cfg, records);
+
+            batch.Clear();
+            // No records at all when the readout returned no segments
+            DecodePeakStream(records.empty() ? NULL : &records[0], long(records.size() * sizeof(ViUInt32)), batch);
+            if (!WritePeakBatch(file, readout.acquisition, batch))
+                statsP->writeError = true;
+
+            ++statsP->nbrAcquisitions;
+            statsP->nbrPeaks += batch.NbrPeaks();
+        }
+        ringP->Release();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Synthetic segments with a peak every 'peakInterval' samples on a noisy base line
+template <class Sample>
+void BenchmarkType(char const* name, ViInt32 peakHeight, long peakInterval)
+{
+    vector<Sample> data(nbrSegments * nbrSamples);
+    for (long seg = 0; seg < nbrSegments; seg++)
+        for (long i = 0; i < nbrSamples; i++)
+        {
+            double const x = double((i + 7 * seg) % peakInterval) - peakInterval / 2;
+            double const noise = double((i * 2654435761u + seg) % 5) - 2.0;
+            data[seg * nbrSamples + i] = Sample(floor(-peakHeight * exp(-0.5 * x * x / 4.0) + noise + 0.5));
+        }
+
+    vector<AqSegmentDescriptor> segDesc(nbrSegments);
+    ::memset(&segDesc[0], 0, segDesc.size() * sizeof(AqSegmentDescriptor));
+
+    SoftPeakConfig cfg;
+    cfg.startDelta = peakHeight / 5;
+    cfg.validDelta = peakHeight / 5;
+    cfg.invertData = true;
+
+    vector<ViUInt32> records;
+    long const nbrPasses = 200;
+    long nbrPeaks = 0;
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (long pass = 0; pass < nbrPasses; pass++)
+    {
+        records.clear();
+        nbrPeaks += SoftPeakTDC(&data[0], nbrSegments, nbrSamples, nbrSamples, &segDesc[0], cfg, records);
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double const nbrSamplesDone = double(nbrPasses) * nbrSegments * nbrSamples;
+    cout << name << " peak every " << peakInterval << " samples: " << nbrSamplesDone / seconds / 1.0e6
+         << " MSamples/s, " << nbrPeaks / seconds << " peaks/s" << endl;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void Benchmark()
+{
+    BenchmarkType<ViInt8>("Int8 ", 100, 1000);
+    BenchmarkType<ViInt8>("Int8 ", 100, 50);
+    BenchmarkType<ViInt16>("Int16", 20000, 1000);
+    BenchmarkType<ViInt16>("Int16", 20000, 50);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    ViStatus status = VI_SUCCESS; // All API functions return a status code that needs to be checked
+
+    cout << "Agilent Acqiris - GetStartedSoftPeakTDC" << endl;
+
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+    {
+        Benchmark();
+        return 0;
+    }
+
+    long const nbrAcquisitions = (argc > 1) ? atol(argv[1]) : 100;
+    if (nbrAcquisitions < 1)
+    {
+        cout << "Usage: GetStartedSoftPeakTDC [nbrAcquisitions | -bench]" << endl;
+        return -1;
+    }
+
+
+    // Search for instruments ////////////////////////////////////////////////////////////
+
+    ViInt32 numInstr; // Number of instruments
+
+    status = AcqrsD1_multiInstrAutoDefine("", &numInstr);
+    CHECK_API_CALL("AcqrsD1_multiInstrAutoDefine", status);
+
+    if (numInstr < 1)
+    {
+        cout << "No instrument found!" << endl;
+        return -1; // No instrument found
+    }
+    ViChar rscStr[16] = "PCI::INSTR0"; // Resource string
+    ViChar options[32] = ""; // No options necessary
+
+
+    // Initialization of the instrument //////////////////////////////////////////////////
+
+    ViSession instrID = VI_NULL; // Instrument handle
+
+    status = Acqrs_InitWithOptions(rscStr, VI_FALSE, VI_FALSE, options, &instrID);
+    CHECK_API_CALL("Acqrs_InitWithOptions", status);
+
+
+    // Configuration of the digitizer ////////////////////////////////////////////////////
+
+	ViReal64 const delayTime = 0.0;
+	ViInt32 const coupling = 3;             // DC coupling, 50 Ohm
+	ViInt32 const bandwidth = 0;            // No bandwidth limit
+	ViReal64 const fullScale = 0.5;         // 500 mV full scale
+	ViReal64 const offset = 0.0;            // No offset
+
+	status = AcqrsD1_configHorizontal(instrID, sampInterval, delayTime);
+	CHECK_API_CALL("AcqrsD1_configHorizontal", status);
+
+	status = AcqrsD1_configMemory(instrID, nbrSamples, nbrSegments);
+	CHECK_API_CALL("AcqrsD1_configMemory", status);
+
+	status = AcqrsD1_configVertical(instrID, usedChannel, fullScale, offset, coupling, bandwidth);
+	CHECK_API_CALL("AcqrsD1_configVertical", status);
+
+	status = AcqrsD1_configTrigClass(instrID, 0, 1 << (usedChannel-1), 0x0, 0, 0.0, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigClass", status);
+
+	status = AcqrsD1_configTrigSource(instrID, usedChannel, 0, 0, 10.0, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigSource", status);
+
+
+    // Readout buffers ///////////////////////////////////////////////////////////////////
+
+    // The sequence readout needs some extra samples per segment
+	ViInt32 const segmentStride = nbrSamples + 32;
+
+	SlotRing<SeqReadout> ring(2);
+	for (long n = 0; n < ring.Size(); n++)
+	{
+	    ring[n].dataArray.resize(nbrSegments * segmentStride + 32);
+	    ring[n].segDescArray.resize(nbrSegments);
+	}
+
+	AqReadParameters readParams;
+	::memset(&readParams, 0, sizeof(readParams));
+	readParams.dataType = (sizeof(SampleType) == 1) ? ReadInt8 : ReadInt16;
+	readParams.readMode = ReadModeSeqW;
+	readParams.firstSegment = 0;
+	readParams.nbrSegments = nbrSegments;
+	readParams.firstSampleInSeg = 0;
+	readParams.nbrSamplesInSeg = nbrSamples;
+	readParams.segmentOffset = segmentStride;
+	readParams.dataArraySize = static_cast<ViInt32>(ring[0].dataArray.size() * sizeof(SampleType));
+	readParams.segDescArraySize = static_cast<ViInt32>(ring[0].segDescArray.size() * sizeof(AqSegmentDescriptor));
+
+
+    // Acquisition and peak finding //////////////////////////////////////////////////////
+
+	FILE* file = fopen("AcqirisPeaks.bin", "wb");
+	if (file == NULL)
+	{
+	    cout << "Cannot create \"AcqirisPeaks.bin\"" << endl;
+	    return -1;
+	}
+
+	PeakStats stats;
+	::memset(&stats, 0, sizeof(stats));
+	std::thread finder(FindPeaks, &ring, segmentStride, file, &stats);
+
+	status = AcqrsD1_acquire(instrID);
+	CHECK_API_CALL("AcqrsD1_acquire", status);
+
+	std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+	for (long acq = 0; acq < nbrAcquisitions; acq++)
+	{
+	    status = AcqrsD1_waitForEndOfAcquisition(instrID, 2000);
+	    if (status != VI_SUCCESS)
+	    {
+	        status = AcqrsD1_stopAcquisition(instrID);
+	        cout << "\nAcquisition timeout - stopped after " << acq << " acquisitions" << endl;
+	        break;
+	    }
+
+	    long const idx = ring.WaitFree();
+	    SeqReadout& readout = ring[idx];
+
+	    status = AcqrsD1_readData(instrID, usedChannel, &readParams, &readout.dataArray[0],
+	                              &readout.dataDesc, &readout.segDescArray[0]);
+	    CHECK_API_CALL("AcqrsD1_readData", status);
+
+	    // Start the next acquisition before the peak finding of this one
+	    if (acq + 1 < nbrAcquisitions)
+	    {
+	        ViStatus const acqStatus = AcqrsD1_acquire(instrID);
+	        CHECK_API_CALL("AcqrsD1_acquire", acqStatus);
+	    }
+
+	    readout.acquisition = ViUInt32(acq);
+	    readout.valid = (status >= VI_SUCCESS);
+	    ring.Publish();
+	}
+
+	ring.Close();
+	finder.join();
+	fclose(file);
+
+	double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	status = AcqrsD1_stopAcquisition(instrID);
+	CHECK_API_CALL("AcqrsD1_stopAcquisition", status);
+
+	cout << "Found " << stats.nbrPeaks << " peaks in " << stats.nbrAcquisitions << " acquisitions ("
+	     << stats.nbrAcquisitions * double(nbrSegments) * nbrSamples / seconds / 1.0e6 << " MSamples/s)" << endl;
+	cout << "Peak finding was busy on " << ring.Stalls() << " readouts" << endl;
+	if (stats.writeError)
+	    cout << "Error writing \"AcqirisPeaks.bin\"" << endl;
+	else
+	    cout << "Saved the peaks to \"AcqirisPeaks.bin\"" << endl;
+
+    status = Acqrs_close(instrID);
+	CHECK_API_CALL("Acqrs_close", status);
+
+    status = Acqrs_closeAll();
+	CHECK_API_CALL("Acqrs_closeAll", status);
+
+    return 0;
+}
@@ -0,0 +1,382 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedSoftwareAvg.cpp : C++ demo program for Agilent Acqiris Digitizers
+//                              Software averaging for digitizers without averaging firmware
+//----------------------------------------------------------------------------------------
+//  Copyright Agilent Technologies, Inc. 1999-2010
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The digitizer acquires 'nbrSegments' triggers per acquisition in sequence mode. Each
+//  acquisition is read with 'ReadModeSeqW' as raw ADC codes and handed to a processing
+//  thread, which sums all segments on the host (see SoftAverager.h) while the next
+//  acquisition is running. Noise-suppressed averaging uses the same settings as the
+//  averager firmware (ThresholdEnable, Threshold, NoiseBaseEnable, NoiseBase).
+//
+//  With 'alignTriggers' every segment is first shifted by its own 'horPos' onto the
+//  trigger-aligned grid (see AlignedAverager.h), so that trigger jitter does not smear
+//  the edges of the average.
+//
+//  The average is written in Volts to "Acqiris.bin" (layout in AvgReadout.h).
+//
+//  Usage: GetStartedSoftwareAvg [nbrAcquisitions]
+//         GetStartedSoftwareAvg -bench      (no instrument needed)
+//
+//  The benchmark compares the host rate in waveforms per second with the rate of the
+//  averager firmware, which accumulates at the sampling rate, i.e. at most one waveform
+//  per 'nbrSamples * sampInterval'.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+using std::cout; using std::endl;
+using std::vector;
+
+#include "AcqirisImport.h" // Common Import for all Agilent Acqiris product families
+#include "AcqirisD1Import.h" // Import for Agilent Acqiris Digitizers
+
+#include "AlignedAverager.h"
+#include "AvgReadout.h"
+#include "SlotRing.h"
+#include "SoftAverager.h"
+
+// Macro for status code checking
+char ErrMsg[256];
+#define CHECK_API_CALL(f, s) { if (s)\
+{ Acqrs_errorMessage(VI_NULL, s, ErrMsg, 256); cout<<f<<": "<<ErrMsg<<endl; } }
+
+// Raw ADC data type used for the readout: ViInt8 for 8-bit digitizers, ViInt16 for
+// digitizers with more than 8 bits
+typedef ViInt8 SampleType;
+
+// Configuration
+ViReal64 const sampInterval = 1.0e-9;   // 1 GS/s
+ViInt32 const nbrSamples = 1024;
+ViInt32 const nbrSegments = 1000;       // Waveforms per acquisition
+ViInt32 const usedChannel = 1;
+
+// Noise-suppressed averaging, levels in Volts
+ViInt32 const enableThreshold = 1;
+ViInt32 const enableNoiseBase = 1;
+ViReal64 const threshold = 0.0;
+ViReal64 const noiseBase = -0.025;
+
+// Trigger jitter correction with the per-segment horPos
+ViInt32 const alignTriggers = 1;
+
+// One sequence readout
+struct SeqReadout
+{
+    vector<SampleType> dataArray;
+    vector<AqSegmentDescriptor> segDescArray;
+    AqDataDescriptor dataDesc;
+    bool valid;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Processing thread. The averager is set up with the first valid readout, whose data
+// descriptor converts the threshold levels into ADC codes.
+struct AvgState
+{
+    SoftAverager* avgP;                 // without trigger alignment
+    AlignedAverager* alignP;            // with trigger alignment
+    AqDataDescriptor firstDesc;
+    SoftAvgConfig cfg;
+};
+
+void AverageReadouts(SlotRing<SeqReadout>* ringP, AvgState* stateP, ViInt32 segmentStride)
+{
+    long idx;
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        SeqReadout const& readout = (*ringP)[idx];
+        if (readout.valid)
+        {
+            AqDataDescriptor const& dataDesc = readout.dataDesc;
+            if (stateP->avgP == NULL && stateP->alignP == NULL)
+            {
+                stateP->firstDesc = dataDesc;
+                stateP->cfg.thresholdEnable = (enableThreshold != 0);
+                stateP->cfg.noiseBaseEnable = (enableNoiseBase != 0);
+                stateP->cfg.threshold = SoftAvgCode(threshold, dataDesc.vGain, dataDesc.vOffset);
+                stateP->cfg.noiseBase = SoftAvgCode(noiseBase, dataDesc.vGain, dataDesc.vOffset);
+
+                int const nbrThreads = (int)std::thread::hardware_concurrency();
+                if (alignTriggers)
+                    stateP->alignP = new AlignedAverager(nbrSamples, nbrThreads, stateP->cfg);
+                else
+                    stateP->avgP = new SoftAverager(nbrSamples, nbrThreads, stateP->cfg);
+            }
+
+            if (stateP->alignP != NULL)
+                stateP->alignP->AddSegments(&readout.dataArray[dataDesc.indexFirstPoint], dataDesc.returnedSegments,
+                                            segmentStride, &readout.segDescArray[0], dataDesc.sampTime);
+            else
+                stateP->avgP->AddSegments(&readout.dataArray[dataDesc.indexFirstPoint],
+                                          dataDesc.returnedSegments, segmentStride);
+        }
+        ringP->Release();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+template <class Sample>
+void BenchmarkType(char const* name, long nbrWaveforms)
+{
+    double const firmwareRate = 1.0 / (nbrSamples * sampInterval);
+
+    vector<Sample> data(nbrSegments * nbrSamples);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = Sample((i * 2654435761u) >> (32 - 8 * sizeof(Sample)));
+
+    vector<AqSegmentDescriptor> segDesc(nbrSegments);
+    for (long s = 0; s < nbrSegments; s++)
+        segDesc[s].horPos = -sampInterval * ((s * 37) % 100) / 100.0;
+
+    int const maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    char const* const modeNames[] = { "      ", " NSA  ", " align" };
+
+    for (int mode = 0; mode < 3; mode++)
+    {
+        SoftAvgConfig cfg;
+        cfg.thresholdEnable = (mode == 1);
+        cfg.noiseBaseEnable = (mode == 1);
+        cfg.threshold = 0;
+        cfg.noiseBase = -3;
+
+        for (int nbrThreads = 1; nbrThreads <= maxThreads; nbrThreads *= 2)
+        {
+            SoftAverager avg(nbrSamples, nbrThreads, cfg);
+            AlignedAverager align(nbrSamples, nbrThreads, cfg);
+            long const nbrPasses = std::max(1L, nbrWaveforms / nbrSegments);
+
+            std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+            for (long pass = 0; pass < nbrPasses; pass++)
+            {
+                if (mode == 2)
+                    align.AddSegments(&data[0], nbrSegments, nbrSamples, &segDesc[0], sampInterval);
+                else
+                    avg.AddSegments(&data[0], nbrSegments, nbrSamples);
+            }
+            double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double const rate = nbrPasses * nbrSegments / seconds;
+            cout << name << modeNames[mode] << " " << nbrThreads << " thread(s): "
+                 << rate << " waveforms/s (" << rate / firmwareRate << " x firmware)" << endl;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+void Benchmark()
+{
+    cout << "Waveforms of " << nbrSamples << " samples; the firmware averager at "
+         << 1.0e-9 / sampInterval << " GS/s sustains at most " << 1.0 / (nbrSamples * sampInterval)
+         << " waveforms/s" << endl;
+
+    BenchmarkType<ViInt8>("Int8 ", 200000);
+    BenchmarkType<ViInt16>("Int16", 200000);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    ViStatus status = VI_SUCCESS; // All API functions return a status code that needs to be checked
+
+    cout << "Agilent Acqiris - GetStartedSoftwareAvg" << endl;
+
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+    {
+        Benchmark();
+        return 0;
+    }
+
+    long const nbrAcquisitions = (argc > 1) ? atol(argv[1]) : 100;
+    if (nbrAcquisitions < 1)
+    {
+        cout << "Usage: GetStartedSoftwareAvg [nbrAcquisitions | -bench]" << endl;
+        return -1;
+    }
+
+
+    // Search for instruments ////////////////////////////////////////////////////////////
+
+    ViInt32 numInstr; // Number of instruments
+
+    status = AcqrsD1_multiInstrAutoDefine("", &numInstr);
+    CHECK_API_CALL("AcqrsD1_multiInstrAutoDefine", status);
+
+    if (numInstr < 1)
+    {
+        cout << "No instrument found!" << endl;
+        return -1; // No instrument found
+    }
+    ViChar rscStr[16] = "PCI::INSTR0"; // Resource string
+    ViChar options[32] = ""; // No options necessary
+
+
+    // Initialization of the instrument //////////////////////////////////////////////////
+
+    ViSession instrID = VI_NULL; // Instrument handle
+
+    status = Acqrs_InitWithOptions(rscStr, VI_FALSE, VI_FALSE, options, &instrID);
+    CHECK_API_CALL("Acqrs_InitWithOptions", status);
+
+
+    // Configuration of the digitizer ////////////////////////////////////////////////////
+
+	ViReal64 const delayTime = 0.0;
+	ViInt32 const coupling = 3;             // DC coupling, 50 Ohm
+	ViInt32 const bandwidth = 0;            // No bandwidth limit
+	ViReal64 const fullScale = 0.5;         // 500 mV full scale
+	ViReal64 const offset = 0.0;            // No offset
+
+	status = AcqrsD1_configHorizontal(instrID, sampInterval, delayTime);
+	CHECK_API_CALL("AcqrsD1_configHorizontal", status);
+
+	status = AcqrsD1_configMemory(instrID, nbrSamples, nbrSegments);
+	CHECK_API_CALL("AcqrsD1_configMemory", status);
+
+	status = AcqrsD1_configVertical(instrID, usedChannel, fullScale, offset, coupling, bandwidth);
+	CHECK_API_CALL("AcqrsD1_configVertical", status);
+
+	status = AcqrsD1_configTrigClass(instrID, 0, 1 << (usedChannel-1), 0x0, 0, 0.0, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigClass", status);
+
+	status = AcqrsD1_configTrigSource(instrID, usedChannel, 0, 0, 10.0, 0.0);
+	CHECK_API_CALL("AcqrsD1_configTrigSource", status);
+
+
+    // Readout buffers ///////////////////////////////////////////////////////////////////
+
+    // The sequence readout needs some extra samples per segment
+	ViInt32 const segmentStride = nbrSamples + 32;
+
+	SlotRing<SeqReadout> ring(2);
+	for (long n = 0; n < ring.Size(); n++)
+	{
+	    ring[n].dataArray.resize(nbrSegments * segmentStride + 32);
+	    ring[n].segDescArray.resize(nbrSegments);
+	}
+
+	AqReadParameters readParams;
+	::memset(&readParams, 0, sizeof(readParams));
+	readParams.dataType = (sizeof(SampleType) == 1) ? ReadInt8 : ReadInt16;
+	readParams.readMode = ReadModeSeqW;
+	readParams.firstSegment = 0;
+	readParams.nbrSegments = nbrSegments;
+	readParams.firstSampleInSeg = 0;
+	readParams.nbrSamplesInSeg = nbrSamples;
+	readParams.segmentOffset = segmentStride;
+	readParams.dataArraySize = static_cast<ViInt32>(ring[0].dataArray.size() * sizeof(SampleType));
+	readParams.segDescArraySize = static_cast<ViInt32>(ring[0].segDescArray.size() * sizeof(AqSegmentDescriptor));
+
+
+    // Acquisition and averaging /////////////////////////////////////////////////////////
+
+	AvgState state;
+	::memset(&state, 0, sizeof(state));
+	std::thread averager(AverageReadouts, &ring, &state, segmentStride);
+
+	status = AcqrsD1_acquire(instrID);
+	CHECK_API_CALL("AcqrsD1_acquire", status);
+
+	std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+	for (long acq = 0; acq < nbrAcquisitions; acq++)
+	{
+	    status = AcqrsD1_waitForEndOfAcquisition(instrID, 2000);
+	    if (status != VI_SUCCESS)
+	    {
+	        status = AcqrsD1_stopAcquisition(instrID);
+	        cout << "\nAcquisition timeout - stopped after " << acq << " acquisitions" << endl;
+	        break;
+	    }
+
+	    long const idx = ring.WaitFree();
+	    SeqReadout& readout = ring[idx];
+
+	    status = AcqrsD1_readData(instrID, usedChannel, &readParams, &readout.dataArray[0],
+	                              &readout.dataDesc, &readout.segDescArray[0]);
+	    CHECK_API_CALL("AcqrsD1_readData", status);
+
+	    // Start the next acquisition before the averaging of this one
+	    if (acq + 1 < nbrAcquisitions)
+	    {
+	        ViStatus const acqStatus = AcqrsD1_acquire(instrID);
+	        CHECK_API_CALL("AcqrsD1_acquire", acqStatus);
+	    }
+
+	    readout.valid = (status >= VI_SUCCESS);
+	    ring.Publish();
+	}
+
+	ring.Close();
+	averager.join();
+
+	double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	status = AcqrsD1_stopAcquisition(instrID);
+	CHECK_API_CALL("AcqrsD1_stopAcquisition", status);
+
+
+    // Save data to file /////////////////////////////////////////////////////////////////
+
+	if (state.avgP != NULL || state.alignP != NULL)
+	{
+	    AqDataDescriptor const& desc = state.firstDesc;
+	    ViInt64 nbrWaveforms = 0;
+	    vector<ViReal64> sums(nbrSamples);
+	    if (state.alignP != NULL)
+	        nbrWaveforms = state.alignP->Sums(&sums[0]);
+	    else
+	    {
+	        vector<ViInt64> intSums(nbrSamples);
+	        nbrWaveforms = state.avgP->Sums(&intSums[0]);
+	        sums.assign(intSums.begin(), intSums.end());
+	    }
+
+	    // With noise base subtraction the sums are relative to the noise base code; add it
+	    // back so that the suppressed samples sit at the noise base level
+	    ViReal64 vOffset = desc.vOffset;
+	    if (state.cfg.thresholdEnable && state.cfg.noiseBaseEnable)
+	        vOffset -= state.cfg.noiseBase * desc.vGain;
+
+	    ViReal64 const scale = (nbrWaveforms > 0) ? desc.vGain / nbrWaveforms : 0.0;
+	    vector<ViReal32> volts(nbrSamples);
+	    for (long i = 0; i < nbrSamples; i++)
+	        volts[i] = ViReal32(sums[i] * scale - vOffset);
+
+	    AvgSegments avg;
+	    avg.nbrSamples = nbrSamples;
+	    avg.nbrSegments = 1;
+	    avg.nbrAvgWforms = ViInt32(nbrWaveforms);
+	    avg.sampTime = desc.sampTime;
+	    avg.volts = volts;
+	    avg.segDesc.resize(1);
+	    ::memset(&avg.segDesc[0], 0, sizeof(AqSegmentDescriptorAvg));
+
+	    cout << "Averaged " << nbrWaveforms << " waveforms in " << seconds << " s ("
+	         << nbrWaveforms / seconds << " waveforms/s)" << endl;
+	    cout << "Averaging thread was busy on " << ring.Stalls() << " readouts" << endl;
+
+	    if (WriteAvgSegments("Acqiris.bin", avg))
+	        cout << "Saved the average to \"Acqiris.bin\"" << endl;
+
+	    delete state.avgP;
+	    delete state.alignP;
+	}
+
+    status = Acqrs_close(instrID);
+	CHECK_API_CALL("Acqrs_close", status);
+
+    status = Acqrs_closeAll();
+	CHECK_API_CALL("Acqrs_closeAll", status);
+
+    return 0;
+}
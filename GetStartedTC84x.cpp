@@ -4,6 +4,8 @@
 //
 //  This is a very simple sample program to demonstrate the TC840 or TC842 instrument.
 //  It starts an acquisition and writes the resulting data to a file called "TC84x.data".
+//  The events also fill time histograms per channel and per channel pair (see
+//  TdcEvents.h), written to "TC84xTOF.txt".
 //
 //----------------------------------------------------------------------------------------
 //
@@ -16,6 +18,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "TdcEvents.h"
+
 int main(int argc, char *argv[])
 {
     // Initialize the instrument
@@ -58,6 +62,17 @@ int main(int argc, char *argv[])
     if (outFile == NULL)
         return printf("Couldn't open output file \"TC84x.data\"");
 
+    // Histograms of the 12 channel times, 100 ps bins up to 1 us, every event
+    TdcEventConfig eventConfig;
+    eventConfig.nbrChannels = 12;
+    eventConfig.countUnit = 0.0;    // unused, the times are in seconds
+    eventConfig.binWidth = 100.0e-12;
+    eventConfig.nbrBins = 10000;
+    eventConfig.nbrPairBins = 4000;
+    eventConfig.requireMask = 0;
+    eventConfig.window = 0.0;
+    TdcEventEngine events(1, eventConfig);
+
     long const nbrAcq = 1;
     for (long nAcq = 0 ; nAcq < nbrAcq ; ++nAcq)
     {
@@ -75,6 +90,8 @@ int main(int argc, char *argv[])
         printf("got %d samples\n", (int)dataDesc.nbrSamples);
 
         // We can assume the number of returned samples is a multiple of 12
+        events.AddRows((ViReal64 const *)dataDesc.dataPtr, dataDesc.nbrSamples/12, 12);
+
         for (int n = 0 ; n < dataDesc.nbrSamples/12 ; ++n)
         {
             ViReal64 *countP = ((ViReal64 *)dataDesc.dataPtr) + n*12;
@@ -94,6 +111,10 @@ int main(int argc, char *argv[])
 
     fclose(outFile);
 
+    printf("%.0f events histogrammed.\n", double(events.Stats().nbrAccepted));
+    if (!events.WriteHistograms("TC84xTOF.txt"))
+        printf("Couldn't write \"TC84xTOF.txt\"\n");
+
     // Stop the acquisition
     status = AcqrsT3_stopAcquisition(idInstr);
 
@@ -0,0 +1,322 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedTC84xStream.cpp
+//
+//  Multi-acquisition TC840 or TC842 loop that keeps up with high event rates. Unlike
+//  GetStartedTC84x the events are read with 'ReadInt32', as counts of the time
+//  resolution, and never printed. Every acquisition is re-armed as soon as it is read;
+//  a second thread then appends the events of the acquisition in columns to the binary
+//  file "TC84x.bin" and fills the time histograms (see TdcEvents.h, "TC84xTOF.txt")
+//  while the next acquisition runs. The counts are only converted to seconds for the
+//  histograms.
+//
+//  TC84x.bin:
+//  - Tc84xFileHeader
+//  - per acquisition: Tc84xBlockHeader, then 'nbrChannels' columns of 'nbrEvents'
+//    ViInt32 counts, channel 0 first. A count <= 0 means no hit.
+//
+//  Usage: GetStartedTC84xStream [nbrAcq [-nohisto]]
+//         GetStartedTC84xStream -bench      (no instrument needed)
+//
+//  The benchmark writes the same synthetic events once as text, as GetStartedTC84x
+//  does, and once as binary columns, and reports both rates.
+//
+//----------------------------------------------------------------------------------------
+//
+//  Copyright Agilent Technologies Inc. 2000, 200-2009
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#include <AcqirisImport.h>
+#include <AcqirisT3Import.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "SlotRing.h"
+#include "TdcEvents.h"
+
+
+long const nbrChannels = 12;            // values per event
+double const countUnit = 50.0e-12;      // time resolution, seconds per count
+
+struct Tc84xFileHeader
+{
+    char magic[8];                      // "AQT84C1"
+    ViInt32 nbrChannels;
+    ViInt32 reserved;
+    ViReal64 countUnit;                 // seconds per count
+};
+
+struct Tc84xBlockHeader
+{
+    char magic[4];                      // "T4B1"
+    ViInt32 acquisition;
+    ViInt32 nbrEvents;
+    ViInt32 reserved;
+};
+
+// One acquisition as read
+struct Tc84xBlock
+{
+    std::vector<char> dataArray;
+    long firstByte;                     // of the events in 'dataArray'
+    long nbrEvents;
+    long acquisition;
+};
+
+// Output and totals of the writer thread
+struct WriterStats
+{
+    FILE *outFile;
+    TdcEventEngine *eventsP;            // NULL: no histograms
+    std::vector<ViInt32> columns;       // work space
+    long nbrBlocks;
+    double nbrEvents;
+    bool writeError;
+};
+
+
+// Events of 'nbrEvents' rows as columns behind a block header
+bool WriteColumns(FILE *outFile, long acquisition, ViInt32 const *rowsP, long nbrEvents,
+                  std::vector<ViInt32> &columns)
+{
+    columns.resize(nbrChannels * nbrEvents + 1);
+    for (long n = 0 ; n < nbrEvents ; ++n)
+        for (long ch = 0 ; ch < nbrChannels ; ++ch)
+            columns[ch * nbrEvents + n] = rowsP[n * nbrChannels + ch];
+
+    Tc84xBlockHeader header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, "T4B1", 4);
+    header.acquisition = ViInt32(acquisition);
+    header.nbrEvents = ViInt32(nbrEvents);
+
+    return fwrite(&header, sizeof(header), 1, outFile) == 1
+        && fwrite(&columns[0], sizeof(ViInt32), nbrChannels * nbrEvents, outFile) == size_t(nbrChannels * nbrEvents);
+}
+
+bool WriteFileHeader(FILE *outFile)
+{
+    Tc84xFileHeader header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, "AQT84C1", 8);
+    header.nbrChannels = ViInt32(nbrChannels);
+    header.countUnit = countUnit;
+    return fwrite(&header, sizeof(header), 1, outFile) == 1;
+}
+
+
+// Writer thread: blocks in acquisition order to the file and the histograms
+void WriteEvents(SlotRing<Tc84xBlock> *ringP, WriterStats *statsP)
+{
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        Tc84xBlock const &block = (*ringP)[idx];
+        ViInt32 const *rowsP = (ViInt32 const *)&block.dataArray[block.firstByte];
+
+        if (!WriteColumns(statsP->outFile, block.acquisition, rowsP, block.nbrEvents, statsP->columns))
+            statsP->writeError = true;
+
+        if (statsP->eventsP != NULL)
+            statsP->eventsP->AddRows(rowsP, block.nbrEvents, nbrChannels);
+
+        ringP->Release();
+        ++statsP->nbrBlocks;
+        statsP->nbrEvents += block.nbrEvents;
+    }
+}
+
+
+// Synthetic events, written as text like GetStartedTC84x and as binary columns
+int Benchmark()
+{
+    long const nbrEvents = 200000;
+    std::vector<ViInt32> rows(nbrEvents * nbrChannels);
+    unsigned int seed = 2468;
+    for (size_t n = 0 ; n < rows.size() ; ++n)
+    {
+        seed = seed * 1103515245u + 12345u;
+        rows[n] = ViInt32((seed >> 8) % 20000);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    FILE *textFile = fopen("TC84xBench.data", "w");
+    if (textFile == NULL)
+        return printf("Couldn't open output file \"TC84xBench.data\"\n"), 1;
+    for (long n = 0 ; n < nbrEvents ; ++n)
+    {
+        fprintf(textFile, "%li", n);
+        for (int i = 0 ; i < nbrChannels ; ++i)
+            fprintf(textFile, "\t%g", rows[n * nbrChannels + i] * countUnit);
+        fprintf(textFile, "\n");
+    }
+    fclose(textFile);
+    double const textSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    FILE *binFile = fopen("TC84xBench.bin", "wb");
+    if (binFile == NULL)
+        return printf("Couldn't open output file \"TC84xBench.bin\"\n"), 1;
+    std::vector<ViInt32> columns;
+    bool ok = WriteFileHeader(binFile);
+    long const eventsPerAcq = 1109;     // about 53248 bytes of Real64 per acquisition
+    for (long n = 0 ; n < nbrEvents ; n += eventsPerAcq)
+        ok = WriteColumns(binFile, n / eventsPerAcq, &rows[n * nbrChannels],
+                          (n + eventsPerAcq < nbrEvents) ? eventsPerAcq : nbrEvents - n, columns) && ok;
+    ok = (fclose(binFile) == 0) && ok;
+    double const binSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    remove("TC84xBench.data");
+    remove("TC84xBench.bin");
+
+    printf("Text:   %g events/s\n", nbrEvents / textSeconds);
+    printf("Binary: %g events/s%s\n", nbrEvents / binSeconds, ok ? "" : ", WRITE ERROR");
+    return ok ? 0 : 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+        return Benchmark();
+
+    long const nbrAcq = (argc > 1) ? atol(argv[1]) : 100;
+    bool const histograms = !(argc > 2 && strcmp(argv[2], "-nohisto") == 0);
+    if (nbrAcq < 1)
+        return printf("Usage: GetStartedTC84xStream [nbrAcq [-nohisto]]\n"), 1;
+
+    // Initialize the instrument
+    ViSession idInstr;
+    ViStatus status = Acqrs_InitWithOptions((ViRsrc)"PCI::INSTR0", VI_FALSE,
+        VI_FALSE, "CAL=0", &idInstr);
+
+    if (status != VI_SUCCESS)
+        return printf("No instrument found.\n"), 1;
+
+    // Configure mode standard
+    ViInt32 modeStandard = 1;
+    ViInt32 modifier = 1;     // enable multi-starts
+    ViInt32 flags = 0;        // If you don't have an input signal, set this to 2
+                              // to enable the on-board test signal
+    status = AcqrsT3_configMode(idInstr, modeStandard, modifier, flags);
+
+    // Configure channels, common on negative slope, other left on positive
+    ViInt32 slope = 1;
+    ViReal64 threshold = 0.0;
+    status = AcqrsT3_configChannel(idInstr, -1, slope, threshold, 0);
+
+    // Host blocks of one acquisition each
+    size_t const arraySize = 53248;
+    long const nbrBlocks = 8;
+
+    SlotRing<Tc84xBlock> ring(nbrBlocks);
+    for (long n = 0 ; n < ring.Size() ; ++n)
+        ring[n].dataArray.resize(arraySize);
+
+    AqT3ReadParameters readParam;
+    ::memset(&readParam, 0, sizeof(readParam));
+    readParam.dataSizeInBytes = arraySize;
+    readParam.nbrSamples = 0;
+    readParam.dataType = ReadInt32;
+    readParam.readMode = AqT3ReadStandard;
+
+    // Histograms of the 12 channel times, 100 ps bins up to 1 us, every event
+    TdcEventConfig eventConfig;
+    eventConfig.nbrChannels = nbrChannels;
+    eventConfig.countUnit = countUnit;
+    eventConfig.binWidth = 100.0e-12;
+    eventConfig.nbrBins = 10000;
+    eventConfig.nbrPairBins = 4000;
+    eventConfig.requireMask = 0;
+    eventConfig.window = 0.0;
+    TdcEventEngine events(1, eventConfig);
+
+    WriterStats stats;
+    stats.outFile = fopen("TC84x.bin", "wb");
+    stats.eventsP = histograms ? &events : NULL;
+    stats.nbrBlocks = 0;
+    stats.nbrEvents = 0.0;
+    stats.writeError = false;
+    if (stats.outFile == NULL)
+    {
+        printf("Couldn't open output file \"TC84x.bin\"\n");
+        Acqrs_closeAll();
+        return 1;
+    }
+    if (!WriteFileHeader(stats.outFile))
+        stats.writeError = true;
+
+    std::thread writer(WriteEvents, &ring, &stats);
+
+    // Calibrate instrument (as we explicitely specified not to on init)
+    status = Acqrs_calibrate(idInstr);
+
+    // Start the first acquisition
+    status = AcqrsT3_acquire(idInstr);
+
+    long nbrTimeouts = 0;
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+    for (long nAcq = 0 ; nAcq < nbrAcq ; ++nAcq)
+    {
+        // Waits only if the writer is 'nbrBlocks' acquisitions behind
+        long const idx = ring.WaitFree();
+        Tc84xBlock &block = ring[idx];
+
+        // Wait for end of acquisition
+        status = AcqrsT3_waitForEndOfAcquisition(idInstr, 8000);
+        if (status != VI_SUCCESS)
+            ++nbrTimeouts;
+
+        AqT3DataDescriptor dataDesc;
+        ::memset(&dataDesc, 0, sizeof(dataDesc));
+        readParam.dataArray = &block.dataArray[0];
+
+        // Read acquired data
+        status = AcqrsT3_readData(idInstr, 0, &readParam, &dataDesc);
+
+        // Start the next acquisition before the events are written
+        if (nAcq + 1 < nbrAcq)
+        {
+            ViStatus const acqStatus = AcqrsT3_acquire(idInstr);
+            if (acqStatus != VI_SUCCESS)
+                printf("Error: acquire %d (%08x)\n", (int)acqStatus, (int)acqStatus);
+        }
+
+        // We can assume the number of returned samples is a multiple of 12
+        block.firstByte = (status == VI_SUCCESS) ? long((char *)dataDesc.dataPtr - &block.dataArray[0]) : 0;
+        block.nbrEvents = (status == VI_SUCCESS) ? long(dataDesc.nbrSamples / nbrChannels) : 0;
+        block.acquisition = nAcq;
+        ring.Publish();
+    }
+
+    // Stop the acquisition
+    status = AcqrsT3_stopAcquisition(idInstr);
+
+    ring.Close();
+    writer.join();
+
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (fclose(stats.outFile) != 0)
+        stats.writeError = true;
+
+    printf("%ld acquisitions, %.0f events in %g s (%g events/s), %ld wait timeouts.\n",
+           stats.nbrBlocks, stats.nbrEvents, seconds, stats.nbrEvents / seconds, nbrTimeouts);
+    printf("The acquisition loop waited %ld times for the writer.\n", ring.Stalls());
+    if (stats.writeError)
+        printf("Error: writing TC84x.bin failed\n");
+    if (histograms && !events.WriteHistograms("TC84xTOF.txt"))
+        printf("Couldn't write \"TC84xTOF.txt\"\n");
+
+    // Close the instruments
+    status = Acqrs_closeAll();
+
+    return 0;
+}
@@ -18,6 +18,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "Tc890Decode.h"
+
 int main(int argc, char *argv[])
 {
     // Initializes instrument
@@ -67,6 +69,7 @@ int main(int argc, char *argv[])
     // Start acquisitions
 	status = AcqrsT3_acquire(idInstr);
 
+    Tc890Decoder decoder;
     long countLast = 0;
 
     long const nbrSwitch = 12;
@@ -84,25 +87,14 @@ int main(int argc, char *argv[])
         // Marks read buffer as to-be-used for acquisition (enables next switch)
         status = AcqrsT3_acquire(idInstr);
 
-        // Simple check not to miss any common hit
-        for (int n = 0 ; n < dataDesc.nbrSamples ; ++n)
-        {
-            long sample = ((long *)dataDesc.dataPtr)[n];
-            long flag = (sample & 0x80000000) >> 31;
-            long channel = (sample & 0x70000000) >> 28;
-            long count = sample & 0x0FFFFFFF;
-
-            if (flag == 0 && channel == 0)
-            {
-                if (count - countLast != 1)
-                    printf("Error: Gap in common count between %ld and %ld\n", countLast, count);
-
-				//printf("%d%c", count, 13);
-                countLast = count;
-
-            }
+        // Simple check not to miss any common hit (see Tc890Decode.h)
+        decoder.Decode((ViUInt32 const *)dataDesc.dataPtr, dataDesc.nbrSamples);
 
-        }
+        for (size_t n = 0 ; n < decoder.Gaps().size() ; ++n)
+            printf("Error: Gap in common count between %u and %u\n",
+                   (unsigned int)decoder.Gaps()[n].countLast, (unsigned int)decoder.Gaps()[n].count);
+        decoder.ClearGaps();
+        countLast = long(decoder.CountLast());
 
         printf("Readout %ld (%d) last common %ld.\n", nSwitch, (int)dataDesc.nbrSamples, countLast);
         fflush(stdout);
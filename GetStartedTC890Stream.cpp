@@ -0,0 +1,555 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  GetStartedTC890Stream.cpp
+//
+//  Continuous TC890 acquisition where the readout never waits for the analysis. Like
+//  GetStartedTC890 it uses the internal signal ~10MHz to generate events. On every bank
+//  switch the bank is copied into a ring of host blocks and re-armed at once with
+//  AcqrsT3_acquire(). A second thread takes the blocks in order, optionally writes them
+//  unchanged to "AcqirisTC890.raw" and decodes them (see Tc890Decode.h), checking the
+//  common channel event counter not to miss any. The decoded banks are also built into
+//  start-stop events (see TdcEvents.h) which fill time-of-flight histograms per channel
+//  and per channel pair, written to "AcqirisTOF.txt" at the end. With -coinc only the
+//  events with a hit on every channel of 'mask' (hexadecimal, bit 1 = channel 1, ...)
+//  within 'window' ns are histogrammed. With -hits the words are also stored
+//  compressed (see TdcHitStream.h) to "AcqirisTC890.hits".
+//
+//  When every host block is still waiting for the analysis, the bank is read into a
+//  spare block and dropped (counted): the time between bank switches only depends on
+//  the readout, never on the analysis. A dropped bank shows as a gap in the common count.
+//
+//  Usage: GetStartedTC890Stream [nbrSwitch [-raw] [-hits] [-nodecode] [-coinc mask window]]
+//         GetStartedTC890Stream -bench      (no instrument needed)
+//
+//  The benchmark decodes synthetic banks with Tc890Decoder::Split() on one core, checks
+//  the result against a word by word decoding and reports both rates. It then builds
+//  the events of synthetic banks on one and on several threads, checking that both give
+//  the same histograms, and encodes and decodes the banks with TdcHitStream.h, checking
+//  that the words come back unchanged.
+//
+//----------------------------------------------------------------------------------------
+//
+//  Copyright Agilent Technologies Inc., 2000, 2001-2009
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#include <AcqirisImport.h>
+#include <AcqirisT3Import.h>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "SlotRing.h"
+#include "Tc890Decode.h"
+#include "TdcEvents.h"
+#include "TdcHitStream.h"
+
+
+// One bank as read
+struct Tc890Block
+{
+    std::vector<char> dataArray;
+    long firstByte;                     // of the words in 'dataArray'
+    long nbrWords;
+    long nbrSwitch;
+};
+
+struct Tc890RawHeader
+{
+    char magic[4];                      // "T3R1"
+    ViInt32 nbrSwitch;
+    ViInt32 nbrWords;                   // 32-bit words that follow
+    ViInt32 reserved;
+};
+
+// Options and totals of the analysis thread
+struct AnalysisStats
+{
+    FILE *rawFile;                      // NULL: no raw output
+    FILE *hitsFile;                     // NULL: no compressed output
+    TdcHitEncoder encoder;
+    std::vector<ViUInt8> encoded;
+    bool decode;
+    Tc890Decoder decoder;
+    TdcEventEngine *eventsP;            // with 'decode'
+    long nbrBlocks;
+    long lastSwitch;                    // of the last block analysed, -1 before the first
+    bool writeError;
+};
+
+
+// Analysis thread: raw output and decoding of the blocks in bank order
+void AnalyseBlocks(SlotRing<Tc890Block> *ringP, AnalysisStats *statsP)
+{
+    long idx;
+
+    while ((idx = ringP->WaitFilled()) >= 0)
+    {
+        Tc890Block const &block = (*ringP)[idx];
+        ViUInt32 const *wordsP = (ViUInt32 const *)&block.dataArray[block.firstByte];
+
+        if (statsP->rawFile != NULL)
+        {
+            Tc890RawHeader header;
+            ::memset(&header, 0, sizeof(header));
+            ::memcpy(header.magic, "T3R1", 4);
+            header.nbrSwitch = ViInt32(block.nbrSwitch);
+            header.nbrWords = ViInt32(block.nbrWords);
+            if (fwrite(&header, sizeof(header), 1, statsP->rawFile) != 1
+                || fwrite(wordsP, sizeof(ViUInt32), block.nbrWords, statsP->rawFile) != size_t(block.nbrWords))
+                statsP->writeError = true;
+        }
+
+        if (statsP->hitsFile != NULL)
+        {
+            statsP->encoded.clear();
+            statsP->encoder.Encode(wordsP, block.nbrWords, statsP->encoded);
+            if (!statsP->encoded.empty()
+                && fwrite(&statsP->encoded[0], 1, statsP->encoded.size(), statsP->hitsFile) != statsP->encoded.size())
+                statsP->writeError = true;
+        }
+
+        if (statsP->decode)
+        {
+            Tc890Decoder &decoder = statsP->decoder;
+            decoder.Decode(wordsP, block.nbrWords);
+
+            for (size_t n = 0 ; n < decoder.Gaps().size() ; ++n)
+                printf("Error: Gap in common count between %u and %u\n",
+                       (unsigned int)decoder.Gaps()[n].countLast, (unsigned int)decoder.Gaps()[n].count);
+            decoder.ClearGaps();
+
+            // A bank dropped into the spare block ends the open event
+            if (block.nbrSwitch != statsP->lastSwitch + 1)
+                statsP->eventsP->DropOpenEvent();
+            statsP->eventsP->AddTc890(wordsP, block.nbrWords);
+
+            printf("Readout %ld (%ld) last common %u.\n", block.nbrSwitch, block.nbrWords,
+                   (unsigned int)decoder.CountLast());
+            fflush(stdout);
+        }
+
+        statsP->lastSwitch = block.nbrSwitch;
+        ringP->Release();
+        ++statsP->nbrBlocks;
+    }
+}
+
+
+// Synthetic banks: 27 % common hits counting up with a gap now and then, 3 % markers,
+// the rest on channels 1 to 6
+int Benchmark()
+{
+    std::vector<ViUInt32> words(2 * 1024 * 1024);
+    unsigned int seed = 12345;
+    ViUInt32 common = 0;
+    for (size_t n = 0 ; n < words.size() ; ++n)
+    {
+        seed = seed * 1103515245u + 12345u;
+        unsigned int const r = (seed >> 8) % 100;
+        if (r < 3)
+            words[n] = 0x80000000u | (seed & 0x7fffffff);
+        else if (r < 30)
+        {
+            common = (common + (((seed >> 4) % 10000 == 0) ? 5 : 1)) & Tc890CountMask;
+            words[n] = common;
+        }
+        else
+            words[n] = ((1 + (seed >> 20) % 6) << 28) | ((seed >> 3) & Tc890CountMask);
+    }
+
+    // Word by word, as in GetStartedTC890
+    long const nbrPasses = 20;
+    std::vector<ViUInt32> reference[Tc890NbrChannels];
+    long nbrGaps = 0, nbrMarkers = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long pass = 0 ; pass < nbrPasses ; ++pass)
+    {
+        long countLast = -1;
+        nbrGaps = nbrMarkers = 0;
+        for (int ch = 0 ; ch < Tc890NbrChannels ; ++ch)
+            reference[ch].clear();
+        for (size_t n = 0 ; n < words.size() ; ++n)
+        {
+            long const sample = words[n];
+            long const flag = (sample & 0x80000000) >> 31;
+            long const channel = (sample & 0x70000000) >> 28;
+            long const count = sample & 0x0FFFFFFF;
+
+            if (flag != 0)
+            {
+                ++nbrMarkers;
+                continue;
+            }
+            reference[channel].push_back(ViUInt32(count));
+            if (channel == 0)
+            {
+                if (countLast >= 0 && count - countLast != 1)
+                    ++nbrGaps;
+                countLast = count;
+            }
+        }
+    }
+    double const scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Tc890Decoder decoder;
+    Tc890Split split;
+    start = std::chrono::steady_clock::now();
+    for (long pass = 0 ; pass < nbrPasses ; ++pass)
+    {
+        decoder.Reset();
+        decoder.Split(&words[0], long(words.size()), split);
+    }
+    double const splitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool same = long(decoder.NbrGaps()) == nbrGaps && long(decoder.NbrMarkers()) == nbrMarkers;
+    for (int ch = 0 ; ch < Tc890NbrChannels ; ++ch)
+        same = same && split.counts[ch] == reference[ch];
+
+    double const nbrWords = double(nbrPasses) * words.size();
+    printf("Word by word: %g Mwords/s\n", nbrWords / scalarSeconds / 1.0e6);
+    printf("Split:        %g Mwords/s (%g MB/s of raw data), %s\n", nbrWords / splitSeconds / 1.0e6,
+           nbrWords * sizeof(ViUInt32) / splitSeconds / 1.0e6, same ? "same result" : "RESULTS DIFFER");
+    printf("%ld gaps, %ld markers, common hits %ld\n", nbrGaps, nbrMarkers, (long)split.counts[0].size());
+    return same ? 0 : 1;
+}
+
+
+// Time-of-flight histograms of the TC890 internal signal: one bin is 5 counts
+TdcEventConfig EventConfig(ViUInt32 requireMask, double window)
+{
+    TdcEventConfig cfg;
+    cfg.nbrChannels = Tc890NbrChannels;
+    cfg.countUnit = 50.0e-12;           // resolution of the stop counts
+    cfg.binWidth = 5 * cfg.countUnit;
+    cfg.nbrBins = 4096;
+    cfg.nbrPairBins = 2048;
+    cfg.requireMask = requireMask;
+    cfg.window = window;
+    return cfg;
+}
+
+// Synthetic events: a common hit, then 0 to 3 hits on channel 1 around 40 ns and most
+// of the time one hit on channel 2, 12.6 ns after the first one of channel 1
+void EventWords(std::vector<ViUInt32> &words)
+{
+    words.clear();
+    words.reserve(2 * 1024 * 1024);
+    unsigned int seed = 4321;
+    ViUInt32 common = 0;
+    while (words.size() + 8 < words.capacity())
+    {
+        words.push_back(common++ & Tc890CountMask);
+        seed = seed * 1103515245u + 12345u;
+        int const nbrHits = (seed >> 16) % 4;
+        ViUInt32 const first = 800 + (seed >> 4) % 16;
+        for (int i = 0 ; i < nbrHits ; ++i)
+            words.push_back((1u << 28) | (first + 100 * i));
+        if (nbrHits > 0 && (seed >> 20) % 10 != 0)
+            words.push_back((2u << 28) | (first + 252));
+        if ((seed >> 24) % 50 == 0)
+            words.push_back(0x80000000u);
+    }
+}
+
+int BenchmarkEvents()
+{
+    std::vector<ViUInt32> words;
+    EventWords(words);
+
+    // The same stream in banks of 1 MB, on one thread and on at least 4 of them
+    long const bankWords = 256 * 1024;
+    int const nbrThreads = std::max(4, (int)std::thread::hardware_concurrency());
+    TdcEventEngine single(1, EventConfig(0x6, 20.0e-9));
+    TdcEventEngine multi(nbrThreads, EventConfig(0x6, 20.0e-9));
+
+    long const nbrPasses = 10;
+    double seconds[2] = {0.0, 0.0};
+    TdcEventEngine *engines[2] = {&single, &multi};
+    for (int e = 0 ; e < 2 ; ++e)
+    {
+        std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+        for (long pass = 0 ; pass < nbrPasses ; ++pass)
+            for (long n = 0 ; n < long(words.size()) ; n += bankWords)
+                engines[e]->AddTc890(&words[n], std::min<long>(bankWords, long(words.size()) - n));
+        seconds[e] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    TdcEventConfig const &cfg = single.Config();
+    bool same = single.Stats().nbrEvents == multi.Stats().nbrEvents
+                && single.Stats().nbrAccepted == multi.Stats().nbrAccepted;
+    for (long ch = 0 ; ch < cfg.nbrChannels ; ++ch)
+        same = same && std::equal(single.ChannelHistogram(ch), single.ChannelHistogram(ch) + cfg.nbrBins,
+                                  multi.ChannelHistogram(ch));
+    for (long a = 0 ; a < cfg.nbrChannels ; ++a)
+        for (long b = a + 1 ; b < cfg.nbrChannels ; ++b)
+            same = same && std::equal(single.PairHistogram(a, b), single.PairHistogram(a, b) + cfg.nbrPairBins,
+                                      multi.PairHistogram(a, b));
+
+    // The most filled bin of channel 2 - channel 1 starts at 12.5 ns
+    ViUInt64 const *pairP = single.PairHistogram(1, 2);
+    long const peak = long(std::max_element(pairP, pairP + cfg.nbrPairBins) - pairP);
+
+    double const nbrWords = double(nbrPasses) * words.size();
+    printf("Events, 1 thread:  %g Mwords/s\n", nbrWords / seconds[0] / 1.0e6);
+    printf("Events, %d threads: %g Mwords/s, %s\n", nbrThreads, nbrWords / seconds[1] / 1.0e6,
+           same ? "same histograms" : "HISTOGRAMS DIFFER");
+    printf("%.0f events, %.0f with channels 1 and 2, peak of channel 2 - channel 1 at %g ns\n",
+           double(single.Stats().nbrEvents), double(single.Stats().nbrAccepted),
+           single.PairBinLowEdge(peak) * 1.0e9);
+    return same ? 0 : 1;
+}
+
+
+// Synthetic events in banks of 1 MB, compressed and back
+int BenchmarkHits()
+{
+    std::vector<ViUInt32> words;
+    EventWords(words);
+    long const bankWords = 256 * 1024;
+
+    TdcHitEncoder encoder;
+    std::vector<ViUInt8> encoded;
+    long const nbrPasses = 10;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long pass = 0 ; pass < nbrPasses ; ++pass)
+    {
+        encoder.Reset();
+        encoded.clear();
+        for (long n = 0 ; n < long(words.size()) ; n += bankWords)
+            encoder.Encode(&words[n], std::min<long>(bankWords, long(words.size()) - n), encoded);
+    }
+    double const encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    TdcHitDecoder decoder;
+    std::vector<ViUInt32> decoded;
+    bool valid = true;
+    start = std::chrono::steady_clock::now();
+    for (long pass = 0 ; pass < nbrPasses ; ++pass)
+    {
+        decoded.clear();
+        for (size_t at = 0 ; valid && at < encoded.size() ; )
+        {
+            size_t const blockSize = decoder.Decode(&encoded[at], encoded.size() - at, decoded);
+            valid = blockSize != 0;
+            at += blockSize;
+        }
+    }
+    double const decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool const same = valid && decoded == words;
+    double const nbrWords = double(nbrPasses) * words.size();
+    printf("Hits: %.0f bytes for %.0f raw bytes (%.2f bits per word), %s\n", double(encoded.size()),
+           double(words.size() * sizeof(ViUInt32)), 8.0 * encoded.size() / words.size(),
+           same ? "same words" : "WORDS DIFFER");
+    printf("Hits: encode %g Mwords/s, decode %g Mwords/s\n", nbrWords / encodeSeconds / 1.0e6,
+           nbrWords / decodeSeconds / 1.0e6);
+    return same ? 0 : 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+        return (Benchmark() | BenchmarkEvents() | BenchmarkHits()) != 0 ? 1 : 0;
+
+    long const nbrSwitch = (argc > 1) ? atol(argv[1]) : 100;
+    bool writeRaw = false, writeHits = false, decode = true;
+    ViUInt32 requireMask = 0;
+    double window = 0.0;
+    for (int n = 2 ; n < argc ; ++n)
+    {
+        if (strcmp(argv[n], "-raw") == 0)
+            writeRaw = true;
+        else if (strcmp(argv[n], "-hits") == 0)
+            writeHits = true;
+        else if (strcmp(argv[n], "-nodecode") == 0)
+            decode = false;
+        else if (strcmp(argv[n], "-coinc") == 0 && n + 2 < argc)
+        {
+            requireMask = ViUInt32(strtoul(argv[n + 1], NULL, 16));
+            window = atof(argv[n + 2]) * 1.0e-9;
+            n += 2;
+        }
+    }
+    if (nbrSwitch < 1)
+        return printf("Usage: GetStartedTC890Stream [nbrSwitch [-raw] [-hits] [-nodecode] [-coinc mask window]]\n"), 1;
+
+    // Initializes instrument
+    ViSession idInstr;
+    ViStatus status = Acqrs_InitWithOptions((ViRsrc)"PCI::INSTR0", VI_FALSE,
+            VI_FALSE, "CAL=0", &idInstr);
+
+    if (status != VI_SUCCESS)
+        return printf("No instrument found.\n"), 1;
+
+    // Configure mode continuous and enable internal test signal
+    ViInt32 modeContinuous = 2;
+    status = AcqrsT3_configMode(idInstr, modeContinuous, 1, 2);
+
+    // Configure timeout to very large
+    ViReal64 timeout = 8.0;
+    ViInt32 flags = 0;
+    status = AcqrsT3_configAcqConditions(idInstr, timeout, flags, 0);
+
+    // Configure bank switch on full size (8MB)
+    ViInt32 switchEnable = 0x04;
+    ViInt32 countEvents = 200000;  // unused, for demo purpose only
+    ViInt32 memorySize = 1 * 1024 * 1024;
+    status = AcqrsT3_configMemorySwitch(idInstr, switchEnable, countEvents,
+            memorySize, 0);
+
+    // Configure channels, common on negative slope, other left on positive
+    ViInt32 slope = 1;
+    ViReal64 threshold = 0.0;
+    status = AcqrsT3_configChannel(idInstr, -1, slope, threshold, 0);
+
+    // Host blocks of one bank each, plus the spare block for dropped banks
+    size_t const arraySize = 8 * 1024 * 1024;
+    long const nbrBlocks = 8;
+
+    SlotRing<Tc890Block> ring(nbrBlocks);
+    for (long n = 0 ; n < ring.Size() ; ++n)
+        ring[n].dataArray.resize(arraySize);
+    Tc890Block spare;
+    spare.dataArray.resize(arraySize);
+
+    AqT3ReadParameters readParam;
+    ::memset(&readParam, 0, sizeof(readParam));
+    readParam.dataSizeInBytes = arraySize;
+    readParam.nbrSamples = 0;
+    readParam.dataType = ReadRawData;
+    readParam.readMode = AqT3ReadContinuous;
+
+    // The event building shares the analysis thread with one helper thread per core left
+    int const nbrEventThreads = std::max(1, (int)std::thread::hardware_concurrency() - 2);
+    TdcEventEngine events(nbrEventThreads, EventConfig(requireMask, window));
+
+    AnalysisStats stats;
+    stats.rawFile = NULL;
+    stats.hitsFile = NULL;
+    stats.decode = decode;
+    stats.eventsP = &events;
+    stats.nbrBlocks = 0;
+    stats.lastSwitch = -1;
+    stats.writeError = false;
+    char const *createError = NULL;
+    if (writeRaw && (stats.rawFile = fopen("AcqirisTC890.raw", "wb")) == NULL)
+        createError = "AcqirisTC890.raw";
+    else if (writeHits && (stats.hitsFile = fopen("AcqirisTC890.hits", "wb")) == NULL)
+        createError = "AcqirisTC890.hits";
+    if (createError != NULL)
+    {
+        printf("Error: cannot create %s\n", createError);
+        if (stats.rawFile != NULL)
+            fclose(stats.rawFile);
+        Acqrs_closeAll();
+        return 1;
+    }
+
+    std::thread analysis(AnalyseBlocks, &ring, &stats);
+
+    // Calibrate instrument (as we specified not to on init)
+    status = Acqrs_calibrate(idInstr);
+
+    // Start acquisitions
+    status = AcqrsT3_acquire(idInstr);
+
+    long nbrRead = 0, nbrDropped = 0, nbrTimeouts = 0;
+    long maxReadUs = 0;
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+    for (long nSwitch = 0 ; nSwitch < nbrSwitch ; ++nSwitch)
+    {
+        // Wait for bank switch
+        status = AcqrsT3_waitForEndOfAcquisition(idInstr, 8000);
+        if (status != VI_SUCCESS)
+            ++nbrTimeouts;
+
+        std::chrono::steady_clock::time_point const readStart = std::chrono::steady_clock::now();
+
+        // Read into a free block, or into the spare one when the analysis is behind
+        long const idx = ring.TryFree();
+        Tc890Block &block = (idx >= 0) ? ring[idx] : spare;
+
+        AqT3DataDescriptor dataDesc;
+        ::memset(&dataDesc, 0, sizeof(dataDesc));
+        readParam.dataArray = &block.dataArray[0];
+
+        // Read acquired data (acquisition continues on other bank)
+        status = AcqrsT3_readData(idInstr, 0, &readParam, &dataDesc);
+
+        // Marks read buffer as to-be-used for acquisition (enables next switch)
+        ViStatus const acqStatus = AcqrsT3_acquire(idInstr);
+        if (acqStatus != VI_SUCCESS)
+            printf("Error: acquire %d (%08x)\n", (int)acqStatus, (int)acqStatus);
+
+        long const readUs = long(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - readStart).count());
+        maxReadUs = (readUs > maxReadUs) ? readUs : maxReadUs;
+
+        if (idx < 0)
+        {
+            ++nbrDropped;
+            continue;
+        }
+
+        block.firstByte = (status == VI_SUCCESS) ? long((char *)dataDesc.dataPtr - &block.dataArray[0]) : 0;
+        block.nbrWords = (status == VI_SUCCESS) ? long(dataDesc.nbrSamples) : 0;
+        block.nbrSwitch = nSwitch;
+        ring.Publish();
+        ++nbrRead;
+    }
+
+    // Stops the acquisition & close instruments
+    status = AcqrsT3_stopAcquisition(idInstr);
+
+    ring.Close();
+    analysis.join();
+
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (stats.rawFile != NULL && fclose(stats.rawFile) != 0)
+        stats.writeError = true;
+    if (stats.hitsFile != NULL && fclose(stats.hitsFile) != 0)
+        stats.writeError = true;
+
+    printf("Read %ld banks in %g s, longest read and re-arm %ld us, %ld wait timeouts.\n",
+           nbrRead + nbrDropped, seconds, maxReadUs, nbrTimeouts);
+    printf("Analysed %ld banks, dropped %ld the analysis could not keep up with.\n", stats.nbrBlocks, nbrDropped);
+    if (decode)
+    {
+        Tc890Decoder const &decoder = stats.decoder;
+        printf("%.0f words: %.0f common hits, %.0f markers, %.0f gaps in the common count.\n",
+               double(decoder.NbrWords()), double(decoder.NbrHits(0)), double(decoder.NbrMarkers()),
+               double(decoder.NbrGaps()));
+        for (int ch = 1 ; ch < Tc890NbrChannels ; ++ch)
+            if (decoder.NbrHits(ch) != 0)
+                printf("Channel %d: %.0f hits.\n", ch, double(decoder.NbrHits(ch)));
+
+        TdcEventStats const &eventStats = events.Stats();
+        printf("%.0f events, %.0f accepted with %.0f hits (%.0f lost, %.0f out of range).\n",
+               double(eventStats.nbrEvents), double(eventStats.nbrAccepted), double(eventStats.nbrHits),
+               double(eventStats.nbrLostHits), double(eventStats.nbrOutOfRange));
+        if (eventStats.nbrDropped != 0)
+            printf("%.0f open events dropped with the banks that were not analysed.\n",
+                   double(eventStats.nbrDropped));
+        if (!events.WriteHistograms("AcqirisTOF.txt"))
+            printf("Error: writing AcqirisTOF.txt failed\n");
+    }
+    if (stats.hitsFile != NULL)
+        printf("Compressed %.0f words to %.0f bytes (%.2f bits per word).\n", double(stats.encoder.NbrWords()),
+               double(stats.encoder.NbrBytes()),
+               stats.encoder.NbrWords() ? 8.0 * stats.encoder.NbrBytes() / stats.encoder.NbrWords() : 0.0);
+    if (stats.writeError)
+        printf("Error: writing the output files failed\n");
+
+    status = Acqrs_closeAll();
+
+    return 0;
+}
@@ -12,9 +12,19 @@
 #include <AcqirisD1Import.h>
 #include <stdio.h>
 #include <string.h>
+#include <vector>
+
+#include "GateStore.h"
+#include "PeakStream.h"
+#include "SsrBufferPool.h"
 
 int main(int argc, char *argv[])
 {
+	// The gates of every readout go to a store (see GateStore.h)
+	GateStore store;
+	if (!store.Create("AcqirisGates.bin"))
+		return fprintf(stderr, "ERROR: cannot create AcqirisGates.bin\n"), 1;
+
 	ViSession idInstrument;
 	ViStatus status = Acqrs_InitWithOptions((ViRsrc)"PCI::INSTR0", VI_FALSE,
 			VI_FALSE, "CAL=0", &idInstrument);
@@ -72,18 +82,22 @@ int main(int argc, char *argv[])
 	status = AcqrsD1_configAvgConfig(idInstrument, idChannel, "Threshold", &threshold);
 	status = AcqrsD1_configAvgConfig(idInstrument, idChannel, "InvertData", &invertData);
 
-	// Allocate buffers for readout
-	long const lenGate = 512; // need to be estimated 
-	long const nbrGates = 3;  // need to be estimated
+	// Readout buffers are sized from the measured readouts (see SsrBufferPool.h); the
+	// gates only give the size of the first one
+	long const lenGate = 512;
+	long const nbrGates = 3;
 	long const nbrSamplePerSeg = (8 + lenGate) * nbrGates;
-	long const nbrBytesAlloc = (8 + nbrSamplePerSeg) * nbrSegments;
+	long const nbrBytesInitial = (8 + nbrSamplePerSeg) * nbrSegments;
 
-	signed char *dataArray = new signed char[nbrBytesAlloc];
+	SsrBufferPool pool(nbrBytesInitial, SsrWorstCaseBytes(nbrSamples, nbrSegments));
+	SsrBuffer *bufferP = NULL;
 
 	AqReadParameters readParam;
 	AqDataDescriptor dataDesc;
 
-	printf("# Prepared readout for %ld bytes\n", nbrBytesAlloc);
+	PeakBatch storeBatch;
+
+	printf("# Prepared readout for %ld bytes, worst case %ld bytes\n", nbrBytesInitial, pool.WorstCaseBytes());
 
 	// Perform acquisitions
 	long nbrWforms = 10;
@@ -111,7 +125,6 @@ int main(int argc, char *argv[])
 
 		// Readout gated data (only the one of the last acquisition)
 		::memset(&readParam, 0, sizeof(readParam));
-		::memset(&dataDesc, 0, sizeof(dataDesc));
 		readParam.dataType = ReadInt8;
 		readParam.readMode = ReadModeSSRW;
 		readParam.firstSegment = 0;
@@ -119,48 +132,71 @@ int main(int argc, char *argv[])
 		readParam.firstSampleInSeg = 0;
 		readParam.nbrSamplesInSeg = nbrSamples;
 		readParam.segmentOffset = nbrSamples;
-		readParam.dataArraySize = nbrBytesAlloc;
 		readParam.segDescArraySize = 0;
 
-		status = AcqrsD1_readData(idInstrument, idChannel, &readParam, dataArray,
-								  &dataDesc, NULL);
+		if (bufferP != NULL)
+			pool.Put(bufferP);
+		bufferP = pool.Get();
+		status = pool.Read(idInstrument, idChannel, readParam, *bufferP, dataDesc);
 
 		if (status != VI_SUCCESS)
 		    printf("# readData() error %d (0x%08x)\n", (int)status, (int)status);
 
-		printf("# Read %d bytes: %d segments\n", (int)dataDesc.actualDataSize,
-			   (int)dataDesc.returnedSegments);
+		storeBatch.Clear();
+		if (status >= VI_SUCCESS
+			&& DecodePeakStream(&bufferP->data[0], dataDesc.actualDataSize, storeBatch) == PeakStreamOk
+			&& !store.Append(ViUInt32(nWform), storeBatch))
+			fprintf(stderr, "Error: writing AcqirisGates.bin failed\n");
+
+		printf("# Read %d bytes: %d segments (buffer of %ld bytes)\n", (int)dataDesc.actualDataSize,
+			   (int)dataDesc.returnedSegments, bufferP->Size());
 
 	}
 
-	// Print data of last readout
-	signed char const *dataP = dataArray;
-	signed char const * const dataEndP = dataArray + dataDesc.actualDataSize;
-	int nSeg = 0;
+	SsrBufferStats const& stats = pool.Stats();
+	printf("# Buffers of %.0f bytes on average against %ld worst case: %.0f bytes saved\n",
+		   pool.MeanBufferBytes(), pool.WorstCaseBytes(), pool.SavedBytes());
+	printf("# Largest readout %ld bytes, %ld allocations, %ld readouts repeated\n",
+		   stats.peakBytes, stats.nbrAllocations, stats.nbrRetries);
 
-	while (dataP[3] == 0x04 && dataP < dataEndP)
-    {
-        unsigned int const *segmentP = (unsigned int const *)dataP;
-		dataP += 8;
+	// Queries on the gate index, no samples are read
+	std::vector<long> longGates, lastGates;
+	store.SelectLongerThan(lenGate / 2, longGates);
+	if (storeBatch.NbrSegments() > 0)
+		store.SelectTimeRange(storeBatch.segTimeStamp.front(), storeBatch.segTimeStamp.back(), lastGates);
 
-		unsigned int tsHi = segmentP[0] & 0x00FFFFFF;
-		unsigned int tsLo = segmentP[1];
-        printf("# Segment %d, timestamp %06x:%08x\n", nSeg++, tsHi, tsLo);
+	printf("# Stored %ld gates (%.0f samples) of %ld segments, %ld longer than %ld samples, %ld in the last acquisition\n",
+		   store.NbrGates(), double(store.NbrBytes()), store.NbrSegments(), (long)longGates.size(), lenGate / 2,
+		   (long)lastGates.size());
+	if (!store.Close())
+		fprintf(stderr, "Error: writing AcqirisGates.bin failed\n");
 
-		int nGate = 0;
-
-		while (dataP[3] == 0x00 && dataP < dataEndP)
-		{
-		    unsigned int const *gateP = (unsigned int const *)dataP;
-			dataP += 8;
+	// Print data of last readout
+	PeakBatch batch;
+	long errorOffset = 0;
+	if (bufferP != NULL
+		&& DecodePeakStream(&bufferP->data[0], dataDesc.actualDataSize, batch, &errorOffset) != PeakStreamOk)
+		printf("# Invalid record at offset %ld\n", errorOffset);
+
+	// Gates before the first segment header belong to no segment
+	long nGate = (batch.NbrSegments() > 0) ? batch.segFirstGate[0] : batch.NbrGates();
+	if (nGate > 0)
+		printf("# %ld gates before the first segment header\n", nGate);
+
+	for (long nSeg = 0 ; nSeg < batch.NbrSegments() ; ++nSeg)
+    {
+		printf("# Segment %ld, timestamp %06x:%08x\n", nSeg, (unsigned int)(batch.segTimeStamp[nSeg] >> 32),
+			   (unsigned int)batch.segTimeStamp[nSeg]);
 
-			unsigned int const posGate = gateP[0] & 0x00FFFFFF;
-			unsigned int const lenGate = gateP[1];
-            printf("#   Gate %d: %u samples at position %u\n", nGate++, lenGate, posGate);
+		long const lastGate = (nSeg + 1 < batch.NbrSegments()) ? batch.segFirstGate[nSeg + 1] : batch.NbrGates();
 
-			signed char const *samplesP = dataP;
-			dataP += lenGate;
+		for ( ; nGate < lastGate ; ++nGate)
+		{
+			unsigned int const posGate = batch.gatePosition[nGate];
+			unsigned int const lenGate = batch.gateLength[nGate];
+            printf("#   Gate %ld: %u samples at position %u\n", nGate - batch.segFirstGate[nSeg], lenGate, posGate);
 
+			signed char const *samplesP = batch.gateSamples[nGate];
 			for (unsigned int n = 0 ; n < lenGate ; ++n)
 				printf("%u\t%d\n", posGate + n, samplesP[n]);
 
@@ -169,7 +205,8 @@ int main(int argc, char *argv[])
 	}
 
 	// Cleanup data buffer and instruments
-	delete[] dataArray;
+	if (bufferP != NULL)
+		pool.Put(bufferP);
 
 	status = Acqrs_closeAll();
 
@@ -5,9 +5,9 @@
 //  Copyright Agilent Technologies, Inc. 2009. All rights reserved.
 //
 //////////////////////////////////////////////////////////////////////////////////////////
-// This GetStarted puts the U1084A in Averaging mode and acquires a single averaged 
-// trace. It then writes the acquired trace to a file called 'Acqiris.data' in the
-// current directory. The functions in this file are in the order in which they are
+// This GetStarted puts the U1084A in Averaging mode and acquires one averaged trace
+// per segment. It then converts the traces to Volts and writes them to a binary file
+// called 'Acqiris.bin' in the current directory (see AvgReadout.h for the layout). The functions in this file are in the order in which they are
 // first called.
 
 #include <iostream>
@@ -16,6 +16,8 @@
 #include "AcqirisImport.h"
 #include "AcqirisD1Import.h"
 
+#include "AvgReadout.h"
+
 
 using std::cout;
 using std::endl;
@@ -23,6 +25,7 @@ using std::ofstream;
 
 
 #define NBR_SAMPLES 10240
+#define NBR_SEGMENTS 16
 
 
 // Macro for status code checking
@@ -133,6 +136,10 @@ void Configure(ViSession const instrId)
     status = AcqrsD1_configAvgConfigInt32(instrId, 0, "NbrSamples", nbrSamples);
     CHECK_API_CALL("configAvgConfig(NbrSamples)", status);
 
+    ViInt32 nbrSegments = NBR_SEGMENTS;     // Number of averaged segments (one per trigger in turn)
+    status = AcqrsD1_configAvgConfigInt32(instrId, 0, "NbrSegments", nbrSegments);
+    CHECK_API_CALL("configAvgConfig(NbrSegments)", status);
+
     ViInt32 nbrWaveforms = 100;             // Number of acquisitions to accumulate
     status = AcqrsD1_configAvgConfigInt32(instrId, 0, "NbrWaveforms", nbrWaveforms);
     CHECK_API_CALL("configAvgConfig(NbrWaveforms)", status);
@@ -235,61 +242,22 @@ void ReadData(ViSession const instrId)
 {
     ViStatus status = VI_SUCCESS;
 
-    // Set up the read parameters for reading the accumulated waveform
+    // Read all averaged segments of channel 1. The buffers are sized from the averager
+    // configuration and the sums are converted to Volts using the number of averaged
+    // waveforms, 'vGain' and 'vOffset' of the data descriptor.
     cout << "Reading average" << endl;
-    ViUInt32 average[NBR_SAMPLES + 32];     // The buffer needs to be slightly larger than the
-                                            // actual amount of requested data, to compensate for
-                                            // alignment issues
-    AqSegmentDescriptorAvg segDescAvg;
-
-    AqReadParameters readParamAvg;
-    // - general settings
-    readParamAvg.dataType = ReadInt32;      // Read the average as 32 bit unsigned values
-    readParamAvg.readMode = ReadModeAvgW;   // Use read mode 'Average'
-
-    // - which samples to read
-    readParamAvg.firstSampleInSeg = 0;      // We read the whole waveform
-    readParamAvg.nbrSamplesInSeg = NBR_SAMPLES;
-
-    // - which segments to read
-    readParamAvg.firstSegment = 0;
-    readParamAvg.nbrSegments = 1;
-    readParamAvg.segmentOffset = 0;         // Not used for ReadModeAvgW
-
-    // - size of the data and segment descriptor arrays
-    readParamAvg.dataArraySize = sizeof(average);
-    readParamAvg.segDescArraySize = sizeof(segDescAvg);
-
-    // - these fields must be zero
-    readParamAvg.flags = 0;
-    readParamAvg.reserved = 0;
-    readParamAvg.reserved2 = 0;
-    readParamAvg.reserved3 = 0;
-
-    // Read the average
-    AqDataDescriptor dataDescAvg;
-    status = AcqrsD1_readData(instrId, 1, &readParamAvg, average, &dataDescAvg, &segDescAvg);
+    AvgSegments avg;
+    status = ReadAvgSegments(instrId, 1, avg);
     CHECK_API_CALL("readData(average)", status);
+    if (status < VI_SUCCESS)
+        return;
 
+    cout << "Read " << avg.nbrSegments << " segments of " << avg.nbrSamples << " samples, "
+         << avg.nbrAvgWforms << " waveforms each" << endl;
 
     // Write the data to the output file
-    ofstream outFile("Acqiris.data");
-    if (outFile)
-    {
-        outFile << "Average\n";
-        for (int i = 0; i < dataDescAvg.returnedSamplesPerSeg; ++i)
-        {
-            // Note the use of 'dataDescAvg.indexFirstPoint' to locate the first
-            // valid sample in the data array.
-            ViInt32 avgSample = average[i + dataDescAvg.indexFirstPoint];
-            outFile << avgSample << "\n";
-        }
-        outFile.close();
-    }
-    else
-    {
-        cout << "Could not open output file; discarding data" << endl;
-    }
+    if (!WriteAvgSegments("Acqiris.bin", avg))
+        cout << "Could not write output file; discarding data" << endl;
 }
 
 
@@ -13,6 +13,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "PeakStream.h"
+#include "SsrBufferPool.h"
+
 int main(int argc, char *argv[])
 {
 	ViSession idInstrument;
@@ -85,16 +88,18 @@ int main(int argc, char *argv[])
 
 
 
-	// Allocate buffers for readout
+	// Allocate buffers for readout. The gates are fixed, so their size is the worst case;
+	// the buffers of the pool (see SsrBufferPool.h) follow the measured readouts below it
 	long const nbrSamplePerSeg = (lenGate + 8 ) * nbrGates;
-	long const nbrBytesAlloc = (nbrSamplePerSeg + 8) * nbrSegments;
+	long const nbrBytesWorst = (nbrSamplePerSeg + 8) * nbrSegments;
 
-	signed char *dataArray = new signed char[nbrBytesAlloc];
+	SsrBufferPool pool(nbrBytesWorst, nbrBytesWorst);
+	SsrBuffer *bufferP = NULL;
 
 	AqReadParameters readParam;
 	AqDataDescriptor dataDesc;
 
-	printf("# Prepared readout for %ld bytes\n", nbrBytesAlloc);
+	printf("# Prepared readout for %ld bytes\n", nbrBytesWorst);
 
 	// Perform acquisitions
 	long nbrWforms = 10;
@@ -122,7 +127,6 @@ int main(int argc, char *argv[])
 
 		// Readout gated data (only the one of the last acquisition)
 		::memset(&readParam, 0, sizeof(readParam));
-		::memset(&dataDesc, 0, sizeof(dataDesc));
 		readParam.dataType = ReadInt8;
 		readParam.readMode = ReadModeSSRW;
 		readParam.firstSegment = 0;
@@ -130,48 +134,53 @@ int main(int argc, char *argv[])
 		readParam.firstSampleInSeg = 0;
 		readParam.nbrSamplesInSeg = nbrSamples;
 		readParam.segmentOffset = nbrSamples;
-		readParam.dataArraySize = nbrBytesAlloc;
 		readParam.segDescArraySize = 0;
 
-		status = AcqrsD1_readData(idInstrument, idChannel, &readParam, dataArray,
-								  &dataDesc, NULL);
+		if (bufferP != NULL)
+			pool.Put(bufferP);
+		bufferP = pool.Get();
+		status = pool.Read(idInstrument, idChannel, readParam, *bufferP, dataDesc);
 
 		if (status != VI_SUCCESS)
 		    printf("# readData() error %d (0x%08x)\n", (int)status, (int)status);
 
-		printf("# Read %d bytes: %d segments\n", (int)dataDesc.actualDataSize,
-			   (int)dataDesc.returnedSegments);
+		printf("# Read %d bytes: %d segments (buffer of %ld bytes)\n", (int)dataDesc.actualDataSize,
+			   (int)dataDesc.returnedSegments, bufferP->Size());
 
 	}
 
-	// Print data of last readout
-	signed char const *dataP = dataArray;
-	signed char const * const dataEndP = dataArray + dataDesc.actualDataSize;
-	int nSeg = 0;
+	SsrBufferStats const& stats = pool.Stats();
+	printf("# Buffers of %.0f bytes on average against %ld worst case: %.0f bytes saved\n",
+		   pool.MeanBufferBytes(), pool.WorstCaseBytes(), pool.SavedBytes());
+	printf("# Largest readout %ld bytes, %ld allocations, %ld readouts repeated\n",
+		   stats.peakBytes, stats.nbrAllocations, stats.nbrRetries);
 
-	while (dataP[3] == 0x04 && dataP < dataEndP)
+	// Print data of last readout
+	PeakBatch batch;
+	long errorOffset = 0;
+	if (bufferP != NULL
+		&& DecodePeakStream(&bufferP->data[0], dataDesc.actualDataSize, batch, &errorOffset) != PeakStreamOk)
+		printf("# Invalid record at offset %ld\n", errorOffset);
+
+	// Gates before the first segment header belong to no segment
+	long nGate = (batch.NbrSegments() > 0) ? batch.segFirstGate[0] : batch.NbrGates();
+	if (nGate > 0)
+		printf("# %ld gates before the first segment header\n", nGate);
+
+	for (long nSeg = 0 ; nSeg < batch.NbrSegments() ; ++nSeg)
     {
-        unsigned int const *segmentP = (unsigned int const *)dataP;
-		dataP += 8;
+		printf("# Segment %ld, timestamp %06x:%08x\n", nSeg, (unsigned int)(batch.segTimeStamp[nSeg] >> 32),
+			   (unsigned int)batch.segTimeStamp[nSeg]);
 
-		unsigned int tsHi = segmentP[0] & 0x00FFFFFF;
-		unsigned int tsLo = segmentP[1];
-        printf("# Segment %d, timestamp %06x:%08x\n", nSeg++, tsHi, tsLo);
+		long const lastGate = (nSeg + 1 < batch.NbrSegments()) ? batch.segFirstGate[nSeg + 1] : batch.NbrGates();
 
-		int nGate = 0;
-
-		while (dataP[3] == 0x00 && dataP < dataEndP)
+		for ( ; nGate < lastGate ; ++nGate)
 		{
-		    unsigned int const *gateP = (unsigned int const *)dataP;
-			dataP += 8;
-
-			unsigned int const posGate = gateP[0] & 0x00FFFFFF;
-			unsigned int const lenGate = gateP[1];
-            printf("#   Gate %d: %u samples at position %u\n", nGate++, lenGate, posGate);
-
-			signed char const *samplesP = dataP;
-			dataP += lenGate;
+			unsigned int const posGate = batch.gatePosition[nGate];
+			unsigned int const lenGate = batch.gateLength[nGate];
+            printf("#   Gate %ld: %u samples at position %u\n", nGate - batch.segFirstGate[nSeg], lenGate, posGate);
 
+			signed char const *samplesP = batch.gateSamples[nGate];
 			for (unsigned int n = 0 ; n < lenGate ; ++n)
 				printf("%u\t%d\n", posGate + n, samplesP[n]);
 
@@ -180,7 +189,8 @@ int main(int argc, char *argv[])
 	}
 
 	// Cleanup data buffer and instruments
-	delete[] dataArray;
+	if (bufferP != NULL)
+		pool.Put(bufferP);
 
 	status = Acqrs_closeAll();
 
@@ -0,0 +1,214 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  PeakStream.h : Decoder for the tagged record stream of PeakTDC and SSR readouts
+//----------------------------------------------------------------------------------------
+//
+//  'ReadModePeak' and 'ReadModeSSRW' return a stream of 8-byte records. The tag is the
+//  top byte of the first 32-bit word (byte 3 in memory):
+//  - 0x04 segment header : word0[23:0] timestamp high bits, word1 timestamp low bits
+//  - 0x10 peak           : word0[19:0] signed amplitude in 1/16 LSB,
+//                          word1 position in 1/16 sample
+//  - 0x00 gate header    : word0[23:0] position in samples, word1 length in bytes,
+//                          followed by 'length' bytes of samples
+//
+//  DecodePeakStream() validates the stream and decodes it into a PeakBatch, which holds
+//  one array per field (structure of arrays). Gate samples are not copied: the batch
+//  points into the readout buffer, which must stay valid while the batch is used.
+//  The arrays keep their capacity across Clear(), so a batch reused for every readout
+//  does not allocate once it has grown to the largest readout.
+//
+//  WritePeakBatch() appends the segments and peaks of one readout to a binary file:
+//  - PeakFileBlock
+//  - nbrSegments ViUInt64 timestamps, then nbrSegments ViInt32 first peak indices
+//  - nbrPeaks ViUInt32 positions, then nbrPeaks ViInt32 amplitudes
+//
+//  WriteGateBatch() does the same for the gates of an SSR readout:
+//  - GateFileBlock
+//  - nbrSegments ViUInt64 timestamps, then nbrSegments ViInt32 first gate indices
+//  - nbrGates ViUInt32 positions, then nbrGates ViUInt32 lengths in bytes
+//  - the samples of all gates, one after the other ('nbrBytes' in total)
+//  GateStore.h writes and indexes files of such blocks.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef PEAK_STREAM_H
+#define PEAK_STREAM_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+
+enum PeakStreamTag
+{
+    PeakTagGate = 0x00,
+    PeakTagSegment = 0x04,
+    PeakTagPeak = 0x10
+};
+
+enum PeakStreamStatus
+{
+    PeakStreamOk = 0,
+    PeakStreamBadTag = -1,              // unknown record tag
+    PeakStreamTruncated = -2            // record or gate samples run past the end
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+struct PeakBatch
+{
+    // Segments
+    std::vector<ViUInt64> segTimeStamp;             // 56-bit timestamp
+    std::vector<ViInt32> segFirstPeak;              // index of the first peak of the segment
+    std::vector<ViInt32> segFirstGate;              // index of the first gate of the segment
+
+    // Peaks
+    std::vector<ViUInt32> peakPosition;             // in 1/16 sample
+    std::vector<ViInt32> peakAmplitude;             // in 1/16 LSB
+    std::vector<ViInt32> peakSegment;               // -1 before the first segment header
+
+    // Gates
+    std::vector<ViUInt32> gatePosition;             // first sample of the gate
+    std::vector<ViUInt32> gateLength;               // in bytes
+    std::vector<ViInt8 const*> gateSamples;         // into the readout buffer
+    std::vector<ViInt32> gateSegment;
+
+    void Clear()
+    {
+        segTimeStamp.clear(); segFirstPeak.clear(); segFirstGate.clear();
+        peakPosition.clear(); peakAmplitude.clear(); peakSegment.clear();
+        gatePosition.clear(); gateLength.clear(); gateSamples.clear(); gateSegment.clear();
+    }
+
+    long NbrSegments() const { return long(segTimeStamp.size()); }
+    long NbrPeaks() const { return long(peakPosition.size()); }
+    long NbrGates() const { return long(gatePosition.size()); }
+    long NbrRecords() const { return NbrSegments() + NbrPeaks() + NbrGates(); }
+};
+
+struct PeakFileBlock
+{
+    char magic[4];                                  // "PKB1"
+    ViUInt32 acquisition;                           // acquisition number
+    ViInt32 nbrSegments;
+    ViInt32 nbrPeaks;
+};
+
+struct GateFileBlock
+{
+    char magic[4];                                  // "GTB1"
+    ViUInt32 acquisition;                           // acquisition number
+    ViInt32 nbrSegments;
+    ViInt32 nbrGates;
+    ViUInt32 nbrBytes;                              // gate samples
+    ViUInt32 reserved;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Decode 'length' bytes at 'dataP' and append the records to 'batch'. Returns a
+// PeakStreamStatus; on error '*errorOffsetP' (if given) is the offset of the bad record
+// and the records before it are in 'batch'.
+inline int DecodePeakStream(void const* dataP, long length, PeakBatch& batch, long* errorOffsetP = NULL)
+{
+    ViInt8 const* const startP = (ViInt8 const*)dataP;
+    ViInt8 const* p = startP;
+    ViInt8 const* const endP = startP + length;
+    ViInt32 segment = batch.NbrSegments() - 1;
+
+    int status = PeakStreamOk;
+    while (p < endP)
+    {
+        if (endP - p < 8)
+        {
+            status = PeakStreamTruncated;
+            break;
+        }
+
+        ViUInt32 word[2];
+        ::memcpy(word, p, 8);
+        ViUInt32 const tag = word[0] >> 24;
+
+        if (tag == PeakTagPeak)
+        {
+            // Sign-extend the 20-bit amplitude
+            batch.peakAmplitude.push_back(ViInt32(word[0] << 12) >> 12);
+            batch.peakPosition.push_back(word[1]);
+            batch.peakSegment.push_back(segment);
+            p += 8;
+        }
+        else if (tag == PeakTagGate)
+        {
+            if (word[1] > ViUInt32(endP - p - 8))
+            {
+                status = PeakStreamTruncated;
+                break;
+            }
+            batch.gatePosition.push_back(word[0] & 0x00ffffff);
+            batch.gateLength.push_back(word[1]);
+            batch.gateSamples.push_back(p + 8);
+            batch.gateSegment.push_back(segment);
+            p += 8 + word[1];
+        }
+        else if (tag == PeakTagSegment)
+        {
+            batch.segTimeStamp.push_back((ViUInt64(word[0] & 0x00ffffff) << 32) | word[1]);
+            batch.segFirstPeak.push_back(ViInt32(batch.peakPosition.size()));
+            batch.segFirstGate.push_back(ViInt32(batch.gatePosition.size()));
+            ++segment;
+            p += 8;
+        }
+        else
+        {
+            status = PeakStreamBadTag;
+            break;
+        }
+    }
+
+    if (status != PeakStreamOk && errorOffsetP != NULL)
+        *errorOffsetP = long(p - startP);
+    return status;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+template <class T>
+inline bool WritePeakArray(FILE* file, std::vector<T> const& values)
+{
+    return values.empty() || fwrite(&values[0], sizeof(T), values.size(), file) == values.size();
+}
+
+inline bool WritePeakBatch(FILE* file, ViUInt32 acquisition, PeakBatch const& batch)
+{
+    PeakFileBlock block;
+    ::memcpy(block.magic, "PKB1", 4);
+    block.acquisition = acquisition;
+    block.nbrSegments = batch.NbrSegments();
+    block.nbrPeaks = batch.NbrPeaks();
+
+    return fwrite(&block, sizeof(block), 1, file) == 1
+        && WritePeakArray(file, batch.segTimeStamp) && WritePeakArray(file, batch.segFirstPeak)
+        && WritePeakArray(file, batch.peakPosition) && WritePeakArray(file, batch.peakAmplitude);
+}
+
+inline bool WriteGateBatch(FILE* file, ViUInt32 acquisition, PeakBatch const& batch)
+{
+    GateFileBlock block;
+    ::memset(&block, 0, sizeof(block));
+    ::memcpy(block.magic, "GTB1", 4);
+    block.acquisition = acquisition;
+    block.nbrSegments = batch.NbrSegments();
+    block.nbrGates = batch.NbrGates();
+    for (long n = 0; n < batch.NbrGates(); ++n)
+        block.nbrBytes += batch.gateLength[n];
+
+    bool ok = fwrite(&block, sizeof(block), 1, file) == 1
+        && WritePeakArray(file, batch.segTimeStamp) && WritePeakArray(file, batch.segFirstGate)
+        && WritePeakArray(file, batch.gatePosition) && WritePeakArray(file, batch.gateLength);
+
+    // Samples gate by gate: they are separated by the gate headers in the readout
+    for (long n = 0; ok && n < batch.NbrGates(); ++n)
+        ok = fwrite(batch.gateSamples[n], 1, batch.gateLength[n], file) == batch.gateLength[n];
+    return ok;
+}
+
+#endif // PEAK_STREAM_H
@@ -18,9 +18,12 @@
 #include "AcqirisImport.h"
 #include "AcqirisD1Import.h"
 
+#include "RisReconstruct.h"
+
 using namespace std;
 
 const ViInt32 MAX_SUPPORTED_DEVICES = 10;
+const ViInt32 MAX_READ_FAILURES = 100;	// Failed readouts in a row that end a reconstruction
 
 // ### Global variables ###
 ViSession InstrumentID[MAX_SUPPORTED_DEVICES];	// Array of instrument handles
@@ -32,6 +35,9 @@ ViInt32 nbrSamples = 1000;			  // Number of samples
 ViInt32 of = 10;					  // Oversampling Factor
 ViInt32 oa = 100;					  // Oversampling Accuracy
 char const *OutputFile = "RIS.data"; // Output file
+ViInt32 rm = 0;					  // Reconstruction mode (0 = bins, 1 = linear, 2 = sinc)
+ViInt32 uf = 0;					  // Upsampling factor of the reconstruction grid (0 = of)
+ViInt32 na = 0;					  // Number of acquisitions to reconstruct (0 = until full phase coverage)
 
 // ### Configuration ###
 /*
@@ -64,7 +70,9 @@ ViStatus FindAndSelectDevices(void);
 void Configure(ViInt32 id);
 void ConfigureReadParameters(ViInt32 buffer_size, AqReadParameters *readPar);
 ViStatus Acquire(ViInt32 id);
+ViStatus AcquireAndReconstruct(ViInt32 channel, AqReadParameters *readPar, ViReal64 *waveformArray);
 void saveData(int channel, AqDataDescriptor & descriptor, int nb_iter, int skipped, RISData *ris_data);
+void saveReconstruction(int channel, int nb_iter, RisReconstructor & recon, ViReal64 const *gridArray);
 ViStatus CloseDevices();
 void PrintStatus(ViChar const description[], ViStatus errorCode);
 
@@ -101,6 +109,15 @@ int main(int argc, char *argv[])
 	AqReadParameters readPar;
 	ConfigureReadParameters(buffer_size, &readPar);
 
+	// Reconstruction from all acquisitions (no bins, no skipped acquisitions)
+	// ---------------------------------------------------------------------------
+	if (rm != 0)
+	{
+		AcquireAndReconstruct(channel, &readPar, waveformArray);
+		delete [] waveformArray;
+		return CloseDevices();
+	}
+
 	// Resources allocation and init
 	// ---------------------------------------------------------------------------
 	ViReal64 fc = 0.01 * (oa/2) * si / of;
@@ -212,13 +229,16 @@ ViStatus CheckInputArguments(int argc, char *argv[])
 		if (argc == 1 && strcmp(strP, "-h") == 0)
 		{
 			cout << endl
-				<< "Usage: RisAcquisitionVC [-h] | [-si] [-ns] [-of] [-oa] [-f]" << endl << endl
+				<< "Usage: RisAcquisitionVC [-h] | [-si] [-ns] [-of] [-oa] [-rm] [-uf] [-na] [-f]" << endl << endl
 				<< "Options:" << endl
 				<< "\t-h Displays this help" << endl
 				<< "\t-si Sampling interval" << endl
 				<< "\t-ns Number of samples" << endl << endl				
 				<< "\t-of Oversampling factor" << endl
 				<< "\t-oa Oversampling accuracy (1..100%)" << endl 
+				<< "\t-rm Reconstruction mode (0 = bins, 1 = linear, 2 = windowed sinc)" << endl
+				<< "\t-uf Upsampling factor of the reconstruction grid (default: -of value)" << endl
+				<< "\t-na Number of acquisitions to reconstruct (default: until all grid phases are hit)" << endl
 				<< "\t-f Output file" << endl
 
 				<< "Note: An option value must be glued to the option" << endl << endl
@@ -266,6 +286,33 @@ ViStatus CheckInputArguments(int argc, char *argv[])
 			}
 		}
 
+		else if (strstr(strP, "-rm"))		// Reconstruction mode
+		{
+			if (strlen(strP+3))
+			{
+				iv = atoi(strP+3);
+				if (iv>=0 && iv<=2) rm = iv;
+			}
+		}
+
+		else if (strstr(strP, "-uf"))		// Upsampling factor
+		{
+			if (strlen(strP+3))
+			{
+				iv = atoi(strP+3);
+				if (iv>0) uf = iv;
+			}
+		}
+
+		else if (strstr(strP, "-na"))		// Number of acquisitions
+		{
+			if (strlen(strP+3))
+			{
+				iv = atoi(strP+3);
+				if (iv>1) na = iv;
+			}
+		}
+
 		else if (strstr(strP, "-f"))		// Output file
 		{
 			if (strlen(strP+2)) OutputFile = strP+2;
@@ -273,13 +320,19 @@ ViStatus CheckInputArguments(int argc, char *argv[])
 
 	}
 
+	if (uf == 0) uf = of;
+
 	cout	<< endl << "Agilent Acqiris Digitizer - RIS Demo"
 			<< endl << "^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^" << endl
 			<< "Output file: " << OutputFile << endl
 			<< "Sampling interval: " << si << endl
 			<< "Number of samples: " << nbrSamples << endl
 			<< "Oversampling factor: " << of << endl
-			<< "Oversampling accuracy: " << oa << endl << endl;
+			<< "Oversampling accuracy: " << oa << endl
+			<< "Reconstruction mode: " << rm << endl;
+	if (rm != 0)
+		cout << "Upsampling factor: " << uf << endl;
+	cout << endl;
 
 	return VI_SUCCESS;
 }
@@ -442,6 +495,66 @@ ViStatus Acquire(ViInt32 id)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////////////////
+//! RIS acquisitions with reconstruction on a uniform grid
+/*!
+Every acquisition is kept with its horPos, none is skipped. Acquisitions continue until
+'na' acquisitions have been made or, if 'na' is 0, until every phase of the output grid
+has been hit by at least one acquisition. After 'MAX_READ_FAILURES' failed readouts in a
+row, the status of the last one is returned without a reconstruction.
+*/
+ViStatus AcquireAndReconstruct(ViInt32 channel, AqReadParameters *readPar, ViReal64 *waveformArray)
+{
+	AqDataDescriptor descriptor;
+	AqSegmentDescriptor segDesc;
+	RisReconstructor recon(nbrSamples, si, uf);
+	int nb_iter = 0;
+	int nb_failed = 0;	// readouts failed in a row
+
+	cout << "Acquire ";
+	while ((na > 0) ? (nb_iter < na) : (recon.PhaseCoverage() < uf))
+	{
+		ViStatus status = Acquire(InstrumentID[InstrIdx]);
+		if (status) return status;
+
+		status = AcqrsD1_readData(	InstrumentID[InstrIdx], 
+									channel, 
+									readPar, 
+									waveformArray, 
+									&descriptor, 
+									&segDesc);
+
+		PrintStatus("AcqrsD1_readData", status);
+
+		if (!(nb_iter % 10)) cout << ".";	// show progress
+
+		nb_iter++;
+
+		if (status < VI_SUCCESS)
+		{
+			if (++nb_failed < MAX_READ_FAILURES) continue;	// next acquisition
+
+			cout << endl << "Stopped after " << nb_failed << " failed readouts in a row" << endl;
+			return status;
+		}
+		nb_failed = 0;
+
+		recon.AddAcquisition(segDesc.horPos, waveformArray);
+	}
+
+	cout << " done." << endl << "Iterations: " << nb_iter << endl;
+	cout << "Phases covered: " << recon.PhaseCoverage() << " of " << uf << endl;
+
+	ViReal64 *gridArray = new ViReal64[recon.NbrGridPoints()];
+	recon.Reconstruct(rm == 2 ? RisSinc : RisLinear, gridArray);
+
+	saveReconstruction(channel, nb_iter, recon, gridArray);
+
+	delete [] gridArray;
+
+	return VI_SUCCESS;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 //! Save results in a file
 /*!
@@ -474,6 +587,35 @@ void saveData(int channel, AqDataDescriptor & descriptor, int nb_iter, int skipp
 	outFile.close();
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+//! Save the reconstructed waveform in a file
+void saveReconstruction(int channel, int nb_iter, RisReconstructor & recon, ViReal64 const *gridArray)
+{
+	cout << "Saving data ";
+	ofstream outFile(OutputFile);
+	outFile << "# Number of samples: " << recon.NbrGridPoints() << " S" << endl;
+	outFile << "# Time increment: " << recon.GridInterval() << " s" << endl;
+	outFile << "# Initial time: " << recon.InitialTime() << " s" << endl;
+	outFile << "# Channel: " << channel << endl;
+	outFile << "# Reconstruction: " << (rm == 2 ? "windowed sinc" : "linear") << endl;
+	outFile << "# Upsampling factor: " << uf << endl;
+	outFile << "# Iterations: " << nb_iter << endl;
+	outFile << "# Acquisitions used: " << recon.NbrAcquisitions() << endl;
+	outFile << '\x20' << endl;
+
+	long const nbrPoints = recon.NbrGridPoints();
+	for (long d=0; d<nbrPoints; d++)
+	{
+		outFile << gridArray[d] << endl;
+
+		if (!(d % (nbrPoints /10)))
+			cout << ".";
+	}
+
+	cout << " done.";
+	outFile.close();
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 //! Close all devices
 ViStatus CloseDevices()
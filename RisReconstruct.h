@@ -0,0 +1,330 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  RisReconstruct.h : Random interleaved sampling reconstruction on a uniform grid
+//----------------------------------------------------------------------------------------
+//
+//  Every acquisition is kept together with its exact trigger position 'horPos'. Sample i
+//  of an acquisition is located at t = i * sampInterval + horPos, with horPos in
+//  [-sampInterval, 0]. The acquisitions are ordered by horPos, which merges all samples
+//  into a single time-sorted sequence without sorting the samples themselves. This
+//  sequence is then resampled onto a grid of 'upsampling' points per sampling interval.
+//
+//  Kernels:
+//  - RisLinear : linear interpolation between the two bracketing samples
+//  - RisSinc   : Lanczos windowed sinc (3 lobes) at the grid spacing. Each sample is
+//                weighted by the time span it covers (half the distance to its neighbours),
+//                which compensates for the irregular sample spacing, and the result is
+//                normalized by the sum of the weights.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef RIS_RECONSTRUCT_H
+#define RIS_RECONSTRUCT_H
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#include "AqSimd.h"
+
+enum RisKernel { RisLinear = 1, RisSinc = 2 };
+
+static int const RisSincLobes = 3;
+static double const RisPi = 3.14159265358979323846;
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifdef AQ_SSE2
+// sin(pi * x) for |x| < 2^31, evaluated on two lanes
+inline __m128d RisSinPi(__m128d x)
+{
+    // Reduce to r in [-0.5, 0.5] with x = n + r, sin(pi * x) = (-1)^n * sin(pi * r)
+    __m128i const n = _mm_cvtpd_epi32(x);
+    __m128d r = _mm_mul_pd(_mm_sub_pd(x, _mm_cvtepi32_pd(n)), _mm_set1_pd(RisPi));
+    __m128d const r2 = _mm_mul_pd(r, r);
+
+    __m128d p = _mm_set1_pd(-1.0 / 39916800.0);
+    p = _mm_add_pd(_mm_mul_pd(p, r2), _mm_set1_pd(1.0 / 362880.0));
+    p = _mm_add_pd(_mm_mul_pd(p, r2), _mm_set1_pd(-1.0 / 5040.0));
+    p = _mm_add_pd(_mm_mul_pd(p, r2), _mm_set1_pd(1.0 / 120.0));
+    p = _mm_add_pd(_mm_mul_pd(p, r2), _mm_set1_pd(-1.0 / 6.0));
+    p = _mm_add_pd(_mm_mul_pd(p, r2), _mm_set1_pd(1.0));
+    r = _mm_mul_pd(p, r);
+
+    // Move the parity of n into the sign bit of each 64-bit lane
+    __m128i odd = _mm_and_si128(n, _mm_set1_epi32(1));
+    odd = _mm_slli_epi64(_mm_shuffle_epi32(odd, _MM_SHUFFLE(1, 1, 0, 0)), 63);
+    return _mm_xor_pd(r, _mm_castsi128_pd(odd));
+}
+
+// Lanczos kernel sinc(x) * sinc(x / a), zero outside |x| < a
+inline __m128d RisLanczos(__m128d x)
+{
+    __m128d const a = _mm_set1_pd(RisSincLobes);
+    __m128d const absX = _mm_and_pd(x, _mm_castsi128_pd(_mm_srli_epi64(_mm_set1_epi32(-1), 1)));
+
+    __m128d const num = _mm_mul_pd(_mm_mul_pd(a, RisSinPi(x)), RisSinPi(_mm_div_pd(x, a)));
+    __m128d const den = _mm_mul_pd(_mm_set1_pd(RisPi * RisPi), _mm_mul_pd(x, x));
+    __m128d const tiny = _mm_cmplt_pd(absX, _mm_set1_pd(1.0e-9));
+    __m128d w = _mm_div_pd(num, _mm_or_pd(_mm_andnot_pd(tiny, den), _mm_and_pd(tiny, _mm_set1_pd(1.0))));
+    w = _mm_or_pd(_mm_andnot_pd(tiny, w), _mm_and_pd(tiny, _mm_set1_pd(1.0)));
+    return _mm_and_pd(w, _mm_cmplt_pd(absX, a));
+}
+#endif
+
+inline double RisLanczos(double x)
+{
+    double const absX = fabs(x);
+    if (absX < 1.0e-9) return 1.0;
+    if (absX >= RisSincLobes) return 0.0;
+    return RisSincLobes * sin(RisPi * x) * sin(RisPi * x / RisSincLobes) / (RisPi * RisPi * x * x);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class RisReconstructor
+{
+public:
+    RisReconstructor(long nbrSamples, double sampInterval, long upsampling)
+        : m_nbrSamples(nbrSamples), m_sampInterval(sampInterval), m_upsampling(upsampling),
+          m_phaseCount(upsampling, 0), m_phaseCoverage(0)
+    {
+    }
+
+    // Store one acquisition. 'waveform' holds 'nbrSamples' values in Volts.
+    void AddAcquisition(double horPos, double const* waveform)
+    {
+        m_horPos.push_back(horPos);
+        m_waveforms.insert(m_waveforms.end(), waveform, waveform + m_nbrSamples);
+
+        long const bucket = PhaseBucket(horPos);
+        if (m_phaseCount[bucket]++ == 0)
+            ++m_phaseCoverage;
+    }
+
+    long NbrAcquisitions() const { return (long)m_horPos.size(); }
+
+    // Number of output grid phases that contain at least one acquisition
+    long PhaseCoverage() const { return m_phaseCoverage; }
+
+    long NbrGridPoints() const { return m_nbrSamples * m_upsampling; }
+    double GridInterval() const { return m_sampInterval / m_upsampling; }
+    double InitialTime() const { return -m_sampInterval; }
+
+    // Resample all stored acquisitions onto 'NbrGridPoints()' points starting at
+    // 'InitialTime()' with a spacing of 'GridInterval()'
+    void Reconstruct(RisKernel kernel, double* outArray)
+    {
+        Merge();
+
+        if (kernel == RisSinc)
+            ResampleSinc(outArray);
+        else
+            ResampleLinear(outArray);
+    }
+
+private:
+    long PhaseBucket(double horPos) const
+    {
+        long bucket = long(-horPos / m_sampInterval * m_upsampling);
+        return std::min(std::max(bucket, 0L), m_upsampling - 1);
+    }
+
+    struct IndexLess
+    {
+        std::vector<double> const& key;
+        IndexLess(std::vector<double> const& k) : key(k) {}
+        bool operator()(long a, long b) const { return key[a] < key[b]; }
+    };
+
+    // Build the time-sorted sample sequence. Ordering the acquisitions by horPos orders
+    // the samples within each sampling interval, so no per-sample sort is needed as long
+    // as all horPos values lie within one sampling interval.
+    void Merge()
+    {
+        long const nbrAcq = NbrAcquisitions();
+        std::vector<long> order(nbrAcq);
+        for (long a = 0; a < nbrAcq; ++a)
+            order[a] = a;
+        std::sort(order.begin(), order.end(), IndexLess(m_horPos));
+
+        m_time.resize(m_nbrSamples * nbrAcq);
+        m_value.resize(m_nbrSamples * nbrAcq);
+
+        for (long i = 0, j = 0; i < m_nbrSamples; ++i)
+        {
+            for (long k = 0; k < nbrAcq; ++k, ++j)
+            {
+                long const a = order[k];
+                m_time[j] = i * m_sampInterval + m_horPos[a];
+                m_value[j] = m_waveforms[a * m_nbrSamples + i];
+            }
+        }
+
+        if (nbrAcq > 0 && m_horPos[order[nbrAcq - 1]] - m_horPos[order[0]] >= m_sampInterval)
+        {
+            // Out-of-range horPos values: fall back to a full sort of the samples
+            std::vector<long> idx(m_time.size());
+            for (size_t j = 0; j < idx.size(); ++j)
+                idx[j] = (long)j;
+            std::sort(idx.begin(), idx.end(), IndexLess(m_time));
+
+            std::vector<double> time(idx.size()), value(idx.size());
+            for (size_t j = 0; j < idx.size(); ++j)
+            {
+                time[j] = m_time[idx[j]];
+                value[j] = m_value[idx[j]];
+            }
+            m_time.swap(time);
+            m_value.swap(value);
+        }
+
+        // Time span covered by each sample
+        long const nbrMerged = (long)m_time.size();
+        m_span.resize(nbrMerged);
+        for (long j = 0; j < nbrMerged; ++j)
+        {
+            double const before = j > 0 ? m_time[j] - m_time[j - 1] : 0.0;
+            double const after = j + 1 < nbrMerged ? m_time[j + 1] - m_time[j] : 0.0;
+            m_span[j] = 0.5 * (before + after);
+        }
+    }
+
+    // Index of the last merged sample at or before each grid point (clamped so that
+    // [index, index + 1] is always a valid pair)
+    void Bracket(std::vector<long>& left) const
+    {
+        long const nbrGrid = NbrGridPoints();
+        long const last = (long)m_time.size() - 2;
+        double const t0 = InitialTime(), dt = GridInterval();
+
+        left.resize(nbrGrid);
+        long j = 0;
+        for (long k = 0; k < nbrGrid; ++k)
+        {
+            double const t = t0 + k * dt;
+            while (j < last && m_time[j + 1] <= t)
+                ++j;
+            left[k] = j;
+        }
+    }
+
+    void ResampleLinear(double* outArray) const
+    {
+        long const nbrGrid = NbrGridPoints();
+        if (m_time.size() < 2)
+        {
+            std::fill(outArray, outArray + nbrGrid, m_value.empty() ? 0.0 : m_value[0]);
+            return;
+        }
+
+        std::vector<long> left;
+        Bracket(left);
+
+        double const t0 = InitialTime(), dt = GridInterval();
+        double const* const T = &m_time[0];
+        double const* const Y = &m_value[0];
+        long k = 0;
+
+#ifdef AQ_SSE2
+        for (; k + 1 < nbrGrid; k += 2)
+        {
+            long const j0 = left[k], j1 = left[k + 1];
+            __m128d const t = _mm_set_pd(t0 + (k + 1) * dt, t0 + k * dt);
+            __m128d const ta = _mm_set_pd(T[j1], T[j0]);
+            __m128d const tb = _mm_set_pd(T[j1 + 1], T[j0 + 1]);
+            __m128d const ya = _mm_set_pd(Y[j1], Y[j0]);
+            __m128d const yb = _mm_set_pd(Y[j1 + 1], Y[j0 + 1]);
+
+            // Coincident samples give a zero span; use the left value in that case
+            __m128d const span = _mm_sub_pd(tb, ta);
+            __m128d const valid = _mm_cmpgt_pd(span, _mm_setzero_pd());
+            __m128d frac = _mm_div_pd(_mm_sub_pd(t, ta), _mm_or_pd(span, _mm_andnot_pd(valid, _mm_set1_pd(1.0))));
+            frac = _mm_and_pd(frac, valid);
+            frac = _mm_min_pd(_mm_max_pd(frac, _mm_setzero_pd()), _mm_set1_pd(1.0));
+
+            _mm_storeu_pd(outArray + k, _mm_add_pd(ya, _mm_mul_pd(frac, _mm_sub_pd(yb, ya))));
+        }
+#endif
+        for (; k < nbrGrid; ++k)
+        {
+            long const j = left[k];
+            double const span = T[j + 1] - T[j];
+            double frac = span > 0.0 ? (t0 + k * dt - T[j]) / span : 0.0;
+            frac = std::min(std::max(frac, 0.0), 1.0);
+            outArray[k] = Y[j] + frac * (Y[j + 1] - Y[j]);
+        }
+    }
+
+    void ResampleSinc(double* outArray) const
+    {
+        long const nbrGrid = NbrGridPoints();
+        long const nbrMerged = (long)m_time.size();
+        double const t0 = InitialTime(), dt = GridInterval();
+        double const reach = RisSincLobes * dt;
+
+        // The linear result is used where the sinc weights do not cover the grid point
+        ResampleLinear(outArray);
+        if (nbrMerged < 2)
+            return;
+
+        double const* const T = &m_time[0];
+        double const* const Y = &m_value[0];
+        double const* const S = &m_span[0];
+        long lo = 0, hi = 0;
+
+        for (long k = 0; k < nbrGrid; ++k)
+        {
+            double const t = t0 + k * dt;
+            while (lo < nbrMerged && T[lo] <= t - reach)
+                ++lo;
+            if (hi < lo)
+                hi = lo;
+            while (hi < nbrMerged && T[hi] < t + reach)
+                ++hi;
+
+            double acc = 0.0, sumW = 0.0;
+            long j = lo;
+#ifdef AQ_SSE2
+            __m128d const tv = _mm_set1_pd(t);
+            __m128d const invDt = _mm_set1_pd(1.0 / dt);
+            __m128d accV = _mm_setzero_pd(), sumV = _mm_setzero_pd();
+            for (; j + 1 < hi; j += 2)
+            {
+                __m128d const x = _mm_mul_pd(_mm_sub_pd(tv, _mm_loadu_pd(T + j)), invDt);
+                __m128d const w = _mm_mul_pd(RisLanczos(x), _mm_loadu_pd(S + j));
+                accV = _mm_add_pd(accV, _mm_mul_pd(w, _mm_loadu_pd(Y + j)));
+                sumV = _mm_add_pd(sumV, w);
+            }
+            double accLanes[2], sumLanes[2];
+            _mm_storeu_pd(accLanes, accV);
+            _mm_storeu_pd(sumLanes, sumV);
+            acc = accLanes[0] + accLanes[1];
+            sumW = sumLanes[0] + sumLanes[1];
+#endif
+            for (; j < hi; ++j)
+            {
+                double const w = RisLanczos((t - T[j]) / dt) * S[j];
+                acc += w * Y[j];
+                sumW += w;
+            }
+
+            if (sumW > 0.5 * dt)
+                outArray[k] = acc / sumW;
+        }
+    }
+
+    long m_nbrSamples;
+    double m_sampInterval;
+    long m_upsampling;
+
+    std::vector<double> m_horPos;       // horPos of each acquisition
+    std::vector<double> m_waveforms;    // acquisitions, 'nbrSamples' values each
+    std::vector<long> m_phaseCount;     // acquisitions per output grid phase
+    long m_phaseCoverage;
+
+    std::vector<double> m_time;         // merged, time-sorted samples
+    std::vector<double> m_value;
+    std::vector<double> m_span;         // time span covered by each merged sample
+};
+
+#endif // RIS_RECONSTRUCT_H
@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  SlotRing.h : Fixed ring of readout buffers shared by a producer and a consumer thread
+//----------------------------------------------------------------------------------------
+//
+//  The producer (the thread talking to the instrument) takes a free slot with WaitFree(),
+//  fills it and hands it over with Publish(). The consumer (processing / writing) takes
+//  filled slots in the same order with WaitFilled() and gives them back with Release().
+//  No slot is ever copied; the 'Slot' type carries the buffer and its descriptors.
+//
+//  Stalls() counts how often the producer found every slot still in use, i.e. how often
+//  host processing did not keep up with the instrument.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef SLOT_RING_H
+#define SLOT_RING_H
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+
+template <class Slot>
+class SlotRing
+{
+public:
+    explicit SlotRing(long nbrSlots)
+        : m_slots(nbrSlots), m_nbrSlots(nbrSlots),
+          m_nbrTaken(0), m_nbrPublished(0), m_nbrConsumed(0), m_nbrReleased(0),
+          m_stalls(0), m_closed(false)
+    {
+    }
+
+    long Size() const { return m_nbrSlots; }
+    Slot& operator[](long idx) { return m_slots[idx]; }
+
+    // Producer: index of the next free slot. Blocks while all slots are in use.
+    long WaitFree()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (Full())
+        {
+            ++m_stalls;
+            while (Full())
+                m_freed.wait(lock);
+        }
+        return long(m_nbrTaken++ % m_nbrSlots);
+    }
+
+    // Producer: index of the next free slot, or -1 if all slots are in use
+    long TryFree()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (Full())
+            return -1;
+        return long(m_nbrTaken++ % m_nbrSlots);
+    }
+
+    // Producer: the slot returned by the last WaitFree() / TryFree() is filled
+    void Publish()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_nbrPublished;
+        m_filled.notify_one();
+    }
+
+    // Producer: no more slots will be published
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_filled.notify_all();
+    }
+
+    // Consumer: index of the next filled slot, or -1 once the ring is closed and drained
+    long WaitFilled()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_nbrConsumed == m_nbrPublished && !m_closed)
+            m_filled.wait(lock);
+        if (m_nbrConsumed == m_nbrPublished)
+            return -1;
+        return long(m_nbrConsumed++ % m_nbrSlots);
+    }
+
+    // Consumer: the slot returned by the last WaitFilled() can be reused
+    void Release()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_nbrReleased;
+        m_freed.notify_one();
+    }
+
+    // Number of slots filled but not yet released by the consumer
+    long Pending()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return long(m_nbrPublished - m_nbrReleased);
+    }
+
+    long Stalls()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stalls;
+    }
+
+private:
+    bool Full() const { return m_nbrTaken - m_nbrReleased >= (unsigned long long)m_nbrSlots; }
+
+    std::vector<Slot> m_slots;
+    long m_nbrSlots;
+
+    unsigned long long m_nbrTaken;      // slots handed to the producer
+    unsigned long long m_nbrPublished;  // slots filled by the producer
+    unsigned long long m_nbrConsumed;   // slots handed to the consumer
+    unsigned long long m_nbrReleased;   // slots given back by the consumer
+    long m_stalls;
+    bool m_closed;
+
+    std::mutex m_mutex;
+    std::condition_variable m_filled;
+    std::condition_variable m_freed;
+};
+
+#endif // SLOT_RING_H
@@ -0,0 +1,274 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  SoftAverager.h : Host-side averaging of raw multi-segment readouts
+//----------------------------------------------------------------------------------------
+//
+//  For digitizers without averaging firmware. Raw 8-bit or 16-bit ADC codes, as read
+//  with 'ReadModeSeqW', are summed per sample. The segments of each readout are split
+//  between worker threads; every thread sums into its own 32-bit partial sums, which
+//  are flushed into 64-bit sums before they can overflow.
+//
+//  Noise-suppressed averaging follows the averager firmware settings:
+//  - thresholdEnable : samples at or below 'threshold' contribute 0
+//  - noiseBaseEnable : 'noiseBase' is subtracted from the samples above the threshold
+//                      (only effective together with 'thresholdEnable', like the firmware)
+//  Both values are in ADC codes of the data type read (see SoftAvgCode()).
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef SOFT_AVERAGER_H
+#define SOFT_AVERAGER_H
+
+#include <algorithm>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+#include "vpptype.h"
+#include "AqSimd.h"
+#include "AvgAccumulate.h"
+
+
+struct SoftAvgConfig
+{
+    bool thresholdEnable;
+    bool noiseBaseEnable;
+    ViInt32 threshold;                  // in ADC codes
+    ViInt32 noiseBase;                  // in ADC codes
+};
+
+// Convert a level in Volts into ADC codes with the data descriptor 'vGain' / 'vOffset'
+inline ViInt32 SoftAvgCode(ViReal64 volts, ViReal64 vGain, ViReal64 vOffset)
+{
+    return ViInt32(floor((volts + vOffset) / vGain + 0.5));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// accP[i] += f(dataP[i]) for one segment, where f applies the noise suppression
+template <class Sample>
+inline void SoftAvgSegmentScalar(ViInt32* accP, Sample const* dataP, long nbrSamples, SoftAvgConfig const& cfg)
+{
+    if (!cfg.thresholdEnable)
+    {
+        for (long i = 0; i < nbrSamples; ++i)
+            accP[i] += dataP[i];
+        return;
+    }
+
+    ViInt32 const base = cfg.noiseBaseEnable ? cfg.noiseBase : 0;
+    for (long i = 0; i < nbrSamples; ++i)
+    {
+        ViInt32 const x = dataP[i];
+        if (x > cfg.threshold)
+            accP[i] += x - base;
+    }
+}
+
+template <class Sample>
+inline void SoftAvgSegment(ViInt32* accP, Sample const* dataP, long nbrSamples, SoftAvgConfig const& cfg)
+{
+    SoftAvgSegmentScalar(accP, dataP, nbrSamples, cfg);
+}
+
+#ifdef AQ_SSE2
+// Add four groups of four 32-bit values to accP[0..15]
+inline void SoftAvgAdd16(ViInt32* accP, __m128i a0, __m128i a1, __m128i a2, __m128i a3)
+{
+    __m128i* const p = (__m128i*)accP;
+    _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), a0));
+    _mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), a1));
+    _mm_storeu_si128(p + 2, _mm_add_epi32(_mm_loadu_si128(p + 2), a2));
+    _mm_storeu_si128(p + 3, _mm_add_epi32(_mm_loadu_si128(p + 3), a3));
+}
+
+template <>
+inline void SoftAvgSegment<ViInt8>(ViInt32* accP, ViInt8 const* dataP, long nbrSamples, SoftAvgConfig const& cfg)
+{
+    // A threshold below the 8-bit range keeps every sample, one above it drops them all
+    bool const suppress = cfg.thresholdEnable && cfg.threshold >= -128;
+    ViInt32 const thr = std::min<ViInt32>(cfg.threshold, 127);
+    ViInt32 const base = (cfg.thresholdEnable && cfg.noiseBaseEnable) ? cfg.noiseBase : 0;
+
+    // The 16-bit intermediate holds x - base only for a base within the 8-bit range
+    if (base < -128 || base > 127)
+    {
+        SoftAvgSegmentScalar(accP, dataP, nbrSamples, cfg);
+        return;
+    }
+
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const thrV = _mm_set1_epi8((char)thr);
+    __m128i const baseV = _mm_set1_epi16((short)base);
+
+    long i = 0;
+    for (; i + 16 <= nbrSamples; i += 16)
+    {
+        __m128i const v = _mm_loadu_si128((__m128i const*)(dataP + i));
+        __m128i const sign8 = _mm_cmpgt_epi8(zero, v);
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(v, sign8), baseV);
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(v, sign8), baseV);
+
+        if (suppress)
+        {
+            __m128i const keep = _mm_cmpgt_epi8(v, thrV);
+            lo = _mm_and_si128(lo, _mm_unpacklo_epi8(keep, keep));
+            hi = _mm_and_si128(hi, _mm_unpackhi_epi8(keep, keep));
+        }
+
+        __m128i const signLo = _mm_srai_epi16(lo, 15);
+        __m128i const signHi = _mm_srai_epi16(hi, 15);
+        SoftAvgAdd16(accP + i, _mm_unpacklo_epi16(lo, signLo), _mm_unpackhi_epi16(lo, signLo),
+                     _mm_unpacklo_epi16(hi, signHi), _mm_unpackhi_epi16(hi, signHi));
+    }
+
+    SoftAvgSegmentScalar(accP + i, dataP + i, nbrSamples - i, cfg);
+}
+
+template <>
+inline void SoftAvgSegment<ViInt16>(ViInt32* accP, ViInt16 const* dataP, long nbrSamples, SoftAvgConfig const& cfg)
+{
+    bool const suppress = cfg.thresholdEnable && cfg.threshold >= -32768;
+    ViInt32 const thr = std::min<ViInt32>(cfg.threshold, 32767);
+    ViInt32 const base = (cfg.thresholdEnable && cfg.noiseBaseEnable) ? cfg.noiseBase : 0;
+
+    __m128i const thrV = _mm_set1_epi16((short)thr);
+    __m128i const baseV = _mm_set1_epi32(base);
+
+    long i = 0;
+    for (; i + 8 <= nbrSamples; i += 8)
+    {
+        __m128i const v = _mm_loadu_si128((__m128i const*)(dataP + i));
+        __m128i const sign = _mm_srai_epi16(v, 15);
+        __m128i lo = _mm_sub_epi32(_mm_unpacklo_epi16(v, sign), baseV);
+        __m128i hi = _mm_sub_epi32(_mm_unpackhi_epi16(v, sign), baseV);
+
+        if (suppress)
+        {
+            __m128i const keep = _mm_cmpgt_epi16(v, thrV);
+            lo = _mm_and_si128(lo, _mm_unpacklo_epi16(keep, keep));
+            hi = _mm_and_si128(hi, _mm_unpackhi_epi16(keep, keep));
+        }
+
+        __m128i* const p = (__m128i*)(accP + i);
+        _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), lo));
+        _mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), hi));
+    }
+
+    SoftAvgSegmentScalar(accP + i, dataP + i, nbrSamples - i, cfg);
+}
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class SoftAverager
+{
+public:
+    SoftAverager(long nbrSamples, int nbrThreads, SoftAvgConfig const& cfg)
+        : m_nbrSamples(nbrSamples), m_nbrThreads(std::max(nbrThreads, 1)), m_cfg(cfg),
+          m_workers(m_nbrThreads)
+    {
+        for (int t = 0; t < m_nbrThreads; ++t)
+        {
+            m_workers[t].partial.assign(nbrSamples, 0);
+            m_workers[t].sums.assign(nbrSamples, 0);
+            m_workers[t].nbrPartial = 0;
+            m_workers[t].nbrWaveforms = 0;
+        }
+    }
+
+    long NbrSamples() const { return m_nbrSamples; }
+    int NbrThreads() const { return m_nbrThreads; }
+
+    // Add 'nbrSegments' segments of 'NbrSamples()' samples each. Segment s starts at
+    // dataP + s * segmentStride.
+    template <class Sample>
+    void AddSegments(Sample const* dataP, long nbrSegments, long segmentStride)
+    {
+        int const nbrUsed = (int)std::min<long>(m_nbrThreads, nbrSegments);
+        if (nbrUsed < 1)
+            return;
+
+        std::vector<std::thread> threads;
+        long first = 0;
+        for (int t = 0; t < nbrUsed; ++t)
+        {
+            long const last = nbrSegments * (t + 1) / nbrUsed;
+            if (t + 1 < nbrUsed)
+                threads.push_back(std::thread(&SoftAverager::Work<Sample>, this, t, dataP, first, last, segmentStride));
+            else
+                Work<Sample>(t, dataP, first, last, segmentStride);
+            first = last;
+        }
+
+        for (size_t n = 0; n < threads.size(); ++n)
+            threads[n].join();
+    }
+
+    // Merge the per-thread sums into 'sumP' ('NbrSamples()' values); returns the number
+    // of averaged waveforms
+    ViInt64 Sums(ViInt64* sumP)
+    {
+        std::fill(sumP, sumP + m_nbrSamples, ViInt64(0));
+        ViInt64 nbrWaveforms = 0;
+
+        for (int t = 0; t < m_nbrThreads; ++t)
+        {
+            Flush(m_workers[t]);
+            for (long i = 0; i < m_nbrSamples; ++i)
+                sumP[i] += m_workers[t].sums[i];
+            nbrWaveforms += m_workers[t].nbrWaveforms;
+        }
+        return nbrWaveforms;
+    }
+
+private:
+    struct Worker
+    {
+        std::vector<ViInt32> partial;       // 32-bit sums since the last flush
+        std::vector<ViInt64> sums;          // 64-bit sums
+        long nbrPartial;                    // segments in 'partial'
+        ViInt64 nbrWaveforms;
+    };
+
+    // Segments that can be added to 32-bit sums without overflow
+    template <class Sample>
+    long FlushLimit() const
+    {
+        ViInt64 maxAbs = (sizeof(Sample) == 1) ? 128 : 32768;
+        if (m_cfg.thresholdEnable && m_cfg.noiseBaseEnable)
+            maxAbs += (m_cfg.noiseBase < 0) ? -ViInt64(m_cfg.noiseBase) : ViInt64(m_cfg.noiseBase);
+        return long(0x7fffffffLL / maxAbs);
+    }
+
+    void Flush(Worker& w)
+    {
+        if (w.nbrPartial == 0)
+            return;
+        AccumulateInt32(&w.sums[0], &w.partial[0], m_nbrSamples);
+        std::fill(w.partial.begin(), w.partial.end(), 0);
+        w.nbrPartial = 0;
+    }
+
+    template <class Sample>
+    void Work(int t, Sample const* dataP, long first, long last, long segmentStride)
+    {
+        Worker& w = m_workers[t];
+        long const limit = FlushLimit<Sample>();
+
+        for (long s = first; s < last; ++s)
+        {
+            if (w.nbrPartial == limit)
+                Flush(w);
+            SoftAvgSegment(&w.partial[0], dataP + s * segmentStride, m_nbrSamples, m_cfg);
+            ++w.nbrPartial;
+            ++w.nbrWaveforms;
+        }
+    }
+
+    long m_nbrSamples;
+    int m_nbrThreads;
+    SoftAvgConfig m_cfg;
+    std::vector<Worker> m_workers;
+};
+
+#endif // SOFT_AVERAGER_H
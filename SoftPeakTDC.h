@@ -0,0 +1,187 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  SoftPeakTDC.h : Host-side peak detection on raw digitizer segments
+//----------------------------------------------------------------------------------------
+//
+//  Software version of the PeakTDC mode of the AP240 / U1084A for digitizers without it.
+//  It follows the firmware settings:
+//  - startDelta : a peak starts where a sample exceeds the previous one by at least
+//                 'startDelta' ("StartDeltaPosPeakV")
+//  - validDelta : the peak is valid once the signal has fallen by at least 'validDelta'
+//                 from its maximum ("ValidDeltaPosPeakV"); it is then reported and the
+//                 search for the next start begins
+//  - invertData : negative peaks ("InvertData")
+//  The deltas are in ADC codes of the data type read (see SoftPeakDelta()).
+//
+//  A first SSE2 pass skips 16 (8-bit) or 8 (16-bit) samples at a time while no start
+//  condition is met; only the regions around candidates are handled sample by sample.
+//  The maximum of each valid peak is refined with a parabola through its neighbours.
+//
+//  The output is the PeakTDC record stream (see PeakStream.h): a segment header with
+//  the timestamp, then one peak record per peak, position in 1/16 sample and amplitude
+//  in 1/16 LSB.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef SOFT_PEAK_TDC_H
+#define SOFT_PEAK_TDC_H
+
+#include <math.h>
+#include <vector>
+
+#include "AcqirisD1Import.h"
+#include "AqSimd.h"
+#include "PeakStream.h"
+
+
+struct SoftPeakConfig
+{
+    ViInt32 startDelta;                 // in ADC codes
+    ViInt32 validDelta;                 // in ADC codes
+    bool invertData;
+};
+
+// Convert a level difference in Volts into ADC codes with the data descriptor 'vGain'
+inline ViInt32 SoftPeakDelta(ViReal64 volts, ViReal64 vGain)
+{
+    ViInt32 const delta = ViInt32(ceil(volts / vGain - 1e-9));
+    return delta < 1 ? 1 : delta;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// First i >= 'first' where a peak may start, i.e. y[i+1] - y[i] >= startDelta with
+// y = x (-x if inverted); 'last' if there is none before 'last'
+template <class Sample>
+inline long SoftPeakScanScalar(Sample const* dataP, long first, long last, SoftPeakConfig const& cfg)
+{
+    long i = first;
+    for (; i < last; ++i)
+    {
+        ViInt32 const rise = ViInt32(dataP[i + 1]) - dataP[i];
+        if ((cfg.invertData ? -rise : rise) >= cfg.startDelta)
+            break;
+    }
+    return i;
+}
+
+template <class Sample>
+inline long SoftPeakScan(Sample const* dataP, long first, long last, SoftPeakConfig const& cfg)
+{
+    return SoftPeakScanScalar(dataP, first, last, cfg);
+}
+
+#ifdef AQ_SSE2
+template <>
+inline long SoftPeakScan<ViInt8>(ViInt8 const* dataP, long first, long last, SoftPeakConfig const& cfg)
+{
+    long i = first;
+
+    // Saturated 8-bit differences decide correctly for start deltas up to 127
+    if (cfg.startDelta <= 127)
+    {
+        __m128i const limit = _mm_set1_epi8((char)(cfg.startDelta - 1));
+        for (; i + 16 <= last; i += 16)
+        {
+            __m128i const v0 = _mm_loadu_si128((__m128i const*)(dataP + i));
+            __m128i const v1 = _mm_loadu_si128((__m128i const*)(dataP + i + 1));
+            __m128i const rise = cfg.invertData ? _mm_subs_epi8(v0, v1) : _mm_subs_epi8(v1, v0);
+            if (_mm_movemask_epi8(_mm_cmpgt_epi8(rise, limit)) != 0)
+                break;
+        }
+    }
+    return SoftPeakScanScalar(dataP, i, last, cfg);
+}
+
+template <>
+inline long SoftPeakScan<ViInt16>(ViInt16 const* dataP, long first, long last, SoftPeakConfig const& cfg)
+{
+    long i = first;
+
+    if (cfg.startDelta <= 32767)
+    {
+        __m128i const limit = _mm_set1_epi16((short)(cfg.startDelta - 1));
+        for (; i + 8 <= last; i += 8)
+        {
+            __m128i const v0 = _mm_loadu_si128((__m128i const*)(dataP + i));
+            __m128i const v1 = _mm_loadu_si128((__m128i const*)(dataP + i + 1));
+            __m128i const rise = cfg.invertData ? _mm_subs_epi16(v0, v1) : _mm_subs_epi16(v1, v0);
+            if (_mm_movemask_epi8(_mm_cmpgt_epi16(rise, limit)) != 0)
+                break;
+        }
+    }
+    return SoftPeakScanScalar(dataP, i, last, cfg);
+}
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Append the peak records of one segment of 'nbrSamples' samples to 'records' (two
+// 32-bit words per record); returns the number of peaks
+template <class Sample>
+inline long SoftPeakSegment(Sample const* dataP, long nbrSamples, SoftPeakConfig const& cfg,
+                            std::vector<ViUInt32>& records)
+{
+    ViInt32 const sign = cfg.invertData ? -1 : 1;
+    long const last = nbrSamples - 1;
+    long nbrPeaks = 0;
+    long i = 0;
+
+    while ((i = SoftPeakScan(dataP, i, last, cfg)) < last)
+    {
+        // Follow the peak from its start to the point where it is valid
+        long top = i + 1;
+        ViInt32 topValue = sign * dataP[top];
+        long j = i + 2;
+        for (; j < nbrSamples; ++j)
+        {
+            ViInt32 const y = sign * dataP[j];
+            if (y > topValue)
+            {
+                top = j;
+                topValue = y;
+            }
+            else if (topValue - y >= cfg.validDelta)
+                break;
+        }
+        if (j == nbrSamples)
+            break;                      // not valid before the end of the segment
+
+        // Parabola through the maximum and its neighbours; the maximum is strictly above
+        // the sample before it and at least equal to the one after it
+        double const a = sign * dataP[top - 1];
+        double const b = topValue;
+        double const c = sign * dataP[top + 1];
+        double const offset = 0.5 * (a - c) / (a - 2.0 * b + c);
+        double const amplitude = b - 0.25 * (a - c) * offset;
+
+        ViInt32 ampl16 = ViInt32(floor(amplitude * 16.0 + 0.5));
+        ampl16 = ampl16 > 0x7ffff ? 0x7ffff : (ampl16 < -0x80000 ? -0x80000 : ampl16);
+        records.push_back(ViUInt32(PeakTagPeak) << 24 | (ViUInt32(ampl16) & 0x000fffff));
+        records.push_back(ViUInt32(floor((top + offset) * 16.0 + 0.5)));
+        ++nbrPeaks;
+
+        i = j;
+    }
+
+    return nbrPeaks;
+}
+
+// Peak records of 'nbrSegments' segments, segment s at dataP + s * segmentStride, each
+// preceded by a segment header with the timestamp of segDescP[s]; returns the number
+// of peaks
+template <class Sample>
+inline long SoftPeakTDC(Sample const* dataP, long nbrSegments, long segmentStride, long nbrSamples,
+                        AqSegmentDescriptor const* segDescP, SoftPeakConfig const& cfg,
+                        std::vector<ViUInt32>& records)
+{
+    long nbrPeaks = 0;
+    for (long seg = 0; seg < nbrSegments; ++seg)
+    {
+        records.push_back(ViUInt32(PeakTagSegment) << 24 | (ViUInt32(segDescP[seg].timeStampHi) & 0x00ffffff));
+        records.push_back(ViUInt32(segDescP[seg].timeStampLo));
+        nbrPeaks += SoftPeakSegment(dataP + seg * segmentStride, nbrSamples, cfg, records);
+    }
+    return nbrPeaks;
+}
+
+#endif // SOFT_PEAK_TDC_H
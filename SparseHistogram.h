@@ -0,0 +1,270 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  SparseHistogram.h : Sparse storage of PeakTDC histograms
+//----------------------------------------------------------------------------------------
+//
+//  TDC histograms are mostly empty bins. SparseHistogram keeps only the non-zero bins,
+//  as ascending bin numbers with their counts. Merging, range sums and centroids work
+//  directly on this form; no dense array is rebuilt.
+//
+//  On file, a histogram is stored as:
+//  - SparseHistoFileHeader
+//  - 'nbrNonZero' pairs (bin - previous bin - 1, count), both as LEB128 variable length
+//    integers. A run of consecutive non-zero bins costs one byte per bin for the offset.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef SPARSE_HISTOGRAM_H
+#define SPARSE_HISTOGRAM_H
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+#include "AqSimd.h"
+
+
+struct SparseHistoFileHeader
+{
+    char magic[8];                                  // "AQSPH01"
+    ViUInt32 nbrBins;                               // dense size
+    ViUInt32 nbrNonZero;
+    ViUInt32 nbrBytes;                              // encoded pairs that follow
+    ViUInt32 reserved;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class SparseHistogram
+{
+public:
+    SparseHistogram() : m_nbrBins(0) {}
+    explicit SparseHistogram(ViUInt32 nbrBins) : m_nbrBins(nbrBins) {}
+
+    ViUInt32 NbrBins() const { return m_nbrBins; }
+    long NbrNonZero() const { return long(m_bins.size()); }
+    ViUInt32 Bin(long n) const { return m_bins[n]; }
+    ViUInt64 Count(long n) const { return m_counts[n]; }
+
+    // Build from 'nbrBins' dense bins (ViUInt16, ViUInt32 or ViUInt64)
+    template <class Bin>
+    void FromDense(Bin const* binsP, ViUInt32 nbrBins)
+    {
+        m_nbrBins = nbrBins;
+        m_bins.clear();
+        m_counts.clear();
+
+        ViUInt32 i = 0;
+        while (i < nbrBins)
+        {
+            i = SkipZeros(binsP, i, nbrBins);
+            for (; i < nbrBins && binsP[i] != 0; ++i)
+            {
+                m_bins.push_back(i);
+                m_counts.push_back(binsP[i]);
+            }
+        }
+    }
+
+    // Dense bins into 'binsP' ('NbrBins()' values)
+    void ToDense(ViUInt64* binsP) const
+    {
+        std::fill(binsP, binsP + m_nbrBins, ViUInt64(0));
+        for (size_t n = 0; n < m_bins.size(); ++n)
+            binsP[m_bins[n]] = m_counts[n];
+    }
+
+    // this += other, in one pass over both lists of non-zero bins
+    void Merge(SparseHistogram const& other)
+    {
+        std::vector<ViUInt32> bins;
+        std::vector<ViUInt64> counts;
+        bins.reserve(m_bins.size() + other.m_bins.size());
+        counts.reserve(m_bins.size() + other.m_bins.size());
+
+        size_t a = 0, b = 0;
+        while (a < m_bins.size() || b < other.m_bins.size())
+        {
+            if (b == other.m_bins.size() || (a < m_bins.size() && m_bins[a] < other.m_bins[b]))
+            {
+                bins.push_back(m_bins[a]);
+                counts.push_back(m_counts[a++]);
+            }
+            else if (a == m_bins.size() || other.m_bins[b] < m_bins[a])
+            {
+                bins.push_back(other.m_bins[b]);
+                counts.push_back(other.m_counts[b++]);
+            }
+            else
+            {
+                bins.push_back(m_bins[a]);
+                counts.push_back(m_counts[a++] + other.m_counts[b++]);
+            }
+        }
+
+        m_bins.swap(bins);
+        m_counts.swap(counts);
+        m_nbrBins = std::max(m_nbrBins, other.m_nbrBins);
+    }
+
+    // Sum of the counts in bins [firstBin, lastBin]
+    ViUInt64 Sum(ViUInt32 firstBin, ViUInt32 lastBin) const
+    {
+        ViUInt64 sum = 0;
+        for (size_t n = Lower(firstBin); n < m_bins.size() && m_bins[n] <= lastBin; ++n)
+            sum += m_counts[n];
+        return sum;
+    }
+
+    // Count-weighted mean bin of [firstBin, lastBin]; -1 if the range is empty
+    double Centroid(ViUInt32 firstBin, ViUInt32 lastBin) const
+    {
+        double sum = 0.0, weighted = 0.0;
+        for (size_t n = Lower(firstBin); n < m_bins.size() && m_bins[n] <= lastBin; ++n)
+        {
+            sum += double(m_counts[n]);
+            weighted += double(m_counts[n]) * m_bins[n];
+        }
+        return sum > 0.0 ? weighted / sum : -1.0;
+    }
+
+    // Centroid of all bins; -1 if empty (NbrBins() - 1 would wrap around for 0 bins)
+    double Centroid() const
+    {
+        return m_nbrBins == 0 ? -1.0 : Centroid(0, m_nbrBins - 1);
+    }
+
+    bool Write(FILE* file) const
+    {
+        std::vector<unsigned char> bytes;
+        bytes.reserve(m_bins.size() * 3);
+        ViUInt32 next = 0;
+        for (size_t n = 0; n < m_bins.size(); ++n)
+        {
+            PutVarint(bytes, m_bins[n] - next);
+            PutVarint(bytes, m_counts[n]);
+            next = m_bins[n] + 1;
+        }
+
+        SparseHistoFileHeader header;
+        ::memset(&header, 0, sizeof(header));
+        ::memcpy(header.magic, "AQSPH01", 8);
+        header.nbrBins = m_nbrBins;
+        header.nbrNonZero = ViUInt32(m_bins.size());
+        header.nbrBytes = ViUInt32(bytes.size());
+
+        return fwrite(&header, sizeof(header), 1, file) == 1
+            && (bytes.empty() || fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size());
+    }
+
+    // The histogram is left unchanged if the file does not hold a valid one
+    bool Read(FILE* file)
+    {
+        SparseHistoFileHeader header;
+        if (fread(&header, sizeof(header), 1, file) != 1 || ::memcmp(header.magic, "AQSPH01", 8) != 0)
+            return false;
+
+        // A pair takes 2 to MaxPairBytes bytes, and there is at most one per bin: check
+        // before allocating
+        if (header.nbrNonZero > header.nbrBins || header.nbrNonZero > header.nbrBytes / 2
+            || header.nbrBytes > ViUInt64(header.nbrNonZero) * MaxPairBytes)
+            return false;
+
+        std::vector<unsigned char> bytes(header.nbrBytes);
+        if (!bytes.empty() && fread(&bytes[0], 1, bytes.size(), file) != bytes.size())
+            return false;
+
+        std::vector<ViUInt32> bins(header.nbrNonZero);
+        std::vector<ViUInt64> counts(header.nbrNonZero);
+
+        size_t pos = 0;
+        ViUInt64 next = 0;
+        for (size_t n = 0; n < bins.size(); ++n)
+        {
+            ViUInt64 delta = 0;
+            if (!GetVarint(bytes, pos, delta) || !GetVarint(bytes, pos, counts[n]))
+                return false;
+            if (delta >= header.nbrBins - next)
+                return false;
+            next += delta;
+            bins[n] = ViUInt32(next++);
+        }
+        if (pos != bytes.size())
+            return false;
+
+        m_nbrBins = header.nbrBins;
+        m_bins.swap(bins);
+        m_counts.swap(counts);
+        return true;
+    }
+
+private:
+    enum { MaxPairBytes = 5 + 10 };     // LEB128 of a 32-bit offset and a 64-bit count
+
+    // Index of the first non-zero bin >= 'bin'
+    size_t Lower(ViUInt32 bin) const
+    {
+        return size_t(std::lower_bound(m_bins.begin(), m_bins.end(), bin) - m_bins.begin());
+    }
+
+    template <class Bin>
+    static ViUInt32 SkipZeros(Bin const* binsP, ViUInt32 i, ViUInt32 nbrBins)
+    {
+#ifdef AQ_SSE2
+        // 16 bytes of zero bins at a time
+        ViUInt32 const perVector = ViUInt32(16 / sizeof(Bin));
+        __m128i const zero = _mm_setzero_si128();
+        for (; i + perVector <= nbrBins; i += perVector)
+        {
+            __m128i const v = _mm_loadu_si128((__m128i const*)(binsP + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xffff)
+                break;
+        }
+#endif
+        while (i < nbrBins && binsP[i] == 0)
+            ++i;
+        return i;
+    }
+
+    static void PutVarint(std::vector<unsigned char>& bytes, ViUInt64 value)
+    {
+        while (value >= 0x80)
+        {
+            bytes.push_back((unsigned char)(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back((unsigned char)value);
+    }
+
+    static bool GetVarint(std::vector<unsigned char> const& bytes, size_t& pos, ViUInt64& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < bytes.size(); shift += 7)
+        {
+            unsigned char const byte = bytes[pos++];
+            value |= ViUInt64(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    ViUInt32 m_nbrBins;
+    std::vector<ViUInt32> m_bins;       // ascending non-zero bins
+    std::vector<ViUInt64> m_counts;
+};
+
+// Merge many histograms pairwise, so that every bin is copied O(log n) times
+inline SparseHistogram MergeSparseHistograms(std::vector<SparseHistogram> histograms)
+{
+    if (histograms.empty())
+        return SparseHistogram();
+
+    for (size_t step = 1; step < histograms.size(); step *= 2)
+        for (size_t n = 0; n + step < histograms.size(); n += 2 * step)
+            histograms[n].Merge(histograms[n + step]);
+    return histograms[0];
+}
+
+#endif // SPARSE_HISTOGRAM_H
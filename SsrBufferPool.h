@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  SsrBufferPool.h : Readout buffers for SSR and PeakTDC data sized from measured readouts
+//----------------------------------------------------------------------------------------
+//
+//  The size of an 'ReadModeSSRW' readout depends on the number and length of the gates
+//  found in the acquisition. Allocating for the worst case wastes memory for every
+//  buffer kept around; a fixed estimate overflows on a burst of gates.
+//
+//  SsrBufferPool keeps the 'actualDataSize' of the last 'historyLength' readouts and
+//  sizes its buffers to a percentile of them, plus a margin, rounded up to 4 KB and
+//  bounded by the worst case. Free buffers are kept in the pool; a buffer is only
+//  reallocated when it is too small for the current target or more than twice as large.
+//
+//  Read() reads one acquisition into a buffer of the pool. If the readout fails or fills
+//  the buffer completely, the buffer is grown to the worst case and the same acquisition
+//  is read again (the data stays in the digitizer until the next 'processData').
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef SSR_BUFFER_POOL_H
+#define SSR_BUFFER_POOL_H
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "AcqirisImport.h"
+#include "AcqirisD1Import.h"
+
+
+// Largest 'ReadModeSSRW' readout of threshold gates: every other sample starts a gate
+// of one sample, each with its 8-byte header, after the 8-byte segment header
+inline long SsrWorstCaseBytes(long nbrSamples, long nbrSegments)
+{
+    return (8 + (nbrSamples + 1) / 2 * (8 + 1)) * nbrSegments;
+}
+
+struct SsrBuffer
+{
+    std::vector<ViInt8> data;
+    long Size() const { return long(data.size()); }
+};
+
+struct SsrBufferStats
+{
+    long nbrReads;
+    long nbrRetries;                    // readouts repeated with a worst-case buffer
+    long nbrAllocations;
+    long peakBytes;                     // largest 'actualDataSize'
+    double sumBufferBytes;              // buffer size at every read
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class SsrBufferPool
+{
+public:
+    // 'initialBytes' is used until the first readout has been measured
+    SsrBufferPool(long initialBytes, long worstCaseBytes, double percentile = 0.99, double margin = 1.25,
+                  long historyLength = 256)
+        : m_initialBytes(initialBytes), m_worstCaseBytes(worstCaseBytes), m_percentile(percentile),
+          m_margin(margin), m_historyLength(std::max(historyLength, 1L)), m_nextHistory(0)
+    {
+        ::memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    ~SsrBufferPool()
+    {
+        for (size_t n = 0; n < m_free.size(); ++n)
+            delete m_free[n];
+    }
+
+    // Buffer size for the next readout
+    long TargetBytes() const
+    {
+        long target = m_initialBytes;
+        if (!m_history.empty())
+        {
+            std::vector<ViUInt32> sizes(m_history);
+            size_t const k = std::min(sizes.size() - 1, size_t(m_percentile * sizes.size()));
+            std::nth_element(sizes.begin(), sizes.begin() + k, sizes.end());
+            target = long(sizes[k] * m_margin);
+        }
+        target = (target + 4095) & ~4095L;
+        return std::max(4096L, std::min(target, m_worstCaseBytes));
+    }
+
+    // A buffer of at least 'TargetBytes()'; give it back with Put()
+    SsrBuffer* Get()
+    {
+        SsrBuffer* bufferP = NULL;
+        if (m_free.empty())
+            bufferP = new SsrBuffer;
+        else
+        {
+            bufferP = m_free.back();
+            m_free.pop_back();
+        }
+
+        long const target = TargetBytes();
+        if (bufferP->Size() < target || bufferP->Size() > 2 * target)
+            Resize(*bufferP, target);
+        return bufferP;
+    }
+
+    void Put(SsrBuffer* bufferP) { m_free.push_back(bufferP); }
+
+    // Read one acquisition into 'buffer'. 'readParam' is filled except for 'dataArraySize'.
+    ViStatus Read(ViSession instrId, ViInt32 channel, AqReadParameters readParam, SsrBuffer& buffer,
+                  AqDataDescriptor& dataDesc)
+    {
+        ViStatus status = ReadOnce(instrId, channel, readParam, buffer, dataDesc);
+        if ((status < VI_SUCCESS || long(dataDesc.actualDataSize) >= buffer.Size())
+            && buffer.Size() < m_worstCaseBytes)
+        {
+            ++m_stats.nbrRetries;
+            Resize(buffer, m_worstCaseBytes);
+            status = ReadOnce(instrId, channel, readParam, buffer, dataDesc);
+        }
+
+        if (status >= VI_SUCCESS)
+            Record(dataDesc.actualDataSize);
+        return status;
+    }
+
+    // Record a readout size measured outside Read()
+    void Record(ViUInt32 actualDataSize)
+    {
+        if (long(m_history.size()) < m_historyLength)
+            m_history.push_back(actualDataSize);
+        else
+            m_history[m_nextHistory] = actualDataSize;
+        m_nextHistory = (m_nextHistory + 1) % m_historyLength;
+        m_stats.peakBytes = std::max(m_stats.peakBytes, long(actualDataSize));
+    }
+
+    long WorstCaseBytes() const { return m_worstCaseBytes; }
+    SsrBufferStats const& Stats() const { return m_stats; }
+
+    // Mean buffer size over the reads, and the memory saved per buffer against the
+    // worst-case allocation
+    double MeanBufferBytes() const { return m_stats.nbrReads > 0 ? m_stats.sumBufferBytes / m_stats.nbrReads : 0.0; }
+    double SavedBytes() const { return m_worstCaseBytes - MeanBufferBytes(); }
+
+private:
+    ViStatus ReadOnce(ViSession instrId, ViInt32 channel, AqReadParameters& readParam, SsrBuffer& buffer,
+                      AqDataDescriptor& dataDesc)
+    {
+        ++m_stats.nbrReads;
+        m_stats.sumBufferBytes += buffer.Size();
+
+        readParam.dataArraySize = ViInt32(buffer.Size());
+        ::memset(&dataDesc, 0, sizeof(dataDesc));
+        return AcqrsD1_readData(instrId, channel, &readParam, &buffer.data[0], &dataDesc, NULL);
+    }
+
+    void Resize(SsrBuffer& buffer, long nbrBytes)
+    {
+        // Swap to release the old capacity when shrinking
+        std::vector<ViInt8>(nbrBytes).swap(buffer.data);
+        ++m_stats.nbrAllocations;
+    }
+
+    long m_initialBytes;
+    long m_worstCaseBytes;
+    double m_percentile;
+    double m_margin;
+    long m_historyLength;
+    std::vector<ViUInt32> m_history;    // ring of the last readout sizes
+    long m_nextHistory;
+    std::vector<SsrBuffer*> m_free;
+    SsrBufferStats m_stats;
+};
+
+#endif // SSR_BUFFER_POOL_H
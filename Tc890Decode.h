@@ -0,0 +1,263 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Tc890Decode.h : Decoding of the raw 32-bit words of the TC890 time-to-digital converter
+//----------------------------------------------------------------------------------------
+//
+//  In continuous mode ('ReadRawData') every word is
+//      bit 31      flag: 0 = hit, 1 = marker (overflow of the time counter, ...)
+//      bits 30-28  channel, 0 = common channel
+//      bits 27-0   count
+//  The common channel counts its events: two consecutive common hits differ by one
+//  (modulo 2^28), otherwise events were lost.
+//
+//  Tc890Decoder follows the stream across readouts. Split() sorts the counts of a
+//  readout into one array per channel (Tc890Split) in two passes:
+//  - SSE2: 16 words at a time are reduced to one key byte each (channel, or 8 for a
+//    marker) and the keys are counted with byte compares, without branches
+//  - the arrays are sized from the key counts and every count is stored by its key
+//  The gaps in the common count are then found in the common array, 4 differences at a
+//  time; only the rare vectors with a gap are looked at one by one.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef TC890_DECODE_H
+#define TC890_DECODE_H
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+#include "AqSimd.h"
+
+
+enum { Tc890NbrChannels = 8, Tc890MarkerKey = 8, Tc890CountMask = 0x0fffffff };
+
+inline ViUInt32 Tc890Flag(ViUInt32 word) { return word >> 31; }
+inline ViUInt32 Tc890Channel(ViUInt32 word) { return (word >> 28) & 0x7; }
+inline ViUInt32 Tc890Count(ViUInt32 word) { return word & Tc890CountMask; }
+
+// Channel of a hit, Tc890MarkerKey for a marker
+inline ViUInt32 Tc890Key(ViUInt32 word) { return (word >> 31) ? ViUInt32(Tc890MarkerKey) : Tc890Channel(word); }
+
+struct Tc890Gap
+{
+    ViUInt64 commonHit;                 // common hit after the gap, counted from the start
+    ViUInt32 countLast;
+    ViUInt32 count;
+};
+
+// Counts of one readout, by channel (the markers are only counted)
+struct Tc890Split
+{
+    std::vector<ViUInt32> counts[Tc890NbrChannels];
+    ViUInt64 nbrMarkers;
+
+    void Clear()
+    {
+        for (int ch = 0; ch < Tc890NbrChannels; ++ch)
+            counts[ch].clear();
+        nbrMarkers = 0;
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Key of every word into 'keysP' and the number of words per key into 'nbrPerKey'
+// (Tc890NbrChannels + 1 values, added to)
+inline void Tc890Keys(ViUInt32 const* wordsP, long nbrWords, ViUInt8* keysP, ViUInt64* nbrPerKey)
+{
+    long n = 0;
+#ifdef AQ_SSE2
+    __m128i const mask7 = _mm_set1_epi32(7);
+    __m128i const marker = _mm_set1_epi32(Tc890MarkerKey);
+    __m128i const one = _mm_set1_epi8(1);
+    __m128i keyV[Tc890NbrChannels + 1];
+    for (int k = 0; k <= Tc890NbrChannels; ++k)
+        keyV[k] = _mm_set1_epi8(char(k));
+
+    while (n + 16 <= nbrWords)
+    {
+        // Byte counters, flushed before they can wrap
+        __m128i acc[Tc890NbrChannels + 1];
+        for (int k = 0; k <= Tc890NbrChannels; ++k)
+            acc[k] = _mm_setzero_si128();
+
+        long const end = n + 16 * std::min<long>(255, (nbrWords - n) / 16);
+        for (; n < end; n += 16)
+        {
+            __m128i key32[4];
+            for (int q = 0; q < 4; ++q)
+            {
+                __m128i const w = _mm_loadu_si128((__m128i const*)(wordsP + n + 4 * q));
+                __m128i const flag = _mm_srai_epi32(w, 31);
+                __m128i const channel = _mm_and_si128(_mm_srli_epi32(w, 28), mask7);
+                key32[q] = _mm_or_si128(_mm_andnot_si128(flag, channel), _mm_and_si128(flag, marker));
+            }
+            __m128i const keys = _mm_packus_epi16(_mm_packs_epi32(key32[0], key32[1]),
+                                                  _mm_packs_epi32(key32[2], key32[3]));
+            _mm_storeu_si128((__m128i*)(keysP + n), keys);
+
+            for (int k = 0; k <= Tc890NbrChannels; ++k)
+                acc[k] = _mm_add_epi8(acc[k], _mm_and_si128(_mm_cmpeq_epi8(keys, keyV[k]), one));
+        }
+
+        // Horizontal sums of the byte counters
+        for (int k = 0; k <= Tc890NbrChannels; ++k)
+        {
+            __m128i const sums = _mm_sad_epu8(acc[k], _mm_setzero_si128());
+            nbrPerKey[k] += ViUInt64(_mm_cvtsi128_si32(sums)) + ViUInt64(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+        }
+    }
+#endif
+    for (; n < nbrWords; ++n)
+    {
+        keysP[n] = ViUInt8(Tc890Key(wordsP[n]));
+        ++nbrPerKey[keysP[n]];
+    }
+}
+
+// Positions i in [0, nbrCounts - 1) where counts[i + 1] - counts[i] != 1 (modulo 2^28)
+inline void Tc890FindGaps(ViUInt32 const* countsP, long nbrCounts, std::vector<long>& positions)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128i const mask = _mm_set1_epi32(Tc890CountMask);
+    __m128i const one = _mm_set1_epi32(1);
+    for (; i + 5 <= nbrCounts; i += 4)
+    {
+        __m128i const c0 = _mm_loadu_si128((__m128i const*)(countsP + i));
+        __m128i const c1 = _mm_loadu_si128((__m128i const*)(countsP + i + 1));
+        __m128i const step = _mm_and_si128(_mm_sub_epi32(c1, c0), mask);
+        int const bad = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(step, one))) & 0xf;
+        if (bad != 0)
+        {
+            for (int q = 0; q < 4; ++q)
+                if (bad & (1 << q))
+                    positions.push_back(i + q);
+        }
+    }
+#endif
+    for (; i + 1 < nbrCounts; ++i)
+        if (((countsP[i + 1] - countsP[i]) & Tc890CountMask) != 1)
+            positions.push_back(i);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class Tc890Decoder
+{
+public:
+    enum { MaxGaps = 1024 };            // gaps kept until ClearGaps()
+
+    Tc890Decoder() { Reset(); }
+
+    void Reset()
+    {
+        ::memset(m_hits, 0, sizeof(m_hits));
+        m_nbrMarkers = 0;
+        m_nbrWords = 0;
+        m_nbrGaps = 0;
+        m_countLast = 0;
+        m_haveCommon = false;
+        m_gaps.clear();
+    }
+
+    // Decode the next 'nbrWords' words of the stream into 'split' (cleared first)
+    void Split(ViUInt32 const* wordsP, long nbrWords, Tc890Split& split)
+    {
+        split.Clear();
+        m_keys.resize(nbrWords > 0 ? nbrWords : 1);
+
+        ViUInt64 nbrPerKey[Tc890NbrChannels + 1] = {0};
+        Tc890Keys(wordsP, nbrWords, &m_keys[0], nbrPerKey);
+
+        // Store every count by its key; the markers all go to one scratch slot
+        ViUInt32 markerSink = 0;
+        ViUInt32* baseP[Tc890NbrChannels + 1];
+        for (int ch = 0; ch < Tc890NbrChannels; ++ch)
+        {
+            split.counts[ch].resize(size_t(nbrPerKey[ch]));
+            baseP[ch] = split.counts[ch].empty() ? &markerSink : &split.counts[ch][0];
+        }
+        baseP[Tc890MarkerKey] = &markerSink;
+
+        // Markers always write to index 0 of their slot
+        long next[Tc890NbrChannels + 1] = {0};
+        long const keep[Tc890NbrChannels + 1] = {-1, -1, -1, -1, -1, -1, -1, -1, 0};
+        ViUInt8 const* const keysP = &m_keys[0];
+        for (long n = 0; n < nbrWords; ++n)
+        {
+            ViUInt32 const key = keysP[n];
+            baseP[key][next[key] & keep[key]] = Tc890Count(wordsP[n]);
+            ++next[key];
+        }
+
+        split.nbrMarkers = nbrPerKey[Tc890MarkerKey];
+        for (int ch = 0; ch < Tc890NbrChannels; ++ch)
+            m_hits[ch] += nbrPerKey[ch];
+        m_nbrMarkers += split.nbrMarkers;
+        m_nbrWords += nbrWords;
+
+        CheckCommon(split.counts[0]);
+    }
+
+    // Decode without keeping the counts
+    void Decode(ViUInt32 const* wordsP, long nbrWords) { Split(wordsP, nbrWords, m_split); }
+
+    ViUInt64 NbrWords() const { return m_nbrWords; }
+    ViUInt64 NbrHits(int channel) const { return m_hits[channel]; }
+    ViUInt64 NbrMarkers() const { return m_nbrMarkers; }
+    ViUInt64 NbrGaps() const { return m_nbrGaps; }
+    ViUInt32 CountLast() const { return m_countLast; }
+
+    // Gaps found since the last ClearGaps(), at most MaxGaps of them
+    std::vector<Tc890Gap> const& Gaps() const { return m_gaps; }
+    void ClearGaps() { m_gaps.clear(); }
+
+private:
+    void CheckCommon(std::vector<ViUInt32> const& common)
+    {
+        if (common.empty())
+            return;
+
+        // The first common hit of the readout continues the previous readout
+        ViUInt64 const firstHit = m_hits[0] - common.size();
+        if (m_haveCommon && ((common[0] - m_countLast) & Tc890CountMask) != 1)
+            AddGap(firstHit, m_countLast, common[0]);
+
+        m_positions.clear();
+        Tc890FindGaps(&common[0], long(common.size()), m_positions);
+        for (size_t n = 0; n < m_positions.size(); ++n)
+            AddGap(firstHit + m_positions[n] + 1, common[m_positions[n]], common[m_positions[n] + 1]);
+
+        m_countLast = common.back();
+        m_haveCommon = true;
+    }
+
+    void AddGap(ViUInt64 commonHit, ViUInt32 countLast, ViUInt32 count)
+    {
+        ++m_nbrGaps;
+        if (m_gaps.size() < MaxGaps)
+        {
+            Tc890Gap gap;
+            gap.commonHit = commonHit;
+            gap.countLast = countLast;
+            gap.count = count;
+            m_gaps.push_back(gap);
+        }
+    }
+
+    ViUInt64 m_hits[Tc890NbrChannels];
+    ViUInt64 m_nbrMarkers;
+    ViUInt64 m_nbrWords;
+    ViUInt64 m_nbrGaps;
+    ViUInt32 m_countLast;
+    bool m_haveCommon;
+    std::vector<Tc890Gap> m_gaps;
+
+    std::vector<ViUInt8> m_keys;        // work space of Split()
+    std::vector<long> m_positions;
+    Tc890Split m_split;                 // for Decode()
+};
+
+#endif // TC890_DECODE_H
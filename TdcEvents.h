@@ -0,0 +1,428 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  TdcEvents.h : Online start-stop event building and time-of-flight histograms for TDCs
+//----------------------------------------------------------------------------------------
+//
+//  An event is a common start and the stop hits measured against it, in seconds. The
+//  TC890 stream is cut into events at every common hit (channel 0): the stop hits that
+//  follow, up to the next common hit, belong to it and their count is the time since
+//  the start in units of 'countUnit'. Markers are skipped. An event still open at the
+//  end of a readout is carried over to the next one, unless DropOpenEvent() tells that
+//  the next readout does not follow it (a bank was lost). The TC84x reads one row of
+//  channel times per event, in seconds or in counts of 'countUnit', a time <= 0 meaning
+//  no hit.
+//
+//  An event is accepted when every channel of 'requireMask' has a hit and, with
+//  'window' > 0, the first hits of these channels are within 'window' of each other.
+//  For an accepted event every hit fills the histogram of its channel (time since the
+//  start) and every pair of hits on channels a < b fills the histogram of the pair
+//  (t_b - t_a, centred on 0). At most 'MaxHitsPerChannel' hits per channel are kept,
+//  the others are counted as lost.
+//
+//  TdcEventEngine spreads a readout over several threads. The TC890 words are split at
+//  common hits, so no event is shared by two threads. Every thread fills its own 32-bit
+//  histograms; after the join they are added into the 64-bit totals (TdcHistogram.h)
+//  and cleared, so the threads never share a bin and need no lock.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef TDC_EVENTS_H
+#define TDC_EVENTS_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "vpptype.h"
+#include "TdcHistogram.h"
+
+
+enum { TdcMaxChannels = 16, MaxHitsPerChannel = 16 };
+
+struct TdcEventConfig
+{
+    long nbrChannels;                   // channels 0 .. nbrChannels - 1, at most TdcMaxChannels
+    double countUnit;                   // seconds per count of a stop hit (TC890, TC84x raw)
+    double binWidth;                    // in seconds, for all histograms
+    long nbrBins;                       // per channel, from 0
+    long nbrPairBins;                   // per pair, from -nbrPairBins / 2 * binWidth
+    ViUInt32 requireMask;               // channels that must all have a hit, 0 = none
+    double window;                      // in seconds, 0 = no limit
+};
+
+// Hits of one event, by channel
+struct TdcEvent
+{
+    long nbrHits[TdcMaxChannels];
+    double time[TdcMaxChannels][MaxHitsPerChannel];
+};
+
+struct TdcEventStats
+{
+    ViUInt64 nbrEvents;
+    ViUInt64 nbrAccepted;
+    ViUInt64 nbrHits;                   // in accepted events
+    ViUInt64 nbrLostHits;               // beyond MaxHitsPerChannel
+    ViUInt64 nbrOutOfRange;             // channel or pair time outside its histogram
+    ViUInt64 nbrOrphans;                // stop hits before the first common hit
+    ViUInt64 nbrDropped;                // open events discarded by DropOpenEvent()
+
+    void Clear() { ::memset(this, 0, sizeof(*this)); }
+
+    void Add(TdcEventStats const& other)
+    {
+        nbrEvents += other.nbrEvents;
+        nbrAccepted += other.nbrAccepted;
+        nbrHits += other.nbrHits;
+        nbrLostHits += other.nbrLostHits;
+        nbrOutOfRange += other.nbrOutOfRange;
+        nbrOrphans += other.nbrOrphans;
+        nbrDropped += other.nbrDropped;
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class TdcEventEngine
+{
+public:
+    TdcEventEngine(int nbrThreads, TdcEventConfig const& cfg)
+        : m_nbrThreads(std::max(nbrThreads, 1)), m_cfg(cfg), m_workers(m_nbrThreads)
+    {
+        m_cfg.nbrChannels = std::min<long>(std::max<long>(m_cfg.nbrChannels, 1), TdcMaxChannels);
+        m_nbrPairs = m_cfg.nbrChannels * (m_cfg.nbrChannels - 1) / 2;
+        for (int t = 0; t < m_nbrThreads; ++t)
+        {
+            m_workers[t].channelBins.resize(m_cfg.nbrChannels * m_cfg.nbrBins);
+            m_workers[t].pairBins.resize(m_nbrPairs * m_cfg.nbrPairBins);
+        }
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_channelBins.assign(m_cfg.nbrChannels * m_cfg.nbrBins, ViUInt64(0));
+        m_pairBins.assign(m_nbrPairs * m_cfg.nbrPairBins, ViUInt64(0));
+        m_stats.Clear();
+        m_haveStart = false;
+        ClearEvent(m_open);
+        for (int t = 0; t < m_nbrThreads; ++t)
+            ClearWorker(m_workers[t]);
+    }
+
+    int NbrThreads() const { return m_nbrThreads; }
+    TdcEventConfig const& Config() const { return m_cfg; }
+    TdcEventStats const& Stats() const { return m_stats; }
+
+    // Histograms: bin i of a channel starts at i * binWidth, bin i of a pair a < b at
+    // (i - nbrPairBins / 2) * binWidth
+    long NbrPairs() const { return m_nbrPairs; }
+    ViUInt64 const* ChannelHistogram(long channel) const { return &m_channelBins[channel * m_cfg.nbrBins]; }
+    ViUInt64 const* PairHistogram(long a, long b) const { return &m_pairBins[PairIndex(a, b) * m_cfg.nbrPairBins]; }
+    double PairBinLowEdge(long bin) const { return (bin - m_cfg.nbrPairBins / 2) * m_cfg.binWidth; }
+
+    // Next 'nbrWords' raw words of a TC890 continuous stream
+    void AddTc890(ViUInt32 const* wordsP, long nbrWords)
+    {
+        if (nbrWords <= 0)
+            return;
+
+        // Threads start on a common hit, the first one continues the open event. Empty
+        // ranges are dropped so that the last thread always ends the readout.
+        int const nbrSplit = (int)std::max<long>(1, std::min<long>(m_nbrThreads, nbrWords / 4096));
+        std::vector<long> bounds(1, 0);
+        for (int t = 1; t < nbrSplit; ++t)
+        {
+            long n = std::max(bounds.back(), nbrWords * t / nbrSplit);
+            while (n < nbrWords && !IsCommon(wordsP[n]))
+                ++n;
+            bounds.push_back(n);
+        }
+        bounds.push_back(nbrWords);
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        int const nbrUsed = int(bounds.size()) - 1;
+
+        // The last thread replaces m_open while the first one runs
+        m_workers[0].event = m_open;
+        m_workers[0].open = m_haveStart;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nbrUsed; ++t)
+        {
+            if (t + 1 < nbrUsed)
+                threads.push_back(std::thread(&TdcEventEngine::WorkTc890, this, t, wordsP, bounds[t],
+                                              bounds[t + 1], false));
+            else
+                WorkTc890(t, wordsP, bounds[t], bounds[t + 1], true);
+        }
+        for (size_t n = 0; n < threads.size(); ++n)
+            threads[n].join();
+
+        Merge(nbrUsed);
+    }
+
+    // The next readout does not continue the last one: its stop hits up to the first
+    // common hit are orphans instead of hits of the open event
+    void DropOpenEvent()
+    {
+        if (m_haveStart)
+            ++m_stats.nbrDropped;
+        m_haveStart = false;
+        ClearEvent(m_open);
+    }
+
+    // 'nbrEvents' rows of nbrChannels times in seconds, row e at timesP + e * rowStride
+    void AddRows(ViReal64 const* timesP, long nbrEvents, long rowStride)
+    {
+        AddRowsOf<ViReal64>(timesP, nbrEvents, rowStride, 1.0);
+    }
+
+    // The same with the times in counts of 'countUnit' (TC84x 'ReadInt32')
+    void AddRows(ViInt32 const* countsP, long nbrEvents, long rowStride)
+    {
+        AddRowsOf<ViInt32>(countsP, nbrEvents, rowStride, m_cfg.countUnit);
+    }
+
+    // Non-empty bins as text: "# channel c" or "# pair a b" then low edge in s, count
+    bool WriteHistograms(char const* fileName) const
+    {
+        FILE* file = fopen(fileName, "w");
+        if (file == NULL)
+            return false;
+
+        fprintf(file, "# Events\t%llu\taccepted\t%llu\n", (unsigned long long)m_stats.nbrEvents,
+                (unsigned long long)m_stats.nbrAccepted);
+        for (long ch = 0; ch < m_cfg.nbrChannels; ++ch)
+        {
+            ViUInt64 const* binsP = ChannelHistogram(ch);
+            fprintf(file, "# channel %ld\n", ch);
+            for (long bin = 0; bin < m_cfg.nbrBins; ++bin)
+                if (binsP[bin] != 0)
+                    fprintf(file, "%g\t%llu\n", bin * m_cfg.binWidth, (unsigned long long)binsP[bin]);
+        }
+        for (long a = 0; a < m_cfg.nbrChannels; ++a)
+            for (long b = a + 1; b < m_cfg.nbrChannels; ++b)
+            {
+                ViUInt64 const* binsP = PairHistogram(a, b);
+                fprintf(file, "# pair %ld %ld\n", a, b);
+                for (long bin = 0; bin < m_cfg.nbrPairBins; ++bin)
+                    if (binsP[bin] != 0)
+                        fprintf(file, "%g\t%llu\n", PairBinLowEdge(bin), (unsigned long long)binsP[bin]);
+            }
+
+        return fclose(file) == 0;
+    }
+
+private:
+    struct Worker
+    {
+        std::vector<ViUInt32> channelBins;
+        std::vector<ViUInt32> pairBins;
+        TdcEventStats stats;
+        TdcEvent event;
+        bool open;                      // 'event' has its common hit
+    };
+
+    static bool IsCommon(ViUInt32 word) { return (word >> 28) == 0; }
+
+    long PairIndex(long a, long b) const { return a * m_cfg.nbrChannels - a * (a + 1) / 2 + (b - a - 1); }
+
+    void ClearEvent(TdcEvent& event) const
+    {
+        for (long ch = 0; ch < m_cfg.nbrChannels; ++ch)
+            event.nbrHits[ch] = 0;
+    }
+
+    void ClearWorker(Worker& w) const
+    {
+        std::fill(w.channelBins.begin(), w.channelBins.end(), ViUInt32(0));
+        std::fill(w.pairBins.begin(), w.pairBins.end(), ViUInt32(0));
+        w.stats.Clear();
+    }
+
+    // Totals += per-thread histograms, which are cleared for the next readout
+    void Merge(int nbrUsed)
+    {
+        for (int t = 0; t < nbrUsed; ++t)
+        {
+            Worker& w = m_workers[t];
+            m_stats.Add(w.stats);
+            if (w.stats.nbrAccepted != 0)
+            {
+                if (!m_channelBins.empty())
+                    MergeHistogram32(&m_channelBins[0], &w.channelBins[0], long(m_channelBins.size()));
+                if (!m_pairBins.empty())
+                    MergeHistogram32(&m_pairBins[0], &w.pairBins[0], long(m_pairBins.size()));
+                ClearWorker(w);
+            }
+            w.stats.Clear();
+        }
+    }
+
+    void AddHit(Worker& w, long channel, double time) const
+    {
+        long& nbr = w.event.nbrHits[channel];
+        if (nbr < MaxHitsPerChannel)
+            w.event.time[channel][nbr++] = time;
+        else
+            ++w.stats.nbrLostHits;
+    }
+
+    void WorkTc890(int t, ViUInt32 const* wordsP, long first, long last, bool keepOpen)
+    {
+        Worker& w = m_workers[t];
+        bool open = (t == 0) && w.open;
+
+        for (long n = first; n < last; ++n)
+        {
+            ViUInt32 const word = wordsP[n];
+            if (word >> 31)
+                continue;
+
+            long const channel = long(word >> 28);
+            if (channel == 0)
+            {
+                if (open)
+                    Fill(w);
+                ClearEvent(w.event);
+                open = true;
+            }
+            else if (!open)
+                ++w.stats.nbrOrphans;
+            else if (channel < m_cfg.nbrChannels)
+                AddHit(w, channel, (word & 0x0fffffff) * m_cfg.countUnit);
+        }
+
+        // The last thread hands its open event to the next readout, the others end on
+        // the common hit that starts the next thread
+        if (keepOpen)
+        {
+            m_open = w.event;
+            m_haveStart = open;
+        }
+        else if (open)
+            Fill(w);
+    }
+
+    template <class Value>
+    void AddRowsOf(Value const* rowsP, long nbrEvents, long rowStride, double unit)
+    {
+        int const nbrUsed = (int)std::max<long>(1, std::min<long>(m_nbrThreads, nbrEvents / 1024));
+
+        std::vector<std::thread> threads;
+        long first = 0;
+        for (int t = 0; t < nbrUsed; ++t)
+        {
+            long const last = nbrEvents * (t + 1) / nbrUsed;
+            if (t + 1 < nbrUsed)
+                threads.push_back(std::thread(&TdcEventEngine::WorkRows<Value>, this, t, rowsP, first, last,
+                                              rowStride, unit));
+            else
+                WorkRows<Value>(t, rowsP, first, last, rowStride, unit);
+            first = last;
+        }
+        for (size_t n = 0; n < threads.size(); ++n)
+            threads[n].join();
+
+        Merge(nbrUsed);
+    }
+
+    template <class Value>
+    void WorkRows(int t, Value const* rowsP, long first, long last, long rowStride, double unit)
+    {
+        Worker& w = m_workers[t];
+        for (long e = first; e < last; ++e)
+        {
+            Value const* const rowP = rowsP + e * rowStride;
+            ClearEvent(w.event);
+            for (long ch = 0; ch < m_cfg.nbrChannels; ++ch)
+                if (rowP[ch] > 0)
+                    AddHit(w, ch, rowP[ch] * unit);
+            Fill(w);
+        }
+    }
+
+    bool Accept(TdcEvent const& event) const
+    {
+        double earliest = 0.0, latest = 0.0;
+        bool any = false;
+        for (long ch = 0; ch < m_cfg.nbrChannels; ++ch)
+        {
+            if (!(m_cfg.requireMask & (1u << ch)))
+                continue;
+            if (event.nbrHits[ch] == 0)
+                return false;
+            double const t = event.time[ch][0];
+            earliest = (!any || t < earliest) ? t : earliest;
+            latest = (!any || t > latest) ? t : latest;
+            any = true;
+        }
+        return m_cfg.window <= 0.0 || latest - earliest <= m_cfg.window;
+    }
+
+    void Fill(Worker& w) const
+    {
+        TdcEvent const& event = w.event;
+        ++w.stats.nbrEvents;
+        if (!Accept(event))
+            return;
+        ++w.stats.nbrAccepted;
+
+        // A time on a bin edge (a whole number of counts) stays in the upper bin despite
+        // the rounding of the conversion to seconds
+        double const invWidth = 1.0 / m_cfg.binWidth;
+        double const edge = 1.0e-6;
+        long const half = m_cfg.nbrPairBins / 2;
+        for (long a = 0; a < m_cfg.nbrChannels; ++a)
+        {
+            long const nbrA = event.nbrHits[a];
+            if (nbrA == 0)
+                continue;
+            w.stats.nbrHits += nbrA;
+
+            ViUInt32* const binsP = &w.channelBins[a * m_cfg.nbrBins];
+            for (long i = 0; i < nbrA; ++i)
+            {
+                double const x = floor(event.time[a][i] * invWidth + edge);
+                if (x >= 0.0 && x < m_cfg.nbrBins)
+                    ++binsP[long(x)];
+                else
+                    ++w.stats.nbrOutOfRange;
+            }
+
+            for (long b = a + 1; b < m_cfg.nbrChannels; ++b)
+            {
+                long const nbrB = event.nbrHits[b];
+                if (nbrB == 0)
+                    continue;
+                ViUInt32* const pairP = &w.pairBins[PairIndex(a, b) * m_cfg.nbrPairBins];
+                for (long i = 0; i < nbrA; ++i)
+                    for (long j = 0; j < nbrB; ++j)
+                    {
+                        double const x = floor((event.time[b][j] - event.time[a][i]) * invWidth + edge) + half;
+                        if (x >= 0.0 && x < m_cfg.nbrPairBins)
+                            ++pairP[long(x)];
+                        else
+                            ++w.stats.nbrOutOfRange;
+                    }
+            }
+        }
+    }
+
+    int m_nbrThreads;
+    TdcEventConfig m_cfg;
+    long m_nbrPairs;
+
+    std::vector<ViUInt64> m_channelBins;
+    std::vector<ViUInt64> m_pairBins;
+    TdcEventStats m_stats;
+
+    TdcEvent m_open;                    // TC890: event still open at the end of the last readout
+    bool m_haveStart;
+
+    std::vector<Worker> m_workers;
+};
+
+#endif // TDC_EVENTS_H
@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  TdcHistogram.h : Host-side accumulation of PeakTDC histograms
+//----------------------------------------------------------------------------------------
+//
+//  The on-board histogram has 16-bit or 32-bit bins ('TdcHistogramDepth'). For long runs
+//  the histogram is read block by block with clearing, and every block is added into
+//  64-bit bins on the host, which do not saturate.
+//
+//  Checkpoint() writes the merged histogram to a temporary file which then replaces the
+//  previous checkpoint, so a reader never sees a partly written file:
+//  - TdcHistoFileHeader
+//  - nbrSegments x nbrBinsPerSeg ViUInt64 bins, segment after segment
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef TDC_HISTOGRAM_H
+#define TDC_HISTOGRAM_H
+
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+#include "AqSimd.h"
+
+
+struct TdcHistoFileHeader
+{
+    char magic[8];                                  // "AQHST01"
+    ViInt32 nbrSegments;
+    ViInt32 nbrBinsPerSeg;
+    ViUInt64 nbrBlocks;                             // readouts merged
+    ViUInt64 nbrWaveforms;                          // acquisitions merged
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// sumP[i] += binsP[i] for 'nbrBins' unsigned 32-bit bins
+inline void MergeHistogram32(ViUInt64* sumP, ViUInt32 const* binsP, long nbrBins)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128i const zero = _mm_setzero_si128();
+    for (; i + 4 <= nbrBins; i += 4)
+    {
+        __m128i const v = _mm_loadu_si128((__m128i const*)(binsP + i));
+        __m128i* const sP = (__m128i*)(sumP + i);
+
+        _mm_storeu_si128(sP, _mm_add_epi64(_mm_loadu_si128(sP), _mm_unpacklo_epi32(v, zero)));
+        _mm_storeu_si128(sP + 1, _mm_add_epi64(_mm_loadu_si128(sP + 1), _mm_unpackhi_epi32(v, zero)));
+    }
+#endif
+    for (; i < nbrBins; ++i)
+        sumP[i] += binsP[i];
+}
+
+// sumP[i] += binsP[i] for 'nbrBins' unsigned 16-bit bins
+inline void MergeHistogram16(ViUInt64* sumP, ViUInt16 const* binsP, long nbrBins)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128i const zero = _mm_setzero_si128();
+    for (; i + 8 <= nbrBins; i += 8)
+    {
+        __m128i const v = _mm_loadu_si128((__m128i const*)(binsP + i));
+        __m128i const lo = _mm_unpacklo_epi16(v, zero);
+        __m128i const hi = _mm_unpackhi_epi16(v, zero);
+        __m128i* const sP = (__m128i*)(sumP + i);
+
+        _mm_storeu_si128(sP, _mm_add_epi64(_mm_loadu_si128(sP), _mm_unpacklo_epi32(lo, zero)));
+        _mm_storeu_si128(sP + 1, _mm_add_epi64(_mm_loadu_si128(sP + 1), _mm_unpackhi_epi32(lo, zero)));
+        _mm_storeu_si128(sP + 2, _mm_add_epi64(_mm_loadu_si128(sP + 2), _mm_unpacklo_epi32(hi, zero)));
+        _mm_storeu_si128(sP + 3, _mm_add_epi64(_mm_loadu_si128(sP + 3), _mm_unpackhi_epi32(hi, zero)));
+    }
+#endif
+    for (; i < nbrBins; ++i)
+        sumP[i] += binsP[i];
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class TdcHistogram
+{
+public:
+    TdcHistogram(long nbrSegments, long nbrBinsPerSeg)
+        : m_nbrSegments(nbrSegments), m_nbrBinsPerSeg(nbrBinsPerSeg),
+          m_bins(nbrSegments * nbrBinsPerSeg, 0), m_nbrBlocks(0), m_nbrWaveforms(0)
+    {
+    }
+
+    long NbrSegments() const { return m_nbrSegments; }
+    long NbrBinsPerSeg() const { return m_nbrBinsPerSeg; }
+    ViUInt64 NbrBlocks() const { return m_nbrBlocks; }
+    ViUInt64 NbrWaveforms() const { return m_nbrWaveforms; }
+    ViUInt64 const* Segment(long seg) const { return &m_bins[seg * m_nbrBinsPerSeg]; }
+
+    // Add one readout of 'nbrWaveforms' acquisitions, segment s at binsP + s * segmentOffset
+    void Merge(ViUInt32 const* binsP, long segmentOffset, ViUInt64 nbrWaveforms)
+    {
+        for (long seg = 0; seg < m_nbrSegments; ++seg)
+            MergeHistogram32(&m_bins[seg * m_nbrBinsPerSeg], binsP + seg * segmentOffset, m_nbrBinsPerSeg);
+        ++m_nbrBlocks;
+        m_nbrWaveforms += nbrWaveforms;
+    }
+
+    void Merge(ViUInt16 const* binsP, long segmentOffset, ViUInt64 nbrWaveforms)
+    {
+        for (long seg = 0; seg < m_nbrSegments; ++seg)
+            MergeHistogram16(&m_bins[seg * m_nbrBinsPerSeg], binsP + seg * segmentOffset, m_nbrBinsPerSeg);
+        ++m_nbrBlocks;
+        m_nbrWaveforms += nbrWaveforms;
+    }
+
+    ViUInt64 TotalCounts() const
+    {
+        ViUInt64 total = 0;
+        for (size_t i = 0; i < m_bins.size(); ++i)
+            total += m_bins[i];
+        return total;
+    }
+
+    bool Checkpoint(char const* fileName) const
+    {
+        std::string const tmpName = std::string(fileName) + ".tmp";
+        FILE* file = fopen(tmpName.c_str(), "wb");
+        if (file == NULL)
+            return false;
+
+        TdcHistoFileHeader header;
+        ::memset(&header, 0, sizeof(header));
+        ::memcpy(header.magic, "AQHST01", 8);
+        header.nbrSegments = ViInt32(m_nbrSegments);
+        header.nbrBinsPerSeg = ViInt32(m_nbrBinsPerSeg);
+        header.nbrBlocks = m_nbrBlocks;
+        header.nbrWaveforms = m_nbrWaveforms;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        if (ok && !m_bins.empty())
+            ok = fwrite(&m_bins[0], sizeof(ViUInt64), m_bins.size(), file) == m_bins.size();
+        ok = (fclose(file) == 0) && ok;
+
+        // rename() does not replace an existing file on Windows
+        if (ok)
+        {
+            remove(fileName);
+            ok = rename(tmpName.c_str(), fileName) == 0;
+        }
+        return ok;
+    }
+
+private:
+    long m_nbrSegments;
+    long m_nbrBinsPerSeg;
+    std::vector<ViUInt64> m_bins;
+    ViUInt64 m_nbrBlocks;
+    ViUInt64 m_nbrWaveforms;
+};
+
+#endif // TDC_HISTOGRAM_H
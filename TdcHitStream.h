@@ -0,0 +1,382 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  TdcHitStream.h : Compressed storage of the TC890 word stream
+//----------------------------------------------------------------------------------------
+//
+//  The counts of a channel change by small steps from one hit to the next (the common
+//  channel counts its events), so most of the 32 bits of a raw word repeat. The stream
+//  is cut into blocks of at most 'TdcHitBlockWords' words, each stored as:
+//  - TdcHitBlockHeader: position of the block in the stream, number of words per key
+//    and the last count of every channel before the block (the anchors), so that every
+//    block decodes on its own and a reader can seek from header to header
+//  - the key of every word (channel, or 8 for a marker), 4 bits each
+//  - the counts of each channel in turn, as differences to the previous count of the
+//    channel (modulo 2^28, signed, zigzag: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) packed
+//    in frames of 'TdcHitFrameValues': one byte with the bit width of the largest
+//    difference of the frame, then the differences at that width
+//  - the markers as raw 32-bit words
+//  Decoding gives back the exact words.
+//
+//  The differences, zigzag and frame widths are computed with SSE2 four at a time, and
+//  decoding rebuilds the counts with a four-wide prefix sum.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef TDC_HIT_STREAM_H
+#define TDC_HIT_STREAM_H
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+#include "Tc890Decode.h"
+
+
+struct TdcHitBlockHeader
+{
+    char magic[4];                              // "HTB1"
+    ViUInt32 nbrBytes;                          // following the header
+    ViUInt64 firstWord;                         // in the stream
+    ViUInt32 nbrPerKey[Tc890NbrChannels + 1];   // words per channel, then markers
+    ViUInt32 anchor[Tc890NbrChannels];          // count before the block, per channel
+    ViUInt32 reserved;
+};
+
+enum { TdcHitBlockWords = 65536, TdcHitFrameValues = 128 };
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// zigzagP[i] = zigzag of the signed 28-bit difference countsP[i] - countsP[i - 1], with
+// 'previous' before countsP[0]
+inline void TdcHitDeltas(ViUInt32 const* countsP, long nbrCounts, ViUInt32 previous, ViUInt32* zigzagP)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    if (nbrCounts >= 4)
+    {
+        zigzagP[0] = 0;                 // placeholder, fixed below
+        for (i = 1; i + 4 <= nbrCounts; i += 4)
+        {
+            __m128i const c = _mm_loadu_si128((__m128i const*)(countsP + i));
+            __m128i const p = _mm_loadu_si128((__m128i const*)(countsP + i - 1));
+            __m128i const d = _mm_srai_epi32(_mm_slli_epi32(_mm_sub_epi32(c, p), 4), 4);
+            __m128i const z = _mm_xor_si128(_mm_slli_epi32(d, 1), _mm_srai_epi32(d, 31));
+            _mm_storeu_si128((__m128i*)(zigzagP + i), z);
+        }
+        ViInt32 const d0 = ViInt32((countsP[0] - previous) << 4) >> 4;
+        zigzagP[0] = (ViUInt32(d0) << 1) ^ ViUInt32(d0 >> 31);
+    }
+#endif
+    for (; i < nbrCounts; ++i)
+    {
+        ViInt32 const d = ViInt32((countsP[i] - (i > 0 ? countsP[i - 1] : previous)) << 4) >> 4;
+        zigzagP[i] = (ViUInt32(d) << 1) ^ ViUInt32(d >> 31);
+    }
+}
+
+// Bits needed for the largest of 'nbr' values
+inline int TdcHitWidth(ViUInt32 const* valuesP, long nbr)
+{
+    ViUInt32 all = 0;
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= nbr; i += 4)
+        acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i const*)(valuesP + i)));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 4));
+    all = ViUInt32(_mm_cvtsi128_si32(acc));
+#endif
+    for (; i < nbr; ++i)
+        all |= valuesP[i];
+
+    int width = 0;
+    while (width < 32 && (all >> width) != 0)
+        ++width;
+    return width;
+}
+
+// countsP[i] = countsP[i - 1] + difference of zigzagP[i] (modulo 2^28), 'previous'
+// before countsP[0]
+inline void TdcHitPrefixSum(ViUInt32 const* zigzagP, long nbr, ViUInt32 previous, ViUInt32* countsP)
+{
+    long i = 0;
+#ifdef AQ_SSE2
+    __m128i const one = _mm_set1_epi32(1);
+    __m128i const mask = _mm_set1_epi32(Tc890CountMask);
+    __m128i last = _mm_set1_epi32(ViInt32(previous));
+    for (; i + 4 <= nbr; i += 4)
+    {
+        __m128i const z = _mm_loadu_si128((__m128i const*)(zigzagP + i));
+        __m128i x = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, one)));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_and_si128(_mm_add_epi32(x, last), mask);
+        _mm_storeu_si128((__m128i*)(countsP + i), x);
+        last = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    if (i > 0)
+        previous = countsP[i - 1];
+#endif
+    for (; i < nbr; ++i)
+    {
+        ViUInt32 const d = (zigzagP[i] >> 1) ^ (0u - (zigzagP[i] & 1));
+        previous = (previous + d) & Tc890CountMask;
+        countsP[i] = previous;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class TdcHitEncoder
+{
+public:
+    TdcHitEncoder() { Reset(); }
+
+    void Reset()
+    {
+        ::memset(m_anchor, 0, sizeof(m_anchor));
+        m_nbrWords = 0;
+        m_nbrBytes = 0;
+    }
+
+    ViUInt64 NbrWords() const { return m_nbrWords; }
+    ViUInt64 NbrBytes() const { return m_nbrBytes; }
+
+    // Append the blocks of the next 'nbrWords' words of the stream to 'out'
+    void Encode(ViUInt32 const* wordsP, long nbrWords, std::vector<ViUInt8>& out)
+    {
+        for (long first = 0; first < nbrWords; first += TdcHitBlockWords)
+            EncodeBlock(wordsP + first, std::min<long>(TdcHitBlockWords, nbrWords - first), out);
+    }
+
+private:
+    void EncodeBlock(ViUInt32 const* wordsP, long nbrWords, std::vector<ViUInt8>& out)
+    {
+        m_keys.resize(nbrWords);
+        ViUInt64 nbrPerKey[Tc890NbrChannels + 1] = {0};
+        Tc890Keys(wordsP, nbrWords, &m_keys[0], nbrPerKey);
+
+        // Words by key: counts per channel, whole words for the markers
+        long offset[Tc890NbrChannels + 2] = {0};
+        for (int k = 0; k <= Tc890NbrChannels; ++k)
+            offset[k + 1] = offset[k] + long(nbrPerKey[k]);
+        m_sorted.resize(nbrWords + 4);
+        long next[Tc890NbrChannels + 1];
+        std::copy(offset, offset + Tc890NbrChannels + 1, next);
+        ViUInt32 const keepMask[2] = {Tc890CountMask, 0xffffffffu};
+        for (long n = 0; n < nbrWords; ++n)
+        {
+            ViUInt32 const key = m_keys[n];
+            m_sorted[next[key]++] = wordsP[n] & keepMask[key >> 3];
+        }
+
+        size_t const headerAt = out.size();
+        out.resize(headerAt + sizeof(TdcHitBlockHeader));
+
+        // Keys, two per byte
+        size_t at = out.size();
+        out.resize(at + (nbrWords + 1) / 2);
+        for (long n = 0; n + 1 < nbrWords; n += 2)
+            out[at + n / 2] = ViUInt8(m_keys[n] | (m_keys[n + 1] << 4));
+        if (nbrWords & 1)
+            out[at + nbrWords / 2] = m_keys[nbrWords - 1];
+
+        // Differences per channel, frame by frame
+        TdcHitBlockHeader header;
+        ::memset(&header, 0, sizeof(header));
+        ::memcpy(header.magic, "HTB1", 4);
+        header.firstWord = m_nbrWords;
+        for (int ch = 0; ch < Tc890NbrChannels; ++ch)
+        {
+            long const nbr = offset[ch + 1] - offset[ch];
+            header.nbrPerKey[ch] = ViUInt32(nbr);
+            header.anchor[ch] = m_anchor[ch];
+            if (nbr == 0)
+                continue;
+
+            m_zigzag.resize(nbr);
+            TdcHitDeltas(&m_sorted[offset[ch]], nbr, m_anchor[ch], &m_zigzag[0]);
+            for (long f = 0; f < nbr; f += TdcHitFrameValues)
+                PackFrame(&m_zigzag[f], std::min<long>(TdcHitFrameValues, nbr - f), out);
+            m_anchor[ch] = m_sorted[offset[ch + 1] - 1];
+        }
+
+        // Markers as they are
+        long const nbrMarkers = long(nbrPerKey[Tc890MarkerKey]);
+        header.nbrPerKey[Tc890MarkerKey] = ViUInt32(nbrMarkers);
+        if (nbrMarkers > 0)
+        {
+            at = out.size();
+            out.resize(at + nbrMarkers * sizeof(ViUInt32));
+            ::memcpy(&out[at], &m_sorted[offset[Tc890MarkerKey]], nbrMarkers * sizeof(ViUInt32));
+        }
+
+        header.nbrBytes = ViUInt32(out.size() - headerAt - sizeof(header));
+        ::memcpy(&out[headerAt], &header, sizeof(header));
+
+        m_nbrWords += nbrWords;
+        m_nbrBytes += out.size() - headerAt;
+    }
+
+    static void PackFrame(ViUInt32 const* valuesP, long nbr, std::vector<ViUInt8>& out)
+    {
+        int const width = TdcHitWidth(valuesP, nbr);
+        size_t at = out.size();
+        out.resize(at + 1 + (nbr * width + 7) / 8);
+        out[at++] = ViUInt8(width);
+
+        // At most 31 bits wait in 'bits' before a value of at most 28 bits is added
+        ViUInt64 bits = 0;
+        int nbrBits = 0;
+        for (long i = 0; i < nbr; ++i)
+        {
+            bits |= ViUInt64(valuesP[i]) << nbrBits;
+            nbrBits += width;
+            if (nbrBits >= 32)
+            {
+                ViUInt32 const low = ViUInt32(bits);
+                ::memcpy(&out[at], &low, 4);
+                at += 4;
+                bits >>= 32;
+                nbrBits -= 32;
+            }
+        }
+        for (; nbrBits > 0; nbrBits -= 8, bits >>= 8)
+            out[at++] = ViUInt8(bits);
+    }
+
+    ViUInt32 m_anchor[Tc890NbrChannels];
+    ViUInt64 m_nbrWords;
+    ViUInt64 m_nbrBytes;
+
+    std::vector<ViUInt8> m_keys;        // work space of EncodeBlock()
+    std::vector<ViUInt32> m_sorted;
+    std::vector<ViUInt32> m_zigzag;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class TdcHitDecoder
+{
+public:
+    // Size of the block at 'dataP' (header included), 0 if 'nbrBytes' do not hold a
+    // whole block
+    static size_t BlockSize(ViUInt8 const* dataP, size_t nbrBytes)
+    {
+        TdcHitBlockHeader header;
+        if (nbrBytes < sizeof(header))
+            return 0;
+        ::memcpy(&header, dataP, sizeof(header));
+        if (::memcmp(header.magic, "HTB1", 4) != 0 || nbrBytes - sizeof(header) < header.nbrBytes)
+            return 0;
+        return sizeof(header) + header.nbrBytes;
+    }
+
+    // Append the words of the block at 'dataP' to 'words'. Returns the size of the block,
+    // 0 if it is not valid (more than TdcHitBlockWords words, data cut short or
+    // inconsistent); 'words' is then left as it was.
+    size_t Decode(ViUInt8 const* dataP, size_t nbrBytes, std::vector<ViUInt32>& words)
+    {
+        size_t const blockSize = BlockSize(dataP, nbrBytes);
+        if (blockSize == 0)
+            return 0;
+
+        TdcHitBlockHeader header;
+        ::memcpy(&header, dataP, sizeof(header));
+        ViUInt8 const* const endP = dataP + blockSize;
+        ViUInt8 const* p = dataP + sizeof(header);
+
+        // The encoder never writes more than TdcHitBlockWords per block; checking every
+        // count keeps the sum from overflowing
+        long nbrWords = 0;
+        long offset[Tc890NbrChannels + 2] = {0};
+        for (int k = 0; k <= Tc890NbrChannels; ++k)
+        {
+            if (header.nbrPerKey[k] > ViUInt32(TdcHitBlockWords - nbrWords))
+                return 0;
+            nbrWords += long(header.nbrPerKey[k]);
+            offset[k + 1] = nbrWords;
+        }
+
+        ViUInt8 const* const keysP = p;
+        if (size_t(endP - p) < size_t(nbrWords + 1) / 2)
+            return 0;
+        p += (nbrWords + 1) / 2;
+
+        // Counts per channel
+        m_sorted.resize(nbrWords + 1);
+        for (int ch = 0; ch < Tc890NbrChannels; ++ch)
+        {
+            long const nbr = long(header.nbrPerKey[ch]);
+            if (nbr == 0)
+                continue;
+            m_zigzag.resize(nbr);
+            for (long f = 0; f < nbr; f += TdcHitFrameValues)
+                if ((p = UnpackFrame(p, endP, std::min<long>(TdcHitFrameValues, nbr - f), &m_zigzag[f])) == NULL)
+                    return 0;
+            TdcHitPrefixSum(&m_zigzag[0], nbr, header.anchor[ch], &m_sorted[offset[ch]]);
+        }
+
+        long const nbrMarkers = long(header.nbrPerKey[Tc890MarkerKey]);
+        if (size_t(endP - p) < nbrMarkers * sizeof(ViUInt32))
+            return 0;
+        if (nbrMarkers > 0)
+            ::memcpy(&m_sorted[offset[Tc890MarkerKey]], p, nbrMarkers * sizeof(ViUInt32));
+
+        // Words back in stream order
+        size_t const at = words.size();
+        words.resize(at + nbrWords);
+        long next[Tc890NbrChannels + 1];
+        std::copy(offset, offset + Tc890NbrChannels + 1, next);
+        for (long n = 0; n < nbrWords; ++n)
+        {
+            ViUInt32 const key = (keysP[n / 2] >> ((n & 1) * 4)) & 0xf;
+            if (key > Tc890MarkerKey || next[key] >= offset[key + 1])
+            {
+                words.resize(at);
+                return 0;
+            }
+            ViUInt32 const value = m_sorted[next[key]++];
+            words[at + n] = (key == Tc890MarkerKey) ? value : ((key << 28) | value);
+        }
+        return blockSize;
+    }
+
+private:
+    static ViUInt8 const* UnpackFrame(ViUInt8 const* p, ViUInt8 const* endP, long nbr, ViUInt32* valuesP)
+    {
+        if (p >= endP)
+            return NULL;
+        int const width = *p++;
+        size_t const nbrBytes = (nbr * width + 7) / 8;
+        if (width > 32 || size_t(endP - p) < nbrBytes)
+            return NULL;
+
+        ViUInt64 const valueMask = (ViUInt64(1) << width) - 1;
+        ViUInt64 bits = 0;
+        int nbrBits = 0;
+        ViUInt8 const* const frameEndP = p + nbrBytes;
+        for (long i = 0; i < nbr; ++i)
+        {
+            if (nbrBits < width)
+            {
+                ViUInt32 more = 0;
+                size_t const n = std::min<size_t>(4, frameEndP - p);
+                ::memcpy(&more, p, n);
+                p += n;
+                bits |= ViUInt64(more) << nbrBits;
+                nbrBits += int(8 * n);
+            }
+            valuesP[i] = ViUInt32(bits & valueMask);
+            bits >>= width;
+            nbrBits -= width;
+        }
+        return frameEndP;
+    }
+
+    std::vector<ViUInt32> m_sorted;     // work space of Decode()
+    std::vector<ViUInt32> m_zigzag;
+};
+
+#endif // TDC_HIT_STREAM_H
@@ -0,0 +1,208 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+//  TriggerTiming.h : Online analysis of the intervals between trigger timestamps
+//----------------------------------------------------------------------------------------
+//
+//  TriggerTiming is fed the trigger timestamp (in ps, from AqSegmentDescriptor) of every
+//  segment in acquisition order. Each Add() is O(1) and the memory is fixed:
+//  - a histogram of the intervals with 'BinsPerDecade' logarithmic bins from 1 ns to
+//    1000 s (plus underflow / overflow)
+//  - mean, variance and jitter (standard deviation) of the intervals (Welford)
+//  - the trigger rate over the last 'window' triggers (ring of timestamps)
+//  - anomalous gaps: an interval longer than 'gapFactor' times the running typical
+//    interval (exponential average), or a timestamp that does not increase. The last
+//    'MaxGaps' of them are kept.
+//
+//  WriteSummary() stores all of it as text next to the data of the acquisition loop.
+//
+//////////////////////////////////////////////////////////////////////////////////////////
+#ifndef TRIGGER_TIMING_H
+#define TRIGGER_TIMING_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "vpptype.h"
+
+
+struct TriggerGap
+{
+    ViUInt64 timeStamp;                 // trigger after the gap, in ps
+    ViInt64 interval;                   // in ps, <= 0 if the timestamp did not increase
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+class TriggerTiming
+{
+public:
+    enum { BinsPerDecade = 20, NbrDecades = 12, MaxGaps = 16 };
+
+    explicit TriggerTiming(long window = 1000, double gapFactor = 3.0)
+        : m_window(window < 2 ? 2 : window), m_gapFactor(gapFactor),
+          m_stamps(m_window), m_bins(NbrDecades * BinsPerDecade + 2), m_gaps(MaxGaps)
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_nbrTriggers = 0;
+        m_nbrIntervals = 0;
+        m_mean = m_m2 = 0.0;
+        m_min = m_max = 0.0;
+        m_typical = 0.0;
+        m_nbrGaps = 0;
+        m_first = m_last = 0;
+        std::fill(m_bins.begin(), m_bins.end(), ViUInt64(0));
+    }
+
+    void Add(ViUInt64 timeStamp)
+    {
+        if (m_nbrTriggers > 0)
+            AddInterval(timeStamp, ViInt64(timeStamp - m_last));
+        else
+            m_first = timeStamp;
+
+        m_stamps[m_nbrTriggers % m_window] = timeStamp;
+        m_last = timeStamp;
+        ++m_nbrTriggers;
+    }
+
+    ViUInt64 NbrTriggers() const { return m_nbrTriggers; }
+
+    // Interval statistics in seconds
+    double Mean() const { return m_mean * 1.0e-12; }
+    double Jitter() const { return m_nbrIntervals > 1 ? sqrt(m_m2 / (m_nbrIntervals - 1)) * 1.0e-12 : 0.0; }
+    double Min() const { return m_min * 1.0e-12; }
+    double Max() const { return m_max * 1.0e-12; }
+
+    // Triggers per second over the whole run and over the last 'window' triggers
+    double Rate() const
+    {
+        return m_last > m_first ? (m_nbrTriggers - 1) / ((m_last - m_first) * 1.0e-12) : 0.0;
+    }
+
+    double WindowRate() const
+    {
+        ViUInt64 const n = m_nbrTriggers < ViUInt64(m_window) ? m_nbrTriggers : ViUInt64(m_window);
+        if (n < 2)
+            return 0.0;
+        ViUInt64 const oldest = m_stamps[(m_nbrTriggers - n) % m_window];
+        return m_last > oldest ? (n - 1) / ((m_last - oldest) * 1.0e-12) : 0.0;
+    }
+
+    // Anomalous gaps: total count, and the last ones (at most MaxGaps, oldest first)
+    ViUInt64 NbrGaps() const { return m_nbrGaps; }
+    long NbrKeptGaps() const { return long(m_nbrGaps < ViUInt64(MaxGaps) ? m_nbrGaps : ViUInt64(MaxGaps)); }
+    TriggerGap const& Gap(long n) const { return m_gaps[(m_nbrGaps - NbrKeptGaps() + n) % MaxGaps]; }
+
+    // Interval histogram: bin 0 is below 1 ns, the last bin at or above 1000 s
+    long NbrBins() const { return long(m_bins.size()); }
+    ViUInt64 BinCount(long bin) const { return m_bins[bin]; }
+    static double BinLowEdge(long bin)  // in seconds
+    {
+        return bin == 0 ? 0.0 : 1.0e-9 * pow(10.0, double(bin - 1) / BinsPerDecade);
+    }
+
+    // Interval in seconds below which a fraction 'q' of the intervals are, from the
+    // histogram (interpolated on the logarithmic scale within the bin)
+    double Quantile(double q) const
+    {
+        double const target = q * m_nbrIntervals;
+        double sum = 0.0;
+        for (long bin = 0; bin < NbrBins(); ++bin)
+        {
+            if (m_bins[bin] != 0 && sum + m_bins[bin] >= target)
+            {
+                if (bin == 0 || bin == NbrBins() - 1)
+                    return BinLowEdge(bin);
+                double const fraction = (target - sum) / m_bins[bin];
+                return BinLowEdge(bin) * pow(10.0, fraction / BinsPerDecade);
+            }
+            sum += m_bins[bin];
+        }
+        return Max();
+    }
+
+    bool WriteSummary(char const* fileName) const
+    {
+        FILE* file = fopen(fileName, "w");
+        if (file == NULL)
+            return false;
+
+        fprintf(file, "# Trigger timing\n");
+        fprintf(file, "Triggers\t%llu\n", (unsigned long long)m_nbrTriggers);
+        fprintf(file, "RatePerSecond\t%g\n", Rate());
+        fprintf(file, "WindowRatePerSecond\t%g\t(last %ld triggers)\n", WindowRate(), m_window);
+        fprintf(file, "MeanInterval\t%g\n", Mean());
+        fprintf(file, "Jitter\t%g\n", Jitter());
+        fprintf(file, "MinInterval\t%g\n", Min());
+        fprintf(file, "MaxInterval\t%g\n", Max());
+        fprintf(file, "MedianInterval\t%g\n", Quantile(0.5));
+        fprintf(file, "Gaps\t%llu\t(> %g x typical interval, or no increase)\n", (unsigned long long)m_nbrGaps,
+                m_gapFactor);
+        for (long n = 0; n < NbrKeptGaps(); ++n)
+            fprintf(file, "Gap\t%llu\t%g\n", (unsigned long long)Gap(n).timeStamp, Gap(n).interval * 1.0e-12);
+
+        fprintf(file, "# Interval histogram: low edge in s, count\n");
+        for (long bin = 0; bin < NbrBins(); ++bin)
+            if (m_bins[bin] != 0)
+                fprintf(file, "%g\t%llu\n", BinLowEdge(bin), (unsigned long long)m_bins[bin]);
+
+        return fclose(file) == 0;
+    }
+
+private:
+    void AddInterval(ViUInt64 timeStamp, ViInt64 interval)
+    {
+        double const x = double(interval);
+
+        // Anomalous gap against the typical interval before this one
+        if (interval <= 0 || (m_typical > 0.0 && x > m_gapFactor * m_typical))
+        {
+            TriggerGap& gap = m_gaps[m_nbrGaps % MaxGaps];
+            gap.timeStamp = timeStamp;
+            gap.interval = interval;
+            ++m_nbrGaps;
+        }
+        if (interval <= 0)
+            return;
+
+        // The typical interval follows slow rate changes, gaps only nudge it
+        double const update = (m_typical > 0.0 && x > m_gapFactor * m_typical) ? m_gapFactor * m_typical : x;
+        m_typical = (m_typical > 0.0) ? m_typical + (update - m_typical) / 64.0 : x;
+
+        ++m_nbrIntervals;
+        double const delta = x - m_mean;
+        m_mean += delta / m_nbrIntervals;
+        m_m2 += delta * (x - m_mean);
+        m_min = (m_nbrIntervals == 1 || x < m_min) ? x : m_min;
+        m_max = (x > m_max) ? x : m_max;
+
+        // 1 ns = 1000 ps is the low edge of bin 1
+        long bin = long(floor(log10(x / 1000.0) * BinsPerDecade)) + 1;
+        bin = bin < 0 ? 0 : (bin >= NbrBins() ? NbrBins() - 1 : bin);
+        ++m_bins[bin];
+    }
+
+    long m_window;
+    double m_gapFactor;
+
+    ViUInt64 m_nbrTriggers;
+    ViUInt64 m_nbrIntervals;            // increasing timestamps only
+    double m_mean, m_m2;                // in ps
+    double m_min, m_max;
+    double m_typical;
+    ViUInt64 m_first, m_last;
+
+    std::vector<ViUInt64> m_stamps;     // ring of the last 'm_window' timestamps
+    std::vector<ViUInt64> m_bins;
+    std::vector<TriggerGap> m_gaps;     // ring of the last MaxGaps gaps
+    ViUInt64 m_nbrGaps;
+};
+
+#endif // TRIGGER_TIMING_H